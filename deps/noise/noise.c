@@ -270,3 +270,311 @@ float simplex3(
     }
     return (1 + total / max) / 2;
 }
+
+/*
+Batched versions of simplex2 and simplex3. Four samples are computed at a
+time with SSE2 or NEON when available, the permutation and gradient lookups
+are done a lane at a time. The operations are done in the same order as in
+noise2 and noise3 so the results are the same as the scalar functions (this
+file must be built without floating point contraction for that to hold).
+*/
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#define NOISE_SIMD 1
+typedef __m128 vfloat;
+#define vf_set1(a) _mm_set1_ps(a)
+#define vf_load(p) _mm_loadu_ps(p)
+#define vf_store(p, v) _mm_storeu_ps(p, v)
+#define vf_add(a, b) _mm_add_ps(a, b)
+#define vf_sub(a, b) _mm_sub_ps(a, b)
+#define vf_mul(a, b) _mm_mul_ps(a, b)
+#define vf_gt(a, b) _mm_cmpgt_ps(a, b)
+#define vf_and(m, v) _mm_and_ps(m, v)
+#define vf_trunc(a) _mm_cvtepi32_ps(_mm_cvttps_epi32(a))
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define NOISE_SIMD 1
+typedef float32x4_t vfloat;
+#define vf_set1(a) vdupq_n_f32(a)
+#define vf_load(p) vld1q_f32(p)
+#define vf_store(p, v) vst1q_f32(p, v)
+#define vf_add(a, b) vaddq_f32(a, b)
+#define vf_sub(a, b) vsubq_f32(a, b)
+#define vf_mul(a, b) vmulq_f32(a, b)
+#define vf_gt(a, b) vreinterpretq_f32_u32(vcgtq_f32(a, b))
+#define vf_and(m, v) vreinterpretq_f32_u32(vandq_u32( \
+    vreinterpretq_u32_f32(m), vreinterpretq_u32_f32(v)))
+#define vf_trunc(a) vcvtq_f32_s32(vcvtq_s32_f32(a))
+#endif
+
+#ifdef NOISE_SIMD
+
+static inline vfloat vf_floor(vfloat x) {
+    vfloat t = vf_trunc(x);
+    return vf_sub(t, vf_and(vf_gt(t, x), vf_set1(1.0f)));
+}
+
+static vfloat noise2_simd(vfloat x, vfloat y) {
+    vfloat one = vf_set1(1.0f);
+    vfloat s = vf_mul(vf_add(x, y), vf_set1(F2));
+    vfloat i = vf_floor(vf_add(x, s));
+    vfloat j = vf_floor(vf_add(y, s));
+    vfloat t = vf_mul(vf_add(i, j), vf_set1(G2));
+    vfloat xx[3], yy[3], gx[3], gy[3];
+    xx[0] = vf_sub(x, vf_sub(i, t));
+    yy[0] = vf_sub(y, vf_sub(j, t));
+    vfloat i1 = vf_and(vf_gt(xx[0], yy[0]), one);
+    vfloat j1 = vf_sub(one, i1);
+    xx[2] = vf_sub(vf_add(xx[0], vf_set1(G2 * 2.0f)), one);
+    yy[2] = vf_sub(vf_add(yy[0], vf_set1(G2 * 2.0f)), one);
+    xx[1] = vf_add(vf_sub(xx[0], i1), vf_set1(G2));
+    yy[1] = vf_add(vf_sub(yy[0], j1), vf_set1(G2));
+
+    float li[4], lj[4], li1[4];
+    float lgx[3][4], lgy[3][4];
+    vf_store(li, i);
+    vf_store(lj, j);
+    vf_store(li1, i1);
+    for (int l = 0; l < 4; l++) {
+        int I = (int) li[l] & 255;
+        int J = (int) lj[l] & 255;
+        int a = li1[l] != 0;
+        int b = !a;
+        int g[3];
+        g[0] = PERM[I + PERM[J]] % 12;
+        g[1] = PERM[I + a + PERM[J + b]] % 12;
+        g[2] = PERM[I + 1 + PERM[J + 1]] % 12;
+        for (int c = 0; c <= 2; c++) {
+            lgx[c][l] = GRAD3[g[c]][0];
+            lgy[c][l] = GRAD3[g[c]][1];
+        }
+    }
+
+    vfloat zero = vf_set1(0.0f);
+    vfloat noise[3];
+    for (int c = 0; c <= 2; c++) {
+        gx[c] = vf_load(lgx[c]);
+        gy[c] = vf_load(lgy[c]);
+        vfloat f = vf_sub(vf_sub(vf_set1(0.5f), vf_mul(xx[c], xx[c])),
+            vf_mul(yy[c], yy[c]));
+        vfloat f4 = vf_mul(vf_mul(vf_mul(f, f), f), f);
+        vfloat dot = vf_add(vf_mul(gx[c], xx[c]), vf_mul(gy[c], yy[c]));
+        noise[c] = vf_and(vf_gt(f, zero), vf_mul(f4, dot));
+    }
+    return vf_mul(vf_add(vf_add(noise[0], noise[1]), noise[2]),
+        vf_set1(70.0f));
+}
+
+static vfloat noise3_simd(vfloat x, vfloat y, vfloat z) {
+    vfloat s = vf_mul(vf_add(vf_add(x, y), z), vf_set1(F3));
+    vfloat i = vf_floor(vf_add(x, s));
+    vfloat j = vf_floor(vf_add(y, s));
+    vfloat k = vf_floor(vf_add(z, s));
+    vfloat t = vf_mul(vf_add(vf_add(i, j), k), vf_set1(G3));
+    vfloat pos[4][3];
+    pos[0][0] = vf_sub(x, vf_sub(i, t));
+    pos[0][1] = vf_sub(y, vf_sub(j, t));
+    pos[0][2] = vf_sub(z, vf_sub(k, t));
+
+    float li[4], lj[4], lk[4], lp[3][4];
+    float lo1[3][4], lo2[3][4], lg[4][3][4];
+    vf_store(li, i);
+    vf_store(lj, j);
+    vf_store(lk, k);
+    for (int c = 0; c <= 2; c++) {
+        vf_store(lp[c], pos[0][c]);
+    }
+    for (int l = 0; l < 4; l++) {
+        int o1[3], o2[3], g[4];
+        float px = lp[0][l];
+        float py = lp[1][l];
+        float pz = lp[2][l];
+        if (px >= py) {
+            if (py >= pz) {
+                ASSIGN(o1, 1, 0, 0);
+                ASSIGN(o2, 1, 1, 0);
+            } else if (px >= pz) {
+                ASSIGN(o1, 1, 0, 0);
+                ASSIGN(o2, 1, 0, 1);
+            } else {
+                ASSIGN(o1, 0, 0, 1);
+                ASSIGN(o2, 1, 0, 1);
+            }
+        } else {
+            if (py < pz) {
+                ASSIGN(o1, 0, 0, 1);
+                ASSIGN(o2, 0, 1, 1);
+            } else if (px < pz) {
+                ASSIGN(o1, 0, 1, 0);
+                ASSIGN(o2, 0, 1, 1);
+            } else {
+                ASSIGN(o1, 0, 1, 0);
+                ASSIGN(o2, 1, 1, 0);
+            }
+        }
+        int I = (int) li[l] & 255;
+        int J = (int) lj[l] & 255;
+        int K = (int) lk[l] & 255;
+        g[0] = PERM[I + PERM[J + PERM[K]]] % 12;
+        g[1] = PERM[I + o1[0] + PERM[J + o1[1] + PERM[o1[2] + K]]] % 12;
+        g[2] = PERM[I + o2[0] + PERM[J + o2[1] + PERM[o2[2] + K]]] % 12;
+        g[3] = PERM[I + 1 + PERM[J + 1 + PERM[K + 1]]] % 12;
+        for (int c = 0; c <= 2; c++) {
+            lo1[c][l] = o1[c];
+            lo2[c][l] = o2[c];
+            for (int n = 0; n <= 3; n++) {
+                lg[n][c][l] = GRAD3[g[n]][c];
+            }
+        }
+    }
+    for (int c = 0; c <= 2; c++) {
+        pos[3][c] = vf_add(vf_sub(pos[0][c], vf_set1(1.0f)),
+            vf_set1(3.0f * G3));
+        pos[2][c] = vf_add(vf_sub(pos[0][c], vf_load(lo2[c])),
+            vf_set1(2.0f * G3));
+        pos[1][c] = vf_add(vf_sub(pos[0][c], vf_load(lo1[c])), vf_set1(G3));
+    }
+
+    vfloat zero = vf_set1(0.0f);
+    vfloat noise[4];
+    for (int n = 0; n <= 3; n++) {
+        vfloat *p = pos[n];
+        vfloat f = vf_sub(vf_sub(vf_sub(vf_set1(0.6f), vf_mul(p[0], p[0])),
+            vf_mul(p[1], p[1])), vf_mul(p[2], p[2]));
+        vfloat f4 = vf_mul(vf_mul(vf_mul(f, f), f), f);
+        vfloat dot = vf_add(vf_add(
+            vf_mul(p[0], vf_load(lg[n][0])),
+            vf_mul(p[1], vf_load(lg[n][1]))),
+            vf_mul(p[2], vf_load(lg[n][2])));
+        noise[n] = vf_and(vf_gt(f, zero), vf_mul(f4, dot));
+    }
+    return vf_mul(vf_add(vf_add(vf_add(noise[0], noise[1]), noise[2]),
+        noise[3]), vf_set1(32.0f));
+}
+
+static void simplex2_simd(
+    float *out, const float *x, const float *y,
+    int octaves, float persistence, float lacunarity)
+{
+    vfloat vx = vf_load(x);
+    vfloat vy = vf_load(y);
+    float freq = 1.0f;
+    float amp = 1.0f;
+    float max = 1.0f;
+    vfloat total = noise2_simd(vx, vy);
+    for (int i = 1; i < octaves; i++) {
+        freq *= lacunarity;
+        amp *= persistence;
+        max += amp;
+        vfloat n = noise2_simd(
+            vf_mul(vx, vf_set1(freq)), vf_mul(vy, vf_set1(freq)));
+        total = vf_add(total, vf_mul(n, vf_set1(amp)));
+    }
+    float t[4];
+    vf_store(t, total);
+    for (int l = 0; l < 4; l++) {
+        out[l] = (1 + t[l] / max) / 2;
+    }
+}
+
+static void simplex3_simd(
+    float *out, const float *x, const float *y, const float *z,
+    int octaves, float persistence, float lacunarity)
+{
+    vfloat vx = vf_load(x);
+    vfloat vy = vf_load(y);
+    vfloat vz = vf_load(z);
+    float freq = 1.0f;
+    float amp = 1.0f;
+    float max = 1.0f;
+    vfloat total = noise3_simd(vx, vy, vz);
+    for (int i = 1; i < octaves; ++i) {
+        freq *= lacunarity;
+        amp *= persistence;
+        max += amp;
+        vfloat f = vf_set1(freq);
+        vfloat n = noise3_simd(vf_mul(vx, f), vf_mul(vy, f), vf_mul(vz, f));
+        total = vf_add(total, vf_mul(n, vf_set1(amp)));
+    }
+    float t[4];
+    vf_store(t, total);
+    for (int l = 0; l < 4; l++) {
+        out[l] = (1 + t[l] / max) / 2;
+    }
+}
+
+#endif
+
+void simplex2_batch(
+    float *out, const float *x, const float *y, int count,
+    int octaves, float persistence, float lacunarity)
+{
+    int n = 0;
+#ifdef NOISE_SIMD
+    for (; n + 4 <= count; n += 4) {
+        simplex2_simd(out + n, x + n, y + n, octaves, persistence,
+            lacunarity);
+    }
+#endif
+    for (; n < count; n++) {
+        out[n] = simplex2(x[n], y[n], octaves, persistence, lacunarity);
+    }
+}
+
+void simplex3_batch(
+    float *out, const float *x, const float *y, const float *z, int count,
+    int octaves, float persistence, float lacunarity)
+{
+    int n = 0;
+#ifdef NOISE_SIMD
+    for (; n + 4 <= count; n += 4) {
+        simplex3_simd(out + n, x + n, y + n, z + n, octaves, persistence,
+            lacunarity);
+    }
+#endif
+    for (; n < count; n++) {
+        out[n] = simplex3(x[n], y[n], z[n], octaves, persistence,
+            lacunarity);
+    }
+}
+
+#define GRID_BATCH 256
+
+void simplex2_grid(
+    float *out, int x0, int y0, int nx, int ny, double sx, double sy,
+    int octaves, float persistence, float lacunarity)
+{
+    float x[GRID_BATCH], y[GRID_BATCH];
+    int total = nx * ny;
+    for (int start = 0; start < total; start += GRID_BATCH) {
+        int count = total - start < GRID_BATCH ? total - start : GRID_BATCH;
+        for (int n = 0; n < count; n++) {
+            int index = start + n;
+            x[n] = (x0 + index / ny) * sx;
+            y[n] = (y0 + index % ny) * sy;
+        }
+        simplex2_batch(out + start, x, y, count, octaves, persistence,
+            lacunarity);
+    }
+}
+
+void simplex3_grid(
+    float *out, int x0, int y0, int z0, int nx, int ny, int nz,
+    double sx, double sy, double sz,
+    int octaves, float persistence, float lacunarity)
+{
+    float x[GRID_BATCH], y[GRID_BATCH], z[GRID_BATCH];
+    int total = nx * ny * nz;
+    for (int start = 0; start < total; start += GRID_BATCH) {
+        int count = total - start < GRID_BATCH ? total - start : GRID_BATCH;
+        for (int n = 0; n < count; n++) {
+            int index = start + n;
+            x[n] = (x0 + index / (ny * nz)) * sx;
+            y[n] = (y0 + index / nz % ny) * sy;
+            z[n] = (z0 + index % nz) * sz;
+        }
+        simplex3_batch(out + start, x, y, z, count, octaves, persistence,
+            lacunarity);
+    }
+}
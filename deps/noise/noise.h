@@ -37,4 +37,28 @@ float simplex3(
     float x, float y, float z,
     int octaves, float persistence, float lacunarity);
 
+// Fill out[n] with simplex2(x[n], y[n], ...) for count samples.
+void simplex2_batch(
+    float *out, const float *x, const float *y, int count,
+    int octaves, float persistence, float lacunarity);
+
+// Fill out[n] with simplex3(x[n], y[n], z[n], ...) for count samples.
+void simplex3_batch(
+    float *out, const float *x, const float *y, const float *z, int count,
+    int octaves, float persistence, float lacunarity);
+
+// Sample an nx by ny grid of whole numbers from (x0, y0), each scaled by
+// (sx, sy) before sampling. out[i * ny + j] is the same as
+// simplex2((x0 + i) * sx, (y0 + j) * sy, ...).
+void simplex2_grid(
+    float *out, int x0, int y0, int nx, int ny, double sx, double sy,
+    int octaves, float persistence, float lacunarity);
+
+// The 3D version of simplex2_grid, out[(i * ny + j) * nz + k] is the same
+// as simplex3((x0 + i) * sx, (y0 + j) * sy, (z0 + k) * sz, ...).
+void simplex3_grid(
+    float *out, int x0, int y0, int z0, int nx, int ny, int nz,
+    double sx, double sy, double sz,
+    int octaves, float persistence, float lacunarity);
+
 #endif
@@ -0,0 +1,278 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "benchmark.h"
+#include "config.h"
+#include "map.h"
+#include "noise.h"
+#include "util.h"
+
+#define GRID_SIZE (CHUNK_SIZE + 2)
+#define CLOUD_LEVELS 8
+
+static void print_rate(const char *name, int samples, double scalar,
+    double batched)
+{
+    printf("%s: %d samples, one at a time %.0f samples/s, "
+           "batched %.0f samples/s (%.2fx)\n",
+           name, samples, samples / scalar, samples / batched,
+           scalar / batched);
+}
+
+// Sample the terrain and cloud noise of the default worldgen for count
+// chunks, a column at a time and then in batches, and check both give the
+// same results.
+void benchmark_noise(int count)
+{
+    float scalar2[GRID_SIZE * GRID_SIZE];
+    float batched2[GRID_SIZE * GRID_SIZE];
+    float scalar3[GRID_SIZE * CLOUD_LEVELS * GRID_SIZE];
+    float batched3[GRID_SIZE * CLOUD_LEVELS * GRID_SIZE];
+    double scalar2_time = 0;
+    double batched2_time = 0;
+    double scalar3_time = 0;
+    double batched3_time = 0;
+    int mismatches = 0;
+    for (int n = 0; n < count; n++) {
+        int x0 = (n % 64) * CHUNK_SIZE - 1;
+        int z0 = (n / 64) * CHUNK_SIZE - 1;
+
+        double start = monotonic_seconds();
+        for (int i = 0; i < GRID_SIZE; i++) {
+            for (int j = 0; j < GRID_SIZE; j++) {
+                scalar2[i * GRID_SIZE + j] = simplex2(
+                    (x0 + i) * 0.01, (z0 + j) * 0.01, 4, 0.5, 2);
+            }
+        }
+        double middle = monotonic_seconds();
+        simplex2_grid(batched2, x0, z0, GRID_SIZE, GRID_SIZE, 0.01, 0.01,
+            4, 0.5, 2);
+        double end = monotonic_seconds();
+        scalar2_time += middle - start;
+        batched2_time += end - middle;
+
+        start = monotonic_seconds();
+        for (int i = 0; i < GRID_SIZE; i++) {
+            for (int y = 0; y < CLOUD_LEVELS; y++) {
+                for (int j = 0; j < GRID_SIZE; j++) {
+                    scalar3[(i * CLOUD_LEVELS + y) * GRID_SIZE + j] =
+                        simplex3((x0 + i) * 0.01, (64 + y) * 0.1,
+                                 (z0 + j) * 0.01, 8, 0.5, 2);
+                }
+            }
+        }
+        middle = monotonic_seconds();
+        simplex3_grid(batched3, x0, 64, z0, GRID_SIZE, CLOUD_LEVELS,
+            GRID_SIZE, 0.01, 0.1, 0.01, 8, 0.5, 2);
+        end = monotonic_seconds();
+        scalar3_time += middle - start;
+        batched3_time += end - middle;
+
+        for (int i = 0; i < GRID_SIZE * GRID_SIZE; i++) {
+            mismatches += scalar2[i] != batched2[i];
+        }
+        for (int i = 0; i < GRID_SIZE * CLOUD_LEVELS * GRID_SIZE; i++) {
+            mismatches += scalar3[i] != batched3[i];
+        }
+    }
+    print_rate("simplex2", count * GRID_SIZE * GRID_SIZE,
+        scalar2_time, batched2_time);
+    print_rate("simplex3", count * GRID_SIZE * CLOUD_LEVELS * GRID_SIZE,
+        scalar3_time, batched3_time);
+    printf("Samples that differ between the two: %d\n", mismatches);
+}
+
+// The map as it was before keys were packed: three integer mixers to hash
+// the absolute position and a byte at a time compare. Kept to check the map
+// against and to time it by.
+static int reference_hash_int(int key)
+{
+    key = ~key + (key << 15);
+    key = key ^ (key >> 12);
+    key = key + (key << 2);
+    key = key ^ (key >> 4);
+    key = key * 2057;
+    key = key ^ (key >> 16);
+    return key;
+}
+
+static int reference_hash(int x, int y, int z)
+{
+    return reference_hash_int(x) ^ reference_hash_int(y) ^
+        reference_hash_int(z);
+}
+
+static int reference_get(Map *map, int x, int y, int z)
+{
+    unsigned int index = reference_hash(x, y, z) & map->mask;
+    x -= map->dx;
+    y -= map->dy;
+    z -= map->dz;
+    if (x < 0 || x > 255 || y < 0 || y > 255 || z < 0 || z > 255) {
+        return 0;
+    }
+    MapEntry *entry = map->data + index;
+    while (!EMPTY_ENTRY(entry)) {
+        if (entry->e.x == x && entry->e.y == y && entry->e.z == z) {
+            return entry->e.w;
+        }
+        index = (index + 1) & map->mask;
+        entry = map->data + index;
+    }
+    return 0;
+}
+
+static int reference_set(Map *map, int x, int y, int z, int w)
+{
+    unsigned int index = reference_hash(x, y, z) & map->mask;
+    x -= map->dx;
+    y -= map->dy;
+    z -= map->dz;
+    MapEntry *entry = map->data + index;
+    while (!EMPTY_ENTRY(entry)) {
+        if (entry->e.x == x && entry->e.y == y && entry->e.z == z) {
+            if (entry->e.w == w) {
+                return 0;
+            }
+            entry->e.w = w;
+            return 1;
+        }
+        index = (index + 1) & map->mask;
+        entry = map->data + index;
+    }
+    if (!w) {
+        return 0;
+    }
+    entry->e.x = x;
+    entry->e.y = y;
+    entry->e.z = z;
+    entry->e.w = w;
+    map->size++;
+    if (map->size * 2 > map->mask) {
+        Map grown = *map;
+        grown.mask = (map->mask << 1) | 1;
+        grown.size = 0;
+        grown.data = calloc(grown.mask + 1, sizeof(MapEntry));
+        for (unsigned int i = 0; i <= map->mask; i++) {
+            MapEntry *e = map->data + i;
+            if (!EMPTY_ENTRY(e)) {
+                reference_set(&grown, e->e.x + map->dx, e->e.y + map->dy,
+                              e->e.z + map->dz, e->e.w);
+            }
+        }
+        free(map->data);
+        *map = grown;
+    }
+    return 1;
+}
+
+static void print_probes(Map *map)
+{
+    MapProbeStats stats;
+    map_probe_stats(map, &stats);
+    printf("    %u entries in %u slots, probe mean %.2f max %u\n",
+           stats.entries, stats.slots, stats.mean_probe, stats.max_probe);
+}
+
+// Do count random sets, clears and gets on a map and on the reference map,
+// timing the gets of each. Returns the number of results that differ.
+static int compare_map(int count)
+{
+    Map map;
+    Map reference;
+    map_alloc(&map, 31, 0, -17, 0xf);
+    map_alloc(&reference, 31, 0, -17, 0xf);
+    map_set_grow_step(&map, MAP_GROW_STEP);
+    int mismatches = 0;
+    unsigned int r = 7;
+    for (int i = 0; i < count; i++) {
+        r = r * 1103515245 + 12345;
+        int x = 31 + (r >> 8) % GRID_SIZE;
+        int y = (r >> 14) % 256;
+        r = r * 1103515245 + 12345;
+        int z = -17 + (r >> 8) % GRID_SIZE;
+        int w = (r >> 20) % 3 ? 0 : (int)((r >> 22) % 256) - 128;
+        mismatches += map_set(&map, x, y, z, w) !=
+            reference_set(&reference, x, y, z, w);
+    }
+    int *keys = malloc(sizeof(int) * 3 * count);
+    for (int i = 0; i < count; i++) {
+        r = r * 1103515245 + 12345;
+        keys[i * 3] = 30 + (r >> 8) % (GRID_SIZE + 2);
+        keys[i * 3 + 1] = (int)((r >> 14) % 260) - 2;
+        r = r * 1103515245 + 12345;
+        keys[i * 3 + 2] = -18 + (r >> 8) % (GRID_SIZE + 2);
+    }
+    int total = 0;
+    double start = monotonic_seconds();
+    for (int i = 0; i < count; i++) {
+        total += map_get(&map, keys[i * 3], keys[i * 3 + 1], keys[i * 3 + 2]);
+    }
+    double map_time = monotonic_seconds() - start;
+    start = monotonic_seconds();
+    for (int i = 0; i < count; i++) {
+        total -= reference_get(&reference, keys[i * 3], keys[i * 3 + 1],
+                               keys[i * 3 + 2]);
+    }
+    double reference_time = monotonic_seconds() - start;
+    for (int i = 0; i < count; i++) {
+        mismatches += map_get(&map, keys[i * 3], keys[i * 3 + 1],
+                              keys[i * 3 + 2]) !=
+            reference_get(&reference, keys[i * 3], keys[i * 3 + 1],
+                          keys[i * 3 + 2]);
+    }
+    printf("Gets: map %.0f/s, reference %.0f/s (%.2fx)\n",
+           count / map_time, count / reference_time,
+           reference_time / map_time);
+    mismatches += total != 0;
+    printf("Results that differ from the reference: %d\n", mismatches);
+    free(keys);
+    map_free(&map);
+    free(reference.data);
+    return mismatches;
+}
+
+// Set count random blocks in a chunk's map, then set or clear count more,
+// growing the map all at once and then incrementally. Reports the rate, the
+// slowest call that grew the map (the stall an edit would see) and the probe
+// lengths after each half and in a compacted copy. Then checks the map
+// against the reference, returning the number of results that differ.
+int benchmark_map(int count)
+{
+    for (int step = 0; step <= MAP_GROW_STEP; step += MAP_GROW_STEP) {
+        Map map;
+        map_alloc(&map, -1, 0, -1, 0xf);
+        map_set_grow_step(&map, step);
+        printf("%s growth:\n", step ? "Incremental" : "All at once");
+        unsigned int r = 1;
+        for (int phase = 0; phase < 2; phase++) {
+            double slowest = 0;
+            double start = monotonic_seconds();
+            for (int i = 0; i < count; i++) {
+                r = r * 1103515245 + 12345;
+                int x = (r >> 8) % GRID_SIZE - 1;
+                int y = (r >> 14) % 128;
+                r = r * 1103515245 + 12345;
+                int z = (r >> 8) % GRID_SIZE - 1;
+                int w = phase && (r >> 20) % 2 ? 0 : 1 + (r >> 21) % 63;
+                unsigned int mask = map.mask;
+                double set_start = monotonic_seconds();
+                map_set(&map, x, y, z, w);
+                double set_time = monotonic_seconds() - set_start;
+                if (map.mask != mask && set_time > slowest) {
+                    slowest = set_time;
+                }
+            }
+            printf("  %s: %.0f sets/s, slowest growth %.1f us\n",
+                   phase ? "set or clear" : "set", count /
+                   (monotonic_seconds() - start), slowest * 1e6);
+            print_probes(&map);
+        }
+        Map copy;
+        map_copy(&copy, &map);
+        printf("  copy:\n");
+        print_probes(&copy);
+        map_free(&copy);
+        map_free(&map);
+    }
+    return compare_map(count);
+}
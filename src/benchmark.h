@@ -0,0 +1,4 @@
+#pragma once
+
+void benchmark_noise(int count);
+int benchmark_map(int count);
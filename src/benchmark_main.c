@@ -0,0 +1,542 @@
+// A benchmark of the chunk pipeline that runs without a display or GPU. A
+// fixed square of chunks is generated, loaded from a world database made for
+// the run and meshed, first with the built in worldgen and then with a Lua
+// worldgen. The min, median and 99th percentile time of each stage is
+// reported, with the allocations made and bytes produced per chunk by the
+// worldgen, database and meshing steps. Built as piworld-benchmark:
+//
+//     ./piworld-benchmark [--size N] [--rounds N] [--worldgen NAME] [--map N]
+//
+// Then N random sets, clears and gets (0 skips them) are timed on a chunk's
+// map and checked against a reference map, see benchmark_map(). The exit
+// status is a failure if any result differs.
+//
+// With --soak N it instead walks N chunks in a straight line, keeping only
+// the chunks around the walker the way the game does, and reports the
+// resident memory and the pool counters as it goes. The resident memory
+// should stop growing once the first chunks have been dropped.
+
+#include <getopt.h>
+#include <math.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "benchmark.h"
+#include "chunk.h"
+#include "config.h"
+#include "db.h"
+#include "fence.h"
+#include "item.h"
+#include "pool.h"
+#include "pwlua_worldgen.h"
+#include "sign_mesh.h"
+#include "util.h"
+#include "worldgen_cache.h"
+
+#define DEFAULT_SIZE 8
+#define DEFAULT_ROUNDS 3
+#define DEFAULT_WORLDGEN "worldgen1"
+#define SOAK_REPORT_INTERVAL 256
+#define DEFAULT_MAP_OPERATIONS 100000
+
+#define STAGE_WORLDGEN CHUNK_STAGE_COUNT
+#define STAGE_DB_LOAD (CHUNK_STAGE_COUNT + 1)
+#define STAGE_MESH (CHUNK_STAGE_COUNT + 2)
+#define STAGE_COUNT (CHUNK_STAGE_COUNT + 3)
+
+typedef struct {
+    int p;
+    int q;
+    Map maps[WORLDGEN_LAYERS];
+    SignList signs;
+} BenchmarkChunk;
+
+typedef struct {
+    double *times;
+    int count;
+    long allocations;
+    long bytes;
+} Stage;
+
+static const char *stage_names[STAGE_COUNT] = {
+    "  opaque", "  light", "  faces", "  ao", "  vertices", "  occluders",
+    "worldgen", "db load", "mesh"
+};
+
+// The order stages are listed in, mesh followed by its parts.
+static const int stage_order[STAGE_COUNT] = {
+    STAGE_WORLDGEN, STAGE_DB_LOAD, STAGE_MESH,
+    CHUNK_STAGE_OPAQUE, CHUNK_STAGE_LIGHT, CHUNK_STAGE_FACES, CHUNK_STAGE_AO,
+    CHUNK_STAGE_VERTICES, CHUNK_STAGE_OCCLUDERS
+};
+
+static atomic_long allocation_count;
+
+#ifdef __GLIBC__
+// Every allocation is counted on its way to glibc's allocator.
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t count, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+
+void *malloc(size_t size)
+{
+    atomic_fetch_add(&allocation_count, 1);
+    return __libc_malloc(size);
+}
+
+void *calloc(size_t count, size_t size)
+{
+    atomic_fetch_add(&allocation_count, 1);
+    return __libc_calloc(count, size);
+}
+
+void *realloc(void *ptr, size_t size)
+{
+    atomic_fetch_add(&allocation_count, 1);
+    return __libc_realloc(ptr, size);
+}
+#endif
+
+// Add a random but repeatable set of changes to the chunks in the world
+// database, so loading and meshing chunks has blocks, lights and shapes to
+// deal with.
+static void fill_database(int p0, int q0, int size)
+{
+    unsigned int r = 1;
+    for (int p = p0; p < p0 + size; p++) {
+        for (int q = q0; q < q0 + size; q++) {
+            for (int i = 0; i < 64; i++) {
+                r = r * 1103515245 + 12345;
+                int x = p * CHUNK_SIZE + (r >> 8) % CHUNK_SIZE;
+                int z = q * CHUNK_SIZE + (r >> 12) % CHUNK_SIZE;
+                int y = 16 + (r >> 16) % 48;
+                int w = (r >> 24) % 16;
+                db_insert_block(p, q, x, y, z, w);
+                if (i % 8 == 0) {
+                    db_insert_shape(p, q, x, y, z, SLAB1 + (r >> 20) % 15);
+                }
+                if (i % 16 == 0) {
+                    db_insert_light(p, q, x, y + 1, z, 15);
+                }
+            }
+            db_insert_sign(p, q, p * CHUNK_SIZE, 40, q * CHUNK_SIZE, 0,
+                           "benchmark");
+        }
+    }
+}
+
+static void alloc_chunk(BenchmarkChunk *chunk, int p, int q)
+{
+    int dx = p * CHUNK_SIZE - 1;
+    int dz = q * CHUNK_SIZE - 1;
+    chunk->p = p;
+    chunk->q = q;
+    for (int i = 0; i < WORLDGEN_LAYERS; i++) {
+        map_alloc(chunk->maps + i, dx, 0, dz, i == 0 ? 0x3fff : 0xf);
+    }
+    sign_list_alloc(&chunk->signs, 16);
+}
+
+static void free_chunk(BenchmarkChunk *chunk)
+{
+    for (int i = 0; i < WORLDGEN_LAYERS; i++) {
+        map_free(chunk->maps + i);
+    }
+    sign_list_free(&chunk->signs);
+}
+
+static void add_sample(Stage *stage, double seconds, long allocations,
+    long bytes)
+{
+    stage->times[stage->count++] = seconds;
+    stage->allocations += allocations;
+    stage->bytes += bytes;
+}
+
+static int compare_times(const void *a, const void *b)
+{
+    double x = *(const double *)a;
+    double y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+static void print_stages(Stage *stages)
+{
+    printf("%-12s %9s %9s %9s %13s %12s\n", "stage", "min ms", "median ms",
+           "p99 ms", "allocs/chunk", "bytes/chunk");
+    for (int i = 0; i < STAGE_COUNT; i++) {
+        int s = stage_order[i];
+        Stage *stage = stages + s;
+        if (stage->count == 0) {
+            continue;
+        }
+        qsort(stage->times, stage->count, sizeof(double), compare_times);
+        int p99 = ceil(stage->count * 0.99) - 1;
+        printf("%-12s %9.3f %9.3f %9.3f", stage_names[s],
+               stage->times[0] * 1000, stage->times[stage->count / 2] * 1000,
+               stage->times[p99] * 1000);
+        if (s >= CHUNK_STAGE_COUNT) {
+            printf(" %13.1f %12ld\n",
+                   (double)stage->allocations / stage->count,
+                   stage->bytes / stage->count);
+        } else {
+            printf("\n");
+        }
+    }
+}
+
+// Generate, load and mesh the size by size chunks from p0, q0 rounds times,
+// with the Lua worldgen L or the built in one when L is NULL.
+static void run_pipeline(const char *name, lua_State *L, int p0, int q0,
+    int size, int rounds)
+{
+    int span = size + 2;
+    BenchmarkChunk *grid = calloc(span * span, sizeof(BenchmarkChunk));
+    int samples = span * span * rounds;
+    Stage stages[STAGE_COUNT];
+    memset(stages, 0, sizeof(stages));
+    for (int s = 0; s < STAGE_COUNT; s++) {
+        stages[s].times = calloc(samples, sizeof(double));
+    }
+    size_t float_size = config->use_hfloat ? sizeof(hfloat) : sizeof(GLfloat);
+
+    for (int round = 0; round < rounds; round++) {
+        // The chunks being meshed and the chunks around them.
+        for (int a = 0; a < span; a++) {
+            for (int b = 0; b < span; b++) {
+                BenchmarkChunk *chunk = grid + a * span + b;
+                alloc_chunk(chunk, p0 - 1 + a, q0 - 1 + b);
+                Map *maps[WORLDGEN_LAYERS];
+                for (int i = 0; i < WORLDGEN_LAYERS; i++) {
+                    maps[i] = chunk->maps + i;
+                }
+                long allocations = atomic_load(&allocation_count);
+                double start = monotonic_seconds();
+                worldgen_chunk(chunk->p, chunk->q, maps, &chunk->signs, L);
+                double seconds = monotonic_seconds() - start;
+                long bytes = chunk->signs.size * sizeof(Sign);
+                for (int i = 0; i < WORLDGEN_LAYERS; i++) {
+                    bytes += maps[i]->size * sizeof(MapEntry);
+                }
+                add_sample(stages + STAGE_WORLDGEN, seconds,
+                           atomic_load(&allocation_count) - allocations,
+                           bytes);
+            }
+        }
+
+        for (int a = 1; a <= size; a++) {
+            for (int b = 1; b <= size; b++) {
+                BenchmarkChunk *chunk = grid + a * span + b;
+                long entries = chunk->signs.size;
+                for (int i = 0; i < WORLDGEN_LAYERS; i++) {
+                    entries += chunk->maps[i].size;
+                }
+                long allocations = atomic_load(&allocation_count);
+                double start = monotonic_seconds();
+                db_load_blocks(chunk->maps + 0, chunk->p, chunk->q);
+                db_load_extras(chunk->maps + 1, chunk->p, chunk->q);
+                db_load_lights(chunk->maps + 2, chunk->p, chunk->q);
+                db_load_shapes(chunk->maps + 3, chunk->p, chunk->q);
+                db_load_signs(&chunk->signs, chunk->p, chunk->q);
+                db_load_transforms(chunk->maps + 4, chunk->p, chunk->q);
+                double seconds = monotonic_seconds() - start;
+                entries = -entries + chunk->signs.size;
+                for (int i = 0; i < WORLDGEN_LAYERS; i++) {
+                    entries += chunk->maps[i].size;
+                }
+                add_sample(stages + STAGE_DB_LOAD, seconds,
+                           atomic_load(&allocation_count) - allocations,
+                           entries * sizeof(MapEntry));
+            }
+        }
+
+        for (int a = 1; a <= size; a++) {
+            for (int b = 1; b <= size; b++) {
+                BenchmarkChunk *chunk = grid + a * span + b;
+                WorkerItem item;
+                memset(&item, 0, sizeof(item));
+                item.p = chunk->p;
+                item.q = chunk->q;
+                item.dirty_sections = ALL_SECTIONS;
+                item.signs = chunk->signs;
+                for (int dp = -1; dp <= 1; dp++) {
+                    for (int dq = -1; dq <= 1; dq++) {
+                        BenchmarkChunk *other =
+                            grid + (a + dp) * span + (b + dq);
+                        item.block_maps[dp + 1][dq + 1] = other->maps + 0;
+                        item.extra_maps[dp + 1][dq + 1] = other->maps + 1;
+                        item.light_maps[dp + 1][dq + 1] = other->maps + 2;
+                        item.shape_maps[dp + 1][dq + 1] = other->maps + 3;
+                        item.transform_maps[dp + 1][dq + 1] = other->maps + 4;
+                    }
+                }
+                double times[CHUNK_STAGE_COUNT] = {0};
+                item.stage_times = times;
+                long allocations = atomic_load(&allocation_count);
+                double start = monotonic_seconds();
+                compute_chunk(&item);
+                double seconds = monotonic_seconds() - start;
+                long faces = 0;
+                for (int i = 0; i < SECTION_COUNT; i++) {
+                    faces += item.sections[i].faces;
+                    free(item.sections[i].data);
+                }
+                faces += item.dynamic.faces;
+                free(item.dynamic.blocks);
+                free(item.dynamic.data);
+                free(item.sign_data);
+                add_sample(stages + STAGE_MESH, seconds,
+                           atomic_load(&allocation_count) - allocations,
+                           faces * 6 * 10 * float_size +
+                           item.sign_faces * SIGN_GLYPH_FLOATS *
+                           sizeof(GLfloat));
+                for (int s = 0; s < CHUNK_STAGE_COUNT; s++) {
+                    add_sample(stages + s, times[s], 0, 0);
+                }
+            }
+        }
+
+        for (int i = 0; i < span * span; i++) {
+            free_chunk(grid + i);
+        }
+    }
+
+    printf("\n%s: %dx%d chunks, %d rounds\n", name, size, size, rounds);
+    print_stages(stages);
+    for (int s = 0; s < STAGE_COUNT; s++) {
+        free(stages[s].times);
+    }
+    free(grid);
+}
+
+// Resident memory in bytes, or 0 when it cannot be read.
+static long get_resident_bytes(void)
+{
+    long pages = 0;
+    FILE *f = fopen("/proc/self/statm", "r");
+    if (f == NULL) {
+        return 0;
+    }
+    if (fscanf(f, "%*s %ld", &pages) != 1) {
+        pages = 0;
+    }
+    fclose(f);
+    return pages * sysconf(_SC_PAGESIZE);
+}
+
+static void walk_chunk(BenchmarkChunk *chunk, int p, int q)
+{
+    Map *maps[WORLDGEN_LAYERS];
+    alloc_chunk(chunk, p, q);
+    for (int i = 0; i < WORLDGEN_LAYERS; i++) {
+        maps[i] = chunk->maps + i;
+    }
+    worldgen_chunk(p, q, maps, &chunk->signs, NULL);
+    db_load_blocks(chunk->maps + 0, p, q);
+    db_load_extras(chunk->maps + 1, p, q);
+    db_load_lights(chunk->maps + 2, p, q);
+    db_load_shapes(chunk->maps + 3, p, q);
+    db_load_signs(&chunk->signs, p, q);
+    db_load_transforms(chunk->maps + 4, p, q);
+}
+
+static void print_soak(int step, long start_resident)
+{
+    PoolStats stats;
+    pool_stats(&stats);
+    long resident = get_resident_bytes();
+    printf("%7d %9.1f %+9.1f %10ld %10ld %10ld %9.1f %9.1f\n", step,
+           resident / 1048576.0, (resident - start_resident) / 1048576.0,
+           stats.allocations, stats.reused, stats.released,
+           stats.in_use / 1048576.0, stats.free / 1048576.0);
+}
+
+// Walk steps chunks along p with the built in worldgen. A column of size
+// chunks is meshed each step, the columns either side of it are kept for
+// their neighbours and the column behind is freed.
+static void run_soak(int q0, int size, int steps)
+{
+    int span = size + 2;
+    BenchmarkChunk *columns = calloc(3 * span, sizeof(BenchmarkChunk));
+    long start_resident = 0;
+    printf("\nSoak: %d chunks wide, %d steps\n", size, steps);
+    printf("%7s %9s %9s %10s %10s %10s %9s %9s\n", "step", "rss MiB",
+           "growth", "allocs", "reused", "released", "used MiB",
+           "free MiB");
+    for (int p = -1; p <= steps; p++) {
+        BenchmarkChunk *column = columns + (p + 3) % 3 * span;
+        if (p >= 2) {
+            for (int b = 0; b < span; b++) {
+                free_chunk(column + b);
+            }
+        }
+        for (int b = 0; b < span; b++) {
+            walk_chunk(column + b, p, q0 - 1 + b);
+        }
+        if (p < 1) {
+            continue;
+        }
+        // Mesh the column before the one just loaded.
+        for (int b = 1; b <= size; b++) {
+            WorkerItem item;
+            memset(&item, 0, sizeof(item));
+            item.p = p - 1;
+            item.q = q0 - 1 + b;
+            item.dirty_sections = ALL_SECTIONS;
+            item.signs = columns[(p - 1 + 3) % 3 * span + b].signs;
+            for (int dp = -1; dp <= 1; dp++) {
+                for (int dq = -1; dq <= 1; dq++) {
+                    BenchmarkChunk *other =
+                        columns + (p - 1 + dp + 3) % 3 * span + b + dq;
+                    item.block_maps[dp + 1][dq + 1] = other->maps + 0;
+                    item.extra_maps[dp + 1][dq + 1] = other->maps + 1;
+                    item.light_maps[dp + 1][dq + 1] = other->maps + 2;
+                    item.shape_maps[dp + 1][dq + 1] = other->maps + 3;
+                    item.transform_maps[dp + 1][dq + 1] = other->maps + 4;
+                }
+            }
+            compute_chunk(&item);
+            for (int i = 0; i < SECTION_COUNT; i++) {
+                free(item.sections[i].data);
+            }
+            free(item.dynamic.blocks);
+            free(item.dynamic.data);
+            free(item.sign_data);
+        }
+        if (p == SOAK_REPORT_INTERVAL) {
+            start_resident = get_resident_bytes();
+        }
+        if (p % SOAK_REPORT_INTERVAL == 0 || p == steps) {
+            print_soak(p, start_resident ? start_resident :
+                       get_resident_bytes());
+        }
+    }
+    for (int i = 0; i < 3 * span; i++) {
+        free_chunk(columns + i);
+    }
+    free(columns);
+}
+
+static void usage(void)
+{
+    printf("Usage: piworld-benchmark [--size N] [--rounds N] "
+           "[--worldgen NAME] [--soak N] [--map N]\n");
+}
+
+int main(int argc, char **argv)
+{
+    static char worldgen_path[MAX_PATH_LENGTH];
+    char worldgen[MAX_PATH_LENGTH] = DEFAULT_WORLDGEN;
+    int size = DEFAULT_SIZE;
+    int rounds = DEFAULT_ROUNDS;
+    int soak = 0;
+    int map_operations = DEFAULT_MAP_OPERATIONS;
+    int p0 = -size / 2;
+    int q0 = -size / 2;
+
+    init_data_dir();
+    pool_init();
+    reset_config();
+    // Every chunk is generated, not read from the worldgen cache.
+    config->worldgen_cache = 0;
+    config->worldgen_cache_dir[0] = '\0';
+
+    int c;
+    while (1) {
+        int option_index = 0;
+        static struct option long_options[] = {
+            {"size",     required_argument, 0,  0 },
+            {"rounds",   required_argument, 0,  0 },
+            {"worldgen", required_argument, 0,  0 },
+            {"soak",     required_argument, 0,  0 },
+            {"map",      required_argument, 0,  0 },
+            {0,          0,                 0,  0 }
+        };
+        c = getopt_long(argc, argv, "", long_options, &option_index);
+        if (c == -1) {
+            break;
+        }
+        const char *opt_name = long_options[option_index].name;
+        if (c != 0) {
+            usage();
+            return EXIT_FAILURE;
+        } else if (strncmp(opt_name, "size", 4) == 0 &&
+                   sscanf(optarg, "%d", &size) == 1 && size > 0) {
+            p0 = -size / 2;
+            q0 = -size / 2;
+        } else if (strncmp(opt_name, "rounds", 6) == 0 &&
+                   sscanf(optarg, "%d", &rounds) == 1 && rounds > 0) {
+        } else if (strncmp(opt_name, "worldgen", 8) == 0) {
+            snprintf(worldgen, sizeof(worldgen), "%s", optarg);
+        } else if (strncmp(opt_name, "soak", 4) == 0 &&
+                   sscanf(optarg, "%d", &soak) == 1 && soak > 0) {
+        } else if (strncmp(opt_name, "map", 3) == 0 &&
+                   sscanf(optarg, "%d", &map_operations) == 1 &&
+                   map_operations >= 0) {
+        } else {
+            usage();
+            return EXIT_FAILURE;
+        }
+    }
+
+    fence_init();
+    worldgen_cache_init();
+    sign_mesh_init();
+
+    char db_path[] = "/tmp/piworld-benchmark-XXXXXX";
+    int fd = mkstemp(db_path);
+    if (fd == -1) {
+        perror("mkstemp");
+        return EXIT_FAILURE;
+    }
+    close(fd);
+    db_enable();
+    if (db_init(db_path)) {
+        printf("Could not create the benchmark database: %s\n", db_path);
+        remove(db_path);
+        return EXIT_FAILURE;
+    }
+    fill_database(p0, q0, size);
+    // Closing waits for the changes to be written.
+    db_close();
+    db_init(db_path);
+
+    if (soak) {
+        run_soak(q0, size, soak);
+        db_close();
+        remove(db_path);
+        return EXIT_SUCCESS;
+    }
+
+    run_pipeline("Built in worldgen", NULL, p0, q0, size, rounds);
+
+    if (access(worldgen, R_OK) == 0) {
+        snprintf(worldgen_path, sizeof(worldgen_path), "%s", worldgen);
+    } else {
+        snprintf(worldgen_path, sizeof(worldgen_path), "%s/worldgen/%s.lua",
+                 get_data_dir(), worldgen);
+    }
+    if (access(worldgen_path, R_OK) == 0) {
+        pwlua_worldgen_init(worldgen_path);
+        worldgen_cache_set_worldgen(worldgen_path);
+        char name[MAX_PATH_LENGTH + 16];
+        snprintf(name, sizeof(name), "Lua worldgen %s", worldgen);
+        run_pipeline(name, pwlua_worldgen_get_main_thread_instance(),
+                     p0, q0, size, rounds);
+        pwlua_worldgen_deinit();
+    } else {
+        printf("Worldgen file not found: %s\n", worldgen_path);
+    }
+
+    int mismatches = 0;
+    if (map_operations > 0) {
+        printf("\nMap: %d operations\n", map_operations);
+        mismatches = benchmark_map(map_operations);
+    }
+
+    db_close();
+    remove(db_path);
+    return mismatches ? EXIT_FAILURE : EXIT_SUCCESS;
+}
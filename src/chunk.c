@@ -1,21 +1,23 @@
 #include <math.h>
 #include <stdlib.h>
+#include <string.h>
 #include "chunk.h"
 #include "chunks.h"
 #include "client.h"
 #include "config.h"
 #include "cube.h"
 #include "db.h"
+#include "door.h"
+#include "dynamic.h"
 #include "fence.h"
 #include "item.h"
 #include "matrix.h"
 #include "noise.h"
-#include "pw.h"
 #include "pwlua_worldgen.h"
+#include "sign_mesh.h"
 #include "util.h"
 #include "world.h"
-
-void init_chunk(Chunk *chunk, int p, int q);
+#include "worldgen_cache.h"
 
 int chunked(float x)
 {
@@ -72,6 +74,25 @@ int chunk_visible(float planes[6][4], int p, int q, int miny, int maxy,
     return 1;
 }
 
+// Fill the empty maps and signs with what the worldgen makes for chunk p, q,
+// from the worldgen cache when it is there. L is the Lua worldgen to use or
+// NULL for the built in one.
+void worldgen_chunk(int p, int q, Map *maps[WORLDGEN_LAYERS],
+    SignList *signs, lua_State *L)
+{
+    unsigned int key = worldgen_cache_key();
+    if (worldgen_cache_load(key, p, q, maps, signs)) {
+        return;
+    }
+    if (L != NULL) {
+        pwlua_worldgen(L, p, q, maps[0], maps[1], maps[2], maps[3], signs,
+                       maps[4]);
+    } else {
+        create_world_map(p, q, maps[0]);
+    }
+    worldgen_cache_store(key, p, q, maps, signs);
+}
+
 void load_chunk(WorkerItem *item, lua_State *L)
 {
     int p = item->p;
@@ -83,12 +104,10 @@ void load_chunk(WorkerItem *item, lua_State *L)
     Map *transform_map = item->transform_maps[1][1];
     SignList *signs = &item->signs;
     sign_list_alloc(signs, 16);
-    if (L != NULL) {
-        pwlua_worldgen(L, p, q, block_map, extra_map, light_map, shape_map,
-                       signs, transform_map);
-    } else {
-        create_world(p, q, map_set_func, block_map);
-    }
+    Map *maps[WORLDGEN_LAYERS] = {
+        block_map, extra_map, light_map, shape_map, transform_map
+    };
+    worldgen_chunk(p, q, maps, signs, L);
     db_load_blocks(block_map, p, q);
     db_load_extras(extra_map, p, q);
     db_load_lights(light_map, p, q);
@@ -103,54 +122,15 @@ void request_chunk(int p, int q)
     client_chunk(p, q, key);
 }
 
-void init_chunk(Chunk *chunk, int p, int q)
-{
-    chunk->p = p;
-    chunk->q = q;
-    chunk->faces = 0;
-    chunk->sign_faces = 0;
-    chunk->buffer = 0;
-    chunk->sign_buffer = 0;
-    dirty_chunk(chunk);
-    SignList *signs = &chunk->signs;
-    sign_list_alloc(signs, 16);
-    Map *block_map = &chunk->map;
-    Map *extra_map = &chunk->extra;
-    Map *light_map = &chunk->lights;
-    Map *shape_map = &chunk->shape;
-    Map *transform_map = &chunk->transform;
-    DoorMap *doors_map = &chunk->doors;
-    int dx = p * CHUNK_SIZE - 1;
-    int dy = 0;
-    int dz = q * CHUNK_SIZE - 1;
-    map_alloc(block_map, dx, dy, dz, 0x3fff);
-    map_alloc(extra_map, dx, dy, dz, 0xf);
-    map_alloc(light_map, dx, dy, dz, 0xf);
-    map_alloc(shape_map, dx, dy, dz, 0xf);
-    map_alloc(transform_map, dx, dy, dz, 0xf);
-    door_map_alloc(doors_map, dx, dy, dz, 0xf);
-}
-
-void create_chunk(Chunk *chunk, int p, int q)
+// The maps of chunks edited on the main thread grow a little at a time, so
+// an edit never stalls a frame rehashing a whole map.
+void chunk_grow_maps_incrementally(Chunk *chunk)
 {
-    init_chunk(chunk, p, q);
-
-    WorkerItem _item;
-    WorkerItem *item = &_item;
-    item->p = chunk->p;
-    item->q = chunk->q;
-    item->block_maps[1][1] = &chunk->map;
-    item->extra_maps[1][1] = &chunk->extra;
-    item->light_maps[1][1] = &chunk->lights;
-    item->shape_maps[1][1] = &chunk->shape;
-    item->transform_maps[1][1] = &chunk->transform;
-    item->door_maps[1][1] = &chunk->doors;
-    load_chunk(item, pwlua_worldgen_get_main_thread_instance());
-    sign_list_free(&chunk->signs);
-    sign_list_copy(&chunk->signs, &item->signs);
-    sign_list_free(&item->signs);
-
-    request_chunk(p, q);
+    map_set_grow_step(&chunk->map, MAP_GROW_STEP);
+    map_set_grow_step(&chunk->extra, MAP_GROW_STEP);
+    map_set_grow_step(&chunk->lights, MAP_GROW_STEP);
+    map_set_grow_step(&chunk->shape, MAP_GROW_STEP);
+    map_set_grow_step(&chunk->transform, MAP_GROW_STEP);
 }
 
 void occlusion(
@@ -232,15 +212,176 @@ void light_fill(
     light_fill(opaque, light, x, y, z + 1, w, 0);
 }
 
+// The ambient occlusion and light of each corner of the faces of the block
+// at x, y, z.
+static void block_occlusion(
+    char *opaque, char *lights, char *highest, int x, int y, int z,
+    float ao[6][4], float light[6][4])
+{
+    char neighbors[27] = {0};
+    char block_lights[27] = {0};
+    float shades[27] = {0};
+    int index = 0;
+    for (int dx = -1; dx <= 1; dx++) {
+        for (int dy = -1; dy <= 1; dy++) {
+            for (int dz = -1; dz <= 1; dz++) {
+                neighbors[index] = opaque[XYZ(x + dx, y + dy, z + dz)];
+                block_lights[index] = lights[XYZ(x + dx, y + dy, z + dz)];
+                shades[index] = 0;
+                if (y + dy <= highest[XZ(x + dx, z + dz)]) {
+                    for (int oy = 0; oy < 8; oy++) {
+                        if (opaque[XYZ(x + dx, y + dy + oy, z + dz)]) {
+                            shades[index] = 1.0 - oy * 0.125;
+                            break;
+                        }
+                    }
+                }
+                index++;
+            }
+        }
+    }
+    occlusion(neighbors, block_lights, shades, ao, light);
+}
+
+static int compare_dynamic_blocks(const void *a, const void *b)
+{
+    const DynamicBlock *da = (const DynamicBlock *)a;
+    const DynamicBlock *db = (const DynamicBlock *)b;
+    return da->y - db->y;
+}
+
+// Make the faces of both poses of the chunk's doors and gates, see dynamic.h.
+// All of them are made whichever sections are being meshed.
+static void compute_dynamic_blocks(
+    WorkerItem *item, char *opaque, char *lights, char *highest,
+    int ox, int oy, int oz)
+{
+    DynamicBlocks *dynamic = &item->dynamic;
+    memset(dynamic, 0, sizeof(DynamicBlocks));
+    Map *map = item->block_maps[1][1];
+    Map *shape_map = item->shape_maps[1][1];
+    Map *extra_map = item->extra_maps[1][1];
+    Map *transform_map = item->transform_maps[1][1];
+    if (!shape_map || shape_map->size == 0) {
+        return;
+    }
+    MAP_FOR_EACH(shape_map, ex, ey, ez, ew) {
+        if (ew > 0 && is_dynamic_shape(ew) && map_get(map, ex, ey, ez) > 0) {
+            dynamic->count++;
+        }
+    } END_MAP_FOR_EACH;
+    if (dynamic->count == 0) {
+        return;
+    }
+    dynamic->blocks = malloc(sizeof(DynamicBlock) * dynamic->count);
+    int count = 0;
+    MAP_FOR_EACH(shape_map, ex, ey, ez, ew) {
+        if (ew > 0 && is_dynamic_shape(ew) && map_get(map, ex, ey, ez) > 0) {
+            DynamicBlock *block = dynamic->blocks + count++;
+            block->x = ex;
+            block->y = ey;
+            block->z = ez;
+            block->shape = ew;
+            if (ew == GATE) {
+                block->faces = fence_face_count(ew);
+            } else {
+                // Different side faces of a door may be visible when open.
+                int x = ex - ox;
+                int y = ey - oy;
+                int z = ez - oz;
+                block->faces = 4 + !opaque[XYZ(x, y + 1, z)] +
+                    (!opaque[XYZ(x, y - 1, z)] && (ey > 0));
+            }
+            dynamic->faces += block->faces * 2;
+        }
+    } END_MAP_FOR_EACH;
+    qsort(dynamic->blocks, dynamic->count, sizeof(DynamicBlock),
+        compare_dynamic_blocks);
+
+    GLfloat *data = malloc_faces(10, dynamic->faces, sizeof(GLfloat));
+    dynamic->data = data;
+    int face = 0;
+    for (int i = 0; i < dynamic->count;) {
+        int section = dynamic->blocks[i].y / SECTION_SIZE;
+        int end = i;
+        while (end < dynamic->count &&
+               dynamic->blocks[end].y / SECTION_SIZE == section) {
+            end++;
+        }
+        for (int pose = 0; pose < 2; pose++) {
+            for (int j = i; j < end; j++) {
+                DynamicBlock *block = dynamic->blocks + j;
+                int x = block->x - ox;
+                int y = block->y - oy;
+                int z = block->z - oz;
+                int w = map_get(map, block->x, block->y, block->z);
+                int extra = 0;
+                if (extra_map) {
+                    extra = map_get(extra_map, block->x, block->y, block->z);
+                }
+                int transform = 0;
+                if (transform_map) {
+                    transform = map_get(transform_map,
+                        block->x, block->y, block->z);
+                }
+                block->open = is_open(extra);
+                extra = pose ? extra | EXTRA_BIT_OPEN :
+                    extra & ~EXTRA_BIT_OPEN;
+                float ao[6][4];
+                float light[6][4];
+                block_occlusion(opaque, lights, highest, x, y, z, ao, light);
+                float bx = block->x - map->dx;
+                float by = block->y - map->dy;
+                float bz = block->z - map->dz;
+                if (block->shape == GATE) {
+                    make_fence(data + face * 60, ao, light,
+                        1, 1, 1, 1, 1, 1, bx, by, bz, 0.5, w, block->shape,
+                        extra, transform);
+                } else {
+                    make_door(data + face * 60, ao, light,
+                        1, 1, !opaque[XYZ(x, y + 1, z)],
+                        !opaque[XYZ(x, y - 1, z)] && (block->y > 0), 1, 1,
+                        bx, by, bz, 0.5, w, block->shape, extra, transform);
+                }
+                block->first[pose] = face;
+                face += block->faces;
+            }
+        }
+        i = end;
+    }
+}
+
+// Returns the time to start a stage of compute_chunk from, 0 when the
+// stages of item are not being timed.
+static double stage_start(WorkerItem *item)
+{
+    if (!item->stage_times) {
+        return 0;
+    }
+    return monotonic_seconds();
+}
+
+// Add the time since start to stage and return the time now.
+static double stage_end(WorkerItem *item, int stage, double start)
+{
+    if (!item->stage_times) {
+        return 0;
+    }
+    double now = stage_start(item);
+    item->stage_times[stage] += now - start;
+    return now;
+}
+
 void compute_chunk(WorkerItem *item)
 {
     char *opaque = (char *)calloc(XZ_SIZE * XZ_SIZE * Y_SIZE, sizeof(char));
-    char *light = (char *)calloc(XZ_SIZE * XZ_SIZE * Y_SIZE, sizeof(char));
+    char *lights = (char *)calloc(XZ_SIZE * XZ_SIZE * Y_SIZE, sizeof(char));
     char *highest = (char *)calloc(XZ_SIZE * XZ_SIZE, sizeof(char));
 
     int ox = item->p * CHUNK_SIZE - CHUNK_SIZE - 1;
     int oy = -1;
     int oz = item->q * CHUNK_SIZE - CHUNK_SIZE - 1;
+    double stage_time = stage_start(item);
 
     // check for shapes
     Map *shape_map = item->shape_maps[1][1];
@@ -313,6 +454,8 @@ void compute_chunk(WorkerItem *item)
         }
     }
 
+    stage_time = stage_end(item, CHUNK_STAGE_OPAQUE, stage_time);
+
     // flood fill light intensities
     if (has_light) {
         for (int a = 0; a < 3; a++) {
@@ -325,12 +468,14 @@ void compute_chunk(WorkerItem *item)
                     int x = ex - ox;
                     int y = ey - oy;
                     int z = ez - oz;
-                    light_fill(opaque, light, x, y, z, ew, 1);
+                    light_fill(opaque, lights, x, y, z, ew, 1);
                 } END_MAP_FOR_EACH;
             }
         }
     }
 
+    stage_time = stage_end(item, CHUNK_STAGE_LIGHT, stage_time);
+
     Map *map = item->block_maps[1][1];
     if (has_shape) {
         shape_map = item->shape_maps[1][1];
@@ -340,16 +485,36 @@ void compute_chunk(WorkerItem *item)
     if (transform_map && transform_map->size) {
         has_transform = 1;
     }
-    DoorMap *door_map = item->door_maps[1][1];
 
-    // count exposed faces
-    int miny = 256;
-    int maxy = 0;
-    int faces = 0;
+    // count exposed faces in the sections being meshed
+    int dirty_sections = item->dirty_sections;
+    SectionMesh *sections = item->sections;
+    for (int i = 0; i < SECTION_COUNT; i++) {
+        sections[i].faces = 0;
+        sections[i].miny = 256;
+        sections[i].maxy = 0;
+        sections[i].data = NULL;
+    }
     MAP_FOR_EACH(map, ex, ey, ez, ew) {
         if (ew <= 0) {
             continue;
         }
+        int section = ey / SECTION_SIZE;
+        if (!(dirty_sections & (1 << section))) {
+            continue;
+        }
+        SectionMesh *mesh = sections + section;
+        int shape = 0;
+        if (has_shape && shape_map) {
+            shape = map_get(shape_map, ex, ey, ez);
+        }
+        if (is_dynamic_shape(shape)) {
+            // Drawn from the chunk's dynamic blocks, but still in the
+            // section when finding what is visible.
+            mesh->miny = MIN(mesh->miny, ey);
+            mesh->maxy = MAX(mesh->maxy, ey);
+            continue;
+        }
         int x = ex - ox;
         int y = ey - oy;
         int z = ez - oz;
@@ -365,38 +530,48 @@ void compute_chunk(WorkerItem *item)
         }
         if (is_plant(ew)) {
             total = 4;
-        } else if (has_shape && shape_map) {
-            int shape = map_get(shape_map, ex, ey, ez);
-            if (shape) {
-                if (shape >= SLAB1 && shape <= SLAB15) {
-                    // Top face of slab is viewable when a block is above the slab.
-                    f3 = 1;
-                    total = f1 + f2 + f3 + f4 + f5 + f6;
-                } else if (shape == UPPER_DOOR || shape == LOWER_DOOR) {
-                    // Different side faces of a door may be visible when open.
-                    f1 = 1;
-                    f2 = 1;
-                    f5 = 1;
-                    f6 = 1;
-                    total = f1 + f2 + f3 + f4 + f5 + f6;
-                } else if (shape >= FENCE && shape <= GATE) {
-                    // Hidden face removal not yet enabled for fence shapes.
-                    total = fence_face_count(shape);
-                }
-            }
+        } else if (shape >= SLAB1 && shape <= SLAB15) {
+            // Top face of slab is viewable when a block is above the slab.
+            f3 = 1;
+            total = f1 + f2 + f3 + f4 + f5 + f6;
+        } else if (shape >= FENCE && shape <= GATE) {
+            // Hidden face removal not yet enabled for fence shapes.
+            total = fence_face_count(shape);
         }
-        miny = MIN(miny, ey);
-        maxy = MAX(maxy, ey);
-        faces += total;
+        mesh->miny = MIN(mesh->miny, ey);
+        mesh->maxy = MAX(mesh->maxy, ey);
+        mesh->faces += total;
     } END_MAP_FOR_EACH;
 
-    // generate geometry
-    GLfloat *data = malloc_faces(10, faces, sizeof(GLfloat));
-    int offset = 0;
+    stage_time = stage_end(item, CHUNK_STAGE_FACES, stage_time);
+
+    // generate geometry, the time spent on ambient occlusion and lighting
+    // is timed separately and left out of the vertices stage
+    double ao_time = 0;
+    int offsets[SECTION_COUNT] = {0};
+    for (int i = 0; i < SECTION_COUNT; i++) {
+        if (sections[i].faces) {
+            sections[i].data = malloc_faces(10, sections[i].faces,
+                sizeof(GLfloat));
+        }
+    }
     MAP_FOR_EACH(map, ex, ey, ez, ew) {
         if (ew <= 0) {
             continue;
         }
+        int section = ey / SECTION_SIZE;
+        if (!(dirty_sections & (1 << section))) {
+            continue;
+        }
+        int shape = 0;
+        if (has_shape && shape_map) {
+            shape = map_get(shape_map, ex, ey, ez);
+        }
+        if (is_dynamic_shape(shape)) {
+            continue;
+        }
+        GLfloat *data = sections[section].data;
+        int offset = offsets[section];
         int x = ex - ox;
         int y = ey - oy;
         int z = ez - oz;
@@ -410,49 +585,21 @@ void compute_chunk(WorkerItem *item)
         if (total == 0) {
             continue;
         }
-        if (has_shape && shape_map) {
-            int shape = map_get(shape_map, ex, ey, ez);
-            if (shape >= SLAB1 && shape <= SLAB15) {
-                // Top face of slab is viewable when a block is above the slab.
-                f3 = 1;
-                total = f1 + f2 + f3 + f4 + f5 + f6;
-            } else if (shape == UPPER_DOOR || shape == LOWER_DOOR) {
-                // Different side faces of a door may be visible when open.
-                f1 = 1;
-                f2 = 1;
-                f5 = 1;
-                f6 = 1;
-                total = f1 + f2 + f3 + f4 + f5 + f6;
-            } else if (shape >= FENCE && shape <= GATE) {
-                f1 = 1; f2 = 1; f3 = 1; f4 = 1; f5 = 1; f6 = 1;
-                total = fence_face_count(shape);
-            }
-        }
-        char neighbors[27] = {0};
-        char lights[27] = {0};
-        float shades[27] = {0};
-        int index = 0;
-        for (int dx = -1; dx <= 1; dx++) {
-            for (int dy = -1; dy <= 1; dy++) {
-                for (int dz = -1; dz <= 1; dz++) {
-                    neighbors[index] = opaque[XYZ(x + dx, y + dy, z + dz)];
-                    lights[index] = light[XYZ(x + dx, y + dy, z + dz)];
-                    shades[index] = 0;
-                    if (y + dy <= highest[XZ(x + dx, z + dz)]) {
-                        for (int oy = 0; oy < 8; oy++) {
-                            if (opaque[XYZ(x + dx, y + dy + oy, z + dz)]) {
-                                shades[index] = 1.0 - oy * 0.125;
-                                break;
-                            }
-                        }
-                    }
-                    index++;
-                }
-            }
+        if (shape >= SLAB1 && shape <= SLAB15) {
+            // Top face of slab is viewable when a block is above the slab.
+            f3 = 1;
+            total = f1 + f2 + f3 + f4 + f5 + f6;
+        } else if (shape >= FENCE && shape <= GATE) {
+            f1 = 1; f2 = 1; f3 = 1; f4 = 1; f5 = 1; f6 = 1;
+            total = fence_face_count(shape);
         }
+        double ao_start = stage_start(item);
         float ao[6][4];
         float light[6][4];
-        occlusion(neighbors, lights, shades, ao, light);
+        block_occlusion(opaque, lights, highest, x, y, z, ao, light);
+        if (item->stage_times) {
+            ao_time += stage_start(item) - ao_start;
+        }
         if (is_plant(ew)) {
             total = 4;
             float min_ao = 1;
@@ -468,52 +615,25 @@ void compute_chunk(WorkerItem *item)
                 data + offset, min_ao, max_light,
                 entry->e.x, entry->e.y, entry->e.z, 0.5, ew, rotation);
         }
-        else if (has_shape && shape_map) {
-            int shape = map_get(shape_map, ex, ey, ez);
-            if (shape) {
-                int transform = 0;
-                if (has_transform) {
-                    transform = map_get(transform_map, ex, ey, ez);
-                }
-                if (shape >= SLAB1 && shape <= SLAB15) {
-                    make_slab(
-                        data + offset, ao, light,
-                        f1, f2, f3, f4, f5, f6,
-                        entry->e.x, entry->e.y, entry->e.z, 0.5, ew, shape);
-                } else if (shape == LOWER_DOOR || shape == UPPER_DOOR) {
-                    int extra = 0;
-                    if (has_extra && extra_map)  {
-                        extra = map_get(extra_map, ex, ey, ez);
-                    }
-                    door_map_set(door_map, ex, ey, ez, ew, offset, total, ao,
-                        light, f1, f2, f3, f4, f5, f6, 0.5, shape, extra,
-                        transform);
-                    make_door(
-                        data + offset, ao, light,
-                        f1, f2, f3, f4, f5, f6,
-                        entry->e.x, entry->e.y, entry->e.z, 0.5, ew, shape,
-                        extra, transform);
-                } else if (shape >= FENCE && shape <= GATE) {
-                    int extra = 0;
-                    if (has_extra && extra_map)  {
-                        extra = map_get(extra_map, ex, ey, ez);
-                    }
-                    if (shape == GATE) {
-                        door_map_set(door_map, ex, ey, ez, ew, offset, total, ao,
-                            light, f1, f2, f3, f4, f5, f6, 0.5, shape, extra,
-                            transform);
-                    }
-                    make_fence(data + offset, ao, light,
-                        f1, f2, f3, f4, f5, f6,
-                        entry->e.x, entry->e.y, entry->e.z, 0.5, ew, shape,
-                        extra, transform);
-                }
-
-            } else {
-                make_cube(
+        else if (shape) {
+            int transform = 0;
+            if (has_transform) {
+                transform = map_get(transform_map, ex, ey, ez);
+            }
+            if (shape >= SLAB1 && shape <= SLAB15) {
+                make_slab(
                     data + offset, ao, light,
                     f1, f2, f3, f4, f5, f6,
-                    entry->e.x, entry->e.y, entry->e.z, 0.5, ew);
+                    entry->e.x, entry->e.y, entry->e.z, 0.5, ew, shape);
+            } else if (shape >= FENCE && shape <= GATE) {
+                int extra = 0;
+                if (has_extra && extra_map)  {
+                    extra = map_get(extra_map, ex, ey, ez);
+                }
+                make_fence(data + offset, ao, light,
+                    f1, f2, f3, f4, f5, f6,
+                    entry->e.x, entry->e.y, entry->e.z, 0.5, ew, shape,
+                    extra, transform);
             }
         }
         else {
@@ -522,204 +642,68 @@ void compute_chunk(WorkerItem *item)
                 f1, f2, f3, f4, f5, f6,
                 entry->e.x, entry->e.y, entry->e.z, 0.5, ew);
         }
-        offset += total * 60;
+        offsets[section] = offset + total * 60;
     } END_MAP_FOR_EACH;
 
-    free(opaque);
-    free(light);
-    free(highest);
+    compute_dynamic_blocks(item, opaque, lights, highest, ox, oy, oz);
 
-    item->miny = miny;
-    item->maxy = maxy;
-    item->faces = faces;
-    if (config->use_hfloat) {
-        hfloat *hdata = malloc_faces(10, faces, sizeof(hfloat));
-        for (int i=0; i < (6 * 10 * faces); i++) {
-            hdata[i] = float_to_hfloat(data + i);
-        }
-        free(data);
-        item->data = hdata;
-    } else {
-        item->data = data;
+    if (item->stage_times) {
+        stage_time = stage_end(item, CHUNK_STAGE_VERTICES, stage_time);
+        item->stage_times[CHUNK_STAGE_VERTICES] -= ao_time;
+        item->stage_times[CHUNK_STAGE_AO] += ao_time;
     }
-}
 
-void generate_chunk(Chunk *chunk, WorkerItem *item, size_t float_size)
-{
-    chunk->miny = item->miny;
-    chunk->maxy = item->maxy;
-    chunk->faces = item->faces;
-    del_buffer(chunk->buffer);
-    chunk->buffer = gen_faces(10, item->faces, item->data, float_size);
-    gen_sign_chunk_buffer(chunk);
-}
-
-void ensure_chunks_worker(Player *player, Worker *worker, int width,
-    int height, int fov, int ortho, int render_radius, int create_radius)
-{
-    State *s = &player->state;
-    float matrix[16];
-    set_matrix_3d(
-        matrix, width, height,
-        s->x, s->y, s->z, s->rx, s->ry, fov, ortho, render_radius);
-    float planes[6][4];
-    frustum_planes(planes, render_radius, matrix);
-    int p = chunked(s->x);
-    int q = chunked(s->z);
-    int r = create_radius;
-    int start = 0x0fffffff;
-    int best_score = start;
-    int best_a = 0;
-    int best_b = 0;
-    for (int dp = -r; dp <= r; dp++) {
-        for (int dq = -r; dq <= r; dq++) {
-            int a = p + dp;
-            int b = q + dq;
-            int index = (ABS(a) ^ ABS(b)) % config->worker_count;
-            if (index != worker->index) {
-                continue;
-            }
-            Chunk *chunk = find_chunk(a, b);
-            if (chunk && !chunk->dirty) {
-                continue;
-            }
-            int distance = MAX(ABS(dp), ABS(dq));
-            int invisible = !chunk_visible(planes, a, b, 0, 256, ortho);
-            int priority = 0;
-            if (chunk) {
-                priority = chunk->buffer && chunk->dirty;
-            }
-            int score = (invisible << 24) | (priority << 16) | distance;
-            if (score < best_score) {
-                best_score = score;
-                best_a = a;
-                best_b = b;
-            }
-        }
-    }
-    if (best_score == start) {
-        return;
-    }
-    int a = best_a;
-    int b = best_b;
-    int load = 0;
-    Chunk *chunk = find_chunk(a, b);
-    if (!chunk) {
-        load = 1;
-        chunk = next_available_chunk();
-        if (chunk) {
-            init_chunk(chunk, a, b);
-        }
-        else {
-            return;
-        }
-    }
-    WorkerItem *item = &worker->item;
-    item->p = chunk->p;
-    item->q = chunk->q;
-    item->load = load;
-    for (int dp = -1; dp <= 1; dp++) {
-        for (int dq = -1; dq <= 1; dq++) {
-            Chunk *other = chunk;
-            if (dp || dq) {
-                other = find_chunk(chunk->p + dp, chunk->q + dq);
-            }
-            if (other) {
-                Map *block_map = malloc(sizeof(Map));
-                map_copy(block_map, &other->map);
-                Map *extra_map = malloc(sizeof(Map));
-                map_copy(extra_map, &other->extra);
-                Map *light_map = malloc(sizeof(Map));
-                map_copy(light_map, &other->lights);
-                Map *shape_map = malloc(sizeof(Map));
-                map_copy(shape_map, &other->shape);
-                Map *transform_map = malloc(sizeof(Map));
-                map_copy(transform_map, &other->transform);
-                DoorMap *door_map = malloc(sizeof(DoorMap));
-                door_map_copy(door_map, &other->doors);
-                item->block_maps[dp + 1][dq + 1] = block_map;
-                item->extra_maps[dp + 1][dq + 1] = extra_map;
-                item->light_maps[dp + 1][dq + 1] = light_map;
-                item->shape_maps[dp + 1][dq + 1] = shape_map;
-                item->transform_maps[dp + 1][dq + 1] = transform_map;
-                item->door_maps[dp + 1][dq + 1] = door_map;
-            }
-            else {
-                item->block_maps[dp + 1][dq + 1] = 0;
-                item->extra_maps[dp + 1][dq + 1] = 0;
-                item->light_maps[dp + 1][dq + 1] = 0;
-                item->shape_maps[dp + 1][dq + 1] = 0;
-                item->transform_maps[dp + 1][dq + 1] = 0;
-                item->door_maps[dp + 1][dq + 1] = 0;
+    // find the solid blocks at the bottom of each occluder cell
+    for (int a = 0; a < OCCLUDER_CELLS; a++) {
+        for (int b = 0; b < OCCLUDER_CELLS; b++) {
+            int height = Y_SIZE;
+            for (int dx = 0; dx < OCCLUDER_CELL_SIZE; dx++) {
+                for (int dz = 0; dz < OCCLUDER_CELL_SIZE; dz++) {
+                    int x = XZ_LO + 1 + a * OCCLUDER_CELL_SIZE + dx;
+                    int z = XZ_LO + 1 + b * OCCLUDER_CELL_SIZE + dz;
+                    int y = 1;
+                    while (y < height && opaque[XYZ(x, y, z)]) {
+                        y++;
+                    }
+                    height = y;
+                }
             }
+            item->occluders[a][b] = MIN(height - 1, 255);
         }
     }
-    chunk->dirty = 0;
-    worker->state = WORKER_BUSY;
-    cnd_signal(&worker->cnd);
-}
 
-void gen_chunk_buffer(Chunk *chunk, size_t float_size)
-{
-    WorkerItem _item;
-    WorkerItem *item = &_item;
-    item->p = chunk->p;
-    item->q = chunk->q;
-    for (int dp = -1; dp <= 1; dp++) {
-        for (int dq = -1; dq <= 1; dq++) {
-            Chunk *other = chunk;
-            if (dp || dq) {
-                other = find_chunk(chunk->p + dp, chunk->q + dq);
-            }
-            if (other) {
-                item->block_maps[dp + 1][dq + 1] = &other->map;
-                item->extra_maps[dp + 1][dq + 1] = &other->extra;
-                item->light_maps[dp + 1][dq + 1] = &other->lights;
-                item->shape_maps[dp + 1][dq + 1] = &other->shape;
-                item->transform_maps[dp + 1][dq + 1] = &other->transform;
-                item->door_maps[dp + 1][dq + 1] = &other->doors;
+    stage_time = stage_end(item, CHUNK_STAGE_OCCLUDERS, stage_time);
+
+    free(opaque);
+    free(lights);
+    free(highest);
+
+    if (config->use_hfloat) {
+        for (int i = 0; i < SECTION_COUNT; i++) {
+            SectionMesh *mesh = sections + i;
+            if (!mesh->data) {
+                continue;
             }
-            else {
-                item->block_maps[dp + 1][dq + 1] = 0;
-                item->extra_maps[dp + 1][dq + 1] = 0;
-                item->light_maps[dp + 1][dq + 1] = 0;
-                item->shape_maps[dp + 1][dq + 1] = 0;
-                item->transform_maps[dp + 1][dq + 1] = 0;
-                item->door_maps[dp + 1][dq + 1] = 0;
+            GLfloat *data = mesh->data;
+            hfloat *hdata = malloc_faces(10, mesh->faces, sizeof(hfloat));
+            for (int j=0; j < (6 * 10 * mesh->faces); j++) {
+                hdata[j] = float_to_hfloat(data + j);
             }
+            free(data);
+            mesh->data = hdata;
         }
-    }
-    compute_chunk(item);
-    generate_chunk(chunk, item, float_size);
-    chunk->dirty = 0;
-}
-
-void force_chunks(Player *player, size_t float_size)
-{
-    State *s = &player->state;
-    int p = chunked(s->x);
-    int q = chunked(s->z);
-    int r = 1;
-    for (int dp = -r; dp <= r; dp++) {
-        for (int dq = -r; dq <= r; dq++) {
-            int a = p + dp;
-            int b = q + dq;
-            Chunk *chunk = find_chunk(a, b);
-            if (chunk) {
-                if (chunk->dirty) {
-                    gen_chunk_buffer(chunk, float_size);
-                }
-                if (chunk->dirty_signs) {
-                    gen_sign_chunk_buffer(chunk);
-                }
-            } else {
-                chunk = next_available_chunk();
-                if (chunk) {
-                    create_chunk(chunk, a, b);
-                    gen_chunk_buffer(chunk, float_size);
-                }
+        DynamicBlocks *dynamic = &item->dynamic;
+        if (dynamic->data) {
+            GLfloat *data = dynamic->data;
+            hfloat *hdata = malloc_faces(10, dynamic->faces, sizeof(hfloat));
+            for (int j=0; j < (6 * 10 * dynamic->faces); j++) {
+                hdata[j] = float_to_hfloat(data + j);
             }
+            free(data);
+            dynamic->data = hdata;
         }
     }
+    item->sign_data = gen_sign_list_mesh(&item->signs, item->shape_maps[1][1],
+        &item->sign_faces);
+    stage_end(item, CHUNK_STAGE_VERTICES, stage_time);
 }
-
@@ -1,17 +1,52 @@
 #pragma once
 
 #include <GLES2/gl2.h>
-#include "door.h"
+#include "dynamic.h"
 #include "map.h"
+#include "occlusion.h"
 #include "player.h"
 #include "pwlua.h"
 #include "sign.h"
 #include "tinycthread.h"
+#include "vertex_pool.h"
+#include "view.h"
+#include "worldgen_cache.h"
 
 #define WORKER_IDLE 0
 #define WORKER_BUSY 1
 #define WORKER_DONE 2
 
+// Chunks are meshed, culled and drawn in vertical sections of SECTION_SIZE
+// blocks so an edit only remeshes the sections around it.
+#define SECTION_COUNT (CHUNK_HEIGHT / SECTION_SIZE)
+#define ALL_SECTIONS ((1 << SECTION_COUNT) - 1)
+
+typedef struct {
+    int faces;
+    int miny;
+    int maxy;
+    VertexRange range;
+    // The chunk's dynamic blocks in this section.
+    int dynamic_first;
+    int dynamic_count;
+} ChunkSection;
+
+typedef struct {
+    int faces;
+    int miny;
+    int maxy;
+    void *data;
+} SectionMesh;
+
+// The stages of compute_chunk, timed when a WorkerItem's stage_times is set.
+#define CHUNK_STAGE_OPAQUE 0
+#define CHUNK_STAGE_LIGHT 1
+#define CHUNK_STAGE_FACES 2
+#define CHUNK_STAGE_AO 3
+#define CHUNK_STAGE_VERTICES 4
+#define CHUNK_STAGE_OCCLUDERS 5
+#define CHUNK_STAGE_COUNT 6
+
 typedef struct {
     Map map;
     Map extra;
@@ -19,34 +54,55 @@ typedef struct {
     Map shape;
     SignList signs;
     Map transform;
-    DoorMap doors;
+    DynamicBlocks dynamic;
     int p;
     int q;
     int faces;
     int sign_faces;
     int dirty;
+    int dirty_sections;
     int dirty_signs;
+    // Counts changes to the signs, so a mesh made from an older copy of them
+    // is not used.
+    unsigned int sign_generation;
+    // Sections to mark dirty at the end of a batch of edits.
+    int batched;
+    int batch_sections;
+    int batch_light_sections;
+    int meshed;
+    // The frame it was last in the chunk list of a view, for the budget.
+    unsigned int last_seen;
     int miny;
     int maxy;
-    GLuint buffer;
+    unsigned char occluders[OCCLUDER_CELLS][OCCLUDER_CELLS];
+    ChunkSection sections[SECTION_COUNT];
     GLuint sign_buffer;
+    GLsizeiptr sign_capacity;  // bytes in sign_buffer
 } Chunk;
 
 typedef struct {
     int p;
     int q;
     int load;
+    int lod;
     Map *block_maps[3][3];
     Map *extra_maps[3][3];
     Map *light_maps[3][3];
     Map *shape_maps[3][3];
     Map *transform_maps[3][3];
-    DoorMap *door_maps[3][3];
     SignList signs;
-    int miny;
-    int maxy;
-    int faces;
-    void *data;
+    int dirty_sections;
+    SectionMesh sections[SECTION_COUNT];
+    // The glyphs of the signs, made from the chunk's signs of
+    // sign_generation.
+    GLfloat *sign_data;
+    int sign_faces;
+    unsigned int sign_generation;
+    unsigned char occluders[OCCLUDER_CELLS][OCCLUDER_CELLS];
+    SectionMesh lod_mesh;
+    DynamicBlocks dynamic;
+    // Seconds spent in each stage are added here when not NULL.
+    double *stage_times;
 } WorkerItem;
 
 typedef struct {
@@ -63,13 +119,10 @@ int chunked(float x);
 int chunk_distance(Chunk *chunk, int p, int q);
 int chunk_visible(float planes[6][4], int p, int q, int miny, int maxy,
     int ortho);
+void worldgen_chunk(int p, int q, Map *maps[WORLDGEN_LAYERS],
+    SignList *signs, lua_State *L);
 void load_chunk(WorkerItem *item, lua_State *L);
-void create_chunk(Chunk *chunk, int p, int q);
+void chunk_grow_maps_incrementally(Chunk *chunk);
 void request_chunk(int p, int q);
 void compute_chunk(WorkerItem *item);
-void generate_chunk(Chunk *chunk, WorkerItem *item, size_t float_size);
-void ensure_chunks_worker(Player *player, Worker *worker, int width,
-    int height, int fov, int ortho, int render_radius, int create_radius);
-void gen_chunk_buffer(Chunk *chunk, size_t float_size);
-void force_chunks(Player *player, size_t float_size);
 
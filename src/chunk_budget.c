@@ -0,0 +1,143 @@
+#include "chunk_budget.h"
+#include "chunks.h"
+#include "util.h"
+
+static size_t cpu_budget;
+static size_t gpu_budget;
+static size_t budget_float_size = sizeof(GLfloat);
+// Bytes of vertex pages held for each byte of mesh in them, see
+// chunk_budget_totals.
+static double page_bytes_per_byte = 1;
+
+// A budget of 0 is no limit.
+void chunk_budget_set(size_t cpu_bytes, size_t gpu_bytes, size_t float_size)
+{
+    cpu_budget = cpu_bytes;
+    gpu_budget = gpu_bytes;
+    budget_float_size = float_size;
+}
+
+static size_t map_bytes(Map *map)
+{
+    size_t bytes = map->data ? (map->mask + 1) * sizeof(MapEntry) : 0;
+    if (map->old_data) {
+        bytes += (map->old_mask + 1) * sizeof(MapEntry);
+    }
+    return bytes;
+}
+
+size_t chunk_cpu_bytes(Chunk *chunk)
+{
+    return sizeof(Chunk) +
+        map_bytes(&chunk->map) + map_bytes(&chunk->extra) +
+        map_bytes(&chunk->lights) + map_bytes(&chunk->shape) +
+        map_bytes(&chunk->transform) +
+        chunk->signs.capacity * sizeof(Sign) +
+        chunk->dynamic.count * sizeof(DynamicBlock);
+}
+
+// A chunk's sections are charged their share of the vertex pages holding
+// them, so the space pages lose between meshes counts too. Its door and sign
+// buffers are charged their full size.
+size_t chunk_gpu_bytes(Chunk *chunk)
+{
+    size_t faces = 0;
+    for (int i = 0; i < SECTION_COUNT; i++) {
+        faces += chunk->sections[i].range.faces;
+    }
+    return (size_t)(faces * FACE_COMPONENTS * budget_float_size *
+                    page_bytes_per_byte) +
+        chunk->dynamic.capacity + chunk->sign_capacity;
+}
+
+void chunk_budget_totals(size_t *cpu_bytes, size_t *gpu_bytes)
+{
+    size_t held_faces, used_faces;
+    vertex_pool_usage(&held_faces, &used_faces);
+    page_bytes_per_byte = used_faces ? (double)held_faces / used_faces : 1;
+    *cpu_bytes = 0;
+    *gpu_bytes = 0;
+    for (int i = 0; i < chunk_count; i++) {
+        *cpu_bytes += chunk_cpu_bytes(chunks + i);
+        *gpu_bytes += chunk_gpu_bytes(chunks + i);
+    }
+}
+
+static float budget_use(size_t cpu_bytes, size_t gpu_bytes)
+{
+    float use = 0;
+    if (cpu_budget) {
+        use = MAX(use, (float)cpu_bytes / cpu_budget);
+    }
+    if (gpu_budget) {
+        use = MAX(use, (float)gpu_bytes / gpu_budget);
+    }
+    return use;
+}
+
+int chunk_budget_fits(size_t cpu_bytes, size_t gpu_bytes)
+{
+    return budget_use(cpu_bytes, gpu_bytes) <= 1;
+}
+
+// The largest share of either budget in use, above 1 when over budget.
+float chunk_budget_use(void)
+{
+    size_t cpu_bytes, gpu_bytes;
+    chunk_budget_totals(&cpu_bytes, &gpu_bytes);
+    return budget_use(cpu_bytes, gpu_bytes);
+}
+
+static int radius_chunks(int radius, int views)
+{
+    return (radius * 2 + 1) * (radius * 2 + 1) * views;
+}
+
+// The chunks the table needs room for: those within radius of each player
+// and the two players it may observe, and a few loaded for scripts, but no
+// more than the memory budget can hold.
+int chunk_budget_chunk_limit(int radius, int players)
+{
+    size_t limit = radius_chunks(radius, players * 3) + BUDGET_SCRIPT_CHUNKS;
+    if (cpu_budget) {
+        limit = MIN(limit, cpu_budget / sizeof(Chunk));
+    }
+    return MIN(limit, MAX_CHUNKS);
+}
+
+// The largest radius up to max_radius whose chunks are expected to fit below
+// the low water mark of the GPU budget before any have been meshed.
+int chunk_budget_fit_radius(int radius, int max_radius, int views)
+{
+    if (!gpu_budget) {
+        return MIN(radius, max_radius);
+    }
+    int fit = 1;
+    while (fit < MIN(radius, max_radius) &&
+           (double)radius_chunks(fit + 1, views) * BUDGET_CHUNK_GPU_GUESS <=
+           gpu_budget * BUDGET_LOW_WATER) {
+        fit++;
+    }
+    return fit;
+}
+
+// Shrink the view distance when over the high water mark, or grow it towards
+// max_radius when the chunks of the larger distance, at the average size of
+// those loaded, are expected to stay below the low water mark.
+int chunk_budget_pick_radius(int radius, int max_radius, int views)
+{
+    size_t cpu_bytes, gpu_bytes;
+    chunk_budget_totals(&cpu_bytes, &gpu_bytes);
+    float use = budget_use(cpu_bytes, gpu_bytes);
+    if (use > BUDGET_HIGH_WATER && radius > 1) {
+        return radius - 1;
+    }
+    if (radius >= max_radius || chunk_count == 0) {
+        return MIN(radius, max_radius);
+    }
+    float growth = (float)radius_chunks(radius + 1, views) / chunk_count;
+    if (use * MAX(growth, 1) <= BUDGET_LOW_WATER) {
+        return radius + 1;
+    }
+    return radius;
+}
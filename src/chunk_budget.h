@@ -0,0 +1,37 @@
+#pragma once
+
+#include <stddef.h>
+#include "chunk.h"
+
+/*
+ * Chunks are kept while they fit in two budgets, one for the memory of their
+ * maps, signs and doors and one for the GPU memory of their meshes. When
+ * either is exceeded the chunks outside every view's create radius are
+ * deleted, those that have gone longest without being seen first and the
+ * furthest first of those seen at the same time. The view distance shrinks
+ * while that is not enough and grows again while the chunks of a larger
+ * distance would still fit.
+ */
+
+// Shrink the view distance above this share of a budget, grow it while the
+// larger distance is expected to stay below the lower one.
+#define BUDGET_HIGH_WATER 0.9
+#define BUDGET_LOW_WATER 0.6
+// Seconds between checks of the view distance.
+#define BUDGET_INTERVAL 1.0
+// GPU memory a chunk is expected to need before any have been meshed.
+#define BUDGET_CHUNK_GPU_GUESS (512 * 1024)
+// GPU memory left for the screen, textures and far chunks.
+#define BUDGET_GPU_RESERVE_MB 32
+// Room in the chunk table for chunks scripts load outside the views.
+#define BUDGET_SCRIPT_CHUNKS 64
+
+void chunk_budget_set(size_t cpu_bytes, size_t gpu_bytes, size_t float_size);
+size_t chunk_cpu_bytes(Chunk *chunk);
+size_t chunk_gpu_bytes(Chunk *chunk);
+void chunk_budget_totals(size_t *cpu_bytes, size_t *gpu_bytes);
+int chunk_budget_fits(size_t cpu_bytes, size_t gpu_bytes);
+float chunk_budget_use(void);
+int chunk_budget_chunk_limit(int radius, int players);
+int chunk_budget_fit_radius(int radius, int max_radius, int views);
+int chunk_budget_pick_radius(int radius, int max_radius, int views);
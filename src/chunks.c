@@ -1,17 +1,32 @@
+#include <limits.h>
 #include <math.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <sys/sysinfo.h>
+#include <time.h>
+#include "chunk_budget.h"
 #include "chunks.h"
 #include "client.h"
 #include "clients.h"
 #include "db.h"
+#include "dynamic.h"
 #include "item.h"
+#include "lod.h"
 #include "local_player.h"
 #include "local_players.h"
 #include "player.h"
 #include "pw.h"
+#include "pwlua_worldgen.h"
+#include "sign_mesh.h"
+#include "snapshot.h"
+#include "util.h"
+#include "util_gl.h"
 
-Chunk chunks[MAX_CHUNKS];
+Chunk *chunks;
 int chunk_count;
+int chunk_capacity;
 
 int get_shape(int x, int y, int z);
 
@@ -19,7 +34,9 @@ int has_lights(Chunk *chunk);
 
 void chunks_reset(void)
 {
-    memset(chunks, 0, sizeof(Chunk) * MAX_CHUNKS);
+    if (chunk_capacity) {
+        memset(chunks, 0, sizeof(Chunk) * chunk_capacity);
+    }
     chunk_count = 0;
 }
 
@@ -34,22 +51,146 @@ Chunk *find_chunk(int p, int q)
     return 0;
 }
 
-void dirty_chunk(Chunk *chunk)
+static int batching;
+static Chunk **batched;
+static int batched_count;
+
+// The order and distance of each chunk when deleting over the budget.
+static int *evict_order;
+static int *evict_distance;
+static char *evict;
+
+// Make room in chunks[] for count chunks, up to MAX_CHUNKS. The table only
+// grows, and moves when it does, so no Chunk pointer may be held over a call.
+void chunks_reserve(int count)
+{
+    count = MIN(count, MAX_CHUNKS);
+    if (count <= chunk_capacity) {
+        return;
+    }
+    chunks = realloc(chunks, sizeof(Chunk) * count);
+    memset(chunks + chunk_capacity, 0,
+           sizeof(Chunk) * (count - chunk_capacity));
+    batched = realloc(batched, sizeof(Chunk *) * count);
+    evict_order = realloc(evict_order, sizeof(int) * count);
+    evict_distance = realloc(evict_distance, sizeof(int) * count);
+    evict = realloc(evict, count);
+    chunk_capacity = count;
+}
+
+static int section_mask(int y0, int y1)
+{
+    int mask = 0;
+    y0 = MAX(y0, 0);
+    y1 = MIN(y1, CHUNK_HEIGHT - 1);
+    for (int i = y0 / SECTION_SIZE; i <= y1 / SECTION_SIZE; i++) {
+        mask |= 1 << i;
+    }
+    return mask;
+}
+
+static void dirty_sections(Chunk *chunk, int mask)
 {
+    chunk->dirty_sections |= mask;
     chunk->dirty = 1;
-    chunk->dirty_signs = 1;
-    if (has_lights(chunk)) {
-        for (int dp = -1; dp <= 1; dp++) {
-            for (int dq = -1; dq <= 1; dq++) {
-                Chunk *other = find_chunk(chunk->p + dp, chunk->q + dq);
-                if (other) {
-                    other->dirty = 1;
-                }
+}
+
+static void dirty_neighbour_sections(Chunk *chunk, int mask)
+{
+    for (int dp = -1; dp <= 1; dp++) {
+        for (int dq = -1; dq <= 1; dq++) {
+            Chunk *other = find_chunk(chunk->p + dp, chunk->q + dq);
+            if (other) {
+                dirty_sections(other, mask);
             }
         }
     }
 }
 
+static void batch_chunk(Chunk *chunk)
+{
+    if (!chunk->batched) {
+        chunk->batched = 1;
+        batched[batched_count++] = chunk;
+    }
+}
+
+// Mark the sections between heights y0 and y1 for meshing. When the chunk
+// has lights a change can alter the light up to 15 blocks away, in this and
+// the neighbouring chunks.
+void dirty_chunk_range(Chunk *chunk, int y0, int y1)
+{
+    chunk->dirty_signs = 1;
+    chunk->sign_generation++;
+    if (batching) {
+        batch_chunk(chunk);
+        chunk->batch_sections |= section_mask(y0, y1);
+    } else if (has_lights(chunk)) {
+        dirty_neighbour_sections(chunk, section_mask(y0 - 15, y1 + 15));
+    } else {
+        dirty_sections(chunk, section_mask(y0, y1));
+    }
+}
+
+void dirty_chunk(Chunk *chunk)
+{
+    dirty_chunk_range(chunk, 0, CHUNK_HEIGHT - 1);
+}
+
+// Mark the sections a change to the block at height y can alter, the faces
+// and ambient occlusion of the blocks next to it and the shading of the
+// blocks up to 8 below it.
+void dirty_chunk_block(Chunk *chunk, int y)
+{
+    dirty_chunk_range(chunk, y - 8, y + 1);
+}
+
+// Mark the sections a light at height y can reach.
+void dirty_chunk_light(Chunk *chunk, int y)
+{
+    chunk->dirty_signs = 1;
+    if (batching) {
+        batch_chunk(chunk);
+        chunk->batch_light_sections |= section_mask(y - 15, y + 15);
+    } else {
+        dirty_neighbour_sections(chunk, section_mask(y - 15, y + 15));
+    }
+}
+
+// Between chunks_begin_batch() and chunks_end_batch() the sections that
+// edits make dirty are collected per chunk and marked once at the end, so a
+// run of edits to a chunk looks for its lights and neighbours once instead
+// of once per edit. No chunk may be deleted or the table grown during a
+// batch.
+void chunks_begin_batch(void)
+{
+    batching = 1;
+}
+
+void chunks_end_batch(void)
+{
+    batching = 0;
+    for (int i = 0; i < batched_count; i++) {
+        Chunk *chunk = batched[i];
+        int sections = chunk->batch_sections;
+        int light_sections = chunk->batch_light_sections;
+        chunk->batched = 0;
+        chunk->batch_sections = 0;
+        chunk->batch_light_sections = 0;
+        if (sections && has_lights(chunk)) {
+            // 15 blocks either side reaches at most one section further.
+            light_sections |=
+                (sections | sections << 1 | sections >> 1) & ALL_SECTIONS;
+        } else if (sections || !light_sections) {
+            dirty_sections(chunk, sections);
+        }
+        if (light_sections) {
+            dirty_neighbour_sections(chunk, light_sections);
+        }
+    }
+    batched_count = 0;
+}
+
 int highest_block(float x, float z)
 {
     int result = -1;
@@ -166,22 +307,81 @@ int hit_test_face(Player *player, int *x, int *y, int *z, int *face)
     return 0;
 }
 
-int collide(int height, float *x, float *y, float *z, float *ydiff)
+static void fill_collision_cache(CollisionCache *cache, int x, int y, int z)
 {
-    #define AUTO_JUMP_LIMIT 0.5
-    int result = 0;
-    int p = chunked(*x);
-    int q = chunked(*z);
-    Chunk *chunk = find_chunk(p, q);
+    cache->valid = 1;
+    cache->x = x;
+    cache->y = y;
+    cache->z = z;
+    // The chunk's maps also hold the blocks along its edges from its
+    // neighbours, so one chunk has all the blocks needed.
+    Chunk *chunk = find_chunk(chunked(x), chunked(z));
+    cache->loaded = chunk != NULL;
     if (!chunk) {
-        return result;
+        return;
     }
-    Map *map = &chunk->map;
-    Map *shape_map = &chunk->shape;
-    Map *extra_map = &chunk->extra;
+    for (int dy = 0; dy < COLLISION_LEVELS; dy++) {
+        for (int dx = 0; dx < COLLISION_SIZE; dx++) {
+            for (int dz = 0; dz < COLLISION_SIZE; dz++) {
+                int bx = x + dx - 1;
+                int by = y + dy - 2;
+                int bz = z + dz - 1;
+                int shape = map_get(&chunk->shape, bx, by, bz);
+                float height = 0;
+                if (is_obstacle(map_get(&chunk->map, bx, by, bz), shape,
+                                map_get(&chunk->extra, bx, by, bz))) {
+                    height = item_height(shape);
+                }
+                cache->heights[dy][dx][dz] = height;
+            }
+        }
+    }
+}
+
+// Fill the cache for the block at x, y, z unless it already holds it.
+void update_collision_cache(CollisionCache *cache, float x, float y, float z)
+{
+    int nx = roundf(x);
+    int ny = roundf(y);
+    int nz = roundf(z);
+    if (!cache->valid || cache->x != nx || cache->y != ny || cache->z != nz) {
+        fill_collision_cache(cache, nx, ny, nz);
+    }
+}
+
+// The height of the obstacle at x, y, z next to the block the cache was
+// filled for, or 0 if there is none.
+static float cached_obstacle(CollisionCache *cache, int x, int y, int z)
+{
+    return cache->heights[y - cache->y + 2][x - cache->x + 1]
+                         [z - cache->z + 1];
+}
+
+// Whether there is an obstacle at x, y, z, using the cache if it holds the
+// block.
+int collision_obstacle(CollisionCache *cache, int x, int y, int z)
+{
+    if (cache->valid && cache->loaded &&
+        ABS(x - cache->x) <= 1 && ABS(z - cache->z) <= 1 &&
+        y - cache->y >= -2 && y - cache->y <= 2) {
+        return cached_obstacle(cache, x, y, z) > 0;
+    }
+    return is_obstacle(get_block(x, y, z), get_shape(x, y, z),
+                       get_extra(x, y, z));
+}
+
+int collide(CollisionCache *cache, int height, float *x, float *y, float *z,
+            float *ydiff)
+{
+    #define AUTO_JUMP_LIMIT 0.5
+    int result = 0;
     int nx = roundf(*x);
     int ny = roundf(*y);
     int nz = roundf(*z);
+    update_collision_cache(cache, *x, *y, *z);
+    if (!cache->loaded) {
+        return result;
+    }
     float px = *x - nx;
     float py = *y - ny;
     float pz = *z - nz;
@@ -189,69 +389,52 @@ int collide(int height, float *x, float *y, float *z, float *ydiff)
     uint8_t coll_ok = 1;
     uint8_t need_jump = 0;
     for (int dy = 0; dy < height; dy++) {
-        if (px < -pad && is_obstacle(map_get(map, nx - 1, ny - dy, nz),
-                                     map_get(shape_map, nx - 1, ny - dy, nz),
-                                     map_get(extra_map, nx - 1, ny - dy, nz))) {
+        float h;
+        if (px < -pad && (h = cached_obstacle(cache, nx - 1, ny - dy, nz))) {
             *x = nx - pad;
             if (dy == 0) {
                 coll_ok = 0;
-            } else if (coll_ok &&
-                       item_height(map_get(shape_map, nx - 1, ny - dy, nz)) <= AUTO_JUMP_LIMIT) {
+            } else if (coll_ok && h <= AUTO_JUMP_LIMIT) {
                 need_jump = 1;
             }
         }
-        if (px > pad && is_obstacle(map_get(map, nx + 1, ny - dy, nz),
-                                    map_get(shape_map, nx + 1, ny - dy, nz),
-                                    map_get(extra_map, nx + 1, ny - dy, nz))) {
+        if (px > pad && (h = cached_obstacle(cache, nx + 1, ny - dy, nz))) {
             *x = nx + pad;
             if (dy == 0) {
                 coll_ok = 0;
-            } else if (coll_ok &&
-                       item_height(map_get(shape_map, nx + 1, ny - dy, nz)) <= AUTO_JUMP_LIMIT) {
+            } else if (coll_ok && h <= AUTO_JUMP_LIMIT) {
                 need_jump = 1;
             }
         }
-        if (py < -pad && is_obstacle(map_get(map, nx, ny - dy - 1, nz),
-                                     map_get(shape_map, nx, ny - dy - 1, nz),
-                                     map_get(extra_map, nx, ny - dy - 1, nz))) {
+        if (py < -pad && cached_obstacle(cache, nx, ny - dy - 1, nz)) {
             *y = ny - pad;
             result = 1;
         }
-        if (py > pad && is_obstacle(map_get(map, nx, ny - dy + 1, nz),
-                                    map_get(shape_map, nx, ny - dy + 1, nz),
-                                    map_get(extra_map, nx, ny - dy + 1, nz))) {
+        if (py > pad && cached_obstacle(cache, nx, ny - dy + 1, nz)) {
             // reached when player jumps and hits their head on block above
             *y = ny + pad;
             result = 1;
         }
-        if (pz < -pad && is_obstacle(map_get(map, nx, ny - dy, nz - 1),
-                                     map_get(shape_map, nx, ny - dy, nz - 1),
-                                     map_get(extra_map, nx, ny - dy, nz - 1))) {
+        if (pz < -pad && (h = cached_obstacle(cache, nx, ny - dy, nz - 1))) {
             *z = nz - pad;
             if (dy == 0) {
                 coll_ok = 0;
-            } else if (coll_ok &&
-                       item_height(map_get(shape_map, nx, ny - dy, nz - 1)) <= AUTO_JUMP_LIMIT) {
+            } else if (coll_ok && h <= AUTO_JUMP_LIMIT) {
                 need_jump = 1;
             }
         }
-        if (pz > pad && is_obstacle(map_get(map, nx, ny - dy, nz + 1),
-                                    map_get(shape_map, nx, ny - dy, nz + 1),
-                                    map_get(extra_map, nx, ny - dy, nz + 1))) {
+        if (pz > pad && (h = cached_obstacle(cache, nx, ny - dy, nz + 1))) {
             *z = nz + pad;
             if (dy == 0) {
                 coll_ok = 0;
-            } else if (coll_ok &&
-                       item_height(map_get(shape_map, nx, ny - dy, nz + 1)) <= AUTO_JUMP_LIMIT) {
+            } else if (coll_ok && h <= AUTO_JUMP_LIMIT) {
                 need_jump = 1;
             }
         }
 
         // check the 4 diagonally neighboring blocks for obstacle as well
         if (px < -pad && pz > pad &&
-            is_obstacle(map_get(map, nx - 1, ny - dy, nz + 1),
-                        map_get(shape_map, nx - 1, ny - dy, nz + 1),
-                        map_get(extra_map, nx - 1, ny - dy, nz + 1))) {
+            cached_obstacle(cache, nx - 1, ny - dy, nz + 1)) {
             if(ABS(px) < ABS(pz)) {
                 *x = nx - pad;
             } else {
@@ -259,9 +442,7 @@ int collide(int height, float *x, float *y, float *z, float *ydiff)
             }
         }
         if (px > pad && pz > pad &&
-            is_obstacle(map_get(map, nx + 1, ny - dy, nz + 1),
-                        map_get(shape_map, nx + 1, ny - dy, nz + 1),
-                        map_get(extra_map, nx + 1, ny - dy, nz + 1))) {
+            cached_obstacle(cache, nx + 1, ny - dy, nz + 1)) {
             if(ABS(px) < ABS(pz)) {
                 *x = nx + pad;
             } else {
@@ -269,9 +450,7 @@ int collide(int height, float *x, float *y, float *z, float *ydiff)
             }
         }
         if (px < -pad && pz < -pad &&
-            is_obstacle(map_get(map, nx - 1, ny - dy, nz - 1),
-                        map_get(shape_map, nx - 1, ny - dy, nz - 1),
-                        map_get(extra_map, nx - 1, ny - dy, nz - 1))) {
+            cached_obstacle(cache, nx - 1, ny - dy, nz - 1)) {
             if(ABS(px) < ABS(pz)) {
                 *x = nx - pad;
             } else {
@@ -279,9 +458,7 @@ int collide(int height, float *x, float *y, float *z, float *ydiff)
             }
         }
         if (px > pad && pz < -pad &&
-            is_obstacle(map_get(map, nx + 1, ny - dy, nz - 1),
-                        map_get(shape_map, nx + 1, ny - dy, nz - 1),
-                        map_get(extra_map, nx + 1, ny - dy, nz - 1))) {
+            cached_obstacle(cache, nx + 1, ny - dy, nz - 1)) {
             if(ABS(px) < ABS(pz)) {
                 *x = nx + pad;
             } else {
@@ -337,7 +514,90 @@ int has_lights(Chunk *chunk)
     return 0;
 }
 
-void delete_chunks(int delete_radius)
+static void del_chunk_buffers(Chunk *chunk)
+{
+    for (int i = 0; i < SECTION_COUNT; i++) {
+        vertex_pool_free(&chunk->sections[i].range);
+    }
+    del_buffer(chunk->sign_buffer);
+}
+
+static void free_chunk(Chunk *chunk)
+{
+    map_free(&chunk->map);
+    map_free(&chunk->extra);
+    map_free(&chunk->lights);
+    map_free(&chunk->shape);
+    map_free(&chunk->transform);
+    sign_list_free(&chunk->signs);
+    dynamic_blocks_free(&chunk->dynamic);
+    del_chunk_buffers(chunk);
+}
+
+static int min_distance(Chunk *chunk, State **states, int state_count)
+{
+    int distance = INT_MAX;
+    for (int j = 0; j < state_count; j++) {
+        State *s = states[j];
+        distance = MIN(distance,
+            chunk_distance(chunk, chunked(s->x), chunked(s->z)));
+    }
+    return distance;
+}
+
+// Chunks not seen for the longest come first, then the furthest.
+static int compare_evictions(const void *a, const void *b)
+{
+    Chunk *ca = chunks + *(const int *)a;
+    Chunk *cb = chunks + *(const int *)b;
+    if (ca->last_seen != cb->last_seen) {
+        return ca->last_seen < cb->last_seen ? -1 : 1;
+    }
+    return evict_distance[cb - chunks] - evict_distance[ca - chunks];
+}
+
+// Delete the chunks outside keep_radius of every view until the rest fit in
+// the memory budget, see chunk_budget.h.
+static void delete_over_budget(State **states, int state_count,
+    int keep_radius)
+{
+    size_t cpu_bytes, gpu_bytes;
+    if (chunk_budget_use() <= 1) {
+        return;
+    }
+    int *order = evict_order;
+    int order_count = 0;
+    for (int i = 0; i < chunk_count; i++) {
+        evict[i] = 0;
+        evict_distance[i] = min_distance(chunks + i, states, state_count);
+        if (evict_distance[i] > keep_radius) {
+            order[order_count++] = i;
+        }
+    }
+    qsort(order, order_count, sizeof(int), compare_evictions);
+    chunk_budget_totals(&cpu_bytes, &gpu_bytes);
+    for (int i = 0; i < order_count; i++) {
+        Chunk *chunk = chunks + order[i];
+        cpu_bytes -= chunk_cpu_bytes(chunk);
+        gpu_bytes -= chunk_gpu_bytes(chunk);
+        evict[order[i]] = 1;
+        if (chunk_budget_fits(cpu_bytes, gpu_bytes)) {
+            break;
+        }
+    }
+    int count = chunk_count;
+    for (int i = count - 1; i >= 0; i--) {
+        if (evict[i]) {
+            Chunk *chunk = chunks + i;
+            free_chunk(chunk);
+            Chunk *other = chunks + (--count);
+            memcpy(chunk, other, sizeof(Chunk));
+        }
+    }
+    chunk_count = count;
+}
+
+void delete_chunks(int delete_radius, int keep_radius)
 {
     int count = chunk_count;
     int states_count = 0;
@@ -370,68 +630,379 @@ void delete_chunks(int delete_radius)
 
     for (int i = 0; i < count; i++) {
         Chunk *chunk = chunks + i;
-        int delete = 1;
-        for (int j = 0; j < states_count; j++) {
-            State *s = states[j];
-            int p = chunked(s->x);
-            int q = chunked(s->z);
-            if (chunk_distance(chunk, p, q) < delete_radius) {
-                delete = 0;
-                break;
-            }
-        }
-        if (delete) {
-            map_free(&chunk->map);
-            map_free(&chunk->extra);
-            map_free(&chunk->lights);
-            map_free(&chunk->shape);
-            map_free(&chunk->transform);
-            sign_list_free(&chunk->signs);
-            door_map_free(&chunk->doors);
-            del_buffer(chunk->buffer);
-            del_buffer(chunk->sign_buffer);
+        if (min_distance(chunk, states, states_count) >= delete_radius) {
+            free_chunk(chunk);
             Chunk *other = chunks + (--count);
             memcpy(chunk, other, sizeof(Chunk));
         }
     }
     chunk_count = count;
+    delete_over_budget(states, states_count, keep_radius);
 }
 
 void delete_all_chunks(void)
 {
     for (int i = 0; i < chunk_count; i++) {
-        Chunk *chunk = chunks + i;
-        map_free(&chunk->map);
-        map_free(&chunk->extra);
-        map_free(&chunk->lights);
-        map_free(&chunk->shape);
-        map_free(&chunk->transform);
-        door_map_free(&chunk->doors);
-        sign_list_free(&chunk->signs);
-        del_buffer(chunk->buffer);
-        del_buffer(chunk->sign_buffer);
+        free_chunk(chunks + i);
     }
     chunk_count = 0;
+    snapshot_clear();
+    lod_reset();
+    vertex_pool_reset();
 }
 
 Chunk *next_available_chunk(void)
 {
     Chunk *chunk = NULL;
-    if (chunk_count < MAX_CHUNKS) {
+    if (chunk_count < chunk_capacity) {
         chunk = chunks + chunk_count++;
     }
     return chunk;
 }
 
+static void init_chunk(Chunk *chunk, int p, int q)
+{
+    chunk->p = p;
+    chunk->q = q;
+    chunk->faces = 0;
+    chunk->sign_faces = 0;
+    chunk->meshed = 0;
+    memset(chunk->sections, 0, sizeof(chunk->sections));
+    chunk->sign_buffer = 0;
+    chunk->sign_capacity = 0;
+    dirty_chunk(chunk);
+    SignList *signs = &chunk->signs;
+    sign_list_alloc(signs, 16);
+    Map *block_map = &chunk->map;
+    Map *extra_map = &chunk->extra;
+    Map *light_map = &chunk->lights;
+    Map *shape_map = &chunk->shape;
+    Map *transform_map = &chunk->transform;
+    int dx = p * CHUNK_SIZE - 1;
+    int dy = 0;
+    int dz = q * CHUNK_SIZE - 1;
+    map_alloc(block_map, dx, dy, dz, 0x3fff);
+    map_alloc(extra_map, dx, dy, dz, 0xf);
+    map_alloc(light_map, dx, dy, dz, 0xf);
+    map_alloc(shape_map, dx, dy, dz, 0xf);
+    map_alloc(transform_map, dx, dy, dz, 0xf);
+    memset(&chunk->dynamic, 0, sizeof(chunk->dynamic));
+}
+
+void create_chunk(Chunk *chunk, int p, int q)
+{
+    init_chunk(chunk, p, q);
+
+    WorkerItem _item;
+    WorkerItem *item = &_item;
+    item->p = chunk->p;
+    item->q = chunk->q;
+    item->block_maps[1][1] = &chunk->map;
+    item->extra_maps[1][1] = &chunk->extra;
+    item->light_maps[1][1] = &chunk->lights;
+    item->shape_maps[1][1] = &chunk->shape;
+    item->transform_maps[1][1] = &chunk->transform;
+    load_chunk(item, pwlua_worldgen_get_main_thread_instance());
+    chunk_grow_maps_incrementally(chunk);
+    sign_list_free(&chunk->signs);
+    sign_list_copy(&chunk->signs, &item->signs);
+    sign_list_free(&item->signs);
+
+    request_chunk(p, q);
+}
+
+// The bytes a finished item gives to GL, see upload.h.
+size_t worker_item_upload_bytes(WorkerItem *item, size_t float_size)
+{
+    if (item->lod) {
+        return (size_t)item->lod_mesh.faces * FACE_COMPONENTS * float_size;
+    }
+    size_t faces = item->dynamic.faces;
+    for (int i = 0; i < SECTION_COUNT; i++) {
+        if (item->dirty_sections & (1 << i)) {
+            faces += item->sections[i].faces;
+        }
+    }
+    return faces * FACE_COMPONENTS * float_size +
+        (size_t)item->sign_faces * SIGN_GLYPH_FLOATS * sizeof(GLfloat);
+}
+
+void generate_chunk(Chunk *chunk, WorkerItem *item, size_t float_size)
+{
+    chunk->faces = 0;
+    chunk->miny = 256;
+    chunk->maxy = 0;
+    for (int i = 0; i < SECTION_COUNT; i++) {
+        ChunkSection *section = chunk->sections + i;
+        if (item->dirty_sections & (1 << i)) {
+            SectionMesh *mesh = item->sections + i;
+            vertex_pool_realloc(&section->range, mesh->faces, mesh->data,
+                float_size);
+            free(mesh->data);
+            section->faces = mesh->faces;
+            section->miny = mesh->miny;
+            section->maxy = mesh->maxy;
+        }
+        section->dynamic_first = 0;
+        section->dynamic_count = 0;
+    }
+
+    // The extra of a door may have changed while the chunk was meshed.
+    dynamic_blocks_replace(&chunk->dynamic, &item->dynamic, float_size);
+    for (int i = 0; i < chunk->dynamic.count; i++) {
+        DynamicBlock *block = chunk->dynamic.blocks + i;
+        block->open = is_open(map_get(&chunk->extra,
+            block->x, block->y, block->z));
+        ChunkSection *section = chunk->sections + block->y / SECTION_SIZE;
+        if (section->dynamic_count == 0) {
+            section->dynamic_first = i;
+        }
+        section->dynamic_count++;
+    }
+
+    for (int i = 0; i < SECTION_COUNT; i++) {
+        ChunkSection *section = chunk->sections + i;
+        if (section->faces || section->dynamic_count) {
+            chunk->faces += section->faces;
+            chunk->miny = MIN(chunk->miny, section->miny);
+            chunk->maxy = MAX(chunk->maxy, section->maxy);
+        }
+    }
+    chunk->meshed = 1;
+    memcpy(chunk->occluders, item->occluders, sizeof(chunk->occluders));
+    // The signs may have changed while the chunk was meshed.
+    if (item->sign_generation != chunk->sign_generation) {
+        free(item->sign_data);
+        gen_sign_chunk_buffer(chunk);
+    } else {
+        set_sign_chunk_buffer(chunk, item->sign_data, item->sign_faces);
+    }
+    item->sign_data = NULL;
+}
+
+static int ensure_chunk_worker(Worker *worker, int a, int b)
+{
+    int load = 0;
+    Chunk *chunk = find_chunk(a, b);
+    if (!chunk) {
+        load = 1;
+        chunk = next_available_chunk();
+        if (chunk) {
+            init_chunk(chunk, a, b);
+        }
+        else {
+            return 0;
+        }
+    }
+    WorkerItem *item = &worker->item;
+    item->p = chunk->p;
+    item->q = chunk->q;
+    item->load = load;
+    item->lod = 0;
+    item->dirty_sections = load ? ALL_SECTIONS : chunk->dirty_sections;
+    if (!load) {
+        sign_list_copy(&item->signs, &chunk->signs);
+    }
+    item->sign_generation = chunk->sign_generation;
+    for (int dp = -1; dp <= 1; dp++) {
+        for (int dq = -1; dq <= 1; dq++) {
+            Chunk *other = chunk;
+            if (dp || dq) {
+                other = find_chunk(chunk->p + dp, chunk->q + dq);
+            }
+            if (other) {
+                Map *block_map = malloc(sizeof(Map));
+                map_copy(block_map, &other->map);
+                Map *extra_map = malloc(sizeof(Map));
+                map_copy(extra_map, &other->extra);
+                Map *light_map = malloc(sizeof(Map));
+                map_copy(light_map, &other->lights);
+                Map *shape_map = malloc(sizeof(Map));
+                map_copy(shape_map, &other->shape);
+                Map *transform_map = malloc(sizeof(Map));
+                map_copy(transform_map, &other->transform);
+                item->block_maps[dp + 1][dq + 1] = block_map;
+                item->extra_maps[dp + 1][dq + 1] = extra_map;
+                item->light_maps[dp + 1][dq + 1] = light_map;
+                item->shape_maps[dp + 1][dq + 1] = shape_map;
+                item->transform_maps[dp + 1][dq + 1] = transform_map;
+            }
+            else {
+                item->block_maps[dp + 1][dq + 1] = 0;
+                item->extra_maps[dp + 1][dq + 1] = 0;
+                item->light_maps[dp + 1][dq + 1] = 0;
+                item->shape_maps[dp + 1][dq + 1] = 0;
+                item->transform_maps[dp + 1][dq + 1] = 0;
+            }
+        }
+    }
+    chunk->dirty = 0;
+    chunk->dirty_sections = 0;
+    chunk->dirty_signs = 0;
+    worker->state = WORKER_BUSY;
+    cnd_signal(&worker->cnd);
+    return 1;
+}
+
+// Find the best chunk to load or mesh for every idle worker in a single scan
+// of the chunks around all views. A chunk's score is the best it has in any
+// view within create radius of it, each chunk is only scored once even when
+// the views overlap. Returns the number of workers given work.
+int ensure_chunks_workers(View *views, int view_count, Worker *workers,
+    int worker_count, int create_radius)
+{
+    int start = 0x0fffffff;
+    int best_score[MAX_WORKERS];
+    int best_a[MAX_WORKERS];
+    int best_b[MAX_WORKERS];
+    int idle_count = 0;
+    for (int i = 0; i < worker_count; i++) {
+        best_score[i] = start;
+        if (workers[i].state == WORKER_IDLE) {
+            idle_count++;
+        }
+    }
+    if (idle_count == 0) {
+        return 0;
+    }
+    int r = create_radius;
+    for (int v = 0; v < view_count; v++) {
+        View *view = views + v;
+        for (int dp = -r; dp <= r; dp++) {
+            for (int dq = -r; dq <= r; dq++) {
+                int a = view->p + dp;
+                int b = view->q + dq;
+                int index = (ABS(a) ^ ABS(b)) % worker_count;
+                if (workers[index].state != WORKER_IDLE) {
+                    continue;
+                }
+                int seen = 0;
+                for (int u = 0; u < v; u++) {
+                    if (MAX(ABS(a - views[u].p), ABS(b - views[u].q)) <= r) {
+                        seen = 1;
+                        break;
+                    }
+                }
+                if (seen) {
+                    continue;
+                }
+                Chunk *chunk = find_chunk(a, b);
+                if (chunk && !chunk->dirty) {
+                    continue;
+                }
+                int priority = 0;
+                if (chunk) {
+                    priority = chunk->meshed && chunk->dirty;
+                }
+                int score = start;
+                for (int u = v; u < view_count; u++) {
+                    View *other = views + u;
+                    int distance = MAX(ABS(a - other->p), ABS(b - other->q));
+                    if (distance > r) {
+                        continue;
+                    }
+                    int invisible = !chunk_visible(
+                        other->planes, a, b, 0, 256, other->ortho);
+                    score = MIN(score,
+                        (invisible << 24) | (priority << 16) | distance);
+                }
+                if (score < best_score[index]) {
+                    best_score[index] = score;
+                    best_a[index] = a;
+                    best_b[index] = b;
+                }
+            }
+        }
+    }
+    int dispatched = 0;
+    for (int i = 0; i < worker_count; i++) {
+        if (best_score[i] != start) {
+            dispatched += ensure_chunk_worker(workers + i, best_a[i],
+                best_b[i]);
+        }
+    }
+    return dispatched;
+}
+
+void gen_chunk_buffer(Chunk *chunk, size_t float_size)
+{
+    WorkerItem _item;
+    WorkerItem *item = &_item;
+    item->p = chunk->p;
+    item->q = chunk->q;
+    item->dirty_sections = chunk->dirty_sections;
+    item->stage_times = NULL;
+    item->signs = chunk->signs;
+    item->sign_generation = chunk->sign_generation;
+    chunk->dirty_signs = 0;
+    for (int dp = -1; dp <= 1; dp++) {
+        for (int dq = -1; dq <= 1; dq++) {
+            Chunk *other = chunk;
+            if (dp || dq) {
+                other = find_chunk(chunk->p + dp, chunk->q + dq);
+            }
+            if (other) {
+                item->block_maps[dp + 1][dq + 1] = &other->map;
+                item->extra_maps[dp + 1][dq + 1] = &other->extra;
+                item->light_maps[dp + 1][dq + 1] = &other->lights;
+                item->shape_maps[dp + 1][dq + 1] = &other->shape;
+                item->transform_maps[dp + 1][dq + 1] = &other->transform;
+            }
+            else {
+                item->block_maps[dp + 1][dq + 1] = 0;
+                item->extra_maps[dp + 1][dq + 1] = 0;
+                item->light_maps[dp + 1][dq + 1] = 0;
+                item->shape_maps[dp + 1][dq + 1] = 0;
+                item->transform_maps[dp + 1][dq + 1] = 0;
+            }
+        }
+    }
+    compute_chunk(item);
+    generate_chunk(chunk, item, float_size);
+    chunk->dirty = 0;
+    chunk->dirty_sections = 0;
+}
+
+void force_chunks(Player *player, size_t float_size)
+{
+    State *s = &player->state;
+    int p = chunked(s->x);
+    int q = chunked(s->z);
+    int r = 1;
+    for (int dp = -r; dp <= r; dp++) {
+        for (int dq = -r; dq <= r; dq++) {
+            int a = p + dp;
+            int b = q + dq;
+            Chunk *chunk = find_chunk(a, b);
+            if (chunk) {
+                if (chunk->dirty) {
+                    gen_chunk_buffer(chunk, float_size);
+                }
+                if (chunk->dirty_signs) {
+                    gen_sign_chunk_buffer(chunk);
+                }
+            } else {
+                chunk = next_available_chunk();
+                if (chunk) {
+                    create_chunk(chunk, a, b);
+                    gen_chunk_buffer(chunk, float_size);
+                }
+            }
+        }
+    }
+}
+
 void unset_sign(int x, int y, int z)
 {
     int p = chunked(x);
     int q = chunked(z);
+    snapshot_dirty(p, q);
     Chunk *chunk = find_chunk(p, q);
     if (chunk) {
         SignList *signs = &chunk->signs;
         if (sign_list_remove_all(signs, x, y, z)) {
             chunk->dirty_signs = 1;
+            chunk->sign_generation++;
             db_delete_signs(x, y, z);
         }
     }
@@ -443,11 +1014,13 @@ void unset_sign(int x, int y, int z)
 void unset_sign_face(int x, int y, int z, int face) {
     int p = chunked(x);
     int q = chunked(z);
+    snapshot_dirty(p, q);
     Chunk *chunk = find_chunk(p, q);
     if (chunk) {
         SignList *signs = &chunk->signs;
         if (sign_list_remove(signs, x, y, z, face)) {
             chunk->dirty_signs = 1;
+            chunk->sign_generation++;
             db_delete_sign(x, y, z, face);
         }
     }
@@ -459,6 +1032,7 @@ void unset_sign_face(int x, int y, int z, int face) {
 void _set_sign(
     int p, int q, int x, int y, int z, int face, const char *text, int dirty)
 {
+    snapshot_dirty(p, q);
     if (strlen(text) == 0) {
         unset_sign_face(x, y, z, face);
         return;
@@ -467,6 +1041,7 @@ void _set_sign(
     if (chunk) {
         SignList *signs = &chunk->signs;
         sign_list_add(signs, x, y, z, face, text);
+        chunk->sign_generation++;
         if (dirty) {
             chunk->dirty_signs = 1;
         }
@@ -503,6 +1078,7 @@ void toggle_light(int x, int y, int z)
 {
     int p = chunked(x);
     int q = chunked(z);
+    snapshot_dirty(p, q);
     Chunk *chunk = find_chunk(p, q);
     if (chunk) {
         Map *map = &chunk->lights;
@@ -510,12 +1086,13 @@ void toggle_light(int x, int y, int z)
         map_set(map, x, y, z, w);
         db_insert_light(p, q, x, y, z, w);
         client_light(x, y, z, w);
-        dirty_chunk(chunk);
+        dirty_chunk_light(chunk, y);
     }
 }
 
 int _set_light(int p, int q, int x, int y, int z, int w)
 {
+    snapshot_dirty(p, q);
     Chunk *chunk = find_chunk(p, q);
     if (w < 0) {
         w = 0;
@@ -526,7 +1103,7 @@ int _set_light(int p, int q, int x, int y, int z, int w)
     if (chunk) {
         Map *map = &chunk->lights;
         if (map_set(map, x, y, z, w)) {
-            dirty_chunk(chunk);
+            dirty_chunk_light(chunk, y);
             db_insert_light(p, q, x, y, z, w);
         }
     }
@@ -563,29 +1140,9 @@ void set_extra(int x, int y, int z, int w)
 {
     int p = chunked(x);
     int q = chunked(z);
-    _set_extra(p, q, x, y, z, w, 1);
-    for (int dx = -1; dx <= 1; dx++) {
-        for (int dz = -1; dz <= 1; dz++) {
-            if (dx == 0 && dz == 0) {
-                continue;
-            }
-            if (dx && chunked(x + dx) == p) {
-                continue;
-            }
-            if (dz && chunked(z + dz) == q) {
-                continue;
-            }
-            _set_extra(p + dx, q + dz, x, y, z, -w, 1);
-        }
-    }
-    client_extra(x, y, z, w);
-}
-
-void set_extra_non_dirty(int x, int y, int z, int w)
-{
-    int p = chunked(x);
-    int q = chunked(z);
-    _set_extra(p, q, x, y, z, w, 0);
+    // Opening a door or gate leaves the meshes as they are.
+    int dirty = !is_dynamic_shape(get_shape(x, y, z));
+    _set_extra(p, q, x, y, z, w, dirty);
     for (int dx = -1; dx <= 1; dx++) {
         for (int dz = -1; dz <= 1; dz++) {
             if (dx == 0 && dz == 0) {
@@ -597,7 +1154,7 @@ void set_extra_non_dirty(int x, int y, int z, int w)
             if (dz && chunked(z + dz) == q) {
                 continue;
             }
-            _set_extra(p + dx, q + dz, x, y, z, -w, 0);
+            _set_extra(p + dx, q + dz, x, y, z, -w, dirty);
         }
     }
     client_extra(x, y, z, w);
@@ -605,12 +1162,17 @@ void set_extra_non_dirty(int x, int y, int z, int w)
 
 void _set_extra(int p, int q, int x, int y, int z, int w, int dirty)
 {
+    snapshot_dirty(p, q);
     Chunk *chunk = find_chunk(p, q);
     if (chunk) {
         Map *map = &chunk->extra;
         if (map_set(map, x, y, z, w)) {
-            if (dirty) {
-                dirty_chunk(chunk);
+            // Both poses of a door or gate are already in its chunk's mesh.
+            DynamicBlock *block = dynamic_block_get(&chunk->dynamic, x, y, z);
+            if (block) {
+                block->open = is_open(w);
+            } else if (dirty) {
+                dirty_chunk_block(chunk, y);
             }
             db_insert_extra(p, q, x, y, z, w);
         }
@@ -663,12 +1225,13 @@ void set_shape(int x, int y, int z, int w)
 
 void _set_shape(int p, int q, int x, int y, int z, int w, int dirty)
 {
+    snapshot_dirty(p, q);
     Chunk *chunk = find_chunk(p, q);
     if (chunk) {
         Map *map = &chunk->shape;
         if (map_set(map, x, y, z, w)) {
             if (dirty) {
-                dirty_chunk(chunk);
+                dirty_chunk_block(chunk, y);
             }
             db_insert_shape(p, q, x, y, z, w);
         }
@@ -721,12 +1284,13 @@ void set_transform(int x, int y, int z, int w)
 
 void _set_transform(int p, int q, int x, int y, int z, int w, int dirty)
 {
+    snapshot_dirty(p, q);
     Chunk *chunk = find_chunk(p, q);
     if (chunk) {
         Map *map = &chunk->transform;
         if (map_set(map, x, y, z, w)) {
             if (dirty) {
-                dirty_chunk(chunk);
+                dirty_chunk_block(chunk, y);
             }
             db_insert_transform(p, q, x, y, z, w);
         }
@@ -757,12 +1321,13 @@ int get_transform(int x, int y, int z)
 
 void _set_block(int p, int q, int x, int y, int z, int w, int dirty)
 {
+    snapshot_dirty(p, q);
     Chunk *chunk = find_chunk(p, q);
     if (chunk) {
         Map *map = &chunk->map;
         if (map_set(map, x, y, z, w)) {
             if (dirty) {
-                dirty_chunk(chunk);
+                dirty_chunk_block(chunk, y);
             }
             db_insert_block(p, q, x, y, z, w);
         }
@@ -776,7 +1341,6 @@ void _set_block(int p, int q, int x, int y, int z, int w, int dirty)
         _set_extra(p, q, x, y, z, 0, 1);
         _set_shape(p, q, x, y, z, 0, 1);
         _set_transform(p, q, x, y, z, 0, 1);
-        door_map_clear(&chunk->doors, x, y, z);
     }
 }
 
@@ -823,8 +1387,104 @@ int get_block(int x, int y, int z)
 
 void benchmark_chunks(int count)
 {
+    chunks_reserve(count);
     for (int i=0; i<count; i++) {
         Chunk *chunk = chunks + i;
         create_chunk(chunk, i, i);
     }
 }
+
+typedef struct {
+    int p0;
+    int q0;
+    int width;
+    int count;
+    unsigned int key;
+    atomic_int next;
+    atomic_int generated;
+    atomic_int skipped;
+} PregenerateJob;
+
+static int pregenerate_run(void *arg)
+{
+    PregenerateJob *job = arg;
+    lua_State *L = NULL;
+    if (pwlua_worldgen_get_main_thread_instance() != NULL) {
+        L = pwlua_worldgen_new_generator();
+    }
+    int index;
+    while ((index = atomic_fetch_add(&job->next, 1)) < job->count) {
+        int p = job->p0 + index % job->width;
+        int q = job->q0 + index / job->width;
+        if (worldgen_cache_on_disk(job->key, p, q)) {
+            atomic_fetch_add(&job->skipped, 1);
+            continue;
+        }
+        Map layers[WORLDGEN_LAYERS];
+        Map *maps[WORLDGEN_LAYERS];
+        SignList signs;
+        for (int i = 0; i < WORLDGEN_LAYERS; i++) {
+            map_alloc(layers + i, p * CHUNK_SIZE - 1, 0, q * CHUNK_SIZE - 1,
+                      i == 0 ? 0x3fff : 0xf);
+            maps[i] = layers + i;
+        }
+        sign_list_alloc(&signs, 16);
+        worldgen_chunk(p, q, maps, &signs, L);
+        for (int i = 0; i < WORLDGEN_LAYERS; i++) {
+            map_free(layers + i);
+        }
+        sign_list_free(&signs);
+        atomic_fetch_add(&job->generated, 1);
+    }
+    if (L != NULL) {
+        lua_close(L);
+    }
+    return 0;
+}
+
+// Generate the chunks from p0, q0 to p1, q1 into the worldgen cache
+// directory using every core. Chunks already in the directory are skipped,
+// so an interrupted run carries on where it stopped when run again.
+int pregenerate_chunks(int p0, int q0, int p1, int q1)
+{
+    if (strlen(config->worldgen_cache_dir) == 0) {
+        printf("--pregenerate needs a --worldgen-cache-dir to write to\n");
+        return -1;
+    }
+    PregenerateJob job;
+    job.p0 = MIN(p0, p1);
+    job.q0 = MIN(q0, q1);
+    job.width = ABS(p1 - p0) + 1;
+    job.count = job.width * (ABS(q1 - q0) + 1);
+    job.key = worldgen_cache_key();
+    atomic_init(&job.next, 0);
+    atomic_init(&job.generated, 0);
+    atomic_init(&job.skipped, 0);
+    int thread_count = MAX(get_nprocs(), 1);
+    thrd_t *threads = malloc(sizeof(thrd_t) * thread_count);
+    double start = monotonic_seconds();
+    for (int i = 0; i < thread_count; i++) {
+        thrd_create(threads + i, pregenerate_run, &job);
+    }
+    int done = 0;
+    while (done < job.count) {
+        struct timespec delay = {0, 500000000};
+        thrd_sleep(&delay, NULL);
+        int generated = atomic_load(&job.generated);
+        int skipped = atomic_load(&job.skipped);
+        double elapsed = monotonic_seconds() - start;
+        done = generated + skipped;
+        printf("\rChunks: %d/%d (%d%%), %d already done, %.1f chunks/s  ",
+               done, job.count, (int)(100.0 * done / job.count), skipped,
+               elapsed > 0 ? generated / elapsed : 0);
+        fflush(stdout);
+    }
+    for (int i = 0; i < thread_count; i++) {
+        thrd_join(threads[i], NULL);
+    }
+    free(threads);
+    printf("\nGenerated %d chunks in %.1fs using %d threads\n",
+           atomic_load(&job.generated), monotonic_seconds() - start,
+           thread_count);
+    return 0;
+}
@@ -4,12 +4,34 @@
 #include "client.h"
 #include "player.h"
 
+// The most chunks the table is ever grown to hold.
 #define MAX_CHUNKS 8192
 
-extern Chunk chunks[MAX_CHUNKS];
+// Loaded chunks are chunks[0] to chunks[chunk_count - 1], the table has room
+// for chunk_capacity of them.
+extern Chunk *chunks;
 extern int chunk_count;
+extern int chunk_capacity;
+
+// The blocks around a player that collide() looks at: the columns beside
+// and diagonal to the block the player is in, from 2 below to 2 above it.
+#define COLLISION_SIZE 3
+#define COLLISION_LEVELS 5
+
+// Filled in once for a block and reused until the player moves to another
+// block or the cache is cleared with valid = 0. Each entry is 0 when the
+// block there is not an obstacle, otherwise its item_height().
+typedef struct {
+    int valid;
+    int loaded;
+    int x;
+    int y;
+    int z;
+    float heights[COLLISION_LEVELS][COLLISION_SIZE][COLLISION_SIZE];
+} CollisionCache;
 
 void chunks_reset(void);
+void chunks_reserve(int count);
 int hit_test(
     int previous, float x, float y, float z, float rx, float ry,
     int *bx, int *by, int *bz);
@@ -17,9 +39,24 @@ int hit_test_face(Player *player, int *x, int *y, int *z, int *face);
 int get_next_local_player(Client *client, int start);
 Chunk *find_chunk(int p, int q);
 void dirty_chunk(Chunk *chunk);
+void dirty_chunk_range(Chunk *chunk, int y0, int y1);
+void dirty_chunk_block(Chunk *chunk, int y);
+void dirty_chunk_light(Chunk *chunk, int y);
+void chunks_begin_batch(void);
+void chunks_end_batch(void);
 Chunk *next_available_chunk(void);
+void create_chunk(Chunk *chunk, int p, int q);
+size_t worker_item_upload_bytes(WorkerItem *item, size_t float_size);
+void generate_chunk(Chunk *chunk, WorkerItem *item, size_t float_size);
+int ensure_chunks_workers(View *views, int view_count, Worker *workers,
+    int worker_count, int create_radius);
+void gen_chunk_buffer(Chunk *chunk, size_t float_size);
+void force_chunks(Player *player, size_t float_size);
 void toggle_light(int x, int y, int z);
-int collide(int height, float *x, float *y, float *z, float *ydiff);
+void update_collision_cache(CollisionCache *cache, float x, float y, float z);
+int collision_obstacle(CollisionCache *cache, int x, int y, int z);
+int collide(CollisionCache *cache, int height, float *x, float *y, float *z,
+            float *ydiff);
 int highest_block(float x, float z);
 int get_block(int x, int y, int z);
 void set_block(int x, int y, int z, int w);
@@ -27,7 +64,6 @@ int get_light(int p, int q, int x, int y, int z);
 void set_light(int p, int q, int x, int y, int z, int w);
 int get_extra(int x, int y, int z);
 void set_extra(int x, int y, int z, int w);
-void set_extra_non_dirty(int x, int y, int z, int w);
 int get_shape(int x, int y, int z);
 void set_shape(int x, int y, int z, int w);
 int get_transform(int x, int y, int z);
@@ -39,6 +75,7 @@ void _set_transform(int p, int q, int x, int y, int z, int w, int dirty);
 int _set_light(int p, int q, int x, int y, int z, int w);
 void _set_sign(
     int p, int q, int x, int y, int z, int face, const char *text, int dirty);
-void delete_chunks(int delete_radius);
+void delete_chunks(int delete_radius, int keep_radius);
 void delete_all_chunks(void);
 void benchmark_chunks(int count);
+int pregenerate_chunks(int p0, int q0, int p1, int q1);
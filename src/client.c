@@ -5,6 +5,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include "client.h"
+#include "profile.h"
 #include "tinycthread.h"
 
 #define QUEUE_SIZE 1048576
@@ -19,6 +20,13 @@ static char *queue = 0;
 static int qsize = 0;
 static thrd_t recv_thread;
 static mtx_t mutex;
+// Lines sent by a thread between client_begin_batch() and
+// client_end_batch() are collected here and sent together. Only one thread
+// at a time may batch.
+static char *batch = 0;
+static int batch_size = 0;
+static int batch_capacity = 0;
+static _Thread_local int batching = 0;
 
 void client_enable() {
     client_enabled = 1;
@@ -37,7 +45,7 @@ int client_sendall(int sd, char *data, int length) {
         return 0;
     }
     int count = 0;
-    while (count < length) {
+    while (length > 0) {
         int n = send(sd, data + count, length, 0);
         if (n == -1) {
             return -1;
@@ -45,6 +53,7 @@ int client_sendall(int sd, char *data, int length) {
         count += n;
         length -= n;
         bytes_sent += n;
+        profile_add(PROFILE_NET_SENT, n);
     }
     return 0;
 }
@@ -53,10 +62,38 @@ void client_send(char *data) {
     if (!client_enabled) {
         return;
     }
-    if (client_sendall(sd, data, strlen(data)) == -1) {
+    int length = strlen(data);
+    if (batching) {
+        if (batch_size + length > batch_capacity) {
+            while (batch_size + length > batch_capacity) {
+                batch_capacity = batch_capacity ? batch_capacity * 2 : 4096;
+            }
+            batch = realloc(batch, batch_capacity);
+        }
+        memcpy(batch + batch_size, data, length);
+        batch_size += length;
+        return;
+    }
+    if (client_sendall(sd, data, length) == -1) {
+        perror("client_sendall");
+        exit(1);
+    }
+}
+
+void client_begin_batch(void) {
+    batching = client_enabled;
+}
+
+void client_end_batch(void) {
+    if (!batching) {
+        return;
+    }
+    batching = 0;
+    if (batch_size && client_sendall(sd, batch, batch_size) == -1) {
         perror("client_sendall");
         exit(1);
     }
+    batch_size = 0;
 }
 
 void client_version(int version) {
@@ -244,6 +281,7 @@ char *client_recv() {
         memmove(queue, p + 1, remaining);
         qsize -= length;
         bytes_received += length;
+        profile_add(PROFILE_NET_RECEIVED, length);
     }
     mtx_unlock(&mutex);
     return result;
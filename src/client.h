@@ -7,6 +7,8 @@ void client_connect(char *hostname, int port);
 void client_start(void);
 void client_stop(void);
 void client_send(char *data);
+void client_begin_batch(void);
+void client_end_batch(void);
 char *client_recv(void);
 void client_version(int version);
 void client_login(const char *username, const char *identity_token);
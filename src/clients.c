@@ -10,20 +10,67 @@
 Client clients[MAX_CLIENTS];
 int client_count;
 
+// The index + 1 of each remote client in clients, 0 for an empty slot. The
+// local client is always clients[0] and is not in the table as its id is
+// only known once the server sends it.
+static unsigned char client_table[CLIENT_TABLE_SIZE];
+
+typedef struct {
+    Player *player;
+    int cell_x;
+    int cell_z;
+} GridPlayer;
+
+static GridPlayer grid_players[MAX_PLAYERS];
+static int grid_start[PLAYER_GRID_BUCKETS + 1];
+
+static unsigned int client_slot(int id)
+{
+    return ((unsigned int)id * 2654435761u) % CLIENT_TABLE_SIZE;
+}
+
+static void client_table_add(int index)
+{
+    unsigned int slot = client_slot(clients[index].id);
+    while (client_table[slot]) {
+        slot = (slot + 1) % CLIENT_TABLE_SIZE;
+    }
+    client_table[slot] = index + 1;
+}
+
+static void client_table_rebuild(void)
+{
+    memset(client_table, 0, sizeof(client_table));
+    for (int i = 1; i < client_count; i++) {
+        client_table_add(i);
+    }
+}
+
+static void clear_player_grid(void)
+{
+    memset(grid_start, 0, sizeof(grid_start));
+}
 
 void clients_reset(void)
 {
     memset(clients, 0, sizeof(Client) * MAX_CLIENTS);
     client_count = 1;
     clients->id = 0;
+    client_table_rebuild();
+    clear_player_grid();
 }
 
 Client *find_client(int id) {
-    for (int i = 0; i < client_count; i++) {
-        Client *client = clients + i;
+    if (client_count > 0 && clients->id == id) {
+        return clients;
+    }
+    unsigned int slot = client_slot(id);
+    while (client_table[slot]) {
+        Client *client = clients + client_table[slot] - 1;
         if (client->id == id) {
             return client;
         }
+        slot = (slot + 1) % CLIENT_TABLE_SIZE;
     }
     return 0;
 }
@@ -48,29 +95,101 @@ void delete_client(int id)
         return;
     }
     int count = client_count;
-    for (int i = 0; i<MAX_LOCAL_PLAYERS; i++) {
-        Player *player = client->players + i;
-        if (player->is_active) {
-            del_buffer(player->buffer);
-        }
-    }
     Client *other = clients + (--count);
     memcpy(client, other, sizeof(Client));
     client_count = count;
+    client_table_rebuild();
+    clear_player_grid();
 }
 
 void delete_all_players(void)
 {
+    client_count = 0;
+    client_table_rebuild();
+    clear_player_grid();
+}
+
+static int grid_bucket(int cell_x, int cell_z)
+{
+    unsigned int hash = (unsigned int)cell_x * 73856093u ^
+        (unsigned int)cell_z * 19349663u;
+    return hash % PLAYER_GRID_BUCKETS;
+}
+
+static int grid_cell(float v)
+{
+    return floorf(v / PLAYER_GRID_CELL_SIZE);
+}
+
+// Sort the active players of every client into the buckets of the grid,
+// called once a frame after the players have moved.
+void update_player_grid(void)
+{
+    static GridPlayer unsorted[MAX_PLAYERS];
+    static int buckets[MAX_PLAYERS];
+    int count = 0;
+    memset(grid_start, 0, sizeof(grid_start));
     for (int i = 0; i < client_count; i++) {
         Client *client = clients + i;
         for (int j = 0; j < MAX_LOCAL_PLAYERS; j++) {
             Player *player = client->players + j;
-            if (player->is_active) {
-                del_buffer(player->buffer);
+            if (!player->is_active) {
+                continue;
             }
+            GridPlayer *e = unsorted + count;
+            e->player = player;
+            e->cell_x = grid_cell(player->state.x);
+            e->cell_z = grid_cell(player->state.z);
+            buckets[count] = grid_bucket(e->cell_x, e->cell_z);
+            grid_start[buckets[count] + 1]++;
+            count++;
         }
     }
-    client_count = 0;
+    for (int i = 0; i < PLAYER_GRID_BUCKETS; i++) {
+        grid_start[i + 1] += grid_start[i];
+    }
+    int next[PLAYER_GRID_BUCKETS];
+    memcpy(next, grid_start, sizeof(next));
+    for (int i = 0; i < count; i++) {
+        grid_players[next[buckets[i]]++] = unsorted[i];
+    }
+}
+
+// Find up to max_results players in the grid cells within radius of x, z,
+// some may be a little further than radius. Returns the number found.
+int find_players_near(float x, float z, float radius, Player **result,
+    int max_results)
+{
+    int count = 0;
+    int x0 = grid_cell(x - radius);
+    int x1 = grid_cell(x + radius);
+    int z0 = grid_cell(z - radius);
+    int z1 = grid_cell(z + radius);
+    if ((x1 - x0 + 1) * (z1 - z0 + 1) > PLAYER_GRID_BUCKETS) {
+        // Faster to look at every bucket once than the same ones again.
+        for (int i = 0; i < grid_start[PLAYER_GRID_BUCKETS]; i++) {
+            GridPlayer *e = grid_players + i;
+            if (e->cell_x >= x0 && e->cell_x <= x1 &&
+                e->cell_z >= z0 && e->cell_z <= z1 && count < max_results) {
+                result[count++] = e->player;
+            }
+        }
+        return count;
+    }
+    for (int cx = x0; cx <= x1; cx++) {
+        for (int cz = z0; cz <= z1; cz++) {
+            int bucket = grid_bucket(cx, cz);
+            for (int i = grid_start[bucket]; i < grid_start[bucket + 1];
+                 i++) {
+                GridPlayer *e = grid_players + i;
+                if (e->cell_x == cx && e->cell_z == cz &&
+                    count < max_results) {
+                    result[count++] = e->player;
+                }
+            }
+        }
+    }
+    return count;
 }
 
 void parse_buffer(char *buffer)
@@ -93,12 +212,13 @@ void parse_buffer(char *buffer)
                 client = clients + client_count;
                 client_count++;
                 client->id = pid;
+                client_table_add(client_count - 1);
                 // Initialize the players.
                 for (int i=0; i<MAX_LOCAL_PLAYERS; i++) {
                     Player *player = client->players + i;
                     player->is_active = 0;
                     player->id = i + 1;
-                    player->buffer = 0;
+                    player->instance = -1;
                     player->texture_index = i;
                 }
             }
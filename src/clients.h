@@ -3,6 +3,16 @@
 #include "pw.h"
 
 #define MAX_CLIENTS 128
+#define MAX_PLAYERS (MAX_CLIENTS * MAX_LOCAL_PLAYERS)
+
+// Client ids are found through a hash table of indexes into clients.
+#define CLIENT_TABLE_SIZE (MAX_CLIENTS * 2)
+
+// The active players are put in a grid of square cells once a frame so only
+// the players near a point need be looked at, cells are hashed into a fixed
+// number of buckets.
+#define PLAYER_GRID_CELL_SIZE 32
+#define PLAYER_GRID_BUCKETS 64
 
 extern Client clients[MAX_CLIENTS];
 extern int client_count;
@@ -13,4 +23,7 @@ void delete_client(int id);
 void delete_all_players(void);
 int get_first_active_player(Client *client);
 void parse_buffer(char *buffer);
+void update_player_grid(void);
+int find_players_near(float x, float z, float radius, Player **result,
+    int max_results);
 
@@ -37,6 +37,7 @@ void reset_config() {
     config->show_lights = SHOW_LIGHTS;
     config->show_plants = SHOW_PLANTS;
     config->show_player_names = SHOW_PLAYER_NAMES;
+    config->show_profile = SHOW_PROFILE;
     config->show_trees = SHOW_TREES;
     config->show_wireframe = SHOW_WIREFRAME;
     config->use_cache = USE_CACHE;
@@ -50,9 +51,13 @@ void reset_config() {
     config->window_width = WINDOW_WIDTH;
     config->window_height = WINDOW_HEIGHT;
     config->benchmark_create_chunks = 0;
+    config->benchmark_noise = 0;
+    config->benchmark_map = 0;
+    config->pregenerate = 0;
     config->no_limiters = 0;
     config->delete_radius = AUTO_PICK_RADIUS;
     config->time = -1;
+    config->trace = 0;
     config->use_hfloat = HFLOAT_CONFIG;
     strncpy(config->worldgen_path, WORLDGEN_PATH, sizeof(config->worldgen_path));
     config->worldgen_path[sizeof(WORLDGEN_PATH)] = '\0';
@@ -64,6 +69,13 @@ void reset_config() {
     config->hide_osk = 0;
     config->exit_on_vt_close = 0;
     config->worker_count = MIN(get_nprocs(), MAX_WORKERS);
+    config->occlusion_culling = OCCLUSION_CULLING;
+    config->lod_radius = AUTO_PICK_RADIUS;
+    config->chunk_memory = AUTO_PICK_MEMORY;
+    config->chunk_gpu_memory = AUTO_PICK_MEMORY;
+    config->upload_budget = UPLOAD_BUDGET_KB;
+    config->worldgen_cache = WORLDGEN_CACHE;
+    config->worldgen_cache_dir[0] = '\0';
 }
 
 void get_config_path(char *path)
@@ -110,6 +122,7 @@ void parse_startup_config(int argc, char **argv) {
             {"show-lights",       required_argument, 0,  0 },
             {"show-plants",       required_argument, 0,  0 },
             {"show-player-names", required_argument, 0,  0 },
+            {"show-profile",      required_argument, 0,  0 },
             {"show-trees",        required_argument, 0,  0 },
             {"show-wireframe",    required_argument, 0,  0 },
             {"verbose",           no_argument,       0,  0 },
@@ -120,11 +133,17 @@ void parse_startup_config(int argc, char **argv) {
             {"window-title",      required_argument, 0,  0 },
             {"window-xy",         required_argument, 0,  0 },
             {"benchmark-create-chunks", required_argument, 0,  0 },
+            {"benchmark-noise",   required_argument, 0,  0 },
+            {"benchmark-map",     required_argument, 0,  0 },
+            {"pregenerate",       required_argument, 0,  0 },
             {"no-limiters",       no_argument,       0,  0 },
             {"delete-radius",     required_argument, 0,  0 },
             {"time",              required_argument, 0,  0 },
+            {"trace",             required_argument, 0,  0 },
             {"hfloat",            required_argument, 0,  0 },
             {"worldgen",          required_argument, 0,  0 },
+            {"worldgen-cache",    required_argument, 0,  0 },
+            {"worldgen-cache-dir", required_argument, 0,  0 },
             {"ignore-gamepad",    no_argument,       0,  0 },
             {"always-use-osk",    no_argument,       0,  0 },
             {"bind",              required_argument, 0,  0 },
@@ -132,6 +151,11 @@ void parse_startup_config(int argc, char **argv) {
             {"vt",                no_argument,       0,  0 },
             {"hide-osk",          no_argument,       0,  0 },
             {"exit-on-vt-close",  no_argument,       0,  0 },
+            {"occlusion-culling", required_argument, 0,  0 },
+            {"lod-radius",        required_argument, 0,  0 },
+            {"chunk-memory",      required_argument, 0,  0 },
+            {"chunk-gpu-memory",  required_argument, 0,  0 },
+            {"upload-budget",     required_argument, 0,  0 },
             {0,                   0,                 0,  0 }
         };
 
@@ -170,6 +194,8 @@ void parse_startup_config(int argc, char **argv) {
                        sscanf(optarg, "%d", &config->show_plants) == 1) {
             } else if (strncmp(opt_name, "show-player-names", 17) == 0 &&
                        sscanf(optarg, "%d", &config->show_player_names) == 1) {
+            } else if (strncmp(opt_name, "show-profile", 12) == 0 &&
+                       sscanf(optarg, "%d", &config->show_profile) == 1) {
             } else if (strncmp(opt_name, "show-trees", 10) == 0 &&
                        sscanf(optarg, "%d", &config->show_trees) == 1) {
             } else if (strncmp(opt_name, "show-wireframe", 14) == 0 &&
@@ -201,14 +227,34 @@ void parse_startup_config(int argc, char **argv) {
             } else if (strncmp(opt_name, "benchmark-create-chunks", 23) == 0 &&
                        sscanf(optarg, "%d",
                               &config->benchmark_create_chunks) == 1) {
+            } else if (strncmp(opt_name, "benchmark-noise", 15) == 0 &&
+                       sscanf(optarg, "%d", &config->benchmark_noise) == 1) {
+            } else if (strncmp(opt_name, "benchmark-map", 13) == 0 &&
+                       sscanf(optarg, "%d", &config->benchmark_map) == 1) {
+            } else if (strncmp(opt_name, "pregenerate", 11) == 0 &&
+                       sscanf(optarg, "%d,%d,%d,%d",
+                              &config->pregenerate_area[0],
+                              &config->pregenerate_area[1],
+                              &config->pregenerate_area[2],
+                              &config->pregenerate_area[3]) == 4) {
+                config->pregenerate = 1;
             } else if (strncmp(opt_name, "no-limiters", 11) == 0) {
                 config->no_limiters = 1;
             } else if (strncmp(opt_name, "delete-radius", 13) == 0 &&
                        sscanf(optarg, "%d", &config->delete_radius) == 1) {
             } else if (strncmp(opt_name, "time", 4) == 0 &&
                        sscanf(optarg, "%d", &config->time) == 1) {
+            } else if (strncmp(opt_name, "trace", 5) == 0 &&
+                       sscanf(optarg, "%d", &config->trace) == 1) {
             } else if (strncmp(opt_name, "hfloat", 6) == 0 &&
                        sscanf(optarg, "%d", &config->use_hfloat) == 1) {
+            } else if (strncmp(opt_name, "worldgen-cache-dir", 18) == 0 &&
+                       sscanf(optarg, "%256c",
+                              config->worldgen_cache_dir) == 1) {
+                config->worldgen_cache_dir[MIN(strlen(optarg),
+                                               MAX_PATH_LENGTH - 1)] = '\0';
+            } else if (strncmp(opt_name, "worldgen-cache", 14) == 0 &&
+                       sscanf(optarg, "%d", &config->worldgen_cache) == 1) {
             } else if (strncmp(opt_name, "worldgen", 8) == 0 &&
                        sscanf(optarg, "%256c", config->worldgen_path) == 1) {
                 config->worldgen_path[MIN(strlen(optarg),
@@ -229,6 +275,16 @@ void parse_startup_config(int argc, char **argv) {
                 config->hide_osk = 1;
             } else if (strncmp(opt_name, "exit-on-vt-close", 16) == 0) {
                 config->exit_on_vt_close = 1;
+            } else if (strncmp(opt_name, "occlusion-culling", 17) == 0 &&
+                       sscanf(optarg, "%d", &config->occlusion_culling) == 1) {
+            } else if (strncmp(opt_name, "lod-radius", 10) == 0 &&
+                       sscanf(optarg, "%d", &config->lod_radius) == 1) {
+            } else if (strncmp(opt_name, "chunk-memory", 12) == 0 &&
+                       sscanf(optarg, "%d", &config->chunk_memory) == 1) {
+            } else if (strncmp(opt_name, "chunk-gpu-memory", 16) == 0 &&
+                       sscanf(optarg, "%d", &config->chunk_gpu_memory) == 1) {
+            } else if (strncmp(opt_name, "upload-budget", 13) == 0 &&
+                       sscanf(optarg, "%d", &config->upload_budget) == 1) {
             } else {
                 printf("Bad argument for: --%s: %s\n", opt_name, optarg);
                 exit(1);
@@ -23,6 +23,8 @@
 #define SHOW_INFO_TEXT 1
 #define SHOW_CHAT_TEXT 1
 #define SHOW_PLAYER_NAMES 1
+#define SHOW_PROFILE 0
+#define OCCLUSION_CULLING 1
 #define WORLDGEN_PATH ""
 
 // key bindings
@@ -34,6 +36,12 @@
 // advanced parameters
 #define MAX_LOCAL_PLAYERS 4
 #define CHUNK_SIZE 16
+#define CHUNK_HEIGHT 256
+#define SECTION_SIZE 16
+#define LOD_MEMORY_BUDGET (4 * 1024 * 1024)
+#define WORLDGEN_CACHE 128
+// KiB of meshes given to GL each frame.
+#define UPLOAD_BUDGET_KB 1024
 #define COMMIT_INTERVAL 5
 #define DEFAULT_PORT 4080
 #define MAX_ADDR_LENGTH 196
@@ -42,6 +50,10 @@
 #define MAX_FILENAME_LENGTH 196
 #define MAX_TITLE_LENGTH 256
 #define AUTO_PICK_RADIUS -1
+#define AUTO_PICK_MEMORY -1
+#define DEFAULT_VIEW_RADIUS 5
+// The furthest an auto picked view distance grows while chunks fit in memory.
+#define AUTO_MAX_VIEW_RADIUS 12
 #ifdef MESA
 #define HFLOAT_CONFIG 0
 #else
@@ -70,6 +82,7 @@ typedef struct {
     int show_lights;
     int show_plants;
     int show_player_names;
+    int show_profile;
     int show_trees;
     int show_wireframe;
     char server[MAX_ADDR_LENGTH];
@@ -83,9 +96,14 @@ typedef struct {
     int window_width;
     int window_height;
     int benchmark_create_chunks;
+    int benchmark_noise;
+    int benchmark_map;
+    int pregenerate;
+    int pregenerate_area[4];  // p0, q0, p1, q1
     int no_limiters;
     int delete_radius;
     int time;
+    int trace;
     int use_hfloat;
     char worldgen_path[MAX_PATH_LENGTH];
     int day_length;
@@ -97,6 +115,13 @@ typedef struct {
     int hide_osk;
     int exit_on_vt_close;
     int worker_count;
+    int occlusion_culling;
+    int lod_radius;
+    int chunk_memory;
+    int chunk_gpu_memory;
+    int upload_budget;
+    int worldgen_cache;
+    char worldgen_cache_dir[MAX_PATH_LENGTH];
 } Config;
 
 extern Config *config;
@@ -158,6 +158,32 @@ void make_plant(
     mat_apply(data, ma, 24, 0, 10);
 }
 
+// A cube stretched to fill the box from (x0, y0, z0) to (x1, y1, z1), each
+// face shows one whole texture tile.
+void make_box(
+    float *data, float ao[6][4], float light[6][4],
+    int left, int right, int top, int bottom, int front, int back,
+    float x0, float y0, float z0, float x1, float y1, float z1, int w)
+{
+    make_cube(
+        data, ao, light, left, right, top, bottom, front, back,
+        0, 0, 0, 1, w);
+    float cx = (x0 + x1) / 2;
+    float cy = (y0 + y1) / 2;
+    float cz = (z0 + z1) / 2;
+    float hx = (x1 - x0) / 2;
+    float hy = (y1 - y0) / 2;
+    float hz = (z1 - z0) / 2;
+    int count = (left + right + top + bottom + front + back) * 6;
+    for (int i = 0; i < count; i++) {
+        float *d = data + i * 10;
+        d[0] = cx + d[0] * hx;
+        d[1] = cy + d[1] * hy;
+        d[2] = cz + d[2] * hz;
+    }
+}
+
+
 void make_slab_faces(
     float *data, float ao[6][4], float light[6][4],
     int left, int right, int top, int bottom, int front, int back,
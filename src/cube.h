@@ -11,6 +11,11 @@ void make_cube(
     int left, int right, int top, int bottom, int front, int back,
     float x, float y, float z, float n, int w);
 
+void make_box(
+    float *data, float ao[6][4], float light[6][4],
+    int left, int right, int top, int bottom, int front, int back,
+    float x0, float y0, float z0, float x1, float y1, float z1, int w);
+
 void make_slab(
     float *data, float ao[6][4], float light[6][4],
     int left, int right, int top, int bottom, int front, int back,
@@ -31,6 +31,11 @@ static sqlite3_stmt *get_option_stmt;
 static sqlite3_stmt *set_option_stmt;
 
 static Ring ring;
+// Changes made by a thread between db_begin_batch() and db_end_batch() are
+// gathered here and handed to the worker together. Only one thread at a time
+// may batch.
+static Ring batch_ring;
+static _Thread_local int batching;
 static thrd_t thrd;
 static mtx_t mtx;
 static cnd_t cnd;
@@ -378,6 +383,10 @@ void db_insert_block(int p, int q, int x, int y, int z, int w) {
     if (!db_enabled) {
         return;
     }
+    if (batching) {
+        ring_put_block(&batch_ring, p, q, x, y, z, w);
+        return;
+    }
     mtx_lock(&mtx);
     ring_put_block(&ring, p, q, x, y, z, w);
     cnd_signal(&cnd);
@@ -399,6 +408,10 @@ void db_insert_extra(int p, int q, int x, int y, int z, int w) {
     if (!db_enabled) {
         return;
     }
+    if (batching) {
+        ring_put_extra(&batch_ring, p, q, x, y, z, w);
+        return;
+    }
     mtx_lock(&mtx);
     ring_put_extra(&ring, p, q, x, y, z, w);
     cnd_signal(&cnd);
@@ -420,6 +433,10 @@ void db_insert_light(int p, int q, int x, int y, int z, int w) {
     if (!db_enabled) {
         return;
     }
+    if (batching) {
+        ring_put_light(&batch_ring, p, q, x, y, z, w);
+        return;
+    }
     mtx_lock(&mtx);
     ring_put_light(&ring, p, q, x, y, z, w);
     cnd_signal(&cnd);
@@ -457,6 +474,10 @@ void db_insert_shape(int p, int q, int x, int y, int z, int w) {
     if (!db_enabled) {
         return;
     }
+    if (batching) {
+        ring_put_shape(&batch_ring, p, q, x, y, z, w);
+        return;
+    }
     mtx_lock(&mtx);
     ring_put_shape(&ring, p, q, x, y, z, w);
     cnd_signal(&cnd);
@@ -478,6 +499,10 @@ void db_insert_transform(int p, int q, int x, int y, int z, int w) {
     if (!db_enabled) {
         return;
     }
+    if (batching) {
+        ring_put_transform(&batch_ring, p, q, x, y, z, w);
+        return;
+    }
     mtx_lock(&mtx);
     ring_put_transform(&ring, p, q, x, y, z, w);
     cnd_signal(&cnd);
@@ -727,6 +752,7 @@ void db_worker_start(void) {
         return;
     }
     ring_alloc(&ring, 1024);
+    ring_alloc(&batch_ring, 1024);
     mtx_init(&mtx, mtx_plain);
     mtx_init(&load_mtx, mtx_plain);
     cnd_init(&cnd);
@@ -746,6 +772,41 @@ void db_worker_stop(void) {
     mtx_destroy(&load_mtx);
     mtx_destroy(&mtx);
     ring_free(&ring);
+    ring_free(&batch_ring);
+}
+
+void db_begin_batch(void) {
+    batching = db_enabled;
+}
+
+// Pass the batched changes to the worker, taking its lock and waking it
+// once for the whole batch.
+void db_end_batch(void) {
+    if (!batching) {
+        return;
+    }
+    batching = 0;
+    if (ring_empty(&batch_ring)) {
+        return;
+    }
+    RingEntry e;
+    mtx_lock(&mtx);
+    while (ring_get(&batch_ring, &e)) {
+        ring_put(&ring, &e);
+    }
+    cnd_signal(&cnd);
+    mtx_unlock(&mtx);
+}
+
+// The number of changes waiting to be written by the worker.
+int db_worker_backlog(void) {
+    if (!db_enabled) {
+        return 0;
+    }
+    mtx_lock(&mtx);
+    int size = ring_size(&ring);
+    mtx_unlock(&mtx);
+    return size;
 }
 
 int db_worker_run(__attribute__((unused)) void *arg) {
@@ -40,5 +40,8 @@ void db_set_option(char *name, char *value);
 const unsigned char *db_get_option(char *name);
 void db_worker_start(void);
 void db_worker_stop(void);
+int db_worker_backlog(void);
+void db_begin_batch(void);
+void db_end_batch(void);
 int db_worker_run(void *arg);
 
@@ -2,203 +2,11 @@
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
-#include <GLES2/gl2.h>
-#include "chunks.h"
-#include "config.h"
 #include "cube.h"
 #include "door.h"
 #include "item.h"
-#include "pw.h"
 #include "util.h"
 
-void make_door_in_buffer_sub_data(int buffer, int float_size, DoorMapEntry *door);
-
-int door_hash_int(int key) {
-    key = ~key + (key << 15);
-    key = key ^ (key >> 12);
-    key = key + (key << 2);
-    key = key ^ (key >> 4);
-    key = key * 2057;
-    key = key ^ (key >> 16);
-    return key;
-}
-
-int door_hash(int x, int y, int z) {
-    x = door_hash_int(x);
-    y = door_hash_int(y);
-    z = door_hash_int(z);
-    return x ^ y ^ z;
-}
-
-void door_map_alloc(DoorMap *map, int dx, int dy, int dz, int mask) {
-    map->dx = dx;
-    map->dy = dy;
-    map->dz = dz;
-    map->mask = mask;
-    map->size = 0;
-    map->data = (DoorMapEntry *)calloc(map->mask + 1, sizeof(DoorMapEntry));
-}
-
-void door_map_free(DoorMap *map) {
-    free(map->data);
-}
-
-void door_map_copy(DoorMap *dst, DoorMap *src) {
-    dst->dx = src->dx;
-    dst->dy = src->dy;
-    dst->dz = src->dz;
-    dst->mask = src->mask;
-    dst->size = src->size;
-    dst->data = (DoorMapEntry *)calloc(dst->mask + 1, sizeof(DoorMapEntry));
-    memcpy(dst->data, src->data, (dst->mask + 1) * sizeof(DoorMapEntry));
-}
-
-static void door_entry_copy(DoorMapEntry *entry, int offset_into_gl_buffer,
-    int face_count_in_gl_buffer, float ao[6][4], float light[6][4],
-    int left, int right, int top, int bottom,
-    int front, int back,
-    float n, int shape, int extra, int transform) {
-    entry->offset_into_gl_buffer = offset_into_gl_buffer;
-    entry->face_count_in_gl_buffer = face_count_in_gl_buffer;
-    memcpy(entry->ao, ao, sizeof(float) * 6 * 4);
-    memcpy(entry->light, light, sizeof(float) * 6 * 4);
-    entry->left = left;
-    entry->right = right;
-    entry->top = top;
-    entry->bottom = bottom;
-    entry->front = front;
-    entry->back = back;
-    entry->n = n;
-    entry->shape = shape;
-    entry->extra = extra;
-    entry->transform = transform;
-}
-
-int door_map_set(DoorMap *map, int x, int y, int z, int w,
-    int offset_into_gl_buffer, int face_count_in_gl_buffer,
-    float ao[6][4], float light[6][4], int left, int right,
-    int top, int bottom, int front, int back, float n,
-    int shape, int extra, int transform) {
-    unsigned int index = door_hash(x, y, z) & map->mask;
-    x -= map->dx;
-    y -= map->dy;
-    z -= map->dz;
-    DoorMapEntry *entry = map->data + index;
-    int overwrite = 0;
-    while (!DOOR_EMPTY_ENTRY(entry)) {
-        if (entry->e.x == x && entry->e.y == y && entry->e.z == z) {
-            overwrite = 1;
-            break;
-        }
-        index = (index + 1) & map->mask;
-        entry = map->data + index;
-    }
-    if (overwrite) {
-        door_entry_copy(entry, offset_into_gl_buffer, face_count_in_gl_buffer,
-            ao, light, left, right, top, bottom, front, back, n, shape, extra,
-            transform);
-        if (entry->e.w != w) {
-            entry->e.w = w;
-            return 1;
-        }
-    }
-    else if (w) {
-        entry->e.x = x;
-        entry->e.y = y;
-        entry->e.z = z;
-        entry->e.w = w;
-        door_entry_copy(entry, offset_into_gl_buffer, face_count_in_gl_buffer,
-            ao, light, left, right, top, bottom, front, back, n, shape, extra,
-            transform);
-        map->size++;
-        if (map->size * 2 > map->mask) {
-            door_map_grow(map);
-        }
-        return 1;
-    }
-    return 0;
-}
-
-void door_map_clear(DoorMap *map, int x, int y, int z)
-{
-    unsigned int index = door_hash(x, y, z) & map->mask;
-    DoorMapEntry *entry = map->data + index;
-    if (x != map->dx + entry->e.x || y != map->dy + entry->e.y ||
-        z != map->dz + entry->e.z) {
-        return;
-    }
-    entry->e.w = 0;
-    entry->shape = 0;
-    entry->extra = 0;
-    entry->transform = 0;
-}
-
-DoorMapEntry *door_map_get(DoorMap *map, int x, int y, int z) {
-    unsigned int index = door_hash(x, y, z) & map->mask;
-    x -= map->dx;
-    y -= map->dy;
-    z -= map->dz;
-    if (x < 0 || x > 255) return 0;
-    if (y < 0 || y > 255) return 0;
-    if (z < 0 || z > 255) return 0;
-    DoorMapEntry *entry = map->data + index;
-    while (!DOOR_EMPTY_ENTRY(entry)) {
-        if (entry->e.x == x && entry->e.y == y && entry->e.z == z) {
-            return entry;
-        }
-        index = (index + 1) & map->mask;
-        entry = map->data + index;
-    }
-    return 0;
-}
-
-void door_map_grow(DoorMap *map) {
-    DoorMap new_map;
-    new_map.dx = map->dx;
-    new_map.dy = map->dy;
-    new_map.dz = map->dz;
-    new_map.mask = (map->mask << 1) | 1;
-    new_map.size = 0;
-    new_map.data = (DoorMapEntry *)calloc(new_map.mask + 1, sizeof(DoorMapEntry));
-    DOOR_MAP_FOR_EACH(map, ex, ey, ez, ew) {
-        door_map_set(&new_map, ex, ey, ez, ew,
-            entry->offset_into_gl_buffer, entry->face_count_in_gl_buffer,
-            entry->ao, entry->light, entry->left, entry->right, entry->top,
-            entry->bottom, entry->front, entry->back, entry->n, entry->shape,
-            entry->extra, entry->transform);
-    } END_DOOR_MAP_FOR_EACH;
-    free(map->data);
-    map->mask = new_map.mask;
-    map->size = new_map.size;
-    map->data = new_map.data;
-}
-
-void make_door_in_buffer_sub_data(int buffer, int float_size,
-    DoorMapEntry *door)
-{
-    // This is an optimisation to change the shape of just one door block.
-    GLfloat door_data[6*10*6];  // 6 * components * faces
-    make_door(
-        door_data, door->ao, door->light, door->left, door->right, door->top,
-        door->bottom, door->front, door->back, door->e.x, door->e.y, door->e.z,
-        door->n, door->e.w, door->shape, door->extra, door->transform);
-    glBindBuffer(GL_ARRAY_BUFFER, buffer);
-    if (config->use_hfloat) {
-        hfloat hdata[6*10*6];
-        for (size_t i=0; i<(6 * 10 * 6); i++) {
-            hdata[i] = float_to_hfloat(door_data + i);
-        }
-        glBufferSubData(GL_ARRAY_BUFFER,
-            door->offset_into_gl_buffer * float_size,
-            6*10*door->face_count_in_gl_buffer*float_size, hdata);
-    } else {
-        glBufferSubData(GL_ARRAY_BUFFER,
-            door->offset_into_gl_buffer * float_size,
-            6*10*door->face_count_in_gl_buffer*float_size, door_data);
-    }
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
-}
-
 #define DOOR_POSITION_COUNT 4
 void make_door_faces(
     float *data, float ao[6][4], float light[6][4],
@@ -431,38 +239,3 @@ void make_door(
         wleft, wright, wtop, wbottom, wfront, wback,
         x, y, z, n, door_open, transform);
 }
-
-void _door_toggle_open(DoorMapEntry *door, int x, int y, int z, GLuint buffer,
-    size_t float_size)
-{
-    if (is_open(door->extra)) {
-        door->extra &= ~EXTRA_BIT_OPEN;
-    } else {
-        door->extra |= EXTRA_BIT_OPEN;
-    }
-    set_extra_non_dirty(x, y, z, door->extra);
-    make_door_in_buffer_sub_data(buffer, float_size, door);
-}
-
-void door_toggle_open(DoorMap *door_map, DoorMapEntry *door, int x, int y,
-    int z, GLuint buffer)
-{
-    _door_toggle_open(door, x, y, z, buffer, get_float_size());
-
-    DoorMapEntry *matching_door = NULL;
-    if (door->shape == UPPER_DOOR) {
-        DoorMapEntry *e = door_map_get(door_map, x, y - 1, z);
-        if (e && e->shape == LOWER_DOOR) {
-            matching_door = e;
-        }
-    } else if (door->shape == LOWER_DOOR) {
-        DoorMapEntry *e = door_map_get(door_map, x, y + 1, z);
-        if (e && e->shape == UPPER_DOOR) {
-            matching_door = e;
-        }
-    }
-    if (matching_door) {
-        _door_toggle_open(matching_door, x, matching_door->e.y, z, buffer,
-            get_float_size());
-    }
-}
@@ -0,0 +1,81 @@
+#include <stdlib.h>
+#include <string.h>
+#include "chunks.h"
+#include "dynamic.h"
+#include "item.h"
+#include "upload.h"
+#include "util.h"
+#include "util_gl.h"
+#include "vertex_pool.h"
+
+// Take the blocks made by the worker in with, giving their faces to GL in
+// the buffer of the old blocks when they fit.
+void dynamic_blocks_replace(DynamicBlocks *dynamic, DynamicBlocks *with,
+    size_t float_size)
+{
+    GLuint buffer = dynamic->buffer;
+    GLsizeiptr capacity = dynamic->capacity;
+    dynamic->buffer = 0;
+    dynamic_blocks_free(dynamic);
+    *dynamic = *with;
+    memset(with, 0, sizeof(DynamicBlocks));
+    dynamic->buffer = buffer;
+    dynamic->capacity = capacity;
+    upload_buffer(&dynamic->buffer, &dynamic->capacity,
+        (GLsizeiptr)dynamic->faces * FACE_COMPONENTS * float_size, dynamic->data);
+    free(dynamic->data);
+    dynamic->data = NULL;
+}
+
+void dynamic_blocks_free(DynamicBlocks *dynamic)
+{
+    if (dynamic->buffer) {
+        del_buffer(dynamic->buffer);
+    }
+    free(dynamic->blocks);
+    free(dynamic->data);
+    memset(dynamic, 0, sizeof(DynamicBlocks));
+}
+
+DynamicBlock *dynamic_block_get(DynamicBlocks *dynamic, int x, int y, int z)
+{
+    for (int i = 0; i < dynamic->count; i++) {
+        DynamicBlock *block = dynamic->blocks + i;
+        if (block->x == x && block->y == y && block->z == z) {
+            return block;
+        }
+    }
+    return NULL;
+}
+
+// Open or close the door or gate at x, y, z, with the other half of a door.
+void dynamic_block_toggle_open(int x, int y, int z)
+{
+    Chunk *chunk = find_chunk(chunked(x), chunked(z));
+    if (!chunk) {
+        return;
+    }
+    DynamicBlock *block = dynamic_block_get(&chunk->dynamic, x, y, z);
+    if (!block) {
+        return;
+    }
+    int extra = get_extra(x, y, z) ^ EXTRA_BIT_OPEN;
+    set_extra(x, y, z, extra);
+    int other_y = 0;
+    int other_shape = 0;
+    if (block->shape == UPPER_DOOR) {
+        other_y = y - 1;
+        other_shape = LOWER_DOOR;
+    } else if (block->shape == LOWER_DOOR) {
+        other_y = y + 1;
+        other_shape = UPPER_DOOR;
+    }
+    DynamicBlock *other = other_shape ?
+        dynamic_block_get(&chunk->dynamic, x, other_y, z) : NULL;
+    if (other && other->shape == other_shape) {
+        int other_extra = get_extra(x, other_y, z);
+        if (is_open(other_extra) != is_open(extra)) {
+            set_extra(x, other_y, z, other_extra ^ EXTRA_BIT_OPEN);
+        }
+    }
+}
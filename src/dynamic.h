@@ -0,0 +1,41 @@
+#pragma once
+
+#include <GLES2/gl2.h>
+#include <stddef.h>
+
+/*
+ * Doors and gates are dynamic blocks, drawn from a small buffer of their own
+ * in each chunk instead of from the chunk's sections. The faces of both the
+ * closed and the open pose of each block are made when the chunk is meshed,
+ * opening or closing one only changes which of them are drawn, so nothing is
+ * uploaded and neither the chunk nor its neighbours are meshed again.
+ *
+ * The blocks are kept in order of height. The faces of the blocks in one
+ * section are stored with all the closed poses first and then all the open
+ * ones, so blocks next to each other in the same pose are drawn together.
+ */
+
+typedef struct {
+    int x;
+    int y;
+    int z;
+    int shape;
+    int open;
+    int faces;  // in each pose
+    int first[2];  // first face of the closed and the open pose
+} DynamicBlock;
+
+typedef struct {
+    int count;
+    DynamicBlock *blocks;
+    int faces;
+    void *data;  // the faces, until they are given to GL
+    GLuint buffer;
+    GLsizeiptr capacity;  // bytes in buffer
+} DynamicBlocks;
+
+void dynamic_blocks_replace(DynamicBlocks *dynamic, DynamicBlocks *with,
+    size_t float_size);
+void dynamic_blocks_free(DynamicBlocks *dynamic);
+DynamicBlock *dynamic_block_get(DynamicBlocks *dynamic, int x, int y, int z);
+void dynamic_block_toggle_open(int x, int y, int z);
@@ -2,14 +2,11 @@
 #include <math.h>
 #include <stdio.h>
 #include <string.h>
-#include <GLES2/gl2.h>
-#include "chunks.h"
 #include "cube.h"
 #include "door.h"
 #include "fence.h"
 #include "item.h"
 #include "matrix.h"
-#include "pw.h"
 #include "util.h"
 
 #define POST {{P06, P00, P06}, {P10, P16, P10}}
@@ -366,47 +363,3 @@ void make_fence(
             (s->faces + ((transform * s->cuboid_count *6*4*3)) + (i *6*4*3)));
     }
 }
-
-void make_gate_in_buffer_sub_data(int buffer, int float_size,
-    DoorMapEntry *gate)
-{
-    // This is an optimisation to change the shape of just one gate block.
-    GLfloat gate_data[10*6*10*6];  // 10 * 6 * components * faces
-    make_fence(
-        gate_data, gate->ao, gate->light, gate->left, gate->right, gate->top,
-        gate->bottom, gate->front, gate->back, gate->e.x, gate->e.y, gate->e.z,
-        gate->n, gate->e.w, gate->shape, gate->extra, gate->transform);
-    glBindBuffer(GL_ARRAY_BUFFER, buffer);
-    if (config->use_hfloat) {
-        hfloat hdata[10*6*10*6];
-        for (size_t i=0; i<(10 * 6 * 10 * 6); i++) {
-            hdata[i] = float_to_hfloat(gate_data + i);
-        }
-        glBufferSubData(GL_ARRAY_BUFFER,
-            gate->offset_into_gl_buffer * float_size,
-            6*10*gate->face_count_in_gl_buffer*float_size, hdata);
-    } else {
-        glBufferSubData(GL_ARRAY_BUFFER,
-            gate->offset_into_gl_buffer * float_size,
-            6*10*gate->face_count_in_gl_buffer*float_size, gate_data);
-    }
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
-}
-
-void _gate_toggle_open(DoorMapEntry *gate, int x, int y, int z, GLuint buffer)
-{
-    if (is_open(gate->extra)) {
-        gate->extra &= ~EXTRA_BIT_OPEN;
-    } else {
-        gate->extra |= EXTRA_BIT_OPEN;
-    }
-    set_extra_non_dirty(x, y, z, gate->extra);
-    make_gate_in_buffer_sub_data(buffer, get_float_size(), gate);
-}
-
-void gate_toggle_open(DoorMapEntry *gate, int x, int y,
-    int z, GLuint buffer)
-{
-    _gate_toggle_open(gate, x, y, z, buffer);
-}
-
@@ -11,6 +11,3 @@ void make_fence(
     float x, float y, float z, float n, int w, int shape, int extra,
     int rotate);
 
-void gate_toggle_open(DoorMapEntry *gate, int x, int y,
-    int z, GLuint buffer);
-
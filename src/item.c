@@ -326,6 +326,12 @@ int is_door_material(int w)
     return 0;
 }
 
+int is_dynamic_shape(int shape)
+{
+    shape = ABS(shape);
+    return shape == UPPER_DOOR || shape == LOWER_DOOR || shape == GATE;
+}
+
 int is_control(int w) {
     w = ABS(w);
     return (w & EXTRA_BIT_CONTROL) ? 1 : 0;
@@ -11,7 +11,7 @@
 #include "client.h"
 #include "config.h"
 #include "db.h"
-#include "fence.h"
+#include "dynamic.h"
 #include "item.h"
 #include "local_player.h"
 #include "pg.h"
@@ -55,6 +55,8 @@ void local_player_reset(LocalPlayer *local)
 {
     int i = local->player->id - 1;
     local->flying = 0;
+    local->tick_time = 0;
+    local->collision.valid = 0;
     local->item_index = 0;
     local->typing = GameFocus;
     local->observe1 = 0;
@@ -69,7 +71,7 @@ void local_player_reset(LocalPlayer *local)
     local->undo_block.has_sign = 0;
 
     local->player->name[0] = '\0';
-    local->player->buffer = 0;
+    local->player->instance = -1;
     local->player->texture_index = i;
 
     local->mouse_id = UNASSIGNED;
@@ -1075,25 +1077,13 @@ void set_block_under_crosshair(LocalPlayer *local)
     if (hy2 > 0 && hy2 < 256 && is_obstacle(hw2, 0, 0)) {
         int shape = get_shape(hx2, hy2, hz2);
         int extra = get_extra(hx2, hy2, hz2);
-        if (shape == LOWER_DOOR || shape == UPPER_DOOR) {
+        if (shape == LOWER_DOOR || shape == UPPER_DOOR || shape == GATE) {
             // toggle open/close
-            int p = chunked(hx2);
-            int q = chunked(hz2);
-            Chunk *chunk = find_chunk(p, q);
-            DoorMapEntry *door = door_map_get(&chunk->doors, hx2, hy2, hz2);
-            door_toggle_open(&chunk->doors, door, hx2, hy2, hz2, chunk->buffer);
+            dynamic_block_toggle_open(hx2, hy2, hz2);
             return;
         } else if (is_control(extra)) {
             open_menu(local, local->menu);
             return;
-        } else if (shape == GATE) {
-            // toggle open/close
-            int p = chunked(hx2);
-            int q = chunked(hz2);
-            Chunk *chunk = find_chunk(p, q);
-            DoorMapEntry *gate = door_map_get(&chunk->doors, hx2, hy2, hz2);
-            gate_toggle_open(gate, hx2, hy2, hz2, chunk->buffer);
-            return;
         }
     }
     if (hy > 0 && hy < 256 && is_obstacle(hw, 0, 0)) {
@@ -1210,27 +1200,21 @@ void get_motion_vector(int flying, float sz, float sx, float rx, float ry,
     }
 }
 
-void handle_movement(double dt, LocalPlayer *local)
+// Move the player on by one physics tick of PHYSICS_TICK seconds.
+static void movement_tick(LocalPlayer *local, State *s)
 {
-    State *s = &local->player->state;
+    float dt = PHYSICS_TICK;
     int stay_in_crouch = 0;
     float sz = 0;
     float sx = 0;
+    // Look at the world as it is this tick.
+    local->collision.valid = 0;
     if (local->typing == GameFocus) {
-        float m1 = dt * local->view_speed_left_right;
-        float m2 = dt * local->view_speed_up_down;
-
         // Walking
         if (local->forward_is_pressed) sz = -local->movement_speed_forward_back;
         if (local->back_is_pressed) sz = local->movement_speed_forward_back;
         if (local->left_is_pressed) sx = -local->movement_speed_left_right;
         if (local->right_is_pressed) sx = local->movement_speed_left_right;
-
-        // View direction
-        if (local->view_left_is_pressed) s->rx -= m1;
-        if (local->view_right_is_pressed) s->rx += m1;
-        if (local->view_up_is_pressed) s->ry += m2;
-        if (local->view_down_is_pressed) s->ry -= m2;
     }
     float vx, vy, vz;
     get_motion_vector(local->flying, sz, sx, s->rx, s->ry, &vx, &vy, &vz);
@@ -1251,16 +1235,13 @@ void handle_movement(double dt, LocalPlayer *local)
             }
         } else {
             // If previously in a crouch, move to standing position
-            int block_under_player_head = get_block(
-                roundf(s->x), s->y, roundf(s->z));
-            int block_above_player_head = get_block(
-                roundf(s->x), s->y + 2, roundf(s->z));
-            int shape = get_shape(roundf(s->x), s->y, roundf(s->z));
-            int extra = get_extra(roundf(s->x), s->y, roundf(s->z));
-            if (is_obstacle(block_under_player_head, shape, extra)) {
-                shape = get_shape(roundf(s->x), s->y + 2, roundf(s->z));
-                extra = get_extra(roundf(s->x), s->y + 2, roundf(s->z));
-                if (is_obstacle(block_above_player_head, shape, extra)) {
+            CollisionCache *cache = &local->collision;
+            int hx = roundf(s->x);
+            int hy = s->y;
+            int hz = roundf(s->z);
+            update_collision_cache(cache, s->x, s->y, s->z);
+            if (collision_obstacle(cache, hx, hy, hz)) {
+                if (collision_obstacle(cache, hx, hy + 2, hz)) {
                     stay_in_crouch = 1;
                 } else {
                     local->dy = 8;
@@ -1278,7 +1259,7 @@ void handle_movement(double dt, LocalPlayer *local)
         powf(vx * speed, 2) +
         powf(vy * speed + ABS(local->dy) * 2, 2) +
         powf(vz * speed, 2)) * dt * 8);
-    int step = MAX(8, estimate);
+    int step = MAX(PHYSICS_MIN_STEPS, estimate);
     float ut = dt / step;
     vx = vx * ut * speed;
     vy = vy * ut * speed;
@@ -1300,13 +1281,59 @@ void handle_movement(double dt, LocalPlayer *local)
         if (local->crouch_is_pressed || stay_in_crouch) {
             player_min_height = player_couching_height;
         }
-        if (collide(player_min_height, &s->x, &s->y, &s->z, &local->dy)) {
+        if (collide(&local->collision, player_min_height,
+                    &s->x, &s->y, &s->z, &local->dy)) {
             local->dy = 0;
         }
     }
     if (s->y < 0) {
         s->y = highest_block(s->x, s->z) + 2;
+        // Do not show the fall back up.
+        local->tick_previous = *s;
+    }
+}
+
+// Run the physics ticks due in the dt seconds since the last frame and show
+// the player between the last two of them, so movement does not depend on
+// the frame rate.
+void handle_movement(double dt, LocalPlayer *local)
+{
+    State *s = &local->player->state;
+    if (local->typing == GameFocus) {
+        float m1 = dt * local->view_speed_left_right;
+        float m2 = dt * local->view_speed_up_down;
+
+        // View direction
+        if (local->view_left_is_pressed) s->rx -= m1;
+        if (local->view_right_is_pressed) s->rx += m1;
+        if (local->view_up_is_pressed) s->ry += m2;
+        if (local->view_down_is_pressed) s->ry -= m2;
+    }
+    // Start again from where the player is shown if something else has
+    // moved them, like a teleport or a script.
+    if (s->x != local->shown_x || s->y != local->shown_y ||
+        s->z != local->shown_z) {
+        local->tick_current = *s;
+        local->tick_previous = *s;
+        local->tick_time = 0;
+    }
+    local->tick_time += dt;
+    while (local->tick_time >= PHYSICS_TICK) {
+        local->tick_time -= PHYSICS_TICK;
+        local->tick_previous = local->tick_current;
+        local->tick_current.rx = s->rx;
+        local->tick_current.ry = s->ry;
+        movement_tick(local, &local->tick_current);
     }
+    float t = local->tick_time / PHYSICS_TICK;
+    State *a = &local->tick_previous;
+    State *b = &local->tick_current;
+    s->x = a->x + (b->x - a->x) * t;
+    s->y = a->y + (b->y - a->y) * t;
+    s->z = a->z + (b->z - a->z) * t;
+    local->shown_x = s->x;
+    local->shown_y = s->y;
+    local->shown_z = s->z;
 }
 
 void open_on_screen_keyboard(LocalPlayer* local)
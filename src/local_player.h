@@ -1,4 +1,5 @@
 #pragma once
+#include "chunks.h"
 #include "player.h"
 #include "pwlua.h"
 #include "sign.h"
@@ -19,6 +20,11 @@
 #define MAX_GAMEPAD_BUTTONS 16
 #define MAX_GAMEPAD_AXES 6
 
+// Player movement is simulated at a fixed rate, in at least
+// PHYSICS_MIN_STEPS collision steps a tick.
+#define PHYSICS_TICK (1.0 / 60)
+#define PHYSICS_MIN_STEPS 8
+
 typedef struct {
     char lines[MAX_HISTORY_SIZE][MAX_TEXT_LENGTH];
     int size;
@@ -80,6 +86,13 @@ typedef struct LocalPlayer {
     int item_index;
     int flying;
     float dy;
+    // Movement is simulated in fixed ticks, the player is shown part way
+    // from the position at the previous tick to the current one.
+    float tick_time;
+    State tick_previous;
+    State tick_current;
+    float shown_x, shown_y, shown_z;
+    CollisionCache collision;
     char messages[MAX_MESSAGES][MAX_TEXT_LENGTH];
     int message_index;
 
@@ -435,6 +435,9 @@ void parse_command(LocalPlayer *local, const char *buffer, int forward) {
     else if (sscanf(buffer, "/show-player-names %d", &int_option) == 1) {
         config->show_player_names = int_option;
     }
+    else if (sscanf(buffer, "/show-profile %d", &int_option) == 1) {
+        config->show_profile = int_option;
+    }
     else if (sscanf(buffer, "/show-trees %d", &int_option) == 1) {
         if (!is_online()) {
             set_show_trees(int_option);
@@ -543,6 +546,11 @@ void parse_command(LocalPlayer *local, const char *buffer, int forward) {
             pw_set_time(int_option);
         }
     }
+    else if (sscanf(buffer, "/trace %d", &int_option) == 1) {
+        if (int_option > 0) {
+            start_trace(int_option);
+        }
+    }
     else if (sscanf(buffer, "/bind %512s", path) == 1) {
         action_apply_bindings(local, path);
     }
@@ -0,0 +1,355 @@
+#include <stdlib.h>
+#include <string.h>
+#include "chunk.h"
+#include "chunks.h"
+#include "cube.h"
+#include "item.h"
+#include "lod.h"
+#include "map.h"
+#include "util.h"
+
+#define LOD_GRID_SIZE (LOD_MAX_RADIUS * 2 + 1)
+
+LodChunk lod_chunks[MAX_LOD_CHUNKS];
+
+void lod_reset(void)
+{
+    for (int i = 0; i < MAX_LOD_CHUNKS; i++) {
+        vertex_pool_free(&lod_chunks[i].range);
+    }
+    memset(lod_chunks, 0, sizeof(lod_chunks));
+}
+
+// Pick the furthest radius up to the requested one (or twice the render
+// radius when auto picking) whose ring of far chunks fits in the budget.
+// Returns 0 when there is no room for far chunks.
+int lod_pick_radius(int render_radius, int requested)
+{
+    if (requested == 0) {
+        return 0;
+    }
+    int radius = requested;
+    if (requested == AUTO_PICK_RADIUS) {
+        radius = MAX(render_radius * 2, render_radius + 4);
+    }
+    radius = MIN(radius, LOD_MAX_RADIUS);
+    int inner = render_radius * 2 + 1;
+    while (radius > render_radius) {
+        int outer = radius * 2 + 1;
+        if (outer * outer - inner * inner <= MAX_LOD_CHUNKS) {
+            break;
+        }
+        radius--;
+    }
+    return radius > render_radius ? radius : 0;
+}
+
+static void free_lod(LodChunk *lod)
+{
+    vertex_pool_free(&lod->range);
+    lod->state = LOD_EMPTY;
+    lod->faces = 0;
+}
+
+// Free the far chunks no view needs any more: those beyond every view's lod
+// radius, and those inside the render radius of every view that now has the
+// full chunk meshed to take their place.
+void lod_update(View *views, int view_count)
+{
+    for (int i = 0; i < MAX_LOD_CHUNKS; i++) {
+        LodChunk *lod = lod_chunks + i;
+        if (lod->state == LOD_EMPTY) {
+            continue;
+        }
+        int near = 0;
+        for (int v = 0; v < view_count; v++) {
+            int distance = MAX(ABS(lod->p - views[v].p),
+                               ABS(lod->q - views[v].q));
+            if (distance <= views[v].render_radius) {
+                near = 1;
+            }
+        }
+        lod->covered = 0;
+        if (near) {
+            Chunk *chunk = find_chunk(lod->p, lod->q);
+            lod->covered = chunk && chunk->meshed;
+        }
+        int wanted = 0;
+        for (int v = 0; v < view_count; v++) {
+            View *view = views + v;
+            int distance = MAX(ABS(lod->p - view->p), ABS(lod->q - view->q));
+            if (distance <= view->lod_radius &&
+                (distance > view->render_radius || !lod->covered)) {
+                wanted = 1;
+            }
+        }
+        if (!wanted) {
+            free_lod(lod);
+        }
+    }
+}
+
+static void lod_worker(Worker *worker, int p, int q)
+{
+    WorkerItem *item = &worker->item;
+    Chunk *chunk = find_chunk(p, q);
+    item->p = p;
+    item->q = q;
+    item->lod = 1;
+    item->load = !chunk;
+    item->dirty_sections = 0;
+    for (int a = 0; a < 3; a++) {
+        for (int b = 0; b < 3; b++) {
+            item->block_maps[a][b] = 0;
+            item->extra_maps[a][b] = 0;
+            item->light_maps[a][b] = 0;
+            item->shape_maps[a][b] = 0;
+            item->transform_maps[a][b] = 0;
+        }
+    }
+    Map *block_map = malloc(sizeof(Map));
+    item->block_maps[1][1] = block_map;
+    if (chunk) {
+        // Already loaded (but beyond the render radius), only the blocks
+        // are needed to find the height of each column.
+        map_copy(block_map, &chunk->map);
+    } else {
+        int dx = p * CHUNK_SIZE - 1;
+        int dz = q * CHUNK_SIZE - 1;
+        Map *extra_map = malloc(sizeof(Map));
+        Map *light_map = malloc(sizeof(Map));
+        Map *shape_map = malloc(sizeof(Map));
+        Map *transform_map = malloc(sizeof(Map));
+        map_alloc(block_map, dx, 0, dz, 0x3fff);
+        map_alloc(extra_map, dx, 0, dz, 0xf);
+        map_alloc(light_map, dx, 0, dz, 0xf);
+        map_alloc(shape_map, dx, 0, dz, 0xf);
+        map_alloc(transform_map, dx, 0, dz, 0xf);
+        item->extra_maps[1][1] = extra_map;
+        item->light_maps[1][1] = light_map;
+        item->shape_maps[1][1] = shape_map;
+        item->transform_maps[1][1] = transform_map;
+    }
+    worker->state = WORKER_BUSY;
+    cnd_signal(&worker->cnd);
+}
+
+// Give each idle worker the nearest missing far chunk, visible ones first.
+// Returns the number of workers given work.
+int lod_ensure_workers(View *views, int view_count, Worker *workers,
+    int worker_count)
+{
+    static char present[LOD_GRID_SIZE][LOD_GRID_SIZE];
+    int dispatched = 0;
+    for (int i = 0; i < worker_count; i++) {
+        Worker *worker = workers + i;
+        if (worker->state != WORKER_IDLE) {
+            continue;
+        }
+        LodChunk *slot = NULL;
+        for (int j = 0; j < MAX_LOD_CHUNKS; j++) {
+            if (lod_chunks[j].state == LOD_EMPTY) {
+                slot = lod_chunks + j;
+                break;
+            }
+        }
+        if (!slot) {
+            break;
+        }
+        int best_score = 0x0fffffff;
+        int best_a = 0;
+        int best_b = 0;
+        for (int v = 0; v < view_count; v++) {
+            View *view = views + v;
+            int r = view->lod_radius;
+            if (r <= view->render_radius) {
+                continue;
+            }
+            memset(present, 0, sizeof(present));
+            for (int j = 0; j < MAX_LOD_CHUNKS; j++) {
+                LodChunk *lod = lod_chunks + j;
+                int dp = lod->p - view->p;
+                int dq = lod->q - view->q;
+                if (lod->state != LOD_EMPTY && ABS(dp) <= r && ABS(dq) <= r) {
+                    present[dp + r][dq + r] = 1;
+                }
+            }
+            for (int dp = -r; dp <= r; dp++) {
+                for (int dq = -r; dq <= r; dq++) {
+                    int distance = MAX(ABS(dp), ABS(dq));
+                    if (distance <= view->render_radius ||
+                        present[dp + r][dq + r]) {
+                        continue;
+                    }
+                    int a = view->p + dp;
+                    int b = view->q + dq;
+                    int invisible = !chunk_visible(
+                        view->planes, a, b, 0, 256, view->ortho);
+                    int score = (invisible << 24) | distance;
+                    if (score < best_score) {
+                        best_score = score;
+                        best_a = a;
+                        best_b = b;
+                    }
+                }
+            }
+        }
+        if (best_score == 0x0fffffff) {
+            break;
+        }
+        slot->p = best_a;
+        slot->q = best_b;
+        slot->state = LOD_PENDING;
+        slot->covered = 0;
+        lod_worker(worker, best_a, best_b);
+        dispatched++;
+    }
+    return dispatched;
+}
+
+// Build the far mesh of the chunk from the highest block of each column,
+// ignoring plants and clouds. Runs on a worker thread.
+void compute_lod(WorkerItem *item)
+{
+    Map *block_map = item->block_maps[1][1];
+    int top[CHUNK_SIZE][CHUNK_SIZE] = {{0}};
+    int top_w[CHUNK_SIZE][CHUNK_SIZE] = {{0}};
+    MAP_FOR_EACH(block_map, ex, ey, ez, ew) {
+        int x = ex - block_map->dx - 1;
+        int z = ez - block_map->dz - 1;
+        if (x < 0 || z < 0 || x >= CHUNK_SIZE || z >= CHUNK_SIZE) {
+            continue;
+        }
+        if (ew <= 0 || ew == CLOUD || is_plant(ew)) {
+            continue;
+        }
+        if (ey + 1 > top[x][z]) {
+            top[x][z] = ey + 1;
+            top_w[x][z] = ew;
+        }
+    } END_MAP_FOR_EACH;
+
+    // Each cell is as high as its highest column and uses that column's
+    // block for its texture.
+    int height[LOD_CELLS][LOD_CELLS] = {{0}};
+    int tile[LOD_CELLS][LOD_CELLS] = {{0}};
+    for (int a = 0; a < LOD_CELLS; a++) {
+        for (int b = 0; b < LOD_CELLS; b++) {
+            for (int dx = 0; dx < LOD_CELL_SIZE; dx++) {
+                for (int dz = 0; dz < LOD_CELL_SIZE; dz++) {
+                    int x = a * LOD_CELL_SIZE + dx;
+                    int z = b * LOD_CELL_SIZE + dz;
+                    if (top[x][z] > height[a][b]) {
+                        height[a][b] = top[x][z];
+                        tile[a][b] = top_w[x][z];
+                    }
+                }
+            }
+        }
+    }
+
+    // Sides are drawn down to the neighbouring cell, or to the bottom of
+    // the world on the chunk's edges where the neighbour is not known.
+    static const int sides[4][2] = {{-1, 0}, {1, 0}, {0, -1}, {0, 1}};
+    int below[LOD_CELLS][LOD_CELLS][4];
+    int faces = 0;
+    for (int a = 0; a < LOD_CELLS; a++) {
+        for (int b = 0; b < LOD_CELLS; b++) {
+            if (height[a][b] == 0) {
+                continue;
+            }
+            faces++;
+            for (int i = 0; i < 4; i++) {
+                int na = a + sides[i][0];
+                int nb = b + sides[i][1];
+                int nh = 0;
+                if (na >= 0 && nb >= 0 && na < LOD_CELLS && nb < LOD_CELLS) {
+                    nh = height[na][nb];
+                }
+                below[a][b][i] = nh;
+                if (nh < height[a][b]) {
+                    faces++;
+                }
+            }
+        }
+    }
+
+    SectionMesh *mesh = &item->lod_mesh;
+    mesh->faces = faces;
+    mesh->miny = 256;
+    mesh->maxy = 0;
+    mesh->data = NULL;
+    if (faces == 0) {
+        return;
+    }
+    GLfloat *data = malloc_faces(10, faces, sizeof(GLfloat));
+    float ao[6][4] = {{0}};
+    float light[6][4] = {{0}};
+    int offset = 0;
+    for (int a = 0; a < LOD_CELLS; a++) {
+        for (int b = 0; b < LOD_CELLS; b++) {
+            int h = height[a][b];
+            if (h == 0) {
+                continue;
+            }
+            int w = tile[a][b];
+            // Block coordinates local to the map, column x is at x + 1.
+            float x0 = a * LOD_CELL_SIZE + 0.5;
+            float z0 = b * LOD_CELL_SIZE + 0.5;
+            float x1 = x0 + LOD_CELL_SIZE;
+            float z1 = z0 + LOD_CELL_SIZE;
+            make_box(data + offset, ao, light, 0, 0, 1, 0, 0, 0,
+                x0, h - 1.5, z0, x1, h - 0.5, z1, w);
+            offset += 60;
+            mesh->maxy = MAX(mesh->maxy, h);
+            for (int i = 0; i < 4; i++) {
+                int nh = below[a][b][i];
+                if (nh >= h) {
+                    continue;
+                }
+                make_box(data + offset, ao, light,
+                    i == 0, i == 1, 0, 0, i == 2, i == 3,
+                    x0, nh - 0.5, z0, x1, h - 0.5, z1, w);
+                offset += 60;
+                mesh->miny = MIN(mesh->miny, nh);
+            }
+            mesh->miny = MIN(mesh->miny, h - 1);
+        }
+    }
+    if (config->use_hfloat) {
+        hfloat *hdata = malloc_faces(10, faces, sizeof(hfloat));
+        for (int j = 0; j < (6 * 10 * faces); j++) {
+            hdata[j] = float_to_hfloat(data + j);
+        }
+        free(data);
+        mesh->data = hdata;
+    } else {
+        mesh->data = data;
+    }
+}
+
+// Upload a finished far chunk, results for chunks no longer wanted are
+// dropped.
+void generate_lod(WorkerItem *item, size_t float_size)
+{
+    SectionMesh *mesh = &item->lod_mesh;
+    LodChunk *lod = NULL;
+    for (int i = 0; i < MAX_LOD_CHUNKS; i++) {
+        LodChunk *other = lod_chunks + i;
+        if (other->state == LOD_PENDING &&
+            other->p == item->p && other->q == item->q) {
+            lod = other;
+            break;
+        }
+    }
+    if (!lod) {
+        free(mesh->data);
+        return;
+    }
+    vertex_pool_alloc(&lod->range, mesh->faces, mesh->data, float_size);
+    free(mesh->data);
+    lod->faces = mesh->faces;
+    lod->miny = mesh->miny;
+    lod->maxy = mesh->maxy;
+    lod->state = LOD_READY;
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <GLES2/gl2.h>
+#include "chunk.h"
+#include "config.h"
+#include "view.h"
+
+// Beyond the render radius the world is drawn as a coarse height field. Each
+// chunk is split into LOD_CELLS x LOD_CELLS columns of blocks and each column
+// is drawn as a single box as high as its highest block, showing only its
+// top and the sides that stand above its neighbours.
+#define LOD_CELLS 4
+#define LOD_CELL_SIZE (CHUNK_SIZE / LOD_CELLS)
+#define LOD_MAX_FACES (LOD_CELLS * LOD_CELLS * 5)
+#define LOD_MAX_RADIUS 32
+
+// The far chunks share a fixed amount of GPU memory, enough for this many
+// chunks at their largest.
+#define MAX_LOD_CHUNKS ((int)(LOD_MEMORY_BUDGET / \
+    (LOD_MAX_FACES * 6 * 10 * sizeof(GLfloat))))
+
+#define LOD_EMPTY 0
+#define LOD_PENDING 1
+#define LOD_READY 2
+
+typedef struct {
+    int p;
+    int q;
+    int state;
+    int covered;
+    int faces;
+    int miny;
+    int maxy;
+    VertexRange range;
+} LodChunk;
+
+extern LodChunk lod_chunks[MAX_LOD_CHUNKS];
+
+void lod_reset(void);
+int lod_pick_radius(int render_radius, int requested);
+void lod_update(View *views, int view_count);
+int lod_ensure_workers(View *views, int view_count, Worker *workers,
+    int worker_count);
+void compute_lod(WorkerItem *item);
+void generate_lod(WorkerItem *item, size_t float_size);
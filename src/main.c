@@ -4,17 +4,24 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include "benchmark.h"
 #include "chunks.h"
 #include "clients.h"
 #include "db.h"
 #include "fence.h"
 #include "local_players.h"
 #include "pg.h"
+#include "pool.h"
+#include "profile.h"
 #include "pw.h"
 #include "pwlua_startup.h"
 #include "pwlua_standalone.h"
 #include "render.h"
+#include "sign_mesh.h"
+#include "snapshot.h"
+#include "upload.h"
 #include "user_input.h"
+#include "worldgen_cache.h"
 #include "x11_event_handler.h"
 
 #define STB_DS_IMPLEMENTATION
@@ -27,10 +34,13 @@ int main(int argc, char **argv)
     int override_worldgen_from_command_line = 0;
     // INITIALIZATION //
     init_data_dir();
+    pool_init();
     srand(time(NULL));
     rand();
     reset_config();
     parse_startup_config(argc, argv);
+    worldgen_cache_init();
+    sign_mesh_init();
     if (strlen(config->worldgen_path) > 0) {
         set_worldgen(config->worldgen_path);
         override_worldgen_from_command_line = 1;
@@ -47,6 +57,34 @@ int main(int argc, char **argv)
         return EXIT_SUCCESS;
     }
 
+    if (config->pregenerate) {
+        int *area = config->pregenerate_area;
+        if (pregenerate_chunks(area[0], area[1], area[2], area[3])) {
+            return EXIT_FAILURE;
+        }
+        return EXIT_SUCCESS;
+    }
+
+    if (config->benchmark_noise) {
+        if (config->benchmark_noise > 0) {
+            benchmark_noise(config->benchmark_noise);
+        } else {
+            printf("Invalid chunk count: %d\n", config->benchmark_noise);
+        }
+        return EXIT_SUCCESS;
+    }
+
+    if (config->benchmark_map) {
+        if (config->benchmark_map > 0) {
+            if (benchmark_map(config->benchmark_map)) {
+                return EXIT_FAILURE;
+            }
+        } else {
+            printf("Invalid operation count: %d\n", config->benchmark_map);
+        }
+        return EXIT_SUCCESS;
+    }
+
     if (config->lua_standalone) {
         pwlua_standalone_REPL();
         return EXIT_SUCCESS;  //TODO: exit status of lua instance
@@ -79,6 +117,7 @@ int main(int argc, char **argv)
         pg_fullscreen(1);
     }
     set_view_radius(config->view, config->delete_radius);
+    upload_set_budget((size_t)config->upload_budget * 1024);
 
     if (config->ignore_gamepad == 0) {
         pg_set_joystick_button_handler(*handle_joystick_button);
@@ -87,6 +126,9 @@ int main(int argc, char **argv)
 
     user_input_init();
     render_init();
+    if (config->trace > 0) {
+        start_trace(config->trace);
+    }
 
     // OUTER LOOP //
     int running = 1;
@@ -171,6 +213,8 @@ int main(int argc, char **argv)
                 memset(&fps, 0, sizeof(fps));
             }
             update_fps(&fps);
+            profile_frame();
+            profile_count(PROFILE_DB_BACKLOG, db_worker_backlog());
             double now = pg_get_time();
             double dt = now - previous;
             dt = MIN(dt, 0.2);
@@ -178,11 +222,16 @@ int main(int argc, char **argv)
             previous = now;
 
             // DRAIN EDIT QUEUE //
-            drain_edit_queue(100000, 0.005, now);
+            double start = profile_begin();
+            drain_edit_queue(100000, 0.005);
+            snapshot_update();
+            profile_end(PROFILE_EDIT_QUEUE, start);
 
+            pwlua_wake_waiting();
             pwlua_remove_closed_threads();
 
             // HANDLE MOVEMENT //
+            start = profile_begin();
             for (int i=0; i<MAX_LOCAL_PLAYERS; i++) {
                 LocalPlayer *local = &local_players[i];
                 if (local->player->is_active) {
@@ -192,13 +241,16 @@ int main(int argc, char **argv)
 
             // HANDLE JOYSTICK INPUT //
             pg_poll_joystick_events();
+            profile_end(PROFILE_INPUT, start);
 
             // HANDLE DATA FROM SERVER //
+            start = profile_begin();
             char *buffer = client_recv();
             if (buffer) {
                 parse_buffer(buffer);
                 free(buffer);
             }
+            profile_end(PROFILE_NETWORK, start);
 
             // FLUSH DATABASE //
             if (now - last_commit > COMMIT_INTERVAL) {
@@ -220,16 +272,10 @@ int main(int argc, char **argv)
             }
 
             // PREPARE TO RENDER //
-            delete_chunks(get_delete_radius());
-            for (int i=0; i<MAX_LOCAL_PLAYERS; i++) {
-                Player *player = local_players[i].player;
-                if (player->is_active) {
-                    State *s = &player->state;
-                    del_buffer(player->buffer);
-                    player->buffer = gen_player_buffer(s->x, s->y, s->z, s->rx,
-                        s->ry, player->texture_index);
-                }
-            }
+            start = profile_begin();
+            update_view_radius();
+            delete_chunks(get_delete_radius(), get_create_radius());
+            profile_end(PROFILE_DELETE_CHUNKS, start);
             for (int i = 1; i < client_count; i++) {
                 Client *client = clients + i;
                 for (int j = 0; j < MAX_LOCAL_PLAYERS; j++) {
@@ -239,8 +285,13 @@ int main(int argc, char **argv)
                     }
                 }
             }
+            update_player_grid();
+
+            prepare_views();
+            gen_players_buffer();
 
             // RENDER //
+            start = profile_begin();
             glClear(GL_COLOR_BUFFER_BIT);
             glClear(GL_DEPTH_BUFFER_BIT);
             for (int i=0; i<MAX_LOCAL_PLAYERS; i++) {
@@ -249,14 +300,19 @@ int main(int argc, char **argv)
                     render_player_world(local, fps);
                 }
             }
+            profile_end(PROFILE_DRAW, start);
 
 #ifdef DEBUG
             check_gl_error();
 #endif
 
             // SWAP AND POLL //
+            start = profile_begin();
             pg_swap_buffers();
+            profile_end(PROFILE_SWAP, start);
+            start = profile_begin();
             pg_next_event();
+            profile_end(PROFILE_INPUT, start);
             if (check_mode_changed()) {
                 break;
             }
@@ -281,6 +337,7 @@ int main(int argc, char **argv)
         // SHUTDOWN //
         pw_unload_game();
     }
+    profile_trace_stop();
     render_deinit();
     user_input_deinit();
     pw_deinit();
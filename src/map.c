@@ -1,22 +1,42 @@
+#include <limits.h>
 #include <stdlib.h>
 #include <string.h>
 #include "map.h"
+#include "pool.h"
 
-int hash_int(int key) {
-    key = ~key + (key << 15);
-    key = key ^ (key >> 12);
-    key = key + (key << 2);
-    key = key ^ (key >> 4);
-    key = key * 2057;
-    key = key ^ (key >> 16);
-    return key;
+// A map's tables never need cleaning up: linear probing with deletion by
+// backward shift leaves no tombstones behind, so probes only ever walk live
+// entries. A map may grow incrementally, a few slots of the old table at a
+// time on each map_set, with every key in exactly one of the two tables.
+//
+// The key of an entry is its x, y and z relative to the map, packed into the
+// low 24 bits of its value, so a key is hashed with a single multiply and
+// compared with a single compare. With SSE2 or NEON four slots are compared
+// at a time.
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#define MAP_SIMD 1
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define MAP_SIMD 1
+#endif
+
+static inline unsigned int map_key(int x, int y, int z) {
+    MapEntry key;
+    key.e.x = x;
+    key.e.y = y;
+    key.e.z = z;
+    key.e.w = 0;
+    return key.value;
 }
 
-int hash(int x, int y, int z) {
-    x = hash_int(x);
-    y = hash_int(y);
-    z = hash_int(z);
-    return x ^ y ^ z;
+#define KEY_BITS map_key(0xff, 0xff, 0xff)
+
+// Multiply-shift hashing, the top bits of the product depend on every bit
+// of the key. Masks are never 0.
+static inline unsigned int key_slot(unsigned int key, unsigned int mask) {
+    return (key * 2654435769u) >> __builtin_clz(mask);
 }
 
 void map_alloc(Map *map, int dx, int dy, int dz, int mask) {
@@ -25,90 +45,273 @@ void map_alloc(Map *map, int dx, int dy, int dz, int mask) {
     map->dz = dz;
     map->mask = mask;
     map->size = 0;
-    map->data = (MapEntry *)calloc(map->mask + 1, sizeof(MapEntry));
+    map->data = pool_calloc((map->mask + 1) * sizeof(MapEntry));
+    map->old_data = NULL;
+    map->old_mask = 0;
+    map->old_next = 0;
+    map->grow_step = 0;
 }
 
 void map_free(Map *map) {
-    free(map->data);
+    pool_free(map->data, (map->mask + 1) * sizeof(MapEntry));
+    pool_free(map->old_data, (map->old_mask + 1) * sizeof(MapEntry));
+    map->old_data = NULL;
+}
+
+static inline unsigned int home_slot(MapEntry *entry, unsigned int mask) {
+    return key_slot(entry->value & KEY_BITS, mask);
+}
+
+// Put an entry whose key is in neither table into data.
+static void insert_entry(MapEntry *data, unsigned int mask, MapEntry *entry)
+{
+    unsigned int index = home_slot(entry, mask);
+    while (!EMPTY_ENTRY(data + index)) {
+        index = (index + 1) & mask;
+    }
+    data[index] = *entry;
+}
+
+// The slot holding the key, or the empty slot ending its probe.
+static unsigned int find_slot(MapEntry *data, unsigned int mask,
+    unsigned int key)
+{
+    unsigned int index = key_slot(key, mask);
+#ifdef MAP_SIMD
+    // Four slots at a time up to the end of the table, a slot is wanted
+    // when it is empty or holds the key.
+    while (index + 4 <= mask + 1) {
+#if defined(__SSE2__)
+        __m128i v = _mm_loadu_si128((__m128i *)(data + index));
+        __m128i wanted = _mm_or_si128(
+            _mm_cmpeq_epi32(_mm_and_si128(v, _mm_set1_epi32(KEY_BITS)),
+                            _mm_set1_epi32(key)),
+            _mm_cmpeq_epi32(v, _mm_setzero_si128()));
+        int bits = _mm_movemask_ps(_mm_castsi128_ps(wanted));
+        if (bits) {
+            return index + __builtin_ctz(bits);
+        }
+#else
+        uint32x4_t v = vld1q_u32(&data[index].value);
+        uint32x4_t wanted = vorrq_u32(
+            vceqq_u32(vandq_u32(v, vdupq_n_u32(KEY_BITS)), vdupq_n_u32(key)),
+            vceqq_u32(v, vdupq_n_u32(0)));
+        uint32x2_t half = vorr_u32(vget_low_u32(wanted),
+                                   vget_high_u32(wanted));
+        if (vget_lane_u32(vpmax_u32(half, half), 0)) {
+            break;
+        }
+#endif
+        index += 4;
+    }
+    index &= mask;
+#endif
+    MapEntry *entry = data + index;
+    while (!EMPTY_ENTRY(entry) && (entry->value & KEY_BITS) != key) {
+        index = (index + 1) & mask;
+        entry = data + index;
+    }
+    return index;
 }
 
+// Empty the slot and shift back the entries after it that can move closer
+// to their home slots, so no probe crosses an empty slot it should not.
+static void remove_slot(MapEntry *data, unsigned int mask, unsigned int hole)
+{
+    unsigned int index = hole;
+    while (1) {
+        index = (index + 1) & mask;
+        MapEntry *entry = data + index;
+        if (EMPTY_ENTRY(entry)) {
+            break;
+        }
+        // The entry stays when its home is cyclically in (hole, index].
+        unsigned int home = home_slot(entry, mask);
+        int stays = hole <= index ?
+            (home > hole && home <= index) : (home > hole || home <= index);
+        if (!stays) {
+            data[hole] = *entry;
+            hole = index;
+        }
+    }
+    data[hole].value = 0;
+}
+
+// Move up to count slots of the old table into the new one. Removing an
+// entry only shifts entries at or after the slot being moved, so the slots
+// before old_next stay empty.
+static void move_old_slots(Map *map, unsigned int count) {
+    while (map->old_data && count--) {
+        MapEntry *entry = map->old_data + map->old_next;
+        if (EMPTY_ENTRY(entry)) {
+            if (map->old_next++ == map->old_mask) {
+                pool_free(map->old_data,
+                          (map->old_mask + 1) * sizeof(MapEntry));
+                map->old_data = NULL;
+            }
+            continue;
+        }
+        insert_entry(map->data, map->mask, entry);
+        remove_slot(map->old_data, map->old_mask, map->old_next);
+    }
+}
+
+void map_set_grow_step(Map *map, unsigned int step) {
+    map->grow_step = step;
+}
+
+// A copy holds its entries in a single table, smaller than the source's
+// when entries have been deleted since it grew.
 void map_copy(Map *dst, Map *src) {
     dst->dx = src->dx;
     dst->dy = src->dy;
     dst->dz = src->dz;
-    dst->mask = src->mask;
     dst->size = src->size;
-    dst->data = (MapEntry *)calloc(dst->mask + 1, sizeof(MapEntry));
-    memcpy(dst->data, src->data, (dst->mask + 1) * sizeof(MapEntry));
+    dst->old_data = NULL;
+    dst->old_mask = 0;
+    dst->old_next = 0;
+    dst->grow_step = 0;
+    unsigned int mask = src->mask;
+    if (src->size * 8 < mask) {
+        mask = 0xf;
+        while (src->size * 4 > mask) {
+            mask = (mask << 1) | 1;
+        }
+        if (mask > src->mask) {
+            mask = src->mask;
+        }
+    }
+    dst->mask = mask;
+    if (mask == src->mask && !src->old_data) {
+        dst->data = pool_alloc((mask + 1) * sizeof(MapEntry));
+        memcpy(dst->data, src->data, (mask + 1) * sizeof(MapEntry));
+        return;
+    }
+    dst->data = pool_calloc((mask + 1) * sizeof(MapEntry));
+    for (unsigned int i = 0; i <= src->mask; i++) {
+        if (!EMPTY_ENTRY(src->data + i)) {
+            insert_entry(dst->data, mask, src->data + i);
+        }
+    }
+    for (unsigned int i = 0; src->old_data && i <= src->old_mask; i++) {
+        if (!EMPTY_ENTRY(src->old_data + i)) {
+            insert_entry(dst->data, mask, src->old_data + i);
+        }
+    }
 }
 
 int map_set(Map *map, int x, int y, int z, int w) {
-    unsigned int index = hash(x, y, z) & map->mask;
+    if (map->old_data) {
+        move_old_slots(map, map->grow_step);
+    }
     x -= map->dx;
     y -= map->dy;
     z -= map->dz;
-    MapEntry *entry = map->data + index;
-    int overwrite = 0;
-    while (!EMPTY_ENTRY(entry)) {
-        if (entry->e.x == x && entry->e.y == y && entry->e.z == z) {
-            overwrite = 1;
-            break;
+    unsigned int key = map_key(x, y, z);
+    if (map->old_data) {
+        unsigned int index = find_slot(map->old_data, map->old_mask, key);
+        MapEntry *entry = map->old_data + index;
+        if (!EMPTY_ENTRY(entry)) {
+            // Keys that change while growing move to the new table.
+            MapEntry moved = *entry;
+            int old_w = entry->e.w;
+            remove_slot(map->old_data, map->old_mask, index);
+            if (w) {
+                moved.e.w = w;
+                insert_entry(map->data, map->mask, &moved);
+            } else {
+                map->size--;
+            }
+            return old_w != w;
         }
-        index = (index + 1) & map->mask;
-        entry = map->data + index;
     }
-    if (overwrite) {
-        if (entry->e.w != w) {
-            entry->e.w = w;
-            return 1;
+    unsigned int index = find_slot(map->data, map->mask, key);
+    MapEntry *entry = map->data + index;
+    if (!EMPTY_ENTRY(entry)) {
+        if (entry->e.w == w) {
+            return 0;
         }
-    }
-    else if (w) {
-        entry->e.x = x;
-        entry->e.y = y;
-        entry->e.z = z;
-        entry->e.w = w;
-        map->size++;
-        if (map->size * 2 > map->mask) {
-            map_grow(map);
+        if (w) {
+            entry->e.w = w;
+        } else {
+            remove_slot(map->data, map->mask, index);
+            map->size--;
         }
         return 1;
     }
-    return 0;
+    if (!w) {
+        return 0;
+    }
+    entry->value = key;
+    entry->e.w = w;
+    map->size++;
+    if (map->size * 2 > map->mask) {
+        map_grow(map);
+    }
+    return 1;
 }
 
 int map_get(Map *map, int x, int y, int z) {
-    unsigned int index = hash(x, y, z) & map->mask;
     x -= map->dx;
     y -= map->dy;
     z -= map->dz;
     if (x < 0 || x > 255) return 0;
     if (y < 0 || y > 255) return 0;
     if (z < 0 || z > 255) return 0;
-    MapEntry *entry = map->data + index;
-    while (!EMPTY_ENTRY(entry)) {
-        if (entry->e.x == x && entry->e.y == y && entry->e.z == z) {
-            return entry->e.w;
-        }
-        index = (index + 1) & map->mask;
-        entry = map->data + index;
+    unsigned int key = map_key(x, y, z);
+    MapEntry *entry = map->data + find_slot(map->data, map->mask, key);
+    if (EMPTY_ENTRY(entry) && map->old_data) {
+        entry = map->old_data + find_slot(map->old_data, map->old_mask, key);
     }
-    return 0;
+    return EMPTY_ENTRY(entry) ? 0 : entry->e.w;
 }
 
+// Double the table. With a grow step the old table is emptied over the
+// following calls to map_set, otherwise every entry is moved now.
 void map_grow(Map *map) {
-    Map new_map;
-    new_map.dx = map->dx;
-    new_map.dy = map->dy;
-    new_map.dz = map->dz;
-    new_map.mask = (map->mask << 1) | 1;
-    new_map.size = 0;
-    new_map.data = (MapEntry *)calloc(new_map.mask + 1, sizeof(MapEntry));
-    MAP_FOR_EACH(map, ex, ey, ez, ew) {
-        map_set(&new_map, ex, ey, ez, ew);
-    } END_MAP_FOR_EACH;
-    free(map->data);
-    map->mask = new_map.mask;
-    map->size = new_map.size;
-    map->data = new_map.data;
+    if (map->old_data) {
+        move_old_slots(map, UINT_MAX);
+    }
+    MapEntry *old_data = map->data;
+    unsigned int old_mask = map->mask;
+    map->mask = (map->mask << 1) | 1;
+    map->data = pool_calloc((map->mask + 1) * sizeof(MapEntry));
+    if (map->grow_step) {
+        map->old_data = old_data;
+        map->old_mask = old_mask;
+        map->old_next = 0;
+        return;
+    }
+    for (unsigned int i = 0; i <= old_mask; i++) {
+        if (!EMPTY_ENTRY(old_data + i)) {
+            insert_entry(map->data, map->mask, old_data + i);
+        }
+    }
+    pool_free(old_data, (old_mask + 1) * sizeof(MapEntry));
+}
+
+static void add_probes(MapEntry *data, unsigned int mask,
+    MapProbeStats *stats, double *total)
+{
+    for (unsigned int i = 0; data && i <= mask; i++) {
+        if (EMPTY_ENTRY(data + i)) {
+            continue;
+        }
+        unsigned int probe = ((i - home_slot(data + i, mask)) & mask) + 1;
+        *total += probe;
+        if (probe > stats->max_probe) {
+            stats->max_probe = probe;
+        }
+        stats->entries++;
+    }
+}
+
+void map_probe_stats(Map *map, MapProbeStats *stats) {
+    double total = 0;
+    stats->entries = 0;
+    stats->slots = map->mask + 1 + (map->old_data ? map->old_mask + 1 : 0);
+    stats->max_probe = 0;
+    add_probes(map->data, map->mask, stats, &total);
+    add_probes(map->old_data, map->old_mask, stats, &total);
+    stats->mean_probe = stats->entries ? total / stats->entries : 0;
 }
@@ -2,9 +2,15 @@
 
 #define EMPTY_ENTRY(entry) ((entry)->value == 0)
 
+// Entries with w == 0 are deleted rather than stored, so every entry seen
+// has a non zero w. While a map is growing its entries are split between
+// the new table and the old one.
 #define MAP_FOR_EACH(map, ex, ey, ez, ew) \
-    for (unsigned int i = 0; i <= map->mask; i++) { \
-        MapEntry *entry = map->data + i; \
+    for (int each_table = 0; each_table < 2; each_table++) { \
+    MapEntry *each_data = each_table ? map->old_data : map->data; \
+    unsigned int each_mask = each_table ? map->old_mask : map->mask; \
+    for (unsigned int i = 0; each_data && i <= each_mask; i++) { \
+        MapEntry *entry = each_data + i; \
         if (EMPTY_ENTRY(entry)) { \
             continue; \
         } \
@@ -13,7 +19,11 @@
         int ez = entry->e.z + map->dz; \
         int ew = entry->e.w;
 
-#define END_MAP_FOR_EACH }
+#define END_MAP_FOR_EACH }}
+
+// Slots of the old table moved to the new one by each map_set while a map
+// grows incrementally.
+#define MAP_GROW_STEP 64
 
 typedef union {
     unsigned int value;
@@ -32,12 +42,28 @@ typedef struct {
     unsigned int mask;
     unsigned int size;
     MapEntry *data;
+    // The table being emptied into data while growing incrementally, NULL
+    // otherwise, and the next slot of it to move.
+    MapEntry *old_data;
+    unsigned int old_mask;
+    unsigned int old_next;
+    // Old slots moved per map_set, 0 to grow all at once.
+    unsigned int grow_step;
 } Map;
 
+typedef struct {
+    unsigned int entries;
+    unsigned int slots;
+    double mean_probe;  // slots from an entry's home slot to it, plus one
+    unsigned int max_probe;
+} MapProbeStats;
+
 void map_alloc(Map *map, int dx, int dy, int dz, int mask);
 void map_free(Map *map);
 void map_copy(Map *dst, Map *src);
 void map_grow(Map *map);
+void map_set_grow_step(Map *map, unsigned int step);
+void map_probe_stats(Map *map, MapProbeStats *stats);
 int map_set(Map *map, int x, int y, int z, int w);
 int map_get(Map *map, int x, int y, int z);
 
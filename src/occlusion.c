@@ -0,0 +1,245 @@
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include "chunk.h"
+#include "chunks.h"
+#include "occlusion.h"
+#include "util.h"
+
+// Anything closer to the camera than this is never used as an occluder and
+// never culled.
+#define OCCLUSION_NEAR 0.25
+
+typedef struct {
+    float x;
+    float y;
+    float iw;  // 1 / clip space w, larger is closer to the camera
+} ScreenPoint;
+
+typedef struct {
+    float distance;
+    int entry;
+} DrawOrder;
+
+// Inverse depth of the closest occluder covering each pixel, 0 is empty.
+static float depth[OCCLUSION_HEIGHT][OCCLUSION_WIDTH];
+// Room for every section and chunk in the chunk table, order_capacity chunks.
+static DrawOrder *order;
+static char *occluded;
+static int order_capacity;
+
+static int project(float *m, float x, float y, float z, ScreenPoint *out)
+{
+    float cx = m[0] * x + m[4] * y + m[8] * z + m[12];
+    float cy = m[1] * x + m[5] * y + m[9] * z + m[13];
+    float cw = m[3] * x + m[7] * y + m[11] * z + m[15];
+    if (cw < OCCLUSION_NEAR) {
+        return 0;
+    }
+    out->iw = 1 / cw;
+    out->x = (cx * out->iw * 0.5 + 0.5) * OCCLUSION_WIDTH;
+    out->y = (cy * out->iw * 0.5 + 0.5) * OCCLUSION_HEIGHT;
+    return 1;
+}
+
+static void draw_triangle(ScreenPoint *a, ScreenPoint *b, ScreenPoint *c)
+{
+    float area = (b->x - a->x) * (c->y - a->y) - (b->y - a->y) * (c->x - a->x);
+    if (fabsf(area) < 1e-6) {
+        return;
+    }
+    int x0 = MAX(0, (int)floorf(MIN(a->x, MIN(b->x, c->x))));
+    int x1 = MIN(OCCLUSION_WIDTH - 1, (int)ceilf(MAX(a->x, MAX(b->x, c->x))));
+    int y0 = MAX(0, (int)floorf(MIN(a->y, MIN(b->y, c->y))));
+    int y1 = MIN(OCCLUSION_HEIGHT - 1, (int)ceilf(MAX(a->y, MAX(b->y, c->y))));
+    float inv_area = 1 / area;
+    for (int y = y0; y <= y1; y++) {
+        float py = y + 0.5;
+        for (int x = x0; x <= x1; x++) {
+            float px = x + 0.5;
+            float w0 = ((b->x - px) * (c->y - py) - (b->y - py) * (c->x - px))
+                * inv_area;
+            float w1 = ((c->x - px) * (a->y - py) - (c->y - py) * (a->x - px))
+                * inv_area;
+            float w2 = 1 - w0 - w1;
+            if (w0 < 0 || w1 < 0 || w2 < 0) {
+                continue;
+            }
+            float iw = w0 * a->iw + w1 * b->iw + w2 * c->iw;
+            if (iw > depth[y][x]) {
+                depth[y][x] = iw;
+            }
+        }
+    }
+}
+
+static void draw_quad(ScreenPoint *p, int a, int b, int c, int d)
+{
+    draw_triangle(p + a, p + b, p + c);
+    draw_triangle(p + a, p + c, p + d);
+}
+
+// Draw the faces of a solid box that face the camera at (cx, cy, cz).
+static void draw_box(float *m, float cx, float cy, float cz,
+    float x0, float y0, float z0, float x1, float y1, float z1)
+{
+    ScreenPoint p[8];
+    for (int i = 0; i < 8; i++) {
+        float x = (i & 1) ? x1 : x0;
+        float y = (i & 2) ? y1 : y0;
+        float z = (i & 4) ? z1 : z0;
+        if (!project(m, x, y, z, p + i)) {
+            return;
+        }
+    }
+    if (cx < x0) {
+        draw_quad(p, 0, 2, 6, 4);
+    } else if (cx > x1) {
+        draw_quad(p, 1, 3, 7, 5);
+    }
+    if (cy < y0) {
+        draw_quad(p, 0, 1, 5, 4);
+    } else if (cy > y1) {
+        draw_quad(p, 2, 3, 7, 6);
+    }
+    if (cz < z0) {
+        draw_quad(p, 0, 1, 3, 2);
+    } else if (cz > z1) {
+        draw_quad(p, 4, 5, 7, 6);
+    }
+}
+
+// Return 1 if any part of the box could be in front of the occluders drawn
+// so far. The screen rectangle is grown by a pixel to cover the edges of
+// occluders that only partly cover a pixel.
+static int box_visible(float *m,
+    float x0, float y0, float z0, float x1, float y1, float z1)
+{
+    float minx = OCCLUSION_WIDTH;
+    float maxx = 0;
+    float miny = OCCLUSION_HEIGHT;
+    float maxy = 0;
+    float max_iw = 0;
+    for (int i = 0; i < 8; i++) {
+        ScreenPoint p;
+        if (!project(m, (i & 1) ? x1 : x0, (i & 2) ? y1 : y0,
+                     (i & 4) ? z1 : z0, &p)) {
+            return 1;
+        }
+        minx = MIN(minx, p.x);
+        maxx = MAX(maxx, p.x);
+        miny = MIN(miny, p.y);
+        maxy = MAX(maxy, p.y);
+        max_iw = MAX(max_iw, p.iw);
+    }
+    int sx0 = MAX(0, (int)floorf(minx) - 1);
+    int sx1 = MIN(OCCLUSION_WIDTH - 1, (int)floorf(maxx) + 1);
+    int sy0 = MAX(0, (int)floorf(miny) - 1);
+    int sy1 = MIN(OCCLUSION_HEIGHT - 1, (int)floorf(maxy) + 1);
+    if (sx0 > sx1 || sy0 > sy1) {
+        return 1;
+    }
+    for (int y = sy0; y <= sy1; y++) {
+        for (int x = sx0; x <= sx1; x++) {
+            if (depth[y][x] <= max_iw) {
+                return 1;
+            }
+        }
+    }
+    return 0;
+}
+
+static int compare_draw_order(const void *a, const void *b)
+{
+    const DrawOrder *da = (const DrawOrder *)a;
+    const DrawOrder *db = (const DrawOrder *)b;
+    if (da->distance != db->distance) {
+        return (da->distance > db->distance) - (da->distance < db->distance);
+    }
+    return da->entry - db->entry;
+}
+
+static void draw_chunk_occluders(float *m, State *s, Chunk *chunk)
+{
+    for (int a = 0; a < OCCLUDER_CELLS; a++) {
+        for (int b = 0; b < OCCLUDER_CELLS; b++) {
+            int h = chunk->occluders[a][b];
+            if (h == 0) {
+                continue;
+            }
+            float bx = chunk->p * CHUNK_SIZE + a * OCCLUDER_CELL_SIZE - 0.5;
+            float bz = chunk->q * CHUNK_SIZE + b * OCCLUDER_CELL_SIZE - 0.5;
+            draw_box(m, s->x, s->y, s->z,
+                bx, -0.5, bz,
+                bx + OCCLUDER_CELL_SIZE, h - 0.5, bz + OCCLUDER_CELL_SIZE);
+        }
+    }
+}
+
+// Remove the chunk sections hidden behind the solid parts of nearer chunks
+// from the view's draw lists. Chunks are visited front to back, all the
+// sections of a chunk are tested against the depth buffer before the
+// chunk's own occluders are added to it.
+void occlusion_cull(View *view)
+{
+    State *s = &view->player->state;
+    float *m = view->matrix;
+    int count = view->chunk_list_count;
+    view->occluded_faces = 0;
+    if (count == 0) {
+        return;
+    }
+    if (order_capacity < chunk_capacity) {
+        order_capacity = chunk_capacity;
+        order = realloc(order,
+            sizeof(DrawOrder) * chunk_capacity * SECTION_COUNT);
+        occluded = realloc(occluded, chunk_capacity);
+    }
+    memset(depth, 0, sizeof(depth));
+    memset(occluded, 0, chunk_count);
+    for (int i = 0; i < count; i++) {
+        Chunk *chunk = chunks + view->chunk_list[i] / SECTION_COUNT;
+        float dx = chunk->p * CHUNK_SIZE + CHUNK_SIZE / 2 - s->x;
+        float dz = chunk->q * CHUNK_SIZE + CHUNK_SIZE / 2 - s->z;
+        order[i].distance = dx * dx + dz * dz;
+        order[i].entry = view->chunk_list[i];
+    }
+    qsort(order, count, sizeof(DrawOrder), compare_draw_order);
+    view->chunk_list_count = 0;
+    int visible = 0;
+    for (int i = 0; i < count; i++) {
+        int index = order[i].entry / SECTION_COUNT;
+        Chunk *chunk = chunks + index;
+        ChunkSection *section =
+            chunk->sections + order[i].entry % SECTION_COUNT;
+        float x0 = chunk->p * CHUNK_SIZE - 1;
+        float z0 = chunk->q * CHUNK_SIZE - 1;
+        if (box_visible(m, x0, section->miny - 0.5, z0,
+                x0 + CHUNK_SIZE + 1, section->maxy + 0.5,
+                z0 + CHUNK_SIZE + 1)) {
+            view->chunk_list[view->chunk_list_count++] = order[i].entry;
+            visible = 1;
+        } else {
+            view->occluded_faces += section->faces;
+        }
+        if (i + 1 == count || order[i + 1].entry / SECTION_COUNT != index) {
+            if (visible) {
+                draw_chunk_occluders(m, s, chunk);
+            } else {
+                occluded[index] = 1;
+            }
+            visible = 0;
+        }
+    }
+    // Signs on hidden chunks are hidden too, chunks with signs but nothing
+    // in the chunk list are left alone.
+    int sign_count = 0;
+    for (int i = 0; i < view->sign_list_count; i++) {
+        int index = view->sign_list[i];
+        if (occluded[index]) {
+            continue;
+        }
+        view->sign_list[sign_count++] = index;
+    }
+    view->sign_list_count = sign_count;
+}
@@ -0,0 +1,15 @@
+#pragma once
+
+#include "view.h"
+
+// Each chunk is split into OCCLUDER_CELLS x OCCLUDER_CELLS columns of blocks,
+// each column records how many blocks from the bottom of the world up are
+// solid. These solid boxes are drawn into a small CPU depth buffer to hide
+// the chunks behind them.
+#define OCCLUDER_CELLS 4
+#define OCCLUDER_CELL_SIZE (CHUNK_SIZE / OCCLUDER_CELLS)
+
+#define OCCLUSION_WIDTH 128
+#define OCCLUSION_HEIGHT 64
+
+void occlusion_cull(View *view);
@@ -18,7 +18,7 @@ typedef struct Player {
     State state;
     State state1;
     State state2;
-    GLuint buffer;
+    int instance;  // in the frame's players buffer, -1 when not in it
     int texture_index;
     int is_active;
 } Player;
@@ -0,0 +1,141 @@
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include "pool.h"
+#include "tinycthread.h"
+
+typedef struct FreeBlock {
+    struct FreeBlock *next;
+} FreeBlock;
+
+static FreeBlock *free_lists[POOL_CLASSES];
+static mtx_t locks[POOL_CLASSES];
+
+static atomic_long allocations;
+static atomic_long reused;
+static atomic_long frees;
+static atomic_long released;
+static atomic_long in_use;
+static atomic_long free_bytes;
+
+// The size class of size, or -1 when it is too large for the pool.
+static int size_class(size_t size)
+{
+    int c = 0;
+    while (((size_t)1 << (POOL_MIN_SHIFT + c)) < size) {
+        c++;
+        if (c == POOL_CLASSES) {
+            return -1;
+        }
+    }
+    return c;
+}
+
+// Call once before any thread uses the pool.
+void pool_init(void)
+{
+    for (int c = 0; c < POOL_CLASSES; c++) {
+        mtx_init(locks + c, mtx_plain);
+    }
+}
+
+static void lock(int c)
+{
+    mtx_lock(locks + c);
+}
+
+static void unlock(int c)
+{
+    mtx_unlock(locks + c);
+}
+
+// A block of at least size bytes, its contents are undefined.
+void *pool_alloc(size_t size)
+{
+    atomic_fetch_add(&allocations, 1);
+    atomic_fetch_add(&in_use, size);
+    int c = size_class(size);
+    if (c == -1) {
+        return malloc(size);
+    }
+    size_t block_size = (size_t)1 << (POOL_MIN_SHIFT + c);
+    lock(c);
+    FreeBlock *block = free_lists[c];
+    if (block) {
+        free_lists[c] = block->next;
+    }
+    unlock(c);
+    if (block) {
+        atomic_fetch_add(&reused, 1);
+        atomic_fetch_sub(&free_bytes, block_size);
+        return block;
+    }
+    return malloc(block_size);
+}
+
+void *pool_calloc(size_t size)
+{
+    void *ptr = pool_alloc(size);
+    if (ptr) {
+        memset(ptr, 0, size);
+    }
+    return ptr;
+}
+
+// Give back a block from pool_alloc, size must be the size asked for.
+void pool_free(void *ptr, size_t size)
+{
+    if (ptr == NULL) {
+        return;
+    }
+    atomic_fetch_add(&frees, 1);
+    atomic_fetch_sub(&in_use, size);
+    int c = size_class(size);
+    if (c == -1) {
+        atomic_fetch_add(&released, 1);
+        free(ptr);
+        return;
+    }
+    size_t block_size = (size_t)1 << (POOL_MIN_SHIFT + c);
+    if (atomic_fetch_add(&free_bytes, block_size) + block_size >
+        POOL_MAX_FREE) {
+        atomic_fetch_sub(&free_bytes, block_size);
+        atomic_fetch_add(&released, 1);
+        free(ptr);
+        return;
+    }
+    FreeBlock *block = ptr;
+    lock(c);
+    block->next = free_lists[c];
+    free_lists[c] = block;
+    unlock(c);
+}
+
+void pool_stats(PoolStats *stats)
+{
+    stats->allocations = atomic_load(&allocations);
+    stats->reused = atomic_load(&reused);
+    stats->frees = atomic_load(&frees);
+    stats->released = atomic_load(&released);
+    stats->in_use = atomic_load(&in_use);
+    stats->free = atomic_load(&free_bytes);
+}
+
+// Give every block on the free lists back to the C library.
+void pool_trim(void)
+{
+    for (int c = 0; c < POOL_CLASSES; c++) {
+        lock(c);
+        FreeBlock *block = free_lists[c];
+        free_lists[c] = NULL;
+        unlock(c);
+        while (block) {
+            FreeBlock *next = block->next;
+            atomic_fetch_sub(&free_bytes,
+                             (size_t)1 << (POOL_MIN_SHIFT + c));
+            atomic_fetch_add(&released, 1);
+            free(block);
+            block = next;
+        }
+    }
+}
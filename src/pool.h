@@ -0,0 +1,33 @@
+#pragma once
+
+#include <stddef.h>
+
+/*
+ * The hash tables and sign lists of chunks come and go as the player walks,
+ * always in the same few sizes. Their memory is handed out in power of two
+ * size classes, and given back memory is kept on a free list of its class to
+ * be used again instead of being returned to the C library, up to
+ * POOL_MAX_FREE bytes in all. Larger blocks go straight to malloc. Any
+ * thread may use the pool, each size class has a mutex so a thread switched
+ * out while holding it puts the others to sleep instead of spinning.
+ */
+
+#define POOL_MIN_SHIFT 6  // 64 bytes
+#define POOL_CLASSES 16  // up to 2MiB
+#define POOL_MAX_FREE (16 * 1024 * 1024)
+
+typedef struct {
+    long allocations;
+    long reused;  // allocations given a block from a free list
+    long frees;
+    long released;  // frees given back to the C library
+    size_t in_use;  // bytes
+    size_t free;  // bytes kept on the free lists
+} PoolStats;
+
+void pool_init(void);
+void *pool_alloc(size_t size);
+void *pool_calloc(size_t size);
+void pool_free(void *ptr, size_t size);
+void pool_stats(PoolStats *stats);
+void pool_trim(void);
@@ -0,0 +1,270 @@
+#include <stdarg.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include "config.h"
+#include "profile.h"
+#include "util.h"
+
+// An event is a timer that started at time and ran for value seconds, or a
+// new value for (or an amount to add to) a counter.
+typedef struct {
+    int zone;
+    double time;
+    double value;
+} ProfileEvent;
+
+// Only the thread that owns a ring moves its head, only the main thread
+// moves its tail. When the ring is full new events are dropped.
+typedef struct {
+    atomic_uint head;
+    atomic_uint tail;
+    ProfileEvent events[PROFILE_RING_SIZE];
+} ProfileRing;
+
+static ProfileRing rings[MAX_PROFILE_THREADS];
+static atomic_int ring_used[MAX_PROFILE_THREADS];
+static _Thread_local int ring = -1;
+
+static const char *zone_names[PROFILE_ZONE_COUNT] = {
+    "frame", "input", "edit queue", "network", "check workers",
+    "delete chunks", "cull", "draw", "swap", "worker jobs",
+    "db backlog", "edit backlog", "edit latency", "net sent", "net received",
+    "uploaded"
+};
+
+// Only used by the main thread.
+static double totals[PROFILE_ZONE_COUNT];
+static float history[PROFILE_ZONE_COUNT][PROFILE_HISTORY];
+static int history_index;
+static int history_count;
+static double frame_start;
+
+static FILE *trace_file;
+static char trace_path[MAX_PATH_LENGTH];
+static double trace_start;
+static double trace_end;
+static int trace_events;
+
+static int is_timer(int zone)
+{
+    return zone < PROFILE_DB_BACKLOG;
+}
+
+// Counters that hold their last value rather than adding up.
+int profile_is_level(int zone)
+{
+    return zone >= PROFILE_DB_BACKLOG && zone <= PROFILE_EDIT_LATENCY;
+}
+
+static int thread_ring(void)
+{
+    if (ring == -1) {
+        for (int i = 0; i < MAX_PROFILE_THREADS; i++) {
+            if (atomic_exchange(&ring_used[i], 1) == 0) {
+                ring = i;
+                return ring;
+            }
+        }
+        printf("Too many threads to profile\n");
+        ring = -2;
+    }
+    return ring;
+}
+
+static void record(int zone, double time, double value)
+{
+    int i = thread_ring();
+    if (i < 0) {
+        return;
+    }
+    ProfileRing *r = rings + i;
+    unsigned int head = atomic_load_explicit(&r->head, memory_order_relaxed);
+    unsigned int tail = atomic_load_explicit(&r->tail, memory_order_acquire);
+    if (head - tail >= PROFILE_RING_SIZE) {
+        return;
+    }
+    ProfileEvent *e = r->events + head % PROFILE_RING_SIZE;
+    e->zone = zone;
+    e->time = time;
+    e->value = value;
+    atomic_store_explicit(&r->head, head + 1, memory_order_release);
+}
+
+double profile_begin(void)
+{
+    return monotonic_seconds();
+}
+
+void profile_end(int zone, double start)
+{
+    record(zone, start, profile_begin() - start);
+}
+
+void profile_scope_end(ProfileScope *scope)
+{
+    profile_end(scope->zone, scope->start);
+}
+
+void profile_count(int zone, double value)
+{
+    record(zone, profile_begin(), value);
+}
+
+void profile_add(int zone, double amount)
+{
+    record(zone, profile_begin(), amount);
+}
+
+// Give the thread's ring to the next thread to start, anything left in it
+// is still collected.
+void profile_thread_exit(void)
+{
+    if (ring >= 0) {
+        atomic_store(&ring_used[ring], 0);
+    }
+    ring = -1;
+}
+
+static void trace_event(const char *format, ...)
+    __attribute__((format(printf, 1, 2)));
+
+static void trace_event(const char *format, ...)
+{
+    va_list args;
+    va_start(args, format);
+    fputs(trace_events ? ",\n" : "\n", trace_file);
+    vfprintf(trace_file, format, args);
+    va_end(args);
+    trace_events++;
+}
+
+static void trace_span(int zone, int tid, double start, double duration)
+{
+    if (start < trace_start) {
+        return;
+    }
+    trace_event("{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,"
+        "\"ts\":%.3f,\"dur\":%.3f}", zone_names[zone], tid,
+        (start - trace_start) * 1e6, duration * 1e6);
+}
+
+static void trace_counter(int zone, double time, double value)
+{
+    trace_event("{\"name\":\"%s\",\"ph\":\"C\",\"pid\":1,"
+        "\"ts\":%.3f,\"args\":{\"value\":%g}}", zone_names[zone],
+        (time - trace_start) * 1e6, value);
+}
+
+static void drain(int i)
+{
+    ProfileRing *r = rings + i;
+    unsigned int tail = atomic_load_explicit(&r->tail, memory_order_relaxed);
+    unsigned int head = atomic_load_explicit(&r->head, memory_order_acquire);
+    for (; tail != head; tail++) {
+        ProfileEvent *e = r->events + tail % PROFILE_RING_SIZE;
+        if (profile_is_level(e->zone)) {
+            totals[e->zone] = e->value;
+        } else {
+            totals[e->zone] += e->value;
+        }
+        if (trace_file && is_timer(e->zone)) {
+            trace_span(e->zone, i, e->time, e->value);
+        }
+    }
+    atomic_store_explicit(&r->tail, tail, memory_order_release);
+}
+
+// Collect the events from every thread into the history, called by the main
+// thread at the start of each frame.
+void profile_frame(void)
+{
+    double now = profile_begin();
+    if (frame_start == 0) {
+        frame_start = now;
+    }
+    totals[PROFILE_FRAME] = now - frame_start;
+    for (int i = 0; i < MAX_PROFILE_THREADS; i++) {
+        drain(i);
+    }
+    if (trace_file) {
+        trace_span(PROFILE_FRAME, thread_ring(), frame_start,
+            totals[PROFILE_FRAME]);
+        for (int zone = PROFILE_DB_BACKLOG; zone < PROFILE_ZONE_COUNT;
+             zone++) {
+            trace_counter(zone, frame_start, totals[zone]);
+        }
+    }
+    for (int zone = 0; zone < PROFILE_ZONE_COUNT; zone++) {
+        history[zone][history_index] =
+            is_timer(zone) ? totals[zone] * 1000 : totals[zone];
+        if (!profile_is_level(zone)) {
+            totals[zone] = 0;
+        }
+    }
+    history_index = (history_index + 1) % PROFILE_HISTORY;
+    if (history_count < PROFILE_HISTORY) {
+        history_count++;
+    }
+    frame_start = now;
+    if (trace_file && now >= trace_end) {
+        profile_trace_stop();
+    }
+}
+
+const char *profile_zone_name(int zone)
+{
+    return zone_names[zone];
+}
+
+// The last PROFILE_HISTORY frames of a zone, oldest first. Timers are in
+// milliseconds.
+void profile_get_history(int zone, float *values)
+{
+    for (int i = 0; i < PROFILE_HISTORY; i++) {
+        values[i] = history[zone][(history_index + i) % PROFILE_HISTORY];
+    }
+}
+
+float profile_average(int zone)
+{
+    if (history_count == 0) {
+        return 0;
+    }
+    float total = 0;
+    for (int i = 0; i < history_count; i++) {
+        total += history[zone][(history_index - 1 - i + PROFILE_HISTORY) %
+                               PROFILE_HISTORY];
+    }
+    return total / history_count;
+}
+
+// Write the events of the next seconds to a Chrome trace file at path.
+int profile_trace_start(const char *path, double seconds)
+{
+    profile_trace_stop();
+    trace_file = fopen(path, "w");
+    if (trace_file == NULL) {
+        printf("Cannot write trace to %s\n", path);
+        return 0;
+    }
+    snprintf(trace_path, MAX_PATH_LENGTH, "%s", path);
+    trace_start = profile_begin();
+    trace_end = trace_start + seconds;
+    trace_events = 0;
+    fputs("{\"traceEvents\":[", trace_file);
+    trace_event("{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,"
+        "\"tid\":%d,\"args\":{\"name\":\"main\"}}", thread_ring());
+    printf("Recording a trace for %g seconds\n", seconds);
+    return 1;
+}
+
+void profile_trace_stop(void)
+{
+    if (trace_file == NULL) {
+        return;
+    }
+    fputs("\n]}\n", trace_file);
+    fclose(trace_file);
+    trace_file = NULL;
+    printf("Trace written to %s\n", trace_path);
+}
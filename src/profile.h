@@ -0,0 +1,63 @@
+#pragma once
+
+// Timers and counters for finding out where the time of a frame goes.
+//
+// Any thread can record into its own ring without locking, the main thread
+// empties every ring once a frame in profile_frame(), adding the events up
+// into a history of the last PROFILE_HISTORY frames (shown by
+// /show-profile) and, while a trace is being recorded, writing them to a
+// Chrome trace file (open it in chrome://tracing or ui.perfetto.dev).
+
+// Timers, the time spent in a part of the frame on the main thread, or on
+// jobs in other threads.
+#define PROFILE_FRAME 0
+#define PROFILE_INPUT 1
+#define PROFILE_EDIT_QUEUE 2
+#define PROFILE_NETWORK 3
+#define PROFILE_CHECK_WORKERS 4
+#define PROFILE_DELETE_CHUNKS 5
+#define PROFILE_CULL 6
+#define PROFILE_DRAW 7
+#define PROFILE_SWAP 8
+#define PROFILE_WORKER_JOB 9
+// Counters, the backlogs and the edit latency (the age in milliseconds of
+// the oldest edit applied) are the last value seen in the frame, the others
+// (bytes sent, received and given to GL) are the total for the frame.
+#define PROFILE_DB_BACKLOG 10
+#define PROFILE_EDIT_BACKLOG 11
+#define PROFILE_EDIT_LATENCY 12
+#define PROFILE_NET_SENT 13
+#define PROFILE_NET_RECEIVED 14
+#define PROFILE_UPLOADED 15
+#define PROFILE_ZONE_COUNT 16
+
+#define PROFILE_HISTORY 240
+#define PROFILE_RING_SIZE 1024
+#define MAX_PROFILE_THREADS 32
+
+typedef struct {
+    int zone;
+    double start;
+} ProfileScope;
+
+double profile_begin(void);
+void profile_end(int zone, double start);
+void profile_scope_end(ProfileScope *scope);
+void profile_count(int zone, double value);
+void profile_add(int zone, double amount);
+void profile_thread_exit(void);
+
+void profile_frame(void);
+const char *profile_zone_name(int zone);
+void profile_get_history(int zone, float *values);
+float profile_average(int zone);
+
+int profile_is_level(int zone);
+
+int profile_trace_start(const char *path, double seconds);
+void profile_trace_stop(void);
+
+// Time the rest of the enclosing block.
+#define PROFILE_SCOPE(zone) \
+    ProfileScope profile_scope \
+    __attribute__((cleanup(profile_scope_end))) = {zone, profile_begin()}
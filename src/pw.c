@@ -6,36 +6,47 @@
 #include <GLES2/gl2.h>
 #include <GLES2/gl2ext.h>
 #include <libgen.h>
+#include <limits.h>
 #include <math.h>
 #include <stdio.h>
 #include <string.h>
 #include <sys/stat.h>
+#include <sys/sysinfo.h>
 #include <unistd.h>
 #include "chunk.h"
+#include "chunk_budget.h"
 #include "chunks.h"
 #include "client.h"
 #include "clients.h"
 #include "config.h"
 #include "cube.h"
 #include "db.h"
-#include "door.h"
+#include "dynamic.h"
 #include "item.h"
+#include "lod.h"
 #include "local_player.h"
 #include "local_players.h"
 #include "map.h"
 #include "matrix.h"
 #include "pg.h"
+#include "profile.h"
 #include "pw.h"
 #include "pwlua.h"
 #include "pwlua_worldgen.h"
 #include "render.h"
 #include "ring.h"
 #include "sign.h"
+#include "sign_mesh.h"
+#include "snapshot.h"
 #include "tinycthread.h"
 #include "ui.h"
+#include "upload.h"
 #include "util.h"
+#include "util_gl.h"
+#include "view.h"
 #include "vt.h"
 #include "world.h"
+#include "worldgen_cache.h"
 #include "x11_event_handler.h"
 
 #define MODE_OFFLINE 0
@@ -43,12 +54,27 @@
 
 mtx_t edit_ring_mtx;
 
+// Edits taken from the edit ring wait in the batch of the chunk they change
+// until drain_edit_queue() applies them. Only used by the main thread.
+typedef struct {
+    int p;
+    int q;
+    int distance;
+    double queued;
+    Ring edits;
+} EditBatch;
+
 typedef struct {
     Worker workers[MAX_WORKERS];
     int create_radius;
     int render_radius;
     int delete_radius;
     int sign_radius;
+    int lod_radius;
+    int requested_radius;
+    int max_radius;
+    int delete_margin;
+    double budget_time;
     int width;
     int height;
     float scale;
@@ -64,6 +90,15 @@ typedef struct {
     size_t float_size;
     int use_lua_worldgen;
     Ring edit_ring;
+    EditBatch *edit_batches;
+    int edit_batch_count;
+    int edit_batch_capacity;
+    // Open addressing table of the batches by chunk, holding index + 1.
+    int *edit_batch_index;
+    unsigned int edit_batch_index_mask;
+    int pending_edits;
+    View *main_views[MAX_LOCAL_PLAYERS];
+    View *pip_views[MAX_LOCAL_PLAYERS];
 } Model;
 
 static Model model;
@@ -72,6 +107,8 @@ static Model *g = &model;
 static int prev_width, prev_height;
 static int prev_player_count;
 
+static void free_edit_batches(void);
+
 void pw_init(void)
 {
     prev_width = 0;
@@ -98,10 +135,12 @@ void pw_init(void)
     }
 
     mtx_init(&edit_ring_mtx, mtx_plain);
+    snapshot_init();
 }
 
 void pw_deinit(void)
 {
+    snapshot_deinit();
     mtx_destroy(&edit_ring_mtx);
     if (g->use_lua_worldgen == 1) {
         pwlua_worldgen_deinit();
@@ -174,9 +213,15 @@ void pw_unload_game(void)
     delete_all_chunks();
     delete_all_players();
     ring_free(&g->edit_ring);
+    free_edit_batches();
     set_worldgen(NULL);
 }
 
+int get_create_radius(void)
+{
+    return g->create_radius;
+}
+
 int get_delete_radius(void)
 {
     return g->delete_radius;
@@ -245,13 +290,6 @@ void get_sight_vector(float rx, float ry, float *vx, float *vy, float *vz)
     *vz = sinf(rx - RADIANS(90)) * m;
 }
 
-GLuint gen_player_buffer(float x, float y, float z, float rx, float ry, int p)
-{
-    GLfloat *data = malloc_faces(10, 6, sizeof(GLfloat));
-    make_player(data, x, y, z, rx, ry, p);
-    return gen_faces(10, 6, data, sizeof(GLfloat));
-}
-
 void update_player(Player *player,
     float x, float y, float z, float rx, float ry, int interpolate)
 {
@@ -271,9 +309,6 @@ void update_player(Player *player,
     else {
         State *s = &player->state;
         s->x = x; s->y = y; s->z = z; s->rx = rx; s->ry = ry;
-        del_buffer(player->buffer);
-        player->buffer = gen_player_buffer(s->x, s->y, s->z, s->rx, s->ry,
-                                           player->texture_index);
     }
 }
 
@@ -327,70 +362,71 @@ Player *player_crosshair(Player *player)
     Player *result = 0;
     float threshold = RADIANS(5);
     float best = 0;
-    for (int i = 0; i < client_count; i++) {
-        Client *client = clients + i;
-        for (int j = 0; j < MAX_LOCAL_PLAYERS; j++) {
-            Player *other = client->players + j;
-            if (other == player || !other->is_active) {
-                continue;
-            }
-            float p = player_crosshair_distance(player, other);
-            float d = player_player_distance(player, other);
-            if (d < 96 && p / d < threshold) {
-                if (best == 0 || d < best) {
-                    best = d;
-                    result = other;
-                }
+    Player *near[MAX_PLAYERS];
+    int count = find_players_near(player->state.x, player->state.z, 96,
+        near, MAX_PLAYERS);
+    for (int i = 0; i < count; i++) {
+        Player *other = near[i];
+        if (other == player || !other->is_active) {
+            continue;
+        }
+        float p = player_crosshair_distance(player, other);
+        float d = player_player_distance(player, other);
+        if (d < 96 && p / d < threshold) {
+            if (best == 0 || d < best) {
+                best = d;
+                result = other;
             }
         }
     }
     return result;
 }
 
-void gen_sign_chunk_buffer(Chunk *chunk)
+// Replace the chunk's sign buffer with the glyphs in data, which is freed.
+void set_sign_chunk_buffer(Chunk *chunk, GLfloat *data, int faces)
 {
-    SignList *signs = &chunk->signs;
-
-    // first pass - count characters
-    int max_faces = 0;
-    for (size_t i = 0; i < signs->size; i++) {
-        Sign *e = signs->data + i;
-        max_faces += strlen(e->text);
-    }
-
-    // second pass - generate geometry
-    GLfloat *data = malloc_faces_with_rgba(5, max_faces);
-    int faces = 0;
-    for (size_t i = 0; i < signs->size; i++) {
-        Sign *e = signs->data + i;
-        int shape = get_shape(e->x, e->y, e->z);
-        float y_face_height = item_height(shape);
-        faces += gen_sign_buffer(
-            data + faces * 54, e->x, e->y, e->z, e->face, e->text,
-            y_face_height);
-    }
-
-    del_buffer(chunk->sign_buffer);
-    chunk->sign_buffer = gen_faces_with_rgba(5, faces, data);
+    upload_buffer(&chunk->sign_buffer, &chunk->sign_capacity,
+        (GLsizeiptr)sizeof(GLfloat) * SIGN_GLYPH_FLOATS * faces, data);
+    free(data);
     chunk->sign_faces = faces;
     chunk->dirty_signs = 0;
 }
 
-void map_set_func(int x, int y, int z, int w, void *arg)
+void gen_sign_chunk_buffer(Chunk *chunk)
 {
-    Map *map = (Map *)arg;
-    map_set(map, x, y, z, w);
+    int faces;
+    GLfloat *data = gen_sign_list_mesh(&chunk->signs, &chunk->shape, &faces);
+    set_sign_chunk_buffer(chunk, data, faces);
 }
 
+// Give the meshes of finished jobs to GL while they fit in the frame's upload
+// budget. A job left waiting is the first taken in the next frame.
 void check_workers(void)
 {
-    for (int i = 0; i < config->worker_count; i++) {
+    PROFILE_SCOPE(PROFILE_CHECK_WORKERS);
+    static int first_worker;
+    int waiting = -1;
+    upload_frame_begin();
+    for (int j = 0; j < config->worker_count; j++) {
+        int i = (first_worker + j) % config->worker_count;
         Worker *worker = g->workers + i;
         mtx_lock(&worker->mtx);
-        if (worker->state == WORKER_DONE) {
-            WorkerItem *item = &worker->item;
-            Chunk *chunk = find_chunk(item->p, item->q);
-            if (chunk) {
+        WorkerItem *item = &worker->item;
+        size_t bytes = worker->state == WORKER_DONE ?
+            worker_item_upload_bytes(item, g->float_size) : 0;
+        if (worker->state == WORKER_DONE && !upload_may_take(bytes)) {
+            if (waiting == -1) {
+                waiting = i;
+            }
+        } else if (worker->state == WORKER_DONE) {
+            upload_spend(bytes);
+            Chunk *chunk = item->lod ? NULL : find_chunk(item->p, item->q);
+            if (item->lod) {
+                if (item->load) {
+                    sign_list_free(&item->signs);
+                }
+                generate_lod(item, g->float_size);
+            } else if (chunk) {
                 if (item->load) {
                     Map *block_map = item->block_maps[1][1];
                     Map *extra_map = item->extra_maps[1][1];
@@ -408,18 +444,22 @@ void check_workers(void)
                     map_copy(&chunk->lights, light_map);
                     map_copy(&chunk->shape, shape_map);
                     map_copy(&chunk->transform, transform_map);
-                    sign_list_copy(&chunk->signs, &item->signs);
-                    sign_list_free(&item->signs);
+                    chunk_grow_maps_incrementally(chunk);
+                    chunk->signs = item->signs;
                     request_chunk(item->p, item->q);
+                    snapshot_dirty(item->p, item->q);
+                } else {
+                    sign_list_free(&item->signs);
                 }
 
-                // DoorMap data copy is required whether the doors were added
-                // from loading game data or generated from the worldgen.
-                DoorMap *door_map = item->door_maps[1][1];
-                door_map_free(&chunk->doors);
-                door_map_copy(&chunk->doors, door_map);
-
                 generate_chunk(chunk, item, g->float_size);
+            } else {
+                for (int i = 0; i < SECTION_COUNT; i++) {
+                    free(item->sections[i].data);
+                }
+                dynamic_blocks_free(&item->dynamic);
+                sign_list_free(&item->signs);
+                free(item->sign_data);
             }
             for (int a = 0; a < 3; a++) {
                 for (int b = 0; b < 3; b++) {
@@ -428,7 +468,6 @@ void check_workers(void)
                     Map *light_map = item->light_maps[a][b];
                     Map *shape_map = item->shape_maps[a][b];
                     Map *transform_map = item->transform_maps[a][b];
-                    DoorMap *door_map = item->door_maps[a][b];
                     if (block_map) {
                         map_free(block_map);
                         free(block_map);
@@ -449,29 +488,35 @@ void check_workers(void)
                         map_free(transform_map);
                         free(transform_map);
                     }
-                    if (door_map) {
-                        door_map_free(door_map);
-                        free(door_map);
-                    }
                 }
             }
             worker->state = WORKER_IDLE;
         }
         mtx_unlock(&worker->mtx);
     }
+    if (waiting != -1) {
+        first_worker = waiting;
+    }
 }
 
-void ensure_chunks(Player *player)
+void ensure_chunks(void)
 {
     check_workers();
-    force_chunks(player, g->float_size);
+    for (int i = 0; i < view_count; i++) {
+        force_chunks(views[i].player, g->float_size);
+    }
+    lod_update(views, view_count);
     for (int i = 0; i < config->worker_count; i++) {
-        Worker *worker = g->workers + i;
-        mtx_lock(&worker->mtx);
-        if (worker->state == WORKER_IDLE) {
-            ensure_chunks_worker(player, worker, g->width, g->height, g->fov, g->ortho, g->render_radius, g->create_radius);
-        }
-        mtx_unlock(&worker->mtx);
+        mtx_lock(&g->workers[i].mtx);
+    }
+    // Far chunks are only worked on once there is nothing nearby to do.
+    if (ensure_chunks_workers(views, view_count, g->workers,
+            config->worker_count, g->create_radius) == 0) {
+        lod_ensure_workers(views, view_count, g->workers,
+            config->worker_count);
+    }
+    for (int i = 0; i < config->worker_count; i++) {
+        mtx_unlock(&g->workers[i].mtx);
     }
 }
 
@@ -490,15 +535,22 @@ int worker_run(void *arg)
                 if (L != NULL) {
                     lua_close(L);
                 }
+                profile_thread_exit();
                 thrd_exit(1);
             }
         }
         mtx_unlock(&worker->mtx);
         WorkerItem *item = &worker->item;
+        double start = profile_begin();
         if (item->load) {
             load_chunk(item, L);
         }
-        compute_chunk(item);
+        if (item->lod) {
+            compute_lod(item);
+        } else {
+            compute_chunk(item);
+        }
+        profile_end(PROFILE_WORKER_JOB, start);
         mtx_lock(&worker->mtx);
         worker->state = WORKER_DONE;
         mtx_unlock(&worker->mtx);
@@ -506,15 +558,10 @@ int worker_run(void *arg)
     if (L != NULL) {
         lua_close(L);
     }
+    profile_thread_exit();
     return 0;
 }
 
-void worldgen_set_sign(int x, int y, int z, int face, const char *text,
-                       SignList *sign_list)
-{
-    sign_list_add(sign_list, x, y, z, face, text);
-}
-
 static int file_readable(const char *filename)
 {
     FILE *f = fopen(filename, "r");  /* try to open file */
@@ -540,6 +587,7 @@ void set_worldgen(char *worldgen)
         }
         if (!file_readable(wg_path)) {
             printf("Worldgen file not found: %s\n", wg_path);
+            worldgen_cache_set_worldgen(NULL);
             return;
         }
         strncpy(config->worldgen_path, wg_path, sizeof(config->worldgen_path));
@@ -547,6 +595,8 @@ void set_worldgen(char *worldgen)
         pwlua_worldgen_init(config->worldgen_path);
         g->use_lua_worldgen = 1;
     }
+    worldgen_cache_set_worldgen(g->use_lua_worldgen ?
+                                config->worldgen_path : NULL);
     g->render_option_changed = 1;
 }
 
@@ -693,15 +743,57 @@ void reset_model(void)
     ring_alloc(&g->edit_ring, 1024);
 }
 
-int render_3D_scene(LocalPlayer *local, Player* player, float ts)
+void get_picture_in_picture_size(LocalPlayer *local, int *pw, int *ph)
+{
+    *pw = local->view_width / 4 * g->scale;
+    *ph = local->view_height / 3 * g->scale;
+}
+
+// Set up the views of all local players for this frame, then load and mesh
+// the chunks they need and build their draw lists in one pass.
+void prepare_views(void)
+{
+    views_reset();
+    for (int i = 0; i < MAX_LOCAL_PLAYERS; i++) {
+        LocalPlayer *local = &local_players[i];
+        g->main_views[i] = NULL;
+        g->pip_views[i] = NULL;
+        if (!local->player->is_active || local->show_world != 1) {
+            continue;
+        }
+        Player *player = local->player;
+        if (local->observe1 > 0 && find_client(local->observe1_client_id)) {
+            player = find_client(local->observe1_client_id)->players +
+                     (local->observe1 - 1);
+        }
+        g->main_views[i] = views_add(player,
+            local->view_width, local->view_height,
+            local->ortho_is_pressed ? 64 : 0,
+            local->zoom_is_pressed ? 15 : 65,
+            g->render_radius, g->sign_radius, g->lod_radius);
+        if (local->observe2 && find_client(local->observe2_client_id)) {
+            Player *other = find_client(local->observe2_client_id)->players +
+                            (local->observe2 - 1);
+            int pw, ph;
+            get_picture_in_picture_size(local, &pw, &ph);
+            g->pip_views[i] = views_add(other, pw, ph, 0, 65,
+                g->render_radius, g->sign_radius, g->lod_radius);
+        }
+    }
+    ensure_chunks();
+    double start = profile_begin();
+    views_cull();
+    profile_end(PROFILE_CULL, start);
+}
+
+int render_3D_scene(LocalPlayer *local, Player* player, View *view, float ts)
 {
     State *s = &player->state;
     int face_count = 0;
     render_sky();
     glClear(GL_DEPTH_BUFFER_BIT);
-    ensure_chunks(player);
-    face_count = render_chunks();
-    render_signs();
+    face_count = render_chunks(view);
+    render_signs(view);
     if (local->typing && local->typing_buffer[0] == CRAFT_KEY_SIGN) {
         int x, y, z, face;
         if (hit_test_face(player, &x, &y, &z, &face)) {
@@ -756,14 +848,12 @@ void render_HUD(LocalPlayer *local, Player* player)
     }
 }
 
-void render_picture_in_picture(LocalPlayer *local, Player* player, float ts)
+void render_picture_in_picture(LocalPlayer *local, View *view, float ts)
 {
-    if (local->observe2 && find_client(local->observe2_client_id)) {
-        player = (find_client(local->observe2_client_id))->players +
-                 (local->observe2 - 1);
-
-        int pw = local->view_width / 4 * g->scale;
-        int ph = local->view_height / 3 * g->scale;
+    if (view) {
+        Player *player = view->player;
+        int pw, ph;
+        get_picture_in_picture_size(local, &pw, &ph);
         int offset = 32 * g->scale;
         int pad = 3 * g->scale;
         int sw = pw + pad * 2;
@@ -778,19 +868,18 @@ void render_picture_in_picture(LocalPlayer *local, Player* player, float ts)
         glViewport(g->width - pw - offset + local->view_x,
                    offset + local->view_y, pw, ph);
 
-        g->width = pw;
-        g->height = ph;
-        g->ortho = 0;
-        g->fov = 65;
-        render_set_state(&player->state, pw, ph, g->render_radius,
+        g->width = view->width;
+        g->height = view->height;
+        g->ortho = view->ortho;
+        g->fov = view->fov;
+        render_set_state(&player->state, pw, ph, view->far_radius,
             g->sign_radius, g->ortho, g->fov, g->scale, g->gl_float_type,
             g->float_size);
 
         render_sky();
         glClear(GL_DEPTH_BUFFER_BIT);
-        ensure_chunks(player);
-        render_chunks();
-        render_signs();
+        render_chunks(view);
+        render_signs(view);
         render_players(player);
         glClear(GL_DEPTH_BUFFER_BIT);
         if (config->show_player_names) {
@@ -800,7 +889,8 @@ void render_picture_in_picture(LocalPlayer *local, Player* player, float ts)
     }
 }
 
-void render_HUD_text(LocalPlayer *local, Player* player, float ts, FPS fps, int face_count)
+void render_HUD_text(LocalPlayer *local, Player* player, float ts, FPS fps,
+    int face_count, View *view)
 {
     State *s = &player->state;
     char text_buffer[1024];
@@ -812,12 +902,16 @@ void render_HUD_text(LocalPlayer *local, Player* player, float ts, FPS fps, int
         hour = hour % 12;
         hour = hour ? hour : 12;
         if (config->verbose) {
+            int occluded_count = view ? view->occluded_faces : 0;
+            int draw_calls = view ? view->draw_calls : 0;
+            double submit_time = view ? view->submit_time : 0;
             snprintf(
                 text_buffer, 1024,
-                "(%d, %d) (%.2f, %.2f, %.2f) [%d, %d, %d] %d%cm",
+                "(%d, %d) (%.2f, %.2f, %.2f) [%d, %d, %d/%d, %d %.2fms] %d%cm",
                 chunked(s->x), chunked(s->z), s->x, s->y, s->z,
                 client_count, chunk_count,
-                face_count * 2, hour, am_pm);
+                face_count * 2, occluded_count * 2,
+                draw_calls, submit_time * 1000, hour, am_pm);
             render_text(ALIGN_LEFT, tx, ty, ts, text_buffer);
             ty -= ts * 2;
 
@@ -860,14 +954,19 @@ void render_HUD_text(LocalPlayer *local, Player* player, float ts, FPS fps, int
         snprintf(text_buffer, 1024, "%s", player->name);
         render_text(ALIGN_CENTER, g->width/2, ts, ts, text_buffer);
     }
+    if (config->show_profile) {
+        glClear(GL_DEPTH_BUFFER_BIT);
+        render_profile(ts);
+    }
 }
 
 void render_player_world(LocalPlayer *local, FPS fps)
 {
     Player *player = local->player;
-    State *s = &player->state;
     float ts = 8 * g->scale;
     int face_count = 0;
+    int index = local - local_players;
+    View *view = g->main_views[index];
 
     glViewport(local->view_x, local->view_y, local->view_width,
                local->view_height);
@@ -875,24 +974,25 @@ void render_player_world(LocalPlayer *local, FPS fps)
     g->height = local->view_height;
     g->ortho = local->ortho_is_pressed ? 64 : 0;
     g->fov = local->zoom_is_pressed ? 15 : 65;
-    render_set_state(s, local->view_width, local->view_height, g->render_radius,
-        g->sign_radius, g->ortho, g->fov, g->scale, g->gl_float_type,
-        g->float_size);
 
     if (local->observe1 > 0 && find_client(local->observe1_client_id)) {
         player = find_client(local->observe1_client_id)->players +
                  (local->observe1 - 1);
     }
+    render_set_state(&player->state, local->view_width, local->view_height,
+        view ? view->far_radius : g->render_radius, g->sign_radius, g->ortho,
+        g->fov, g->scale, g->gl_float_type, g->float_size);
 
-    if (local->show_world == 1) {
-        face_count = render_3D_scene(local, player, ts);
+    if (local->show_world == 1 && view) {
+        face_count = render_3D_scene(local, player, view, ts);
         if (local->vt_open == 0) {
             render_HUD(local, player);
         }
-        render_picture_in_picture(local, player, ts);
+        render_picture_in_picture(local, g->pip_views[index], ts);
     }
     if (local->vt_open == 0) {
-        render_HUD_text(local, player, ts, fps, face_count);
+        render_HUD_text(local, player, ts, fps, face_count,
+            local->show_world == 1 ? view : NULL);
     }
 
     // RENDER VIRTUAL TERMINAL //
@@ -919,77 +1019,168 @@ void render_player_world(LocalPlayer *local, FPS fps)
 }
 
 /*
- * Set view radius that will fit into the current size of GPU RAM.
+ * The view radius that fits into the size of GPU RAM the platform reports,
+ * with the margin to the delete radius to use with it. Returns 0 when any
+ * radius fits.
  */
-void set_view_radius(int requested_size, int delete_request)
+static int gpu_mem_radius(int requested_size, int *delete_margin)
+{
+    int gpu_mb = pg_get_gpu_mem_size();
+    if (gpu_mb < 48 || (gpu_mb < 64 && config->players >= 2) ||
+        (gpu_mb < 128 && config->players >= 4)) {
+        // A draw distance of 1 is not enough for the game to be usable,
+        // but this does at least show something on screen (for low
+        // resolutions only - higher ones will crash the game with low GPU
+        // RAM).
+        *delete_margin = 1;
+        return 1;
+    } else if (gpu_mb < 64 || (gpu_mb < 128 && config->players >= 3)) {
+        *delete_margin = 1;
+        return 2;
+    } else if (gpu_mb < 128 && config->players >= 2) {
+        *delete_margin = 2;
+        return 2;
+    } else if (gpu_mb < 128 || (gpu_mb < 256 && config->players >= 3)) {
+        // A GPU RAM size of 64M will result in rendering issues for draw
+        // distances greater than 3 (with a chunk size of 16).
+        *delete_margin = 2;
+        return 3;
+    } else if (gpu_mb < 256 || requested_size == AUTO_PICK_RADIUS) {
+        // For the Raspberry Pi reduce amount to draw to both fit into
+        // 128MiB of GPU RAM and keep the render speed at a reasonable
+        // smoothness.
+        *delete_margin = 3;
+        return 5;
+    }
+    return 0;
+}
+
+// Set the chunk memory budgets from the options, 0 MiB is no limit.
+static void set_chunk_budget(void)
 {
-    int radius = requested_size;
-    int delete_radius = delete_request;
-    if (!config->no_limiters) {
-        int gpu_mb = pg_get_gpu_mem_size();
-        if (gpu_mb < 48 || (gpu_mb < 64 && config->players >= 2) ||
-            (gpu_mb < 128 && config->players >= 4)) {
-            // A draw distance of 1 is not enough for the game to be usable,
-            // but this does at least show something on screen (for low
-            // resolutions only - higher ones will crash the game with low GPU
-            // RAM).
-            radius = 1;
-            delete_radius = radius + 1;
-        } else if (gpu_mb < 64 || (gpu_mb < 128 && config->players >= 3)) {
-            radius = 2;
-            delete_radius = radius + 1;
-        } else if (gpu_mb < 128 && config->players >= 2) {
-            radius = 2;
-            delete_radius = radius + 2;
-        } else if (gpu_mb < 128 || (gpu_mb < 256 && config->players >= 3)) {
-            // A GPU RAM size of 64M will result in rendering issues for draw
-            // distances greater than 3 (with a chunk size of 16).
-            radius = 3;
-            delete_radius = radius + 2;
-        } else if (gpu_mb < 256 || requested_size == AUTO_PICK_RADIUS) {
-            // For the Raspberry Pi reduce amount to draw to both fit into
-            // 128MiB of GPU RAM and keep the render speed at a reasonable
-            // smoothness.
-            radius = 5;
-            delete_radius = radius + 3;
+    size_t mb = 1024 * 1024;
+    size_t cpu_bytes = 0;
+    size_t gpu_bytes = 0;
+    if (config->chunk_memory == AUTO_PICK_MEMORY) {
+        struct sysinfo info;
+        if (sysinfo(&info) == 0) {
+            cpu_bytes = (size_t)info.totalram * info.mem_unit / 4;
         }
+    } else {
+        cpu_bytes = config->chunk_memory * mb;
     }
-
-    if (radius <= 0) {
-        radius = 5;
+    if (config->chunk_gpu_memory == AUTO_PICK_MEMORY) {
+        int gpu_mb = pg_get_gpu_mem_size() - BUDGET_GPU_RESERVE_MB;
+        gpu_bytes = MAX(gpu_mb, BUDGET_GPU_RESERVE_MB / 2) * mb;
+    } else {
+        gpu_bytes = config->chunk_gpu_memory * mb;
     }
-
-    if (delete_radius < radius) {
-        delete_radius = radius + 3;
+    chunk_budget_set(cpu_bytes, gpu_bytes, g->float_size);
+    if (config->verbose) {
+        printf("chunk budget: memory: %zuMiB gpu: %zuMiB\n",
+               cpu_bytes / mb, gpu_bytes / mb);
     }
+}
+
+// Make room in the chunk table for the chunks kept at the largest view
+// radius.
+static void reserve_chunks(void)
+{
+    chunks_reserve(chunk_budget_chunk_limit(g->max_radius + g->delete_margin,
+                                            config->players));
+}
 
+static void apply_view_radius(int radius)
+{
     g->create_radius = radius;
     g->render_radius = radius;
-    g->delete_radius = delete_radius;
+    g->delete_radius = radius + g->delete_margin;
     g->sign_radius = radius;
+    g->lod_radius = lod_pick_radius(radius, config->lod_radius);
 
     if (config->verbose) {
-        printf("\nradii: create: %d render: %d delete: %d sign: %d\n",
+        printf("\nradii: create: %d render: %d delete: %d sign: %d lod: %d\n",
                g->create_radius, g->render_radius, g->delete_radius,
-               g->sign_radius);
+               g->sign_radius, g->lod_radius);
+    }
+}
+
+// The view distance starts at the requested radius, or the default one when
+// auto picking, less what is not expected to fit the chunk memory budget. It
+// is then changed to fit the budget by update_view_radius, up to the
+// requested radius or up to AUTO_MAX_VIEW_RADIUS when auto picking. Unless
+// the GPU budget is given, the radius for the platform's GPU RAM size is
+// also the largest used.
+void set_view_radius(int requested_size, int delete_request)
+{
+    int radius = requested_size;
+    int max_radius = requested_size;
+    if (radius <= 0) {
+        radius = DEFAULT_VIEW_RADIUS;
+        max_radius = config->no_limiters ? radius : AUTO_MAX_VIEW_RADIUS;
+    }
+    int delete_radius = delete_request;
+    if (delete_radius < radius) {
+        delete_radius = radius + 3;
+    }
+    g->requested_radius = requested_size;
+    if (!config->no_limiters &&
+        config->chunk_gpu_memory == AUTO_PICK_MEMORY) {
+        int delete_margin;
+        int gpu_radius = gpu_mem_radius(requested_size, &delete_margin);
+        if (gpu_radius) {
+            radius = gpu_radius;
+            max_radius = gpu_radius;
+            delete_radius = radius + delete_margin;
+        }
+    }
+    g->max_radius = max_radius;
+    g->delete_margin = delete_radius - radius;
+    if (!config->no_limiters) {
+        set_chunk_budget();
+        radius = chunk_budget_fit_radius(radius, max_radius,
+                                         config->players);
+    }
+    reserve_chunks();
+    apply_view_radius(radius);
+}
+
+// Grow or shrink the view distance to fit the chunk memory budget, called
+// every frame but only looks once every BUDGET_INTERVAL.
+void update_view_radius(void)
+{
+    if (config->no_limiters) {
+        return;
+    }
+    double now = pg_get_time();
+    if (now - g->budget_time < BUDGET_INTERVAL) {
+        return;
+    }
+    g->budget_time = now;
+    int radius = chunk_budget_pick_radius(g->render_radius, g->max_radius,
+                                          config->players);
+    if (radius != g->render_radius) {
+        apply_view_radius(radius);
     }
 }
 
 // call after changes to local player count
 void recheck_view_radius(void)
 {
-    set_view_radius(g->render_radius, g->delete_radius);
+    set_view_radius(g->requested_radius, g->render_radius + g->delete_margin);
 }
 
 void set_render_radius(int radius)
 {
-    set_view_radius(radius, g->delete_radius);
+    set_view_radius(radius, radius + g->delete_margin);
 }
 
 void set_delete_radius(int radius)
 {
     if (radius >= g->create_radius && radius <= g->create_radius + 30) {
-        set_view_radius(g->render_radius, radius);
+        g->delete_margin = radius - g->render_radius;
+        reserve_chunks();
+        apply_view_radius(g->render_radius);
     }
 }
 
@@ -1058,49 +1249,243 @@ void set_time_elapsed_and_day_length(float elapsed, int day_length)
     g->time_changed = 1;
 }
 
-void drain_edit_queue(size_t max_items, double max_time, double now)
+static void apply_edit(RingEntry *e)
+{
+    switch (e->type) {
+    case BLOCK:
+        set_block(e->x, e->y, e->z, e->w);
+        break;
+    case EXTRA:
+        set_extra(e->x, e->y, e->z, e->w);
+        break;
+    case SHAPE:
+        set_shape(e->x, e->y, e->z, e->w);
+        break;
+    case LIGHT:
+        set_light(chunked(e->x), chunked(e->z), e->x, e->y, e->z, e->w);
+        break;
+    case SIGN:
+        set_sign(e->x, e->y, e->z, e->w, e->sign);
+        free(e->sign);
+        break;
+    case TRANSFORM:
+        set_transform(e->x, e->y, e->z, e->w);
+        break;
+    case KEY:
+    case COMMIT:
+    case EXIT:
+    default:
+        printf("Edit ring does not support: %d\n", e->type);
+        break;
+    }
+}
+
+static unsigned int edit_batch_slot(int p, int q)
 {
-    if (!ring_empty(&g->edit_ring) && mtx_trylock(&edit_ring_mtx)) {
-        RingEntry e;
-        for (size_t i=0; i<max_items; i++) {
-            int edit_ready = ring_get(&g->edit_ring, &e);
-            if (edit_ready) {
-                switch (e.type) {
-                case BLOCK:
-                    set_block(e.x, e.y, e.z, e.w);
-                    break;
-                case EXTRA:
-                    set_extra(e.x, e.y, e.z, e.w);
-                    break;
-                case SHAPE:
-                    set_shape(e.x, e.y, e.z, e.w);
-                    break;
-                case LIGHT:
-                    set_light(chunked(e.x), chunked(e.z), e.x, e.y, e.z, e.w);
-                    break;
-                case SIGN:
-                    set_sign(e.x, e.y, e.z, e.w, e.sign);
-                    free(e.sign);
-                    break;
-                case TRANSFORM:
-                    set_transform(e.x, e.y, e.z, e.w);
-                    break;
-                case KEY:
-                case COMMIT:
-                case EXIT:
-                default:
-                    printf("Edit ring does not support: %d\n", e.type);
-                    break;
-                }
-            } else {
-                break;
+    return (((unsigned int)p * 73856093u) ^ ((unsigned int)q * 19349663u))
+        & g->edit_batch_index_mask;
+}
+
+static void index_edit_batch(int i)
+{
+    EditBatch *batch = g->edit_batches + i;
+    unsigned int slot = edit_batch_slot(batch->p, batch->q);
+    while (g->edit_batch_index[slot]) {
+        slot = (slot + 1) & g->edit_batch_index_mask;
+    }
+    g->edit_batch_index[slot] = i + 1;
+}
+
+// Make the index again after the batches have moved, it is kept at most half
+// full.
+static void index_edit_batches(void)
+{
+    unsigned int size = 2;
+    while (size < (unsigned int)g->edit_batch_capacity * 2) {
+        size <<= 1;
+    }
+    if (size != g->edit_batch_index_mask + 1 || !g->edit_batch_index) {
+        free(g->edit_batch_index);
+        g->edit_batch_index = malloc(sizeof(int) * size);
+        g->edit_batch_index_mask = size - 1;
+    }
+    memset(g->edit_batch_index, 0, sizeof(int) * size);
+    for (int i = 0; i < g->edit_batch_count; i++) {
+        index_edit_batch(i);
+    }
+}
+
+static EditBatch *find_edit_batch(int p, int q, double now)
+{
+    if (g->edit_batch_index) {
+        unsigned int slot = edit_batch_slot(p, q);
+        int i;
+        while ((i = g->edit_batch_index[slot]) != 0) {
+            EditBatch *batch = g->edit_batches + i - 1;
+            if (batch->p == p && batch->q == q) {
+                return batch;
             }
-            if (pg_get_time() - now > max_time) {
+            slot = (slot + 1) & g->edit_batch_index_mask;
+        }
+    }
+    int grown = 0;
+    if (g->edit_batch_count == g->edit_batch_capacity) {
+        int capacity = MAX(g->edit_batch_capacity * 2, 64);
+        g->edit_batches = realloc(g->edit_batches,
+                                  sizeof(EditBatch) * capacity);
+        memset(g->edit_batches + g->edit_batch_capacity, 0,
+               sizeof(EditBatch) * (capacity - g->edit_batch_capacity));
+        g->edit_batch_capacity = capacity;
+        grown = 1;
+    }
+    // Batches past the count keep their rings to be used again.
+    EditBatch *batch = g->edit_batches + g->edit_batch_count++;
+    if (batch->edits.data == NULL) {
+        ring_alloc(&batch->edits, 64);
+    }
+    batch->p = p;
+    batch->q = q;
+    batch->queued = now;
+    if (grown) {
+        index_edit_batches();
+    } else {
+        index_edit_batch(g->edit_batch_count - 1);
+    }
+    return batch;
+}
+
+// Move everything the other threads have queued into the batches, holding
+// the ring's lock only for the copy.
+static void take_queued_edits(double now)
+{
+    if (ring_empty(&g->edit_ring) ||
+        mtx_trylock(&edit_ring_mtx) != thrd_success) {
+        return;
+    }
+    RingEntry e;
+    EditBatch *batch = NULL;
+    while (ring_get(&g->edit_ring, &e)) {
+        if (batch == NULL || batch->p != e.p || batch->q != e.q) {
+            batch = find_edit_batch(e.p, e.q, now);
+        }
+        ring_put(&batch->edits, &e);
+        g->pending_edits++;
+    }
+    mtx_unlock(&edit_ring_mtx);
+}
+
+static int edit_batch_distance(EditBatch *batch)
+{
+    int distance = INT_MAX;
+    for (int i = 0; i < MAX_LOCAL_PLAYERS; i++) {
+        Player *player = local_players[i].player;
+        if (!player->is_active) {
+            continue;
+        }
+        int dp = ABS(batch->p - chunked(player->state.x));
+        int dq = ABS(batch->q - chunked(player->state.z));
+        distance = MIN(distance, MAX(dp, dq));
+    }
+    return distance;
+}
+
+// Nearest to a player first, then oldest first.
+static int edit_batch_compare(const void *a, const void *b)
+{
+    const EditBatch *ba = a;
+    const EditBatch *bb = b;
+    if (ba->distance != bb->distance) {
+        return ba->distance < bb->distance ? -1 : 1;
+    }
+    if (ba->queued != bb->queued) {
+        return ba->queued < bb->queued ? -1 : 1;
+    }
+    return 0;
+}
+
+// Apply the queued edits, a chunk at a time starting with the chunks nearest
+// the players, until max_items edits have been applied or max_time seconds
+// have passed. All the edits waiting for a chunk are applied together: its
+// sections are marked dirty once, and the changes go to the DB worker and
+// the server as one batch.
+void drain_edit_queue(size_t max_items, double max_time)
+{
+    double start = pg_get_time();
+    double latency = 0;
+    take_queued_edits(start);
+    if (g->edit_batch_count) {
+        for (int i = 0; i < g->edit_batch_count; i++) {
+            EditBatch *batch = g->edit_batches + i;
+            batch->distance = edit_batch_distance(batch);
+        }
+        qsort(g->edit_batches, g->edit_batch_count, sizeof(EditBatch),
+              edit_batch_compare);
+        chunks_begin_batch();
+        db_begin_batch();
+        client_begin_batch();
+        size_t applied = 0;
+        for (int i = 0; i < g->edit_batch_count && applied < max_items;
+             i++) {
+            EditBatch *batch = g->edit_batches + i;
+            RingEntry e;
+            while (applied < max_items && ring_get(&batch->edits, &e)) {
+                apply_edit(&e);
+                applied++;
+                g->pending_edits--;
+            }
+            latency = MAX(latency, start - batch->queued);
+            if (pg_get_time() - start > max_time) {
                 break;
             }
         }
-        mtx_unlock(&edit_ring_mtx);
+        chunks_end_batch();
+        db_end_batch();
+        client_end_batch();
+        // Keep the batches still waiting at the front.
+        int count = 0;
+        for (int i = 0; i < g->edit_batch_count; i++) {
+            if (!ring_empty(&g->edit_batches[i].edits)) {
+                EditBatch batch = g->edit_batches[count];
+                g->edit_batches[count++] = g->edit_batches[i];
+                g->edit_batches[i] = batch;
+            }
+        }
+        g->edit_batch_count = count;
+        index_edit_batches();
     }
+    profile_count(PROFILE_EDIT_BACKLOG, g->pending_edits);
+    profile_count(PROFILE_EDIT_LATENCY, latency * 1000);
+}
+
+static void free_edit_batches(void)
+{
+    for (int i = 0; i < g->edit_batch_capacity; i++) {
+        Ring *edits = &g->edit_batches[i].edits;
+        RingEntry e;
+        while (ring_get(edits, &e)) {
+            if (e.type == SIGN) {
+                free(e.sign);
+            }
+        }
+        ring_free(edits);
+    }
+    free(g->edit_batches);
+    g->edit_batches = NULL;
+    g->edit_batch_count = 0;
+    free(g->edit_batch_index);
+    g->edit_batch_index = NULL;
+    g->edit_batch_index_mask = 0;
+    g->edit_batch_capacity = 0;
+    g->pending_edits = 0;
+}
+
+// Called by the main thread.
+int edit_queue_empty(void)
+{
+    mtx_lock(&edit_ring_mtx);
+    int empty = ring_empty(&g->edit_ring);
+    mtx_unlock(&edit_ring_mtx);
+    return empty && g->edit_batch_count == 0;
 }
 
 void initialize_worker_threads(void)
@@ -1200,3 +1585,11 @@ void set_show_trees(int option)
     g->render_option_changed = 1;  // regenerate world
 }
 
+// Record a Chrome trace of the next seconds into the config dir.
+void start_trace(int seconds)
+{
+    char path[MAX_PATH_LENGTH];
+    snprintf(path, MAX_PATH_LENGTH, "%s/trace.json", config->path);
+    profile_trace_start(path, seconds);
+}
+
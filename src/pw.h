@@ -11,6 +11,7 @@
 #include "tinycthread.h"
 #include "ui.h"
 #include "util.h"
+#include "util_gl.h"
 
 #define UNASSIGNED -1
 
@@ -23,6 +24,7 @@ int check_mode_changed(void);
 int check_time_changed(void);
 int check_render_option_changed(void);
 void pw_unload_game(void);
+int get_create_radius(void);
 int get_delete_radius(void);
 void queue_set_block(int x, int y, int z, int w);
 void queue_set_extra(int x, int y, int z, int w);
@@ -38,18 +40,17 @@ void pw_set_player_angle(int pid, float x, float y);
 int pw_get_crosshair(int pid, int *hx, int *hy, int *hz, int *face);
 const unsigned char *get_sign(int p, int q, int x, int y, int z, int face);
 void set_sign(int x, int y, int z, int face, const char *text);
-void worldgen_set_sign(int x, int y, int z, int face, const char *text,
-                       SignList *sign_list);
 int pw_get_time(void);
 void pw_set_time(int time);
 void set_time_elapsed_and_day_length(float elapsed, int day_length);
-void map_set_func(int x, int y, int z, int w, void *arg);
-void drain_edit_queue(size_t max_items, double max_time, double now);
+void drain_edit_queue(size_t max_items, double max_time);
+int edit_queue_empty(void);
 void toggle_observe_view(LocalPlayer *p);
 void toggle_picture_in_picture_observe_view(LocalPlayer *p);
 void cycle_item_in_hand_down(LocalPlayer *player);
 void cycle_item_in_hand_up(LocalPlayer *player);
-void ensure_chunks(Player *player);
+void ensure_chunks(void);
+void prepare_views(void);
 void pw_exit(void);
 void pw_new_game(char *path);
 void pw_load_game(char *path);
@@ -59,12 +60,14 @@ int player_intersects_block(
     float x, float y, float z,
     int hx, int hy, int hz);
 size_t get_float_size(void);
+void set_sign_chunk_buffer(Chunk *chunk, GLfloat *data, int faces);
 void gen_sign_chunk_buffer(Chunk *chunk);
 void get_sight_vector(float rx, float ry, float *vx, float *vy, float *vz);
 void set_view_radius(int requested_size, int delete_request);
 void set_render_radius(int radius);
 void set_delete_radius(int radius);
 void recheck_view_radius(void);
+void update_view_radius(void);
 void recheck_players_view_size(void);
 void change_player_count(int player_count);
 void remove_player(LocalPlayer *local);
@@ -75,7 +78,7 @@ void set_show_clouds(int option);
 void set_show_lights(int option);
 void set_show_plants(int option);
 void set_show_trees(int option);
-GLuint gen_player_buffer(float x, float y, float z, float rx, float ry, int p);
+void start_trace(int seconds);
 void update_player(Player *player,
     float x, float y, float z, float rx, float ry, int interpolate);
 void interpolate_player(Player *player);
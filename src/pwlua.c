@@ -7,6 +7,7 @@
 #include <lua.h>
 #include <lualib.h>
 #include <lauxlib.h>
+#include <luajit.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -14,50 +15,163 @@
 #include "pw.h"
 #include "pwlua.h"
 #include "pwlua_api.h"
+#include "pwlua_worldgen_api.h"
+#include "snapshot.h"
 #include "tinycthread.h"
+#include "util.h"
 #ifdef RASPI
 #include "RPi_GPIO_Lua_module.h"
 #endif
 
-#define AVAILABLE 0
-#define STARTING 1
-#define STOPPED 2
-#define WAITING 3
+// Script states
+#define IDLE 0     // waiting for a line or a control callback
+#define QUEUED 1   // waiting for a script worker
+#define RUNNING 2  // being run by a script worker
+#define STOPPED 3  // finished, its Lua state is closed
+#define WAITING 4  // waiting for the main thread to make a snapshot or sync
+
+// What a script worker starts when a script has nothing in progress
+#define JOB_NONE 0
+#define JOB_LINE 1
+#define JOB_CALLBACK 2
+
+// Scripts are run as coroutines by a few script workers, each gets to run
+// for SCRIPT_SLICE seconds before it is put at the back of the queue. The
+// time is checked every SCRIPT_SLICE_COUNT Lua instructions.
+#define SCRIPT_WORKERS 2
+#define SCRIPT_SLICE 0.005
+#define SCRIPT_SLICE_COUNT 1000
 
 #define LUA_MAX_CALLBACK_NAME 256
+#define MAX_CONTROL_EVENTS 16
 
 /* mark in error messages for incomplete statements */
 #define EOFMARK		"<eof>"
 #define marklen		(sizeof(EOFMARK)/sizeof(char) - 1)
 
+typedef struct {
+    int player_id;
+    int x;
+    int y;
+    int z;
+    int face;
+} ControlEvent;
+
+// A script, either a player's Lua shell or a script run from the menu. The
+// fields after state are shared with the script workers and protected by
+// mtx, the Lua state is only used by the worker running the script.
 struct LuaThreadState {
-    thrd_t thread;
-    mtx_t mtx;
-    cnd_t cnd;
     lua_State *L;
+    int co_ref;  // registry ref of the coroutine in progress, or LUA_NOREF
     char lua_code[LUA_MAXINPUT];
-    char control_callback[LUA_MAX_CALLBACK_NAME];
     int player_id;
+    int persistent;
+    struct LuaThreadState *next, *prev;
+
     int state;
-    int terminate;
+    char line[LUA_MAXINPUT];
+    int has_line;
+    int running_line;
     int is_shell;
-    struct LuaThreadState *next, *prev;
+    int removed;
+    int callback_ref;
+    char control_callback[LUA_MAX_CALLBACK_NAME];
+    ControlEvent events[MAX_CONTROL_EVENTS];
+    int event_count;
+    struct LuaThreadState *next_queued;
+    // Set by the script's worker before yielding to wait for the main thread.
+    int waiting;
+    SnapshotTicket ticket;
 };
 
 static LuaThreadState *lua_threads;
 
-int pwlua_thread_run(LuaThreadState *lts);
+static int started;
+static mtx_t mtx;
+static cnd_t cnd;
+static thrd_t workers[SCRIPT_WORKERS];
+static LuaThreadState *queue_head;
+static LuaThreadState *queue_tail;
 
+// The coroutine the current thread is running and when its slice ends.
+static _Thread_local lua_State *slice_co;
+static _Thread_local double slice_end;
 
-LuaThreadState *pwlua_new(int player_id)
+static int script_worker_run(void *arg);
+
+static void scheduler_init(void)
+{
+    mtx_init(&mtx, mtx_plain);
+    cnd_init(&cnd);
+    for (int i = 0; i < SCRIPT_WORKERS; i++) {
+        thrd_create(&workers[i], script_worker_run, NULL);
+    }
+    started = 1;
+}
+
+// Call with mtx locked.
+static void enqueue(LuaThreadState *lts)
 {
-    LuaThreadState *lts = malloc(sizeof(LuaThreadState));
-    lts->lua_code[0] = '\0';
+    lts->state = QUEUED;
+    lts->next_queued = NULL;
+    if (queue_tail) {
+        queue_tail->next_queued = lts;
+    } else {
+        queue_head = lts;
+    }
+    queue_tail = lts;
+    cnd_signal(&cnd);
+}
+
+// Put a script at the front of the queue, so it is run as soon as a worker
+// is free. Call with mtx locked.
+static void enqueue_front(LuaThreadState *lts)
+{
+    lts->state = QUEUED;
+    lts->next_queued = queue_head;
+    queue_head = lts;
+    if (queue_tail == NULL) {
+        queue_tail = lts;
+    }
+    cnd_signal(&cnd);
+}
+
+// Call with mtx locked.
+static LuaThreadState *dequeue(void)
+{
+    LuaThreadState *lts = queue_head;
+    if (lts) {
+        queue_head = lts->next_queued;
+        if (queue_head == NULL) {
+            queue_tail = NULL;
+        }
+    }
+    return lts;
+}
+
+static void close_script(LuaThreadState *lts)
+{
+    if (lts->L) {
+        lua_close(lts->L);
+        lts->L = NULL;
+    }
+    lts->co_ref = LUA_NOREF;
+    lts->callback_ref = LUA_NOREF;
     lts->control_callback[0] = '\0';
+    lts->event_count = 0;
+    lts->running_line = 0;
+}
+
+LuaThreadState *pwlua_new(int player_id)
+{
+    if (!started) {
+        scheduler_init();
+    }
+    LuaThreadState *lts = calloc(1, sizeof(LuaThreadState));
+    lts->co_ref = LUA_NOREF;
+    lts->callback_ref = LUA_NOREF;
     lts->player_id = player_id;
-    lts->state = AVAILABLE;
-    lts->is_shell = 0;
-    lts->terminate = 0;
+    lts->state = IDLE;
     if (lua_threads == NULL) {
         // First lua thread
         lua_threads = lts;
@@ -80,6 +194,7 @@ LuaThreadState *pwlua_new_shell(int player_id)
 {
     LuaThreadState *lts = pwlua_new(player_id);
     lts->is_shell = 1;
+    lts->persistent = 1;
     return lts;
 }
 
@@ -101,19 +216,24 @@ void pwlua_remove(LuaThreadState *lts)
             }
         }
     }
+    mtx_lock(&mtx);
+    if (lts->state == QUEUED || lts->state == RUNNING) {
+        // The worker frees it once it is done with it.
+        lts->removed = 1;
+        mtx_unlock(&mtx);
+        return;
+    }
+    mtx_unlock(&mtx);
+    close_script(lts);
     free(lts);
 }
 
 LuaThreadState *get_lua_state(lua_State *L)
 {
-    LuaThreadState *lts_match = NULL;
-    for (LuaThreadState *lts=lua_threads; lts; lts=lts->next) {
-        if (L == lts->L) {
-            lts_match = lts;
-            break;
-        }
-    }
-    return lts_match;
+    lua_getfield(L, LUA_REGISTRYINDEX, "pwlua_script");
+    LuaThreadState *lts = lua_touserdata(L, -1);
+    lua_pop(L, 1);
+    return lts;
 }
 
 void pwlua_set_is_shell(lua_State *L, int is_shell)
@@ -122,31 +242,52 @@ void pwlua_set_is_shell(lua_State *L, int is_shell)
     if (lts == NULL) {
         return;
     }
+    mtx_lock(&mtx);
     lts->is_shell = is_shell;
+    mtx_unlock(&mtx);
 }
 
+// Queue a call of the callback of every script that has one, each script
+// runs its callbacks in order once it has finished what it is doing. Idle
+// scripts go ahead of the scripts that are busy.
 void pwlua_control_callback(int player_id, int x, int y, int z, int face)
 {
+    if (!started) {
+        return;
+    }
+    mtx_lock(&mtx);
     for (LuaThreadState *lts=lua_threads; lts; lts=lts->next) {
-        char lua_code[LUA_MAXINPUT];
-        if (strlen(lts->control_callback) == 0) {
+        if ((lts->callback_ref == LUA_NOREF &&
+             lts->control_callback[0] == '\0') ||
+            lts->event_count == MAX_CONTROL_EVENTS ||
+            lts->state == STOPPED) {
             continue;
         }
-        snprintf(lua_code, LUA_MAXINPUT, "$%s(%d,%d,%d,%d,%d)",
-                 lts->control_callback, player_id, x, y, z, face);
-        pwlua_parse_line(lts, lua_code);
+        lts->events[lts->event_count++] =
+            (ControlEvent){player_id, x, y, z, face};
+        if (lts->state == IDLE) {
+            enqueue_front(lts);
+        }
     }
+    mtx_unlock(&mtx);
 }
 
-void set_control_block_callback(lua_State *L, const char *text)
+// Set the function called when a player uses a control block, either the
+// function itself or the name of a global function (looked up at each call).
+// nil removes the callback.
+void set_control_block_callback(lua_State *L, int index)
 {
     LuaThreadState *lts = get_lua_state(L);
     if (lts == NULL) {
         return;
     }
-    if (text == NULL) {
-        lts->control_callback[0] = '\0';
-    } else {
+    int ref = LUA_NOREF;
+    char name[LUA_MAX_CALLBACK_NAME] = "";
+    if (lua_isfunction(L, index)) {
+        lua_pushvalue(L, index);
+        ref = luaL_ref(L, LUA_REGISTRYINDEX);
+    } else if (lua_type(L, index) == LUA_TSTRING) {
+        const char *text = lua_tostring(L, index);
         // Validate the callback function name by only allowing alphanumeric
         // and underscore characters.
         for (size_t i=0; i<strlen(text); i++) {
@@ -156,8 +297,14 @@ void set_control_block_callback(lua_State *L, const char *text)
                 return;
             }
         }
-        snprintf(lts->control_callback, LUA_MAX_CALLBACK_NAME, "%s", text);
+        snprintf(name, LUA_MAX_CALLBACK_NAME, "%s", text);
     }
+    mtx_lock(&mtx);
+    int old_ref = lts->callback_ref;
+    lts->callback_ref = ref;
+    snprintf(lts->control_callback, LUA_MAX_CALLBACK_NAME, "%s", name);
+    mtx_unlock(&mtx);
+    luaL_unref(L, LUA_REGISTRYINDEX, old_ref);
 }
 
 void pwlua_parse_line(LuaThreadState *lts, const char *buffer)
@@ -165,41 +312,51 @@ void pwlua_parse_line(LuaThreadState *lts, const char *buffer)
     if (lts == NULL) {
         return;
     }
-    if (lts->state == STOPPED) {
-        thrd_join(lts->thread, NULL);
-        cnd_destroy(&lts->cnd);
-        mtx_destroy(&lts->mtx);
-        lts->state = AVAILABLE;
-    }
-
-    if (lts->state == AVAILABLE) {
-        // Start the Lua thread and run the line of Lua code.
-        lts->state = STARTING;
-        snprintf(lts->lua_code, LUA_MAXINPUT, "%s", buffer + 1);
-        lts->control_callback[0] = '\0';
-        mtx_init(&lts->mtx, mtx_plain);
-        cnd_init(&lts->cnd);
-        thrd_create(&lts->thread, (void *)pwlua_thread_run, lts);
-    } else if (lts->state == WAITING) {
-        // Post Lua code line to thread and signal for it to run.
-        snprintf(lts->lua_code, LUA_MAXINPUT, "%s", buffer + 1);
-        cnd_signal(&lts->cnd);
-    } else {
+    mtx_lock(&mtx);
+    if (lts->has_line || lts->running_line) {
+        mtx_unlock(&mtx);
         char *still_running_msg = "Lua still running";
         add_message(lts->player_id, still_running_msg);
+        return;
+    }
+    snprintf(lts->line, LUA_MAXINPUT, "%s", buffer + 1);
+    lts->has_line = 1;
+    if (lts->state == IDLE || lts->state == STOPPED) {
+        enqueue(lts);
     }
+    mtx_unlock(&mtx);
+}
+
+// Queue the scripts whose requests the main thread has answered, called by
+// the main thread after snapshot_update().
+void pwlua_wake_waiting(void)
+{
+    if (!started) {
+        return;
+    }
+    mtx_lock(&mtx);
+    for (LuaThreadState *lts=lua_threads; lts; lts=lts->next) {
+        if (lts->state == WAITING && snapshot_ticket_done(&lts->ticket)) {
+            lts->waiting = 0;
+            enqueue(lts);
+        }
+    }
+    mtx_unlock(&mtx);
 }
 
 void pwlua_remove_closed_threads(void)
 {
+    if (!started) {
+        return;
+    }
     LuaThreadState *lts = lua_threads;
     while (lts) {
         LuaThreadState *lts_to_check = lts;
         lts = lts->next;
-        if (lts_to_check->state == STOPPED && !lts_to_check->is_shell) {
-            thrd_join(lts_to_check->thread, NULL);
-            cnd_destroy(&lts_to_check->cnd);
-            mtx_destroy(&lts_to_check->mtx);
+        mtx_lock(&mtx);
+        int stopped = lts_to_check->state == STOPPED;
+        mtx_unlock(&mtx);
+        if (stopped && !lts_to_check->persistent) {
             pwlua_remove(lts_to_check);
         }
     }
@@ -276,11 +433,10 @@ static int multiline(LuaThreadState *lts)
 }
 
 /*
-Print (using piworld's add_message) any values on the stack
+Print (using piworld's add_message) any values on the stack of L
 */
-static void l_print(LuaThreadState *lts)
+static void l_print(LuaThreadState *lts, lua_State *L)
 {
-    lua_State *L = lts->L;
     int n = lua_gettop(L);
     if (n > 0) {  /* any result to be printed? */
       luaL_checkstack(L, LUA_MINSTACK, "too many results to print");
@@ -303,33 +459,13 @@ static void l_print(LuaThreadState *lts)
     }
 }
 
-/*
-** Message handler used to run all chunks
-*/
-static int msghandler(lua_State *L)
-{
-    const char *msg = lua_tostring(L, 1);
-    if (msg == NULL) {  /* is error object not a string? */
-        if (luaL_callmeta(L, 1, "__tostring") && /* does it have a metamethod */
-            lua_type(L, -1) == LUA_TSTRING) {  /* that produces a string? */
-            return 1;  /* that is the message */
-        } else {
-            msg = lua_pushfstring(L, "(error object is a %s value)",
-                                     luaL_typename(L, 1));
-        }
-    }
-    luaL_traceback(L, L, msg, 1);  /* append a standard traceback */
-    return 1;  /* return the traceback */
-}
-
 /*
 ** Check whether 'status' is not OK and, if so, prints the error
 ** message on the top of the stack. It assumes that the error object
-** is a string, as it was either generated by Lua or by 'msghandler'.
+** is a string, as it was either generated by Lua or by 'traceback'.
 */
-static int report(LuaThreadState *lts, int status)
+static int report(LuaThreadState *lts, lua_State *L, int status)
 {
-    lua_State *L = lts->L;
     if (status != LUA_OK) {
         const char *msg = lua_tostring(L, -1);
         add_message(lts->player_id, msg);
@@ -338,21 +474,6 @@ static int report(LuaThreadState *lts, int status)
     return status;
 }
 
-/*
-** Interface to 'lua_pcall', which sets appropriate message function
-** and C-signal handler. Used to run all chunks.
-*/
-static int docall(lua_State *L, int narg, int nres)
-{
-    int status;
-    int base = lua_gettop(L) - narg;  /* function index */
-    lua_pushcfunction(L, msghandler);  /* push message handler */
-    lua_insert(L, base);  /* put it under function and args */
-    status = lua_pcall(L, narg, nres, base);
-    lua_remove(L, base);  /* remove message handler from the stack */
-    return status;
-}
-
 /*
 ** Read a line and try to load (compile) it first as an expression (by
 ** adding "return " in front of it) and second as a statement. Return
@@ -376,63 +497,261 @@ static int loadline(LuaThreadState *lts)
     return status;
 }
 
-void process_lua_code_line(LuaThreadState *lts)
+// Yield the script's coroutine when its slice is used up. Nothing is
+// yielded while the script is inside a coroutine of its own or a call that
+// cannot be yielded across, the slice ends once it is back out.
+static void slice_hook(lua_State *L, __attribute__((unused)) lua_Debug *ar)
 {
-    lua_State *L = lts->L;
-    int status;
+    if (L == slice_co && monotonic_seconds() > slice_end &&
+        lua_isyieldable(L)) {
+        lua_yield(L, 0);
+    }
+}
 
-    status = loadline(lts);
+// Give up the script's worker until ticket is done, or wait for it here when
+// the script cannot be yielded (inside a coroutine of its own).
+static int wait_for_ticket(lua_State *L, SnapshotTicket *ticket)
+{
+    LuaThreadState *lts = get_lua_state(L);
+    if (lts && L == slice_co && lua_isyieldable(L)) {
+        lts->ticket = *ticket;
+        lts->waiting = 1;
+        return lua_yield(L, 0);
+    }
+    snapshot_ticket_wait(ticket);
+    return 0;
+}
 
-    if (status == LUA_OK) {
-        status = docall(L, 0, LUA_MULTRET);
+// wait_for_chunk(x, y, z) makes sure the chunk holding x, z can be read
+// without blocking, the first arguments of the read functions are passed on.
+static int pwlua_wait_for_chunk(lua_State *L)
+{
+    if (!lua_isnumber(L, 1) || !lua_isnumber(L, 3)) {
+        return 0;  // the read reports the bad arguments
     }
-    if (status == LUA_OK) {
-        l_print(lts);
-    } else {
-        report(lts, status);
+    SnapshotTicket ticket;
+    if (snapshot_request_chunk(lua_tointeger(L, 1), lua_tointeger(L, 3),
+            &ticket)) {
+        return wait_for_ticket(L, &ticket);
     }
+    return 0;
 }
 
-int pwlua_thread_run_protected_mode(lua_State *L)
+// sync_world(), see snapshot_sync().
+int pwlua_sync(lua_State *L)
 {
-    LuaThreadState *lts = (LuaThreadState *)lua_touserdata(L, 1);
-
-    do {
-        process_lua_code_line(lts);
-        if (!lts->is_shell) {
-            break;
-        }
-        lts->state = WAITING;
-        cnd_wait(&lts->cnd, &lts->mtx);
-    } while (!lts->terminate);
+    SnapshotTicket ticket;
+    if (snapshot_request_sync(&ticket)) {
+        return wait_for_ticket(L, &ticket);
+    }
+    return 0;
+}
 
+// Compiled traces do not call the slice hook, so no function of a script is
+// compiled. no_jit(f) turns it off for f and the functions made by f.
+static int pwlua_no_jit(lua_State *L)
+{
+    luaJIT_setmode(L, 1, LUAJIT_MODE_ALLFUNC | LUAJIT_MODE_OFF);
     return 0;
 }
 
-int pwlua_thread_run(LuaThreadState *lts)
+static void open_script(LuaThreadState *lts)
 {
     lua_State *L = luaL_newstate();
     lts->L = L;
 
     luaL_openlibs(L);
+    lua_sethook(L, slice_hook, LUA_MASKCOUNT, SCRIPT_SLICE_COUNT);
 
 #ifdef RASPI
     luaopen_GPIO(L);
 #endif
 
+    lua_pushlightuserdata(L, lts);
+    lua_setfield(L, LUA_REGISTRYINDEX, "pwlua_script");
+
     lua_pushnumber(L, lts->player_id);
     lua_setglobal(L, "player_id");
 
     pwlua_api_add_functions(L);
     pwlua_api_add_constants(L);
 
-    lua_pushcfunction(L, &pwlua_thread_run_protected_mode);
-    lua_pushlightuserdata(L, lts);
-    int status = lua_pcall(L, 1, 1, 0);
+    // The built in dofile calls the file from C, which could not be yielded
+    // across.
+    (void)luaL_dostring(L, "function dofile(...) "
+                           "return assert(loadfile(...))() end");
+
+    // Code loaded by a script is not compiled either. Reads of chunks the
+    // main thread has no snapshot of yet give up the worker until it has.
+    lua_register(L, "no_jit", pwlua_no_jit);
+    lua_register(L, "wait_for_chunk", pwlua_wait_for_chunk);
+    (void)luaL_dostring(L,
+        "local no_jit, wait = no_jit, wait_for_chunk "
+        "_G.no_jit, _G.wait_for_chunk = nil, nil "
+        "for _, name in ipairs({'load', 'loadstring', 'loadfile'}) do "
+        "  local load = _G[name] "
+        "  _G[name] = function(...) "
+        "    local chunk, message = load(...) "
+        "    if chunk then no_jit(chunk) end "
+        "    return chunk, message "
+        "  end "
+        "end "
+        "local search = package.loaders[2] "
+        "package.loaders[2] = function(name) "
+        "  local loader = search(name) "
+        "  if type(loader) == 'function' then no_jit(loader) end "
+        "  return loader "
+        "end "
+        "for _, name in ipairs({'get_block', 'get_sign', 'get_light', "
+        "    'get_control', 'set_control', 'get_shape', 'get_transform', "
+        "    'get_open', 'set_open'}) do "
+        "  local read = _G[name] "
+        "  _G[name] = function(...) wait(...) return read(...) end "
+        "end");
+}
 
-    lua_close(L);
-    lts->state = STOPPED;
-    return status;
+// Make a new coroutine for a line or callback, leaving the function it is to
+// run on its stack.
+static lua_State *new_coroutine(LuaThreadState *lts)
+{
+    lua_State *co = lua_newthread(lts->L);
+    lts->co_ref = luaL_ref(lts->L, LUA_REGISTRYINDEX);
+    return co;
+}
+
+static void end_coroutine(LuaThreadState *lts)
+{
+    luaL_unref(lts->L, LUA_REGISTRYINDEX, lts->co_ref);
+    lts->co_ref = LUA_NOREF;
+}
+
+// Run the script until it is done with its job or its slice is over.
+// Returns 1 when the job is done.
+static int run_slice(LuaThreadState *lts, int job, ControlEvent *event,
+                     int callback_ref, const char *callback_name)
+{
+    if (lts->L == NULL) {
+        open_script(lts);
+    }
+    lua_State *L = lts->L;
+    lua_State *co;
+    int narg = 0;
+    if (job == JOB_LINE) {
+        int status = loadline(lts);
+        if (status != LUA_OK) {
+            report(lts, L, status);
+            return 1;
+        }
+        luaJIT_setmode(L, -1, LUAJIT_MODE_ALLFUNC | LUAJIT_MODE_OFF);
+        co = new_coroutine(lts);
+        lua_xmove(L, co, 1);
+    } else if (job == JOB_CALLBACK) {
+        co = new_coroutine(lts);
+        if (callback_ref != LUA_NOREF) {
+            lua_rawgeti(co, LUA_REGISTRYINDEX, callback_ref);
+        } else {
+            lua_getglobal(co, callback_name);
+        }
+        if (!lua_isfunction(co, -1)) {
+            add_message(lts->player_id, "Control callback is not a function");
+            end_coroutine(lts);
+            return 1;
+        }
+        luaJIT_setmode(co, -1, LUAJIT_MODE_ALLFUNC | LUAJIT_MODE_OFF);
+        lua_pushinteger(co, event->player_id);
+        lua_pushinteger(co, event->x);
+        lua_pushinteger(co, event->y);
+        lua_pushinteger(co, event->z);
+        lua_pushinteger(co, event->face);
+        narg = 5;
+    } else {
+        lua_rawgeti(L, LUA_REGISTRYINDEX, lts->co_ref);
+        co = lua_tothread(L, -1);
+        lua_pop(L, 1);
+    }
+
+    slice_co = co;
+    slice_end = monotonic_seconds() + SCRIPT_SLICE;
+    int status = lua_resume(co, narg);
+    slice_co = NULL;
+    if (status == LUA_YIELD) {
+        lua_settop(co, 0);  // anything yielded by the script is dropped
+        return 0;
+    }
+    if (status == LUA_OK) {
+        l_print(lts, co);
+    } else {
+        luaL_traceback(L, co, lua_tostring(co, -1), 0);
+        report(lts, L, status);
+    }
+    lua_settop(L, 0);
+    end_coroutine(lts);
+    return 1;
+}
+
+static int script_worker_run(__attribute__((unused)) void *arg)
+{
+    mtx_lock(&mtx);
+    while (1) {
+        LuaThreadState *lts = dequeue();
+        if (lts == NULL) {
+            cnd_wait(&cnd, &mtx);
+            continue;
+        }
+        if (lts->removed) {
+            close_script(lts);
+            free(lts);
+            continue;
+        }
+        lts->state = RUNNING;
+        int job = JOB_NONE;
+        ControlEvent event = {0, 0, 0, 0, 0};
+        int callback_ref = lts->callback_ref;
+        char callback_name[LUA_MAX_CALLBACK_NAME];
+        snprintf(callback_name, LUA_MAX_CALLBACK_NAME, "%s",
+                 lts->control_callback);
+        if (lts->co_ref != LUA_NOREF) {
+            job = JOB_NONE;  // carry on with the one in progress
+        } else if (lts->event_count > 0) {
+            job = JOB_CALLBACK;
+            event = lts->events[0];
+            lts->event_count--;
+            memmove(lts->events, lts->events + 1,
+                    sizeof(ControlEvent) * lts->event_count);
+        } else if (lts->has_line) {
+            job = JOB_LINE;
+            memcpy(lts->lua_code, lts->line, LUA_MAXINPUT);
+            lts->has_line = 0;
+            lts->running_line = 1;
+        } else {
+            lts->state = IDLE;
+            continue;
+        }
+        mtx_unlock(&mtx);
+        int done = run_slice(lts, job, &event, callback_ref, callback_name);
+        mtx_lock(&mtx);
+        if (lts->removed) {
+            close_script(lts);
+            free(lts);
+        } else if (!done && lts->waiting) {
+            lts->state = WAITING;
+        } else if (!done) {
+            enqueue(lts);
+        } else if (!lts->is_shell && lts->running_line) {
+            close_script(lts);
+            lts->state = STOPPED;
+        } else {
+            if (job == JOB_LINE) {
+                lts->running_line = 0;
+            }
+            if (lts->has_line || lts->event_count > 0) {
+                enqueue(lts);
+            } else {
+                lts->state = IDLE;
+            }
+        }
+    }
+    return 0;
 }
 
 /******************************************************************************
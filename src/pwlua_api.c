@@ -2,6 +2,7 @@
 #include <lua.h>
 #include <lualib.h>
 #include <lauxlib.h>
+#include <string.h>
 #include "action.h"
 #include "config.h"
 #include "chunk.h"
@@ -13,6 +14,8 @@
 #include "noise.h"
 #include "pw.h"
 #include "pwlua.h"
+#include "pwlua_worldgen.h"
+#include "snapshot.h"
 #include "world.h"
 
 static int pwlua_echo(lua_State *L);
@@ -41,15 +44,6 @@ static int pwlua_set_open(lua_State *L);
 static int pwlua_set_shell(lua_State *L);
 static int pwlua_sync_world(lua_State *L);
 
-static int pwlua_map_set(lua_State *L);
-static int pwlua_map_set_extra(lua_State *L);
-static int pwlua_map_set_light(lua_State *L);
-static int pwlua_map_set_shape(lua_State *L);
-static int pwlua_map_set_transform(lua_State *L);
-static int pwlua_map_set_sign(lua_State *L);
-static int pwlua_simplex2(lua_State *L);
-static int pwlua_simplex3(lua_State *L);
-
 static int pwlua_menu_add_item(lua_State *L);
 static int pwlua_menu_set_title(lua_State *L);
 static int pwlua_menu_get_title(lua_State *L);
@@ -106,118 +100,6 @@ void pwlua_api_add_functions(lua_State *L)
     lua_register(L, "pw_exit", pwlua_pw_exit);
 }
 
-void pwlua_api_add_worldgen_functions(lua_State *L)
-{
-    lua_register(L, "map_set", pwlua_map_set);
-    lua_register(L, "map_set_extra", pwlua_map_set_extra);
-    lua_register(L, "map_set_light", pwlua_map_set_light);
-    lua_register(L, "map_set_shape", pwlua_map_set_shape);
-    lua_register(L, "map_set_transform", pwlua_map_set_transform);
-    lua_register(L, "map_set_sign", pwlua_map_set_sign);
-    lua_register(L, "simplex2", pwlua_simplex2);
-    lua_register(L, "simplex3", pwlua_simplex3);
-}
-
-void pwlua_api_add_constants(lua_State *L)
-{
-#define PUSH_CONST(b) { lua_pushnumber(L, b); \
-    lua_setglobal(L, ""#b""); }
-
-    PUSH_CONST(CHUNK_SIZE);
-    PUSH_CONST(BEDROCK);
-
-    PUSH_CONST(EMPTY);
-    PUSH_CONST(GRASS);
-    PUSH_CONST(SAND);
-    PUSH_CONST(STONE);
-    PUSH_CONST(BRICK);
-    PUSH_CONST(WOOD);
-    PUSH_CONST(CEMENT);
-    PUSH_CONST(DIRT);
-    PUSH_CONST(PLANK);
-    PUSH_CONST(SNOW);
-    PUSH_CONST(GLASS);
-    PUSH_CONST(COBBLE);
-    PUSH_CONST(LIGHT_STONE);
-    PUSH_CONST(DARK_STONE);
-    PUSH_CONST(CHEST);
-    PUSH_CONST(LEAVES);
-    PUSH_CONST(TALL_GRASS);
-    PUSH_CONST(YELLOW_FLOWER);
-    PUSH_CONST(RED_FLOWER);
-    PUSH_CONST(PURPLE_FLOWER);
-    PUSH_CONST(SUN_FLOWER);
-    PUSH_CONST(WHITE_FLOWER);
-    PUSH_CONST(BLUE_FLOWER);
-    PUSH_CONST(COLOR_00);
-    PUSH_CONST(COLOR_01);
-    PUSH_CONST(COLOR_02);
-    PUSH_CONST(COLOR_03);
-    PUSH_CONST(COLOR_04);
-    PUSH_CONST(COLOR_05);
-    PUSH_CONST(COLOR_06);
-    PUSH_CONST(COLOR_07);
-    PUSH_CONST(COLOR_08);
-    PUSH_CONST(COLOR_09);
-    PUSH_CONST(COLOR_10);
-    PUSH_CONST(COLOR_11);
-    PUSH_CONST(COLOR_12);
-    PUSH_CONST(COLOR_13);
-    PUSH_CONST(COLOR_14);
-    PUSH_CONST(COLOR_15);
-    PUSH_CONST(COLOR_16);
-    PUSH_CONST(COLOR_17);
-    PUSH_CONST(COLOR_18);
-    PUSH_CONST(COLOR_19);
-    PUSH_CONST(COLOR_20);
-    PUSH_CONST(COLOR_21);
-    PUSH_CONST(COLOR_22);
-    PUSH_CONST(COLOR_23);
-    PUSH_CONST(COLOR_24);
-    PUSH_CONST(COLOR_25);
-    PUSH_CONST(COLOR_26);
-    PUSH_CONST(COLOR_27);
-    PUSH_CONST(COLOR_28);
-    PUSH_CONST(COLOR_29);
-    PUSH_CONST(COLOR_30);
-    PUSH_CONST(COLOR_31);
-
-    PUSH_CONST(CUBE);
-    PUSH_CONST(SLAB1);
-    PUSH_CONST(SLAB2);
-    PUSH_CONST(SLAB3);
-    PUSH_CONST(SLAB4);
-    PUSH_CONST(SLAB5);
-    PUSH_CONST(SLAB6);
-    PUSH_CONST(SLAB7);
-    PUSH_CONST(SLAB8);
-    PUSH_CONST(SLAB9);
-    PUSH_CONST(SLAB10);
-    PUSH_CONST(SLAB11);
-    PUSH_CONST(SLAB12);
-    PUSH_CONST(SLAB13);
-    PUSH_CONST(SLAB14);
-    PUSH_CONST(SLAB15);
-    PUSH_CONST(UPPER_DOOR);
-    PUSH_CONST(LOWER_DOOR);
-    PUSH_CONST(FENCE);
-    PUSH_CONST(FENCE_POST);
-    PUSH_CONST(FENCE_HALF);
-    PUSH_CONST(FENCE_L);
-    PUSH_CONST(FENCE_T);
-    PUSH_CONST(FENCE_X);
-    PUSH_CONST(GATE);
-
-    PUSH_CONST(DOOR_X);
-    PUSH_CONST(DOOR_X_PLUS);
-    PUSH_CONST(DOOR_Z);
-    PUSH_CONST(DOOR_Z_PLUS);
-    PUSH_CONST(DOOR_X_FLIP);
-    PUSH_CONST(DOOR_X_PLUS_FLIP);
-    PUSH_CONST(DOOR_Z_FLIP);
-    PUSH_CONST(DOOR_Z_PLUS_FLIP);
-}
-
 static int pwlua_echo(lua_State *L)
 {
     int player_id;
@@ -247,7 +129,7 @@ static int pwlua_get_block(lua_State *L)
     x = luaL_checkint(L, 1);
     y = luaL_checkint(L, 2);
     z = luaL_checkint(L, 3);
-    w = get_block(x, y, z);
+    w = snapshot_get_block(x, y, z);
     lua_pushinteger(L, w);
     return 1;
 }
@@ -386,9 +268,12 @@ static int pwlua_get_sign(lua_State *L)
     y = luaL_checkint(L, 2);
     z = luaL_checkint(L, 3);
     face = luaL_checkint(L, 4);
-    const char *existing_sign = (const char *) get_sign(
-        chunked(x), chunked(z), x, y, z, face);
-    lua_pushstring(L, existing_sign);
+    char text[MAX_SIGN_LENGTH];
+    if (snapshot_get_sign(x, y, z, face, text, sizeof(text))) {
+        lua_pushstring(L, text);
+    } else {
+        lua_pushnil(L);
+    }
     return 1;
 }
 
@@ -447,7 +332,7 @@ static int pwlua_get_light(lua_State *L)
     x = luaL_checkint(L, 1);
     y = luaL_checkint(L, 2);
     z = luaL_checkint(L, 3);
-    w = get_light(chunked(x), chunked(z), x, y, z);
+    w = snapshot_get_light(x, y, z);
     lua_pushinteger(L, w);
     return 1;
 }
@@ -477,7 +362,7 @@ static int pwlua_get_control(lua_State *L)
     x = luaL_checkint(L, 1);
     y = luaL_checkint(L, 2);
     z = luaL_checkint(L, 3);
-    w = is_control(get_extra(x, y, z));
+    w = is_control(snapshot_get_extra(x, y, z));
     lua_pushinteger(L, w);
     return 1;
 }
@@ -494,9 +379,9 @@ static int pwlua_set_control(lua_State *L)
     z = luaL_checkint(L, 3);
     w = luaL_checkint(L, 4);
     if (w) {
-        w = get_extra(x, y, z) | EXTRA_BIT_CONTROL;
+        w = snapshot_get_extra(x, y, z) | EXTRA_BIT_CONTROL;
     } else {
-        w = get_extra(x, y, z) & ~EXTRA_BIT_CONTROL;
+        w = snapshot_get_extra(x, y, z) & ~EXTRA_BIT_CONTROL;
     }
     queue_set_extra(x, y, z, w);
     return 0;
@@ -505,12 +390,10 @@ static int pwlua_set_control(lua_State *L)
 static int pwlua_set_control_callback(lua_State *L)
 {
     int argcount = lua_gettop(L);
-    const char *text;
     if (argcount != 1) {
         return ERROR_ARG_COUNT;
     }
-    text = lua_tolstring(L, 1, NULL);
-    set_control_block_callback(L, text);
+    set_control_block_callback(L, 1);
     return 0;
 }
 
@@ -524,7 +407,7 @@ static int pwlua_get_shape(lua_State *L)
     x = luaL_checkint(L, 1);
     y = luaL_checkint(L, 2);
     z = luaL_checkint(L, 3);
-    w = get_shape(x, y, z);
+    w = snapshot_get_shape(x, y, z);
     lua_pushinteger(L, w);
     return 1;
 }
@@ -554,7 +437,7 @@ static int pwlua_get_transform(lua_State *L)
     x = luaL_checkint(L, 1);
     y = luaL_checkint(L, 2);
     z = luaL_checkint(L, 3);
-    w = get_transform(x, y, z);
+    w = snapshot_get_transform(x, y, z);
     lua_pushinteger(L, w);
     return 1;
 }
@@ -584,7 +467,7 @@ static int pwlua_get_open(lua_State *L)
     x = luaL_checkint(L, 1);
     y = luaL_checkint(L, 2);
     z = luaL_checkint(L, 3);
-    w = is_open(get_extra(x, y, z));
+    w = is_open(snapshot_get_extra(x, y, z));
     lua_pushinteger(L, w);
     return 1;
 }
@@ -601,142 +484,14 @@ static int pwlua_set_open(lua_State *L)
     z = luaL_checkint(L, 3);
     w = luaL_checkint(L, 4);
     if (w) {
-        w = get_extra(x, y, z) | EXTRA_BIT_OPEN;
+        w = snapshot_get_extra(x, y, z) | EXTRA_BIT_OPEN;
     } else {
-        w = get_extra(x, y, z) & ~EXTRA_BIT_OPEN;
+        w = snapshot_get_extra(x, y, z) & ~EXTRA_BIT_OPEN;
     }
     queue_set_extra(x, y, z, w);
     return 0;
 }
 
-static int pwlua_map_set(lua_State *L)
-{
-    int n = lua_gettop(L);    /* number of arguments */
-    if (n != 4) {
-        lua_pushstring(L, "incorrect argument count");
-        lua_error(L);
-    }
-    int x, y, z, w;
-    void *block_map;
-
-    lua_getglobal(L, "_block_map");
-    block_map = lua_touserdata(L, -1);
-
-    x = lua_tointeger(L, 1);
-    y = lua_tointeger(L, 2);
-    z = lua_tointeger(L, 3);
-    w = lua_tointeger(L, 4);
-    map_set_func(x, y, z, w, block_map);
-    return 0;
-}
-
-static int pwlua_map_set_extra(lua_State *L)
-{
-    int n = lua_gettop(L);    /* number of arguments */
-    if (n != 4) {
-        lua_pushstring(L, "incorrect argument count");
-        lua_error(L);
-    }
-    int x, y, z, w;
-    void *extra_map;
-
-    lua_getglobal(L, "_extra_map");
-    extra_map = lua_touserdata(L, -1);
-
-    x = lua_tointeger(L, 1);
-    y = lua_tointeger(L, 2);
-    z = lua_tointeger(L, 3);
-    w = lua_tointeger(L, 4);
-    map_set_func(x, y, z, w, extra_map);
-    return 0;
-}
-
-static int pwlua_map_set_light(lua_State *L)
-{
-    int n = lua_gettop(L);    /* number of arguments */
-    if (n != 4) {
-        lua_pushstring(L, "incorrect argument count");
-        lua_error(L);
-    }
-    int x, y, z, w;
-    void *light_map;
-
-    lua_getglobal(L, "_light_map");
-    light_map = lua_touserdata(L, -1);
-
-    x = lua_tointeger(L, 1);
-    y = lua_tointeger(L, 2);
-    z = lua_tointeger(L, 3);
-    w = lua_tointeger(L, 4);
-    map_set_func(x, y, z, w, light_map);
-    return 0;
-}
-
-static int pwlua_map_set_shape(lua_State *L)
-{
-    int n = lua_gettop(L);    /* number of arguments */
-    if (n != 4) {
-        lua_pushstring(L, "incorrect argument count");
-        lua_error(L);
-    }
-    int x, y, z, w;
-    void *shape_map;
-
-    lua_getglobal(L, "_shape_map");
-    shape_map = lua_touserdata(L, -1);
-
-    x = lua_tointeger(L, 1);
-    y = lua_tointeger(L, 2);
-    z = lua_tointeger(L, 3);
-    w = lua_tointeger(L, 4);
-    map_set_func(x, y, z, w, shape_map);
-    return 0;
-}
-
-static int pwlua_map_set_transform(lua_State *L)
-{
-    int n = lua_gettop(L);    /* number of arguments */
-    if (n != 4) {
-        lua_pushstring(L, "incorrect argument count");
-        lua_error(L);
-    }
-    int x, y, z, w;
-    void *transform_map;
-
-    lua_getglobal(L, "_transform_map");
-    transform_map = lua_touserdata(L, -1);
-
-    x = lua_tointeger(L, 1);
-    y = lua_tointeger(L, 2);
-    z = lua_tointeger(L, 3);
-    w = lua_tointeger(L, 4);
-    map_set_func(x, y, z, w, transform_map);
-    return 0;
-}
-
-static int pwlua_map_set_sign(lua_State *L)
-{
-    int n = lua_gettop(L);    /* number of arguments */
-    if (n != 5) {
-        lua_pushstring(L, "incorrect argument count");
-        lua_error(L);
-    }
-    int x, y, z, face;
-    const char *text;
-    void *sign_list;
-
-    lua_getglobal(L, "_sign_list");
-    sign_list = lua_touserdata(L, -1);
-
-    x = lua_tointeger(L, 1);
-    y = lua_tointeger(L, 2);
-    z = lua_tointeger(L, 3);
-    face = lua_tointeger(L, 4);
-    text = lua_tolstring(L, 5, NULL);
-    worldgen_set_sign(x, y, z, face, text, sign_list);
-    return 0;
-}
-
 static int pwlua_set_shell(lua_State *L)
 {
     int argcount = lua_gettop(L);
@@ -757,41 +512,7 @@ static int pwlua_sync_world(lua_State *L)
     if (argcount != 0) {
         return ERROR_ARG_COUNT;
     }
-    drain_edit_queue(100000, 1, 0);
-    return 0;
-}
-
-static int pwlua_simplex2(lua_State *L)
-{
-    float x, y;
-    int octaves;
-    float persistence;
-    float lacunarity;
-    x = lua_tonumber(L, 1);
-    y = lua_tonumber(L, 2);
-    octaves = lua_tointeger(L, 3);
-    persistence = lua_tonumber(L, 4);
-    lacunarity = lua_tonumber(L, 5);
-    float v = simplex2(x, y, octaves, persistence, lacunarity);
-    lua_pushnumber(L, v);
-    return 1;
-}
-
-static int pwlua_simplex3(lua_State *L)
-{
-    float x, y, z;
-    int octaves;
-    float persistence;
-    float lacunarity;
-    x = lua_tonumber(L, 1);
-    y = lua_tonumber(L, 2);
-    z = lua_tonumber(L, 3);
-    octaves = lua_tointeger(L, 4);
-    persistence = lua_tonumber(L, 5);
-    lacunarity = lua_tonumber(L, 6);
-    float v = simplex3(x, y, z, octaves, persistence, lacunarity);
-    lua_pushnumber(L, v);
-    return 1;
+    return pwlua_sync(L);
 }
 
 static int pwlua_menu_set_title(lua_State *L)
@@ -12,6 +12,7 @@ Lua startup script handling, including registering of any on_* event handlers.
 #include "pw.h"
 #include "pwlua.h"
 #include "pwlua_api.h"
+#include "pwlua_worldgen_api.h"
 #include "stb_ds.h"
 #include "ui.h"
 
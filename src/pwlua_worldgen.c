@@ -1,44 +1,156 @@
 
-#include "pw.h"
-#include "pwlua_api.h"
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "map.h"
 #include "pwlua_worldgen.h"
+#include "pwlua_worldgen_api.h"
+
+// Data a worldgen script makes once, in its worldgen_shared_init function,
+// for all of its Lua states to read. Each state holds a reference so the
+// data outlives a worldgen change until the workers using it are done.
+typedef struct {
+    atomic_int refs;
+    size_t size;
+    char data[];
+} SharedRegion;
 
 lua_State *lua_worldgen_for_main_thread;
 char *lua_worldgen_path;
+static SharedRegion *shared_region;
+
+static void release_shared_region(SharedRegion *region)
+{
+    if (region && atomic_fetch_sub(&region->refs, 1) == 1) {
+        free(region);
+    }
+}
+
+static int shared_region_gc(lua_State *L)
+{
+    SharedRegion **handle = lua_touserdata(L, 1);
+    release_shared_region(*handle);
+    *handle = NULL;
+    return 0;
+}
+
+static void attach_shared_region(lua_State *L)
+{
+    SharedRegion **handle = lua_newuserdata(L, sizeof(SharedRegion *));
+    *handle = shared_region;
+    if (shared_region) {
+        atomic_fetch_add(&shared_region->refs, 1);
+    }
+    lua_createtable(L, 0, 1);
+    lua_pushcfunction(L, shared_region_gc);
+    lua_setfield(L, -2, "__gc");
+    lua_setmetatable(L, -2);
+    lua_setfield(L, LUA_REGISTRYINDEX, WORLDGEN_SHARED);
+}
+
+static void make_shared_region(lua_State *L)
+{
+    lua_getglobal(L, "worldgen_shared_init");
+    if (!lua_isfunction(L, -1)) {
+        lua_pop(L, 1);
+        return;
+    }
+    if (lua_pcall(L, 0, 1, 0) != 0) {
+        printf("error running function 'worldgen_shared_init': %s\n",
+               lua_tostring(L, -1));
+        lua_pop(L, 1);
+        return;
+    }
+    size_t size;
+    const char *data = lua_tolstring(L, -1, &size);
+    if (data) {
+        shared_region = malloc(sizeof(SharedRegion) + size);
+        atomic_init(&shared_region->refs, 1);
+        shared_region->size = size;
+        memcpy(shared_region->data, data, size);
+        attach_shared_region(L);
+    }
+    lua_pop(L, 1);
+}
+
+// worldgen_shared() returns a pointer to the data made by
+// worldgen_shared_init, to be read with the LuaJIT FFI, and its size in
+// bytes. Returns nil if there is none.
+int pwlua_worldgen_shared(lua_State *L)
+{
+    lua_getfield(L, LUA_REGISTRYINDEX, WORLDGEN_SHARED);
+    SharedRegion **handle = lua_touserdata(L, -1);
+    lua_pop(L, 1);
+    if (handle == NULL || *handle == NULL) {
+        lua_pushnil(L);
+        return 1;
+    }
+    lua_pushlightuserdata(L, (*handle)->data);
+    lua_pushinteger(L, (*handle)->size);
+    return 2;
+}
+
+// Add the blocks written to the volume to the block map, blocks in the
+// volume replace any set for the same position with map_set.
+static void commit_volume(WorldgenTarget *target, int p, int q)
+{
+    Map *block_map = target->block_map;
+    int x0 = p * CHUNK_SIZE - 1;
+    int z0 = q * CHUNK_SIZE - 1;
+    signed char *column = target->volume;
+    for (int a = 0; a < VOLUME_SIZE; a++) {
+        for (int b = 0; b < VOLUME_SIZE; b++) {
+            for (int y = 0; y < CHUNK_HEIGHT; y++) {
+                if (column[y]) {
+                    map_set(block_map, x0 + a, y, z0 + b, column[y]);
+                }
+            }
+            column += CHUNK_HEIGHT;
+        }
+    }
+}
 
 void pwlua_worldgen(lua_State *L, int p, int q, void *block_map,
     void *extra_map, void *light_map, void *shape_map, void *sign_list,
     void *transform_map)
 {
-    lua_pushlightuserdata(L, block_map);
-    lua_setglobal(L, "_block_map");
-    lua_pushlightuserdata(L, extra_map);
-    lua_setglobal(L, "_extra_map");
-    lua_pushlightuserdata(L, light_map);
-    lua_setglobal(L, "_light_map");
-    lua_pushlightuserdata(L, shape_map);
-    lua_setglobal(L, "_shape_map");
-    lua_pushlightuserdata(L, sign_list);
-    lua_setglobal(L, "_sign_list");
-    lua_pushlightuserdata(L, transform_map);
-    lua_setglobal(L, "_transform_map");
+    lua_getfield(L, LUA_REGISTRYINDEX, WORLDGEN_TARGET);
+    WorldgenTarget *target = lua_touserdata(L, -1);
+    lua_pop(L, 1);
+    target->block_map = block_map;
+    target->extra_map = extra_map;
+    target->light_map = light_map;
+    target->shape_map = shape_map;
+    target->sign_list = sign_list;
+    target->transform_map = transform_map;
+    if (target->volume_used) {
+        memset(target->volume, 0, sizeof(target->volume));
+    }
 
     lua_getfield(L, LUA_GLOBALSINDEX, "worldgen");  /* function to be called */
     lua_pushinteger(L, p);                          /* 1st argument */
     lua_pushinteger(L, q);                          /* 2nd argument */
     lua_call(L, 2, 0);     /* call 'worldgen' with 2 arguments and 0 results */
+
+    if (target->volume_used) {
+        commit_volume(target, p, q);
+    }
 }
 
 void pwlua_worldgen_init(char *filename)
 {
     lua_worldgen_path = filename;
     lua_worldgen_for_main_thread = pwlua_worldgen_new_generator();
+    make_shared_region(lua_worldgen_for_main_thread);
 }
 
 void pwlua_worldgen_deinit(void)
 {
     lua_close(lua_worldgen_for_main_thread);
     lua_worldgen_for_main_thread = NULL;
+    release_shared_region(shared_region);
+    shared_region = NULL;
 }
 
 lua_State *pwlua_worldgen_new_generator(void)
@@ -48,6 +160,7 @@ lua_State *pwlua_worldgen_new_generator(void)
     luaL_openlibs(L);
     pwlua_api_add_constants(L);
     pwlua_api_add_worldgen_functions(L);
+    attach_shared_region(L);
 
     luaL_dofile(L, lua_worldgen_path);
 
@@ -3,8 +3,31 @@
 #include <lua.h>
 #include <lualib.h>
 #include <lauxlib.h>
+#include "config.h"
 #include "world.h"
 
+#define WORLDGEN_TARGET "pw_worldgen_target"
+#define WORLDGEN_SHARED "pw_worldgen_shared"
+
+// A worldgen script can write the blocks of the chunk and its 1 block border
+// straight into this volume using the LuaJIT FFI, saving a call into C for
+// every block. Columns are stored one after the other, the block at
+// (x, y, z) is at ((x - x0) * VOLUME_SIZE + (z - z0)) * CHUNK_HEIGHT + y where
+// x0 and z0 are the chunk's first x and z less 1.
+#define VOLUME_SIZE (CHUNK_SIZE + 2)
+
+// Where the worldgen functions write, set for each chunk generated.
+typedef struct {
+    void *block_map;
+    void *extra_map;
+    void *light_map;
+    void *shape_map;
+    void *sign_list;
+    void *transform_map;
+    int volume_used;
+    signed char volume[VOLUME_SIZE * VOLUME_SIZE * CHUNK_HEIGHT];
+} WorldgenTarget;
+
 void pwlua_worldgen(lua_State *L, int p, int q, void *block_map,
     void *extra_map, void *light_map, void *shape_map, void *sign_list,
     void *transform_map);
@@ -12,4 +35,4 @@ void pwlua_worldgen_init(char *filename);
 void pwlua_worldgen_deinit(void);
 lua_State *pwlua_worldgen_new_generator(void);
 lua_State *pwlua_worldgen_get_main_thread_instance(void);
-
+int pwlua_worldgen_shared(lua_State *L);
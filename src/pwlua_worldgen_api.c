@@ -0,0 +1,379 @@
+#include <lua.h>
+#include <lualib.h>
+#include <lauxlib.h>
+#include <stdlib.h>
+#include <string.h>
+#include "item.h"
+#include "map.h"
+#include "noise.h"
+#include "pwlua_worldgen.h"
+#include "pwlua_worldgen_api.h"
+#include "sign.h"
+
+static int pwlua_map_set(lua_State *L);
+static int pwlua_map_set_extra(lua_State *L);
+static int pwlua_map_set_light(lua_State *L);
+static int pwlua_map_set_shape(lua_State *L);
+static int pwlua_map_set_transform(lua_State *L);
+static int pwlua_map_set_sign(lua_State *L);
+static int pwlua_worldgen_volume(lua_State *L);
+static int pwlua_simplex2(lua_State *L);
+static int pwlua_simplex3(lua_State *L);
+static int pwlua_simplex2_grid(lua_State *L);
+static int pwlua_simplex3_grid(lua_State *L);
+
+// The map functions find the maps of the chunk being generated through an
+// upvalue instead of looking up globals on every call.
+static void register_worldgen_function(lua_State *L, const char *name,
+    lua_CFunction f)
+{
+    lua_getfield(L, LUA_REGISTRYINDEX, WORLDGEN_TARGET);
+    lua_pushcclosure(L, f, 1);
+    lua_setglobal(L, name);
+}
+
+void pwlua_api_add_worldgen_functions(lua_State *L)
+{
+    WorldgenTarget *target = lua_newuserdata(L, sizeof(WorldgenTarget));
+    memset(target, 0, sizeof(WorldgenTarget));
+    lua_setfield(L, LUA_REGISTRYINDEX, WORLDGEN_TARGET);
+
+    register_worldgen_function(L, "map_set", pwlua_map_set);
+    register_worldgen_function(L, "map_set_extra", pwlua_map_set_extra);
+    register_worldgen_function(L, "map_set_light", pwlua_map_set_light);
+    register_worldgen_function(L, "map_set_shape", pwlua_map_set_shape);
+    register_worldgen_function(L, "map_set_transform",
+        pwlua_map_set_transform);
+    register_worldgen_function(L, "map_set_sign", pwlua_map_set_sign);
+    register_worldgen_function(L, "worldgen_volume", pwlua_worldgen_volume);
+    lua_register(L, "worldgen_shared", pwlua_worldgen_shared);
+    lua_register(L, "simplex2", pwlua_simplex2);
+    lua_register(L, "simplex3", pwlua_simplex3);
+    lua_register(L, "simplex2_grid", pwlua_simplex2_grid);
+    lua_register(L, "simplex3_grid", pwlua_simplex3_grid);
+}
+
+void pwlua_api_add_constants(lua_State *L)
+{
+#define PUSH_CONST(b) { lua_pushnumber(L, b); \
+    lua_setglobal(L, ""#b""); }
+
+    PUSH_CONST(CHUNK_SIZE);
+    PUSH_CONST(CHUNK_HEIGHT);
+    PUSH_CONST(VOLUME_SIZE);
+    PUSH_CONST(BEDROCK);
+
+    PUSH_CONST(EMPTY);
+    PUSH_CONST(GRASS);
+    PUSH_CONST(SAND);
+    PUSH_CONST(STONE);
+    PUSH_CONST(BRICK);
+    PUSH_CONST(WOOD);
+    PUSH_CONST(CEMENT);
+    PUSH_CONST(DIRT);
+    PUSH_CONST(PLANK);
+    PUSH_CONST(SNOW);
+    PUSH_CONST(GLASS);
+    PUSH_CONST(COBBLE);
+    PUSH_CONST(LIGHT_STONE);
+    PUSH_CONST(DARK_STONE);
+    PUSH_CONST(CHEST);
+    PUSH_CONST(LEAVES);
+    PUSH_CONST(TALL_GRASS);
+    PUSH_CONST(YELLOW_FLOWER);
+    PUSH_CONST(RED_FLOWER);
+    PUSH_CONST(PURPLE_FLOWER);
+    PUSH_CONST(SUN_FLOWER);
+    PUSH_CONST(WHITE_FLOWER);
+    PUSH_CONST(BLUE_FLOWER);
+    PUSH_CONST(COLOR_00);
+    PUSH_CONST(COLOR_01);
+    PUSH_CONST(COLOR_02);
+    PUSH_CONST(COLOR_03);
+    PUSH_CONST(COLOR_04);
+    PUSH_CONST(COLOR_05);
+    PUSH_CONST(COLOR_06);
+    PUSH_CONST(COLOR_07);
+    PUSH_CONST(COLOR_08);
+    PUSH_CONST(COLOR_09);
+    PUSH_CONST(COLOR_10);
+    PUSH_CONST(COLOR_11);
+    PUSH_CONST(COLOR_12);
+    PUSH_CONST(COLOR_13);
+    PUSH_CONST(COLOR_14);
+    PUSH_CONST(COLOR_15);
+    PUSH_CONST(COLOR_16);
+    PUSH_CONST(COLOR_17);
+    PUSH_CONST(COLOR_18);
+    PUSH_CONST(COLOR_19);
+    PUSH_CONST(COLOR_20);
+    PUSH_CONST(COLOR_21);
+    PUSH_CONST(COLOR_22);
+    PUSH_CONST(COLOR_23);
+    PUSH_CONST(COLOR_24);
+    PUSH_CONST(COLOR_25);
+    PUSH_CONST(COLOR_26);
+    PUSH_CONST(COLOR_27);
+    PUSH_CONST(COLOR_28);
+    PUSH_CONST(COLOR_29);
+    PUSH_CONST(COLOR_30);
+    PUSH_CONST(COLOR_31);
+
+    PUSH_CONST(CUBE);
+    PUSH_CONST(SLAB1);
+    PUSH_CONST(SLAB2);
+    PUSH_CONST(SLAB3);
+    PUSH_CONST(SLAB4);
+    PUSH_CONST(SLAB5);
+    PUSH_CONST(SLAB6);
+    PUSH_CONST(SLAB7);
+    PUSH_CONST(SLAB8);
+    PUSH_CONST(SLAB9);
+    PUSH_CONST(SLAB10);
+    PUSH_CONST(SLAB11);
+    PUSH_CONST(SLAB12);
+    PUSH_CONST(SLAB13);
+    PUSH_CONST(SLAB14);
+    PUSH_CONST(SLAB15);
+    PUSH_CONST(UPPER_DOOR);
+    PUSH_CONST(LOWER_DOOR);
+    PUSH_CONST(FENCE);
+    PUSH_CONST(FENCE_POST);
+    PUSH_CONST(FENCE_HALF);
+    PUSH_CONST(FENCE_L);
+    PUSH_CONST(FENCE_T);
+    PUSH_CONST(FENCE_X);
+    PUSH_CONST(GATE);
+
+    PUSH_CONST(DOOR_X);
+    PUSH_CONST(DOOR_X_PLUS);
+    PUSH_CONST(DOOR_Z);
+    PUSH_CONST(DOOR_Z_PLUS);
+    PUSH_CONST(DOOR_X_FLIP);
+    PUSH_CONST(DOOR_X_PLUS_FLIP);
+    PUSH_CONST(DOOR_Z_FLIP);
+    PUSH_CONST(DOOR_Z_PLUS_FLIP);
+}
+
+static int pwlua_map_set(lua_State *L)
+{
+    int n = lua_gettop(L);    /* number of arguments */
+    if (n != 4) {
+        lua_pushstring(L, "incorrect argument count");
+        lua_error(L);
+    }
+    int x, y, z, w;
+    WorldgenTarget *target = lua_touserdata(L, lua_upvalueindex(1));
+    void *block_map = target->block_map;
+
+    x = lua_tointeger(L, 1);
+    y = lua_tointeger(L, 2);
+    z = lua_tointeger(L, 3);
+    w = lua_tointeger(L, 4);
+    map_set(block_map, x, y, z, w);
+    return 0;
+}
+
+static int pwlua_map_set_extra(lua_State *L)
+{
+    int n = lua_gettop(L);    /* number of arguments */
+    if (n != 4) {
+        lua_pushstring(L, "incorrect argument count");
+        lua_error(L);
+    }
+    int x, y, z, w;
+    WorldgenTarget *target = lua_touserdata(L, lua_upvalueindex(1));
+    void *extra_map = target->extra_map;
+
+    x = lua_tointeger(L, 1);
+    y = lua_tointeger(L, 2);
+    z = lua_tointeger(L, 3);
+    w = lua_tointeger(L, 4);
+    map_set(extra_map, x, y, z, w);
+    return 0;
+}
+
+static int pwlua_map_set_light(lua_State *L)
+{
+    int n = lua_gettop(L);    /* number of arguments */
+    if (n != 4) {
+        lua_pushstring(L, "incorrect argument count");
+        lua_error(L);
+    }
+    int x, y, z, w;
+    WorldgenTarget *target = lua_touserdata(L, lua_upvalueindex(1));
+    void *light_map = target->light_map;
+
+    x = lua_tointeger(L, 1);
+    y = lua_tointeger(L, 2);
+    z = lua_tointeger(L, 3);
+    w = lua_tointeger(L, 4);
+    map_set(light_map, x, y, z, w);
+    return 0;
+}
+
+static int pwlua_map_set_shape(lua_State *L)
+{
+    int n = lua_gettop(L);    /* number of arguments */
+    if (n != 4) {
+        lua_pushstring(L, "incorrect argument count");
+        lua_error(L);
+    }
+    int x, y, z, w;
+    WorldgenTarget *target = lua_touserdata(L, lua_upvalueindex(1));
+    void *shape_map = target->shape_map;
+
+    x = lua_tointeger(L, 1);
+    y = lua_tointeger(L, 2);
+    z = lua_tointeger(L, 3);
+    w = lua_tointeger(L, 4);
+    map_set(shape_map, x, y, z, w);
+    return 0;
+}
+
+static int pwlua_map_set_transform(lua_State *L)
+{
+    int n = lua_gettop(L);    /* number of arguments */
+    if (n != 4) {
+        lua_pushstring(L, "incorrect argument count");
+        lua_error(L);
+    }
+    int x, y, z, w;
+    WorldgenTarget *target = lua_touserdata(L, lua_upvalueindex(1));
+    void *transform_map = target->transform_map;
+
+    x = lua_tointeger(L, 1);
+    y = lua_tointeger(L, 2);
+    z = lua_tointeger(L, 3);
+    w = lua_tointeger(L, 4);
+    map_set(transform_map, x, y, z, w);
+    return 0;
+}
+
+static int pwlua_map_set_sign(lua_State *L)
+{
+    int n = lua_gettop(L);    /* number of arguments */
+    if (n != 5) {
+        lua_pushstring(L, "incorrect argument count");
+        lua_error(L);
+    }
+    int x, y, z, face;
+    const char *text;
+    WorldgenTarget *target = lua_touserdata(L, lua_upvalueindex(1));
+    void *sign_list = target->sign_list;
+
+    x = lua_tointeger(L, 1);
+    y = lua_tointeger(L, 2);
+    z = lua_tointeger(L, 3);
+    face = lua_tointeger(L, 4);
+    text = lua_tolstring(L, 5, NULL);
+    sign_list_add(sign_list, x, y, z, face, text);
+    return 0;
+}
+
+static int pwlua_worldgen_volume(lua_State *L)
+{
+    WorldgenTarget *target = lua_touserdata(L, lua_upvalueindex(1));
+    target->volume_used = 1;
+    lua_pushlightuserdata(L, target->volume);
+    return 1;
+}
+
+static int pwlua_simplex2(lua_State *L)
+{
+    float x, y;
+    int octaves;
+    float persistence;
+    float lacunarity;
+    x = lua_tonumber(L, 1);
+    y = lua_tonumber(L, 2);
+    octaves = lua_tointeger(L, 3);
+    persistence = lua_tonumber(L, 4);
+    lacunarity = lua_tonumber(L, 5);
+    float v = simplex2(x, y, octaves, persistence, lacunarity);
+    lua_pushnumber(L, v);
+    return 1;
+}
+
+static int pwlua_simplex3(lua_State *L)
+{
+    float x, y, z;
+    int octaves;
+    float persistence;
+    float lacunarity;
+    x = lua_tonumber(L, 1);
+    y = lua_tonumber(L, 2);
+    z = lua_tonumber(L, 3);
+    octaves = lua_tointeger(L, 4);
+    persistence = lua_tonumber(L, 5);
+    lacunarity = lua_tonumber(L, 6);
+    float v = simplex3(x, y, z, octaves, persistence, lacunarity);
+    lua_pushnumber(L, v);
+    return 1;
+}
+
+#define MAX_NOISE_GRID_SAMPLES (1 << 20)
+
+static void push_noise_grid(lua_State *L, float *samples, int count)
+{
+    lua_createtable(L, count, 0);
+    for (int i = 0; i < count; i++) {
+        lua_pushnumber(L, samples[i]);
+        lua_rawseti(L, -2, i + 1);
+    }
+}
+
+// simplex2_grid(x0, y0, nx, ny, sx, sy, octaves, persistence, lacunarity)
+// returns an array where t[i * ny + j + 1] is
+// simplex2((x0 + i) * sx, (y0 + j) * sy, octaves, persistence, lacunarity).
+static int pwlua_simplex2_grid(lua_State *L)
+{
+    int x0 = luaL_checkint(L, 1);
+    int y0 = luaL_checkint(L, 2);
+    int nx = luaL_checkint(L, 3);
+    int ny = luaL_checkint(L, 4);
+    double sx = luaL_checknumber(L, 5);
+    double sy = luaL_checknumber(L, 6);
+    int octaves = luaL_checkint(L, 7);
+    float persistence = luaL_checknumber(L, 8);
+    float lacunarity = luaL_checknumber(L, 9);
+    if (nx <= 0 || ny <= 0 || nx > MAX_NOISE_GRID_SAMPLES / ny) {
+        return luaL_error(L, "simplex2_grid: bad grid size %dx%d", nx, ny);
+    }
+    float *samples = malloc(sizeof(float) * nx * ny);
+    simplex2_grid(samples, x0, y0, nx, ny, sx, sy, octaves, persistence,
+        lacunarity);
+    push_noise_grid(L, samples, nx * ny);
+    free(samples);
+    return 1;
+}
+
+// simplex3_grid(x0, y0, z0, nx, ny, nz, sx, sy, sz, octaves, persistence,
+// lacunarity) returns an array where t[(i * ny + j) * nz + k + 1] is
+// simplex3((x0 + i) * sx, (y0 + j) * sy, (z0 + k) * sz, ...).
+static int pwlua_simplex3_grid(lua_State *L)
+{
+    int x0 = luaL_checkint(L, 1);
+    int y0 = luaL_checkint(L, 2);
+    int z0 = luaL_checkint(L, 3);
+    int nx = luaL_checkint(L, 4);
+    int ny = luaL_checkint(L, 5);
+    int nz = luaL_checkint(L, 6);
+    double sx = luaL_checknumber(L, 7);
+    double sy = luaL_checknumber(L, 8);
+    double sz = luaL_checknumber(L, 9);
+    int octaves = luaL_checkint(L, 10);
+    float persistence = luaL_checknumber(L, 11);
+    float lacunarity = luaL_checknumber(L, 12);
+    if (nx <= 0 || ny <= 0 || nz <= 0 ||
+        nx > MAX_NOISE_GRID_SAMPLES / ny / nz) {
+        return luaL_error(L, "simplex3_grid: bad grid size %dx%dx%d",
+            nx, ny, nz);
+    }
+    float *samples = malloc(sizeof(float) * nx * ny * nz);
+    simplex3_grid(samples, x0, y0, z0, nx, ny, nz, sx, sy, sz, octaves,
+        persistence, lacunarity);
+    push_noise_grid(L, samples, nx * ny * nz);
+    free(samples);
+    return 1;
+}
@@ -1,6 +1,7 @@
 #include <ctype.h>
 #include <math.h>
 #include <stddef.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include "chunk.h"
@@ -8,8 +9,13 @@
 #include "clients.h"
 #include "cube.h"
 #include "item.h"
+#include "lod.h"
 #include "matrix.h"
+#include "pg.h"
+#include "profile.h"
 #include "render.h"
+#include "sign_mesh.h"
+#include "vertex_pool.h"
 
 const float RED[4] = {1.0, 0.0, 0.0, 1.0};
 const float GREEN[4] = {0.0, 1.0, 0.0, 1.0};
@@ -45,6 +51,25 @@ Attrib mouse_attrib = {0};
 
 GLuint sky_buffer;
 
+// The meshes of all the active players, made once a frame.
+static GLuint players_buffer;
+static GLfloat *players_data;
+static int players_count;
+
+// The sign being typed, meshed again only when it changes.
+typedef struct {
+    char text[MAX_SIGN_LENGTH];
+    int x;
+    int y;
+    int z;
+    int face;
+    float y_face_height;
+    GLuint buffer;
+    int glyphs;
+} TypedSign;
+
+static TypedSign typed_sign;
+
 typedef struct {
     State *player_state;
     int width;
@@ -60,6 +85,20 @@ typedef struct {
 
 RenderState rs;
 
+// A draw of part of a vertex page, origin is the index of the chunk, or
+// MAX_CHUNKS + the index of the far chunk, whose map offset it is drawn at.
+typedef struct {
+    int page;
+    int origin;
+    int first;
+    int faces;
+} DrawItem;
+
+// Room for every section in the chunk table and every far chunk.
+static DrawItem *draw_queue;
+static int draw_queue_count;
+static int draw_queue_chunks;
+
 GLuint gen_sky_buffer(void);
 
 void render_init(void)
@@ -151,11 +190,18 @@ void render_init(void)
     mouse_attrib.sampler = glGetUniformLocation(program, "sampler");
 
     sky_buffer = gen_sky_buffer();
+    glGenBuffers(1, &players_buffer);
+    players_data = malloc_faces(10, 6 * MAX_PLAYERS, sizeof(GLfloat));
 }
 
 void render_deinit(void)
 {
     del_buffer(sky_buffer);
+    del_buffer(players_buffer);
+    free(players_data);
+    players_data = NULL;
+    del_buffer(typed_sign.buffer);
+    typed_sign.buffer = 0;
 }
 
 // Setup for the next set of render calls.
@@ -251,118 +297,6 @@ GLuint gen_plant_buffer(float x, float y, float z, float n, int w)
     return buffer;
 }
 
-int gen_sign_buffer(
-    GLfloat *data, float x, float y, float z, int face, const char *text,
-    float y_face_height)
-{
-    static const int glyph_dx[8] = {0, 0, -1, 1, 1, 0, -1, 0};
-    static const int glyph_dz[8] = {1, -1, 0, 0, 0, -1, 0, 1};
-    static const int line_dx[8] = {0, 0, 0, 0, 0, 1, 0, -1};
-    static const int line_dy[8] = {-1, -1, -1, -1, 0, 0, 0, 0};
-    static const int line_dz[8] = {0, 0, 0, 0, 1, 0, -1, 0};
-    if (face < 0 || face >= 8) {
-        return 0;
-    }
-
-    // Align sign to the item shape
-    float face_height_offset = 0;
-    if (face >= 0 && face <= 3) { // side faces
-        face_height_offset = 0.5 - (y_face_height / 2);
-    } else if (face >= 4 && face <= 7) { // top faces
-        face_height_offset = 1 - y_face_height;
-    }
-
-    float font_scaling = 1.0;
-    float r = 0.0, g = 0.0, b = 0.0;
-    if (strlen(text) > 2 && text[0] == '\\' &&
-        (isdigit(text[1]) || text[1] == '.')) {
-        font_scaling = atof(&text[1]);
-    }
-    int count = 0;
-    float max_width = 64 / font_scaling;
-    float line_height = 1.25;
-    char lines[1024];
-    int rows = wrap(text, max_width, lines, 1024);
-    rows = MIN(rows, 5);
-    int dx = glyph_dx[face];
-    int dz = glyph_dz[face];
-    int ldx = line_dx[face];
-    int ldy = line_dy[face];
-    int ldz = line_dz[face];
-    float n = 1.0 / (max_width / 10);
-    float sx = x - n * (rows - 1) * (line_height / 2) * ldx;
-    float sy = y - n * (rows - 1) * (line_height / 2) * ldy -
-               face_height_offset;
-    float sz = z - n * (rows - 1) * (line_height / 2) * ldz;
-    char *key;
-    char *line = tokenize(lines, "\n", &key);
-    while (line) {
-        int length = strlen(line);
-        int line_start = 0;
-        int line_width = string_width(line + line_start);
-        line_width = MIN(line_width, max_width);
-        float rx = sx - dx * line_width / max_width / 2;
-        float ry = sy;
-        float rz = sz - dz * line_width / max_width / 2;
-        for (int i = line_start; i < length; i++) {
-            if (line[i] == '\\' && i+1 < length) {
-                // process markup
-                char color_text[MAX_COLOR_STRING_LENGTH];
-                if (i+7 < length && line[i+1] == '#' && isxdigit(line[i+2]) &&
-                    isxdigit(line[i+3]) && isxdigit(line[i+4]) &&
-                    isxdigit(line[i+5]) && isxdigit(line[i+6]) &&
-                    isxdigit(line[i+7])) {
-                    strncpy(color_text, line + i + 1, 7);
-                    color_text[MAX_COLOR_STRING_LENGTH - 1] = '\0';
-                    color_text[7] = '\0';
-                    color_from_text(color_text, &r, &g, &b);
-                } else if (i+4 < length && line[i+1] == '#' &&
-                           isxdigit(line[i+2]) && isxdigit(line[i+3]) &&
-                           isxdigit(line[i+4])) {
-                    strncpy(color_text, line + i + 1, 4);
-                    color_text[MAX_COLOR_STRING_LENGTH - 1] = '\0';
-                    color_text[4] = '\0';
-                    color_from_text(color_text, &r, &g, &b);
-                } else if (isalpha(line[i+1])) {
-                    strncpy(color_text, line + i + 1, 1);
-                    color_text[MAX_COLOR_STRING_LENGTH - 1] = '\0';
-                    color_text[1] = '\0';
-                    color_from_text(color_text, &r, &g, &b);
-                }
-                // eat all remaining markup text
-                while (line[i] != ' ' && i < length) {
-                    i++;
-                }
-                continue;  // do not process markup as displayable text
-            }
-            int width = char_width(line[i]);
-            line_width -= width;
-            if (line_width < 0) {
-                break;
-            }
-            rx += dx * width / max_width / 2;
-            rz += dz * width / max_width / 2;
-            if (line[i] != ' ') {
-                make_character_3d(
-                    data + count * 54, rx, ry, rz, n / 2, face, line[i],
-                    r, g, b);
-                count++;
-            }
-            rx += dx * width / max_width / 2;
-            rz += dz * width / max_width / 2;
-        }
-        sx += n * line_height * ldx;
-        sy += n * line_height * ldy;
-        sz += n * line_height * ldz;
-        line = tokenize(NULL, "\n", &key);
-        rows--;
-        if (rows <= 0) {
-            break;
-        }
-    }
-    return count;
-}
-
 GLuint gen_crosshair_buffer(void)
 {
     int x = rs.width / 2;
@@ -480,12 +414,6 @@ void draw_lines(Attrib *attrib, GLuint buffer, int components, int count)
     glBindBuffer(GL_ARRAY_BUFFER, 0);
 }
 
-void draw_chunk(Attrib *attrib, Chunk *chunk, int gl_float_type, size_t float_size)
-{
-    draw_triangles_3d_ao(attrib, chunk->buffer, chunk->faces * 6,
-                         float_size, gl_float_type);
-}
-
 void draw_item(Attrib *attrib, GLuint buffer, int count, size_t type_size,
                int gl_type)
 {
@@ -499,14 +427,6 @@ void draw_text(Attrib *attrib, GLuint buffer, int length) {
     glDisable(GL_BLEND);
 }
 
-void draw_signs(Attrib *attrib, Chunk *chunk)
-{
-    glEnable(GL_POLYGON_OFFSET_FILL);
-    glPolygonOffset(-1.0, -2.0);
-    draw_triangles_3d_text(attrib, chunk->sign_buffer, chunk->sign_faces * 6);
-    glDisable(GL_POLYGON_OFFSET_FILL);
-}
-
 void draw_sign(Attrib *attrib, GLuint buffer, int length)
 {
     glEnable(GL_POLYGON_OFFSET_FILL);
@@ -525,11 +445,6 @@ void draw_plant(Attrib *attrib, GLuint buffer, size_t float_size, int gl_float_t
     draw_item(attrib, buffer, 24, float_size, gl_float_type);
 }
 
-void draw_player(Attrib *attrib, Player *player)
-{
-    draw_cube(attrib, player->buffer, sizeof(GLfloat), GL_FLOAT);
-}
-
 void draw_mouse(Attrib *attrib, GLuint buffer)
 {
     glEnable(GL_BLEND);
@@ -538,77 +453,188 @@ void draw_mouse(Attrib *attrib, GLuint buffer)
     glDisable(GL_BLEND);
 }
 
-int render_chunks(void)
+static int compare_draw_items(const void *a, const void *b)
+{
+    const DrawItem *da = (const DrawItem *)a;
+    const DrawItem *db = (const DrawItem *)b;
+    if (da->page != db->page) {
+        return da->page - db->page;
+    }
+    if (da->origin != db->origin) {
+        return da->origin - db->origin;
+    }
+    return da->first - db->first;
+}
+
+static void queue_draw(VertexRange *range, int origin)
 {
+    DrawItem *item = draw_queue + draw_queue_count++;
+    item->page = range->page;
+    item->origin = origin;
+    item->first = range->first;
+    item->faces = range->faces;
+}
+
+// Draw the doors and gates in the view's chunk sections in their current
+// pose, blocks in the same pose next to each other in their chunk's buffer
+// are drawn with a single call.
+static int render_dynamic_blocks(View *view)
+{
+    size_t stride = rs.float_size * 10;
     int result = 0;
-    State *s = rs.player_state;
-    int p = chunked(s->x);
-    int q = chunked(s->z);
+    int bound = -1;
+    for (int i = 0; i < view->chunk_list_count; i++) {
+        int index = view->chunk_list[i] / SECTION_COUNT;
+        Chunk *chunk = chunks + index;
+        ChunkSection *section =
+            chunk->sections + view->chunk_list[i] % SECTION_COUNT;
+        if (section->dynamic_count == 0 || !chunk->dynamic.buffer) {
+            continue;
+        }
+        if (index != bound) {
+            bound = index;
+            glBindBuffer(GL_ARRAY_BUFFER, chunk->dynamic.buffer);
+            glVertexAttribPointer(block_attrib.position, 3, rs.gl_float_type,
+                GL_FALSE, stride, 0);
+            glVertexAttribPointer(block_attrib.normal, 3, rs.gl_float_type,
+                GL_FALSE, stride, (GLvoid *)(rs.float_size * 3));
+            glVertexAttribPointer(block_attrib.uv, 4, rs.gl_float_type,
+                GL_FALSE, stride, (GLvoid *)(rs.float_size * 6));
+            glUniform4f(block_attrib.map, chunk->map.dx, chunk->map.dy,
+                chunk->map.dz, 0);
+        }
+        DynamicBlock *blocks = chunk->dynamic.blocks + section->dynamic_first;
+        for (int j = 0; j < section->dynamic_count; j++) {
+            DynamicBlock *block = blocks + j;
+            int first = block->first[block->open];
+            int faces = block->faces;
+            while (j + 1 < section->dynamic_count &&
+                   blocks[j + 1].first[blocks[j + 1].open] == first + faces) {
+                faces += blocks[++j].faces;
+            }
+            glDrawArrays(GL_TRIANGLES, first * 6, faces * 6);
+            view->draw_calls++;
+            result += faces;
+        }
+    }
+    return result;
+}
+
+// Draw the view's chunk sections and far chunks. The draws are sorted by
+// vertex page and then by chunk so the buffer and vertex attributes are only
+// set once per page and the map uniform once per chunk, neighbouring
+// sections of a chunk that sit next to each other in a page are drawn with a
+// single call, then the doors and gates.
+int render_chunks(View *view)
+{
+    double start = pg_get_time();
+    int result = 0;
+    State *s = &view->player->state;
     float light = get_daylight();
-    float matrix[16];
-    set_matrix_3d(
-        matrix, rs.width, rs.height,
-        s->x, s->y, s->z, s->rx, s->ry, rs.fov, rs.ortho, rs.render_radius);
-    float planes[6][4];
-    frustum_planes(planes, rs.render_radius, matrix);
     glUseProgram(block_attrib.program);
-    glUniformMatrix4fv(block_attrib.matrix, 1, GL_FALSE, matrix);
+    glUniformMatrix4fv(block_attrib.matrix, 1, GL_FALSE, view->matrix);
     glUniform3f(block_attrib.camera, s->x, s->y, s->z);
     glUniform1i(block_attrib.sampler, 0);
     glUniform1i(block_attrib.extra1, 2);
     glUniform1f(block_attrib.extra2, light);
-    glUniform1f(block_attrib.extra3, rs.render_radius * CHUNK_SIZE);
-    glUniform1i(block_attrib.extra4, rs.ortho);
+    glUniform1f(block_attrib.extra3, view->far_radius * CHUNK_SIZE);
+    glUniform1i(block_attrib.extra4, view->ortho);
     glUniform1f(block_attrib.timer, time_of_day());
-    for (int i = 0; i < chunk_count; i++) {
-        Chunk *chunk = chunks + i;
-        if (chunk_distance(chunk, p, q) > rs.render_radius) {
-            continue;
+
+    if (draw_queue_chunks < chunk_capacity) {
+        draw_queue_chunks = chunk_capacity;
+        draw_queue = realloc(draw_queue, sizeof(DrawItem) *
+            (chunk_capacity * SECTION_COUNT + MAX_LOD_CHUNKS));
+    }
+    draw_queue_count = 0;
+    for (int i = 0; i < view->chunk_list_count; i++) {
+        Chunk *chunk = chunks + view->chunk_list[i] / SECTION_COUNT;
+        ChunkSection *section =
+            chunk->sections + view->chunk_list[i] % SECTION_COUNT;
+        if (section->range.faces) {
+            queue_draw(&section->range, view->chunk_list[i] / SECTION_COUNT);
         }
-        if (!chunk_visible(
-            planes, chunk->p, chunk->q, chunk->miny, chunk->maxy, rs.ortho))
-        {
-            continue;
+    }
+    for (int i = 0; i < view->lod_list_count; i++) {
+        LodChunk *lod = lod_chunks + view->lod_list[i];
+        if (lod->range.faces) {
+            queue_draw(&lod->range, MAX_CHUNKS + view->lod_list[i]);
+        }
+    }
+    qsort(draw_queue, draw_queue_count, sizeof(DrawItem),
+        compare_draw_items);
+
+    size_t stride = rs.float_size * 10;
+    int page = -1;
+    int origin = -1;
+    view->draw_calls = 0;
+    glEnableVertexAttribArray(block_attrib.position);
+    glEnableVertexAttribArray(block_attrib.normal);
+    glEnableVertexAttribArray(block_attrib.uv);
+    for (int i = 0; i < draw_queue_count; i++) {
+        DrawItem *item = draw_queue + i;
+        int faces = item->faces;
+        while (i + 1 < draw_queue_count &&
+               draw_queue[i + 1].page == item->page &&
+               draw_queue[i + 1].origin == item->origin &&
+               draw_queue[i + 1].first == item->first + faces) {
+            faces += draw_queue[++i].faces;
+        }
+        if (item->page != page) {
+            page = item->page;
+            glBindBuffer(GL_ARRAY_BUFFER, vertex_pool_buffer(page));
+            glVertexAttribPointer(block_attrib.position, 3, rs.gl_float_type,
+                GL_FALSE, stride, 0);
+            glVertexAttribPointer(block_attrib.normal, 3, rs.gl_float_type,
+                GL_FALSE, stride, (GLvoid *)(rs.float_size * 3));
+            glVertexAttribPointer(block_attrib.uv, 4, rs.gl_float_type,
+                GL_FALSE, stride, (GLvoid *)(rs.float_size * 6));
+        }
+        if (item->origin != origin) {
+            origin = item->origin;
+            if (origin < MAX_CHUNKS) {
+                Chunk *chunk = chunks + origin;
+                glUniform4f(block_attrib.map, chunk->map.dx, chunk->map.dy,
+                    chunk->map.dz, 0);
+            } else {
+                LodChunk *lod = lod_chunks + (origin - MAX_CHUNKS);
+                glUniform4f(block_attrib.map, lod->p * CHUNK_SIZE - 1, 0,
+                    lod->q * CHUNK_SIZE - 1, 0);
+            }
         }
-        glUniform4f(block_attrib.map, chunk->map.dx, chunk->map.dy, chunk->map.dz, 0);
-        draw_chunk(&block_attrib, chunk, rs.gl_float_type, rs.float_size);
-        result += chunk->faces;
+        glDrawArrays(GL_TRIANGLES, item->first * 6, faces * 6);
+        view->draw_calls++;
+        result += faces;
     }
+    result += render_dynamic_blocks(view);
+    glDisableVertexAttribArray(block_attrib.position);
+    glDisableVertexAttribArray(block_attrib.normal);
+    glDisableVertexAttribArray(block_attrib.uv);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    view->submit_time = pg_get_time() - start;
     return result;
 }
 
-void render_signs(void)
+void render_signs(View *view)
 {
-    State *s = rs.player_state;
-    int p = chunked(s->x);
-    int q = chunked(s->z);
-    float matrix[16];
-    set_matrix_3d(
-        matrix, rs.width, rs.height,
-        s->x, s->y, s->z, s->rx, s->ry, rs.fov, rs.ortho, rs.render_radius);
-    float planes[6][4];
-    frustum_planes(planes, rs.render_radius, matrix);
+    State *s = &view->player->state;
     glUseProgram(text_attrib.program);
-    glUniformMatrix4fv(text_attrib.matrix, 1, GL_FALSE, matrix);
+    glUniformMatrix4fv(text_attrib.matrix, 1, GL_FALSE, view->matrix);
     glUniform3f(text_attrib.camera, s->x, s->y, s->z);
     glUniform1i(text_attrib.sampler, 3);
     glUniform1i(text_attrib.extra1, 1);  // is_sign
     glUniform1i(text_attrib.extra2, 2);  // sky_sampler
-    glUniform1f(text_attrib.extra3, rs.render_radius * CHUNK_SIZE); // fog_distance
-    glUniform1i(text_attrib.extra4, rs.ortho);  // ortho
+    glUniform1f(text_attrib.extra3, view->far_radius * CHUNK_SIZE); // fog_distance
+    glUniform1i(text_attrib.extra4, view->ortho);  // ortho
     glUniform1f(text_attrib.timer, time_of_day());
-    for (int i = 0; i < chunk_count; i++) {
-        Chunk *chunk = chunks + i;
-        if (chunk_distance(chunk, p, q) > rs.sign_radius) {
-            continue;
-        }
-        if (!chunk_visible(
-            planes, chunk->p, chunk->q, chunk->miny, chunk->maxy, rs.ortho))
-        {
-            continue;
-        }
-        draw_signs(&text_attrib, chunk);
+    glEnable(GL_POLYGON_OFFSET_FILL);
+    glPolygonOffset(-1.0, -2.0);
+    for (int i = 0; i < view->sign_list_count; i++) {
+        Chunk *chunk = chunks + view->sign_list[i];
+        draw_triangles_3d_text(&text_attrib, chunk->sign_buffer,
+            chunk->sign_faces * 6);
     }
+    glDisable(GL_POLYGON_OFFSET_FILL);
 }
 
 void render_sign(char *typing_buffer, int x, int y, int z, int face, float y_face_height)
@@ -625,11 +651,59 @@ void render_sign(char *typing_buffer, int x, int y, int z, int face, float y_fac
     char text[MAX_SIGN_LENGTH];
     strncpy(text, typing_buffer + 1, MAX_SIGN_LENGTH);
     text[MAX_SIGN_LENGTH - 1] = '\0';
-    GLfloat *data = malloc_faces_with_rgba(5, strlen(text));
-    int length = gen_sign_buffer(data, x, y, z, face, text, y_face_height);
-    GLuint buffer = gen_faces_with_rgba(5, length, data);
-    draw_sign(&text_attrib, buffer, length);
-    del_buffer(buffer);
+    TypedSign *t = &typed_sign;
+    if (!t->buffer || strcmp(t->text, text) != 0 || t->x != x ||
+        t->y != y || t->z != z || t->face != face ||
+        t->y_face_height != y_face_height) {
+        GLfloat *data = malloc(
+            sizeof(GLfloat) * SIGN_GLYPH_FLOATS * (strlen(text) + 1));
+        t->glyphs = gen_sign_mesh(data, x, y, z, face, text, y_face_height);
+        del_buffer(t->buffer);
+        t->buffer = gen_buffer(
+            sizeof(GLfloat) * SIGN_GLYPH_FLOATS * t->glyphs, data);
+        free(data);
+        snprintf(t->text, MAX_SIGN_LENGTH, "%s", text);
+        t->x = x;
+        t->y = y;
+        t->z = z;
+        t->face = face;
+        t->y_face_height = y_face_height;
+    }
+    draw_sign(&text_attrib, t->buffer, t->glyphs);
+}
+
+// Make the meshes of the players within the render radius of any view into
+// one buffer, replacing the last frame's. Called once a frame after the
+// players have moved and the views are made.
+void gen_players_buffer(void)
+{
+    players_count = 0;
+    for (int i = 0; i < client_count; i++) {
+        Client *client = clients + i;
+        for (int j = 0; j < MAX_LOCAL_PLAYERS; j++) {
+            client->players[j].instance = -1;
+        }
+    }
+    for (int v = 0; v < view_count; v++) {
+        State *vs = &views[v].player->state;
+        Player *near[MAX_PLAYERS];
+        int count = find_players_near(vs->x, vs->z,
+            views[v].render_radius * CHUNK_SIZE, near, MAX_PLAYERS);
+        for (int i = 0; i < count; i++) {
+            Player *player = near[i];
+            if (!player->is_active || player->instance >= 0) {
+                continue;
+            }
+            State *s = &player->state;
+            make_player(players_data + players_count * 6 * 60,
+                s->x, s->y, s->z, s->rx, s->ry, player->texture_index);
+            player->instance = players_count++;
+        }
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, players_buffer);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(GLfloat) * players_count * 6 * 60,
+        players_data, GL_STREAM_DRAW);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
 }
 
 void render_players(Player *player)
@@ -644,16 +718,34 @@ void render_players(Player *player)
     glUniform3f(block_attrib.camera, s->x, s->y, s->z);
     glUniform1i(block_attrib.sampler, 0);
     glUniform1f(block_attrib.timer, time_of_day());
-    for (int i = 0; i < client_count; i++) {
-        Client *client = clients + i;
-        for (int j = 0; j < MAX_LOCAL_PLAYERS; j++) {
-            Player *other = client->players + j;
-            if (other != player && other->is_active) {
-                glUniform4f(block_attrib.map, 0, 0, 0, 0);
-                draw_player(&block_attrib, other);
-            }
-        }
+    glUniform4f(block_attrib.map, 0, 0, 0, 0);
+    // Everyone near a view but this view's own player, in at most two
+    // calls.
+    int skip = player->instance;
+    if (skip < 0 || skip >= players_count) {
+        skip = players_count;
     }
+    glBindBuffer(GL_ARRAY_BUFFER, players_buffer);
+    glEnableVertexAttribArray(block_attrib.position);
+    glEnableVertexAttribArray(block_attrib.normal);
+    glEnableVertexAttribArray(block_attrib.uv);
+    glVertexAttribPointer(block_attrib.position, 3, GL_FLOAT, GL_FALSE,
+        sizeof(GLfloat) * 10, 0);
+    glVertexAttribPointer(block_attrib.normal, 3, GL_FLOAT, GL_FALSE,
+        sizeof(GLfloat) * 10, (GLvoid *)(sizeof(GLfloat) * 3));
+    glVertexAttribPointer(block_attrib.uv, 4, GL_FLOAT, GL_FALSE,
+        sizeof(GLfloat) * 10, (GLvoid *)(sizeof(GLfloat) * 6));
+    if (skip > 0) {
+        glDrawArrays(GL_TRIANGLES, 0, skip * 36);
+    }
+    if (skip + 1 < players_count) {
+        glDrawArrays(GL_TRIANGLES, (skip + 1) * 36,
+            (players_count - skip - 1) * 36);
+    }
+    glDisableVertexAttribArray(block_attrib.position);
+    glDisableVertexAttribArray(block_attrib.normal);
+    glDisableVertexAttribArray(block_attrib.uv);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
 }
 
 void render_sky(void)
@@ -770,6 +862,103 @@ void render_text_cursor(float x, float y)
     del_buffer(text_cursor_buffer);
 }
 
+// The parts of the frame stacked in the profile graph, from the bottom up.
+static const int profile_graph_zones[] = {
+    PROFILE_INPUT, PROFILE_EDIT_QUEUE, PROFILE_NETWORK, PROFILE_CHECK_WORKERS,
+    PROFILE_DELETE_CHUNKS, PROFILE_CULL, PROFILE_DRAW, PROFILE_SWAP
+};
+#define PROFILE_GRAPH_ZONE_COUNT \
+    (int)(sizeof(profile_graph_zones) / sizeof(profile_graph_zones[0]))
+#define PROFILE_GRAPH_MS 33.3
+
+static const float profile_colors[PROFILE_WORKER_JOB][4] = {
+    {0.5, 0.5, 0.5, 1.0},  // frame
+    {1.0, 1.0, 0.3, 1.0},  // input
+    {1.0, 0.6, 0.1, 1.0},  // edit queue
+    {0.2, 0.8, 1.0, 1.0},  // network
+    {0.7, 0.4, 1.0, 1.0},  // check workers
+    {1.0, 0.4, 0.7, 1.0},  // delete chunks
+    {0.3, 1.0, 0.3, 1.0},  // cull
+    {1.0, 0.2, 0.2, 1.0},  // draw
+    {0.3, 0.5, 1.0, 1.0},  // swap
+};
+
+// Draw the time of each of the last frames split into its parts, with lines
+// at 60 and 30 fps, and the averages of every timer and counter beside it.
+void render_profile(float ts)
+{
+    float values[PROFILE_HISTORY];
+    float stack[PROFILE_HISTORY] = {0};
+    float data[PROFILE_HISTORY * 4];
+    float x0 = ts;
+    float y0 = ts * 4;
+    float bar = MAX(1, (int)(rs.width / 2 / PROFILE_HISTORY));
+    float width = bar * PROFILE_HISTORY;
+    float ms = (rs.height / 4) / PROFILE_GRAPH_MS;
+    float matrix[16];
+    set_matrix_2d(matrix, rs.width, rs.height);
+    glUseProgram(line_attrib.program);
+    glUniformMatrix4fv(line_attrib.matrix, 1, GL_FALSE, matrix);
+    glLineWidth(bar);
+    for (int z = -1; z < PROFILE_GRAPH_ZONE_COUNT; z++) {
+        // The whole frame goes behind its parts, the time not in any of
+        // them is left showing above.
+        int zone = z < 0 ? PROFILE_FRAME : profile_graph_zones[z];
+        profile_get_history(zone, values);
+        for (int i = 0; i < PROFILE_HISTORY; i++) {
+            float bottom = zone == PROFILE_FRAME ? 0 : stack[i];
+            float top = MIN(bottom + values[i], PROFILE_GRAPH_MS);
+            if (zone != PROFILE_FRAME) {
+                stack[i] = top;
+            }
+            float x = x0 + (i + 0.5) * bar;
+            data[i * 4 + 0] = x;
+            data[i * 4 + 1] = y0 + bottom * ms;
+            data[i * 4 + 2] = x;
+            data[i * 4 + 3] = y0 + top * ms;
+        }
+        glUniform4fv(line_attrib.extra1, 1, profile_colors[zone]);
+        GLuint buffer = gen_buffer(sizeof(data), data);
+        draw_lines(&line_attrib, buffer, 2, PROFILE_HISTORY * 2);
+        del_buffer(buffer);
+    }
+    float frame_lines[] = {
+        x0, y0 + 16.7 * ms, x0 + width, y0 + 16.7 * ms,
+        x0, y0 + 33.3 * ms, x0 + width, y0 + 33.3 * ms
+    };
+    glLineWidth(rs.scale);
+    glUniform4fv(line_attrib.extra1, 1, hud_text_color);
+    GLuint buffer = gen_buffer(sizeof(frame_lines), frame_lines);
+    draw_lines(&line_attrib, buffer, 2, 4);
+    del_buffer(buffer);
+
+    char text[MAX_TEXT_LENGTH];
+    float tx = x0 + width + ts * 2;
+    float ty = y0;
+    float frame_seconds = profile_average(PROFILE_FRAME) / 1000;
+    for (int zone = PROFILE_ZONE_COUNT - 1; zone >= 0; zone--) {
+        float average = profile_average(zone);
+        if (zone == PROFILE_EDIT_LATENCY) {
+            snprintf(text, MAX_TEXT_LENGTH, "%-13s %6.2fms",
+                profile_zone_name(zone), average);
+        } else if (profile_is_level(zone)) {
+            snprintf(text, MAX_TEXT_LENGTH, "%-13s %6.0f",
+                profile_zone_name(zone), average);
+        } else if (zone > PROFILE_DB_BACKLOG) {
+            float rate = frame_seconds > 0 ? average / frame_seconds : 0;
+            snprintf(text, MAX_TEXT_LENGTH, "%-13s %6.1fKB/s",
+                profile_zone_name(zone), rate / 1024);
+        } else {
+            snprintf(text, MAX_TEXT_LENGTH, "%-13s %6.2fms",
+                profile_zone_name(zone), average);
+        }
+        render_text_rgba(ALIGN_LEFT, tx, ty, ts, text, hud_text_background,
+            zone < PROFILE_WORKER_JOB ? profile_colors[zone] :
+            hud_text_color);
+        ty += ts * 2;
+    }
+}
+
 void render_mouse_cursor(float x, float y, int p)
 {
     float matrix[16];
@@ -0,0 +1,219 @@
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "cube.h"
+#include "item.h"
+#include "sign_mesh.h"
+#include "tinycthread.h"
+#include "util.h"
+
+typedef struct {
+    char text[MAX_SIGN_LENGTH];
+    int face;  // -1 when unused
+    int glyphs;
+    GLfloat *data;  // the glyphs of a sign at 0, 0, 0 on a full block
+} SignLayout;
+
+static SignLayout layouts[SIGN_LAYOUT_CACHE_SIZE];
+static mtx_t layout_mtx;
+
+void sign_mesh_init(void)
+{
+    mtx_init(&layout_mtx, mtx_plain);
+    for (int i = 0; i < SIGN_LAYOUT_CACHE_SIZE; i++) {
+        layouts[i].face = -1;
+    }
+}
+
+static unsigned int layout_slot(int face, const char *text)
+{
+    unsigned int h = 2166136261u ^ face;
+    for (const char *c = text; *c; c++) {
+        h = (h ^ (unsigned char)*c) * 16777619u;
+    }
+    return h % SIGN_LAYOUT_CACHE_SIZE;
+}
+
+// Lay out the glyphs of a sign on face of a full block at 0, 0, 0.
+static int layout_sign(GLfloat *data, int face, const char *text)
+{
+    static const int glyph_dx[8] = {0, 0, -1, 1, 1, 0, -1, 0};
+    static const int glyph_dz[8] = {1, -1, 0, 0, 0, -1, 0, 1};
+    static const int line_dx[8] = {0, 0, 0, 0, 0, 1, 0, -1};
+    static const int line_dy[8] = {-1, -1, -1, -1, 0, 0, 0, 0};
+    static const int line_dz[8] = {0, 0, 0, 0, 1, 0, -1, 0};
+    float font_scaling = 1.0;
+    float r = 0.0, g = 0.0, b = 0.0;
+    if (strlen(text) > 2 && text[0] == '\\' &&
+        (isdigit(text[1]) || text[1] == '.')) {
+        font_scaling = atof(&text[1]);
+    }
+    int count = 0;
+    float max_width = 64 / font_scaling;
+    float line_height = 1.25;
+    char lines[1024];
+    int rows = wrap(text, max_width, lines, 1024);
+    rows = MIN(rows, 5);
+    int dx = glyph_dx[face];
+    int dz = glyph_dz[face];
+    int ldx = line_dx[face];
+    int ldy = line_dy[face];
+    int ldz = line_dz[face];
+    float n = 1.0 / (max_width / 10);
+    float sx = -n * (rows - 1) * (line_height / 2) * ldx;
+    float sy = -n * (rows - 1) * (line_height / 2) * ldy;
+    float sz = -n * (rows - 1) * (line_height / 2) * ldz;
+    char *key;
+    char *line = tokenize(lines, "\n", &key);
+    while (line) {
+        int length = strlen(line);
+        int line_start = 0;
+        int line_width = string_width(line + line_start);
+        line_width = MIN(line_width, max_width);
+        float rx = sx - dx * line_width / max_width / 2;
+        float ry = sy;
+        float rz = sz - dz * line_width / max_width / 2;
+        for (int i = line_start; i < length; i++) {
+            if (line[i] == '\\' && i+1 < length) {
+                // process markup
+                char color_text[MAX_COLOR_STRING_LENGTH];
+                if (i+7 < length && line[i+1] == '#' && isxdigit(line[i+2]) &&
+                    isxdigit(line[i+3]) && isxdigit(line[i+4]) &&
+                    isxdigit(line[i+5]) && isxdigit(line[i+6]) &&
+                    isxdigit(line[i+7])) {
+                    strncpy(color_text, line + i + 1, 7);
+                    color_text[MAX_COLOR_STRING_LENGTH - 1] = '\0';
+                    color_text[7] = '\0';
+                    color_from_text(color_text, &r, &g, &b);
+                } else if (i+4 < length && line[i+1] == '#' &&
+                           isxdigit(line[i+2]) && isxdigit(line[i+3]) &&
+                           isxdigit(line[i+4])) {
+                    strncpy(color_text, line + i + 1, 4);
+                    color_text[MAX_COLOR_STRING_LENGTH - 1] = '\0';
+                    color_text[4] = '\0';
+                    color_from_text(color_text, &r, &g, &b);
+                } else if (isalpha(line[i+1])) {
+                    strncpy(color_text, line + i + 1, 1);
+                    color_text[MAX_COLOR_STRING_LENGTH - 1] = '\0';
+                    color_text[1] = '\0';
+                    color_from_text(color_text, &r, &g, &b);
+                }
+                // eat all remaining markup text
+                while (line[i] != ' ' && i < length) {
+                    i++;
+                }
+                continue;  // do not process markup as displayable text
+            }
+            int width = char_width(line[i]);
+            line_width -= width;
+            if (line_width < 0) {
+                break;
+            }
+            rx += dx * width / max_width / 2;
+            rz += dz * width / max_width / 2;
+            if (line[i] != ' ') {
+                make_character_3d(
+                    data + count * SIGN_GLYPH_FLOATS, rx, ry, rz, n / 2, face,
+                    line[i], r, g, b);
+                count++;
+            }
+            rx += dx * width / max_width / 2;
+            rz += dz * width / max_width / 2;
+        }
+        sx += n * line_height * ldx;
+        sy += n * line_height * ldy;
+        sz += n * line_height * ldz;
+        line = tokenize(NULL, "\n", &key);
+        rows--;
+        if (rows <= 0) {
+            break;
+        }
+    }
+    return count;
+}
+
+// Copy the cached layout of text on face into data, returning the number of
+// glyphs or -1 when it is not cached.
+static int copy_layout(GLfloat *data, SignLayout *layout, int face,
+    const char *text)
+{
+    int glyphs = -1;
+    mtx_lock(&layout_mtx);
+    if (layout->face == face && strcmp(layout->text, text) == 0) {
+        glyphs = layout->glyphs;
+        memcpy(data, layout->data,
+               sizeof(GLfloat) * SIGN_GLYPH_FLOATS * glyphs);
+    }
+    mtx_unlock(&layout_mtx);
+    return glyphs;
+}
+
+static void store_layout(GLfloat *data, SignLayout *layout, int face,
+    const char *text, int glyphs)
+{
+    GLfloat *copy = malloc(sizeof(GLfloat) * SIGN_GLYPH_FLOATS * glyphs);
+    memcpy(copy, data, sizeof(GLfloat) * SIGN_GLYPH_FLOATS * glyphs);
+    mtx_lock(&layout_mtx);
+    free(layout->data);
+    snprintf(layout->text, MAX_SIGN_LENGTH, "%s", text);
+    layout->face = face;
+    layout->glyphs = glyphs;
+    layout->data = copy;
+    mtx_unlock(&layout_mtx);
+}
+
+// Mesh a sign on face of the block at x, y, z, which is y_face_height tall.
+// Data must have room for a glyph per character of text. Returns the number
+// of glyphs.
+int gen_sign_mesh(GLfloat *data, float x, float y, float z, int face,
+    const char *text, float y_face_height)
+{
+    if (face < 0 || face >= 8) {
+        return 0;
+    }
+    SignLayout *layout = layouts + layout_slot(face, text);
+    int glyphs = copy_layout(data, layout, face, text);
+    if (glyphs == -1) {
+        glyphs = layout_sign(data, face, text);
+        store_layout(data, layout, face, text, glyphs);
+    }
+
+    // Align sign to the item shape
+    float face_height_offset = 0;
+    if (face >= 0 && face <= 3) { // side faces
+        face_height_offset = 0.5 - (y_face_height / 2);
+    } else if (face >= 4 && face <= 7) { // top faces
+        face_height_offset = 1 - y_face_height;
+    }
+    y -= face_height_offset;
+    for (int i = 0; i < glyphs * 6; i++) {
+        GLfloat *d = data + i * 9;
+        d[0] += x;
+        d[1] += y;
+        d[2] += z;
+    }
+    return glyphs;
+}
+
+// Mesh every sign of a chunk, sitting on the blocks of its shape_map (when
+// not NULL). Returns the glyphs, or NULL when there are none.
+GLfloat *gen_sign_list_mesh(SignList *signs, Map *shape_map, int *faces)
+{
+    int max_faces = 0;
+    for (size_t i = 0; i < signs->size; i++) {
+        max_faces += strlen(signs->data[i].text);
+    }
+    *faces = 0;
+    if (max_faces == 0) {
+        return NULL;
+    }
+    GLfloat *data = malloc(sizeof(GLfloat) * SIGN_GLYPH_FLOATS * max_faces);
+    for (size_t i = 0; i < signs->size; i++) {
+        Sign *e = signs->data + i;
+        int shape = shape_map ? map_get(shape_map, e->x, e->y, e->z) : 0;
+        *faces += gen_sign_mesh(data + *faces * SIGN_GLYPH_FLOATS,
+            e->x, e->y, e->z, e->face, e->text, item_height(shape));
+    }
+    return data;
+}
@@ -0,0 +1,20 @@
+#pragma once
+
+#include <GLES2/gl2.h>
+#include "map.h"
+#include "sign.h"
+
+// The glyphs of a sign are laid out once for each text and face and kept in
+// a cache shared by all threads, a sign is then meshed by moving a copy of
+// its layout into place. So a chunk's signs can be meshed again, on a worker
+// thread with the rest of the chunk or on the main thread when one sign
+// changes, without wrapping and measuring the text of every sign again.
+
+// Position, uv and rgba of the six vertices of a glyph.
+#define SIGN_GLYPH_FLOATS (6 * 9)
+#define SIGN_LAYOUT_CACHE_SIZE 1024
+
+void sign_mesh_init(void);
+int gen_sign_mesh(GLfloat *data, float x, float y, float z, int face,
+    const char *text, float y_face_height);
+GLfloat *gen_sign_list_mesh(SignList *signs, Map *shape_map, int *faces);
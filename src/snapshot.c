@@ -0,0 +1,593 @@
+#include <limits.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "chunk.h"
+#include "chunks.h"
+#include "map.h"
+#include "pw.h"
+#include "sign.h"
+#include "snapshot.h"
+#include "tinycthread.h"
+
+#define TABLE_SIZE (MAX_SNAPSHOTS * 2)
+#define READER_IDLE 0
+
+typedef struct {
+    int p;
+    int q;
+    int stale;
+    int idle_frames;
+    atomic_int used;
+    Map map;
+    Map extra;
+    Map lights;
+    Map shape;
+    Map transform;
+    SignList signs;
+} ChunkSnapshot;
+
+// The snapshots readers can see, a published table is never changed.
+typedef struct {
+    ChunkSnapshot *slots[TABLE_SIZE];
+} SnapshotTable;
+
+// A snapshot or table no longer published, it is freed once no reader has
+// been reading since before epoch.
+typedef struct {
+    void *data;
+    int is_table;
+    unsigned int epoch;
+} Retired;
+
+static int initialized;
+static thrd_t main_thread;
+
+static _Atomic(SnapshotTable *) table;
+static atomic_uint global_epoch;
+static atomic_int reader_used[MAX_SNAPSHOT_READERS];
+static atomic_uint reader_epoch[MAX_SNAPSHOT_READERS];
+static _Thread_local int reader = -1;
+
+// Only used by the main thread.
+static ChunkSnapshot *live[MAX_SNAPSHOTS];
+static int live_count;
+static int table_changed;
+static Retired *retired;
+static int retired_count;
+static int retired_capacity;
+
+// Readers ask the main thread for snapshots of chunks it has not made yet
+// and wait for the frame that makes them.
+static mtx_t request_mtx;
+static cnd_t request_cnd;
+static atomic_int pending;
+static int request_p[MAX_SNAPSHOT_REQUESTS];
+static int request_q[MAX_SNAPSHOT_REQUESTS];
+static int request_count;
+static unsigned int take_count;
+static unsigned int serve_count;
+static int sync_waiting;
+static unsigned int sync_count;
+static int closing;
+
+static int is_main_thread(void)
+{
+    return !initialized || thrd_equal(thrd_current(), main_thread);
+}
+
+static int table_index(int p, int q)
+{
+    return (((unsigned int)p * 73856093u) ^ ((unsigned int)q * 19349663u))
+        & (TABLE_SIZE - 1);
+}
+
+static ChunkSnapshot *find_snapshot(SnapshotTable *t, int p, int q)
+{
+    if (t == NULL) {
+        return NULL;
+    }
+    int index = table_index(p, q);
+    ChunkSnapshot *s;
+    while ((s = t->slots[index]) != NULL) {
+        if (s->p == p && s->q == q) {
+            return s;
+        }
+        index = (index + 1) & (TABLE_SIZE - 1);
+    }
+    return NULL;
+}
+
+static void free_snapshot(ChunkSnapshot *s)
+{
+    map_free(&s->map);
+    map_free(&s->extra);
+    map_free(&s->lights);
+    map_free(&s->shape);
+    map_free(&s->transform);
+    sign_list_free(&s->signs);
+    free(s);
+}
+
+static ChunkSnapshot *make_snapshot(int p, int q, int create)
+{
+    Chunk *chunk = find_chunk(p, q);
+    if (!chunk && create) {
+        chunk = next_available_chunk();
+        if (chunk) {
+            create_chunk(chunk, p, q);
+        }
+    }
+    if (!chunk) {
+        return NULL;
+    }
+    ChunkSnapshot *s = calloc(1, sizeof(ChunkSnapshot));
+    s->p = p;
+    s->q = q;
+    map_copy(&s->map, &chunk->map);
+    map_copy(&s->extra, &chunk->extra);
+    map_copy(&s->lights, &chunk->lights);
+    map_copy(&s->shape, &chunk->shape);
+    map_copy(&s->transform, &chunk->transform);
+    sign_list_copy(&s->signs, &chunk->signs);
+    return s;
+}
+
+static void retire(void *data, int is_table)
+{
+    if (retired_count == retired_capacity) {
+        retired_capacity = retired_capacity ? retired_capacity * 2 : 64;
+        retired = realloc(retired, sizeof(Retired) * retired_capacity);
+    }
+    Retired *r = retired + retired_count++;
+    r->data = data;
+    r->is_table = is_table;
+    r->epoch = atomic_load(&global_epoch);
+    table_changed = 1;
+}
+
+static void remove_live(int index)
+{
+    retire(live[index], 0);
+    live[index] = live[--live_count];
+}
+
+// Publish a new table holding the live snapshots and start a new epoch,
+// readers that start after this can no longer see anything retired before.
+static void publish(void)
+{
+    SnapshotTable *t = NULL;
+    if (live_count) {
+        t = calloc(1, sizeof(SnapshotTable));
+        for (int i = 0; i < live_count; i++) {
+            int index = table_index(live[i]->p, live[i]->q);
+            while (t->slots[index]) {
+                index = (index + 1) & (TABLE_SIZE - 1);
+            }
+            t->slots[index] = live[i];
+        }
+    }
+    SnapshotTable *old = atomic_exchange(&table, t);
+    if (old) {
+        retire(old, 1);
+    }
+    atomic_fetch_add(&global_epoch, 1);
+    table_changed = 0;
+}
+
+static void reclaim(void)
+{
+    unsigned int oldest = UINT_MAX;
+    for (int i = 0; i < MAX_SNAPSHOT_READERS; i++) {
+        unsigned int epoch = atomic_load(&reader_epoch[i]);
+        if (epoch != READER_IDLE && epoch < oldest) {
+            oldest = epoch;
+        }
+    }
+    int count = 0;
+    for (int i = 0; i < retired_count; i++) {
+        Retired *r = retired + i;
+        if (r->epoch < oldest) {
+            if (r->is_table) {
+                free(r->data);
+            } else {
+                free_snapshot(r->data);
+            }
+        } else {
+            retired[count++] = *r;
+        }
+    }
+    retired_count = count;
+}
+
+static void add_snapshot(int p, int q)
+{
+    for (int i = 0; i < live_count; i++) {
+        if (live[i]->p == p && live[i]->q == q) {
+            return;
+        }
+    }
+    if (live_count == MAX_SNAPSHOTS) {
+        int oldest = 0;
+        for (int i = 1; i < live_count; i++) {
+            if (live[i]->idle_frames > live[oldest]->idle_frames) {
+                oldest = i;
+            }
+        }
+        remove_live(oldest);
+    }
+    ChunkSnapshot *s = make_snapshot(p, q, 1);
+    if (s) {
+        live[live_count++] = s;
+        table_changed = 1;
+    }
+}
+
+void snapshot_init(void)
+{
+    main_thread = thrd_current();
+    mtx_init(&request_mtx, mtx_plain);
+    cnd_init(&request_cnd);
+    atomic_store(&global_epoch, 1);
+    initialized = 1;
+}
+
+// Wake any waiting readers, the snapshots themselves are left in place as
+// script threads may still be reading them.
+void snapshot_deinit(void)
+{
+    mtx_lock(&request_mtx);
+    closing = 1;
+    cnd_broadcast(&request_cnd);
+    mtx_unlock(&request_mtx);
+}
+
+// Called once a frame by the main thread after the edit queue has been
+// drained.
+void snapshot_update(void)
+{
+    int answer = 0;
+    unsigned int serving = 0;
+    int count = 0;
+    int requests_p[MAX_SNAPSHOT_REQUESTS];
+    int requests_q[MAX_SNAPSHOT_REQUESTS];
+    if (atomic_exchange(&pending, 0)) {
+        mtx_lock(&request_mtx);
+        count = request_count;
+        memcpy(requests_p, request_p, sizeof(int) * count);
+        memcpy(requests_q, request_q, sizeof(int) * count);
+        request_count = 0;
+        serving = ++take_count;
+        answer = 1;
+        mtx_unlock(&request_mtx);
+    }
+    for (int i = live_count - 1; i >= 0; i--) {
+        ChunkSnapshot *s = live[i];
+        if (atomic_exchange(&s->used, 0)) {
+            s->idle_frames = 0;
+        } else if (++s->idle_frames > SNAPSHOT_IDLE_FRAMES) {
+            remove_live(i);
+            continue;
+        }
+        if (s->stale) {
+            ChunkSnapshot *replacement = make_snapshot(s->p, s->q, 0);
+            if (replacement) {
+                retire(s, 0);
+                live[i] = replacement;
+            } else {
+                // The chunk is no longer loaded, a reader asking for it
+                // again will load it.
+                remove_live(i);
+            }
+        }
+    }
+    for (int i = 0; i < count; i++) {
+        add_snapshot(requests_p[i], requests_q[i]);
+    }
+    if (table_changed) {
+        publish();
+    }
+    if (retired_count) {
+        reclaim();
+    }
+    if (answer) {
+        mtx_lock(&request_mtx);
+        serve_count = serving;
+        if (sync_waiting) {
+            if (edit_queue_empty()) {
+                sync_waiting = 0;
+                sync_count++;
+            } else {
+                atomic_store(&pending, 1);
+            }
+        }
+        cnd_broadcast(&request_cnd);
+        mtx_unlock(&request_mtx);
+    }
+}
+
+// Mark the snapshot of chunk p, q, if there is one, to be made again at the
+// end of the frame.
+void snapshot_dirty(int p, int q)
+{
+    for (int i = 0; i < live_count; i++) {
+        if (live[i]->p == p && live[i]->q == q) {
+            live[i]->stale = 1;
+            return;
+        }
+    }
+}
+
+// Drop all snapshots, for when the whole world changes.
+void snapshot_clear(void)
+{
+    if (live_count == 0) {
+        return;
+    }
+    while (live_count) {
+        remove_live(live_count - 1);
+    }
+    publish();
+    reclaim();
+}
+
+void snapshot_thread_exit(void)
+{
+    if (reader != -1) {
+        atomic_store(&reader_epoch[reader], READER_IDLE);
+        atomic_store(&reader_used[reader], 0);
+        reader = -1;
+    }
+}
+
+// Call with request_mtx locked.
+static int ticket_done(SnapshotTicket *ticket)
+{
+    if (closing) {
+        return 1;
+    }
+    if (ticket->sync) {
+        return sync_count != ticket->count;
+    }
+    return (int)(serve_count - ticket->count) >= 0;
+}
+
+// Whether what ticket waits for has been done, or the game is closing.
+int snapshot_ticket_done(SnapshotTicket *ticket)
+{
+    mtx_lock(&request_mtx);
+    int done = ticket_done(ticket);
+    mtx_unlock(&request_mtx);
+    return done;
+}
+
+void snapshot_ticket_wait(SnapshotTicket *ticket)
+{
+    mtx_lock(&request_mtx);
+    while (!ticket_done(ticket)) {
+        cnd_wait(&request_cnd, &request_mtx);
+    }
+    mtx_unlock(&request_mtx);
+}
+
+// Ask for everything queued with the queue_set_* functions so far to be
+// applied, ticket is done once it can be read back. Returns 0 when there is
+// nothing to wait for.
+int snapshot_request_sync(SnapshotTicket *ticket)
+{
+    if (is_main_thread()) {
+        drain_edit_queue(100000, 1);
+        return 0;
+    }
+    mtx_lock(&request_mtx);
+    sync_waiting++;
+    atomic_store(&pending, 1);
+    ticket->sync = 1;
+    ticket->count = sync_count;
+    mtx_unlock(&request_mtx);
+    return 1;
+}
+
+// Wait until everything queued with the queue_set_* functions so far has
+// been applied and can be read back.
+void snapshot_sync(void)
+{
+    SnapshotTicket ticket;
+    if (snapshot_request_sync(&ticket)) {
+        snapshot_ticket_wait(&ticket);
+    }
+}
+
+static int reader_slot(void)
+{
+    if (reader == -1) {
+        for (int i = 0; i < MAX_SNAPSHOT_READERS; i++) {
+            if (atomic_exchange(&reader_used[i], 1) == 0) {
+                reader = i;
+                break;
+            }
+        }
+        if (reader == -1) {
+            printf("Too many threads reading the world\n");
+        }
+    }
+    return reader;
+}
+
+// Ask the main thread for a snapshot of chunk p, q, ticket is done once it
+// has been made. Call with request_mtx locked.
+static void queue_request(int p, int q, SnapshotTicket *ticket)
+{
+    int found = 0;
+    for (int i = 0; i < request_count; i++) {
+        if (request_p[i] == p && request_q[i] == q) {
+            found = 1;
+            break;
+        }
+    }
+    if (!found && request_count < MAX_SNAPSHOT_REQUESTS) {
+        request_p[request_count] = p;
+        request_q[request_count] = q;
+        request_count++;
+    }
+    atomic_store(&pending, 1);
+    ticket->sync = 0;
+    ticket->count = take_count + 1;
+}
+
+// Ask the main thread for a snapshot of chunk p, q and wait until it has
+// been made. Returns 0 when shutting down.
+static int request_snapshot(int p, int q)
+{
+    SnapshotTicket ticket;
+    mtx_lock(&request_mtx);
+    if (closing) {
+        mtx_unlock(&request_mtx);
+        return 0;
+    }
+    queue_request(p, q, &ticket);
+    mtx_unlock(&request_mtx);
+    snapshot_ticket_wait(&ticket);
+    return 1;
+}
+
+// Ask for a snapshot of the chunk holding x, z without waiting for it, so a
+// script can give up its thread until ticket is done. Returns 0 when it can
+// be read now.
+int snapshot_request_chunk(int x, int z, SnapshotTicket *ticket)
+{
+    if (is_main_thread()) {
+        return 0;
+    }
+    int p = chunked(x);
+    int q = chunked(z);
+    int r = reader_slot();
+    if (r == -1) {
+        return 0;
+    }
+    atomic_store(&reader_epoch[r], atomic_load(&global_epoch));
+    int found = find_snapshot(atomic_load(&table), p, q) != NULL;
+    atomic_store(&reader_epoch[r], READER_IDLE);
+    if (found) {
+        return 0;
+    }
+    mtx_lock(&request_mtx);
+    int wait = !closing;
+    if (wait) {
+        queue_request(p, q, ticket);
+    }
+    mtx_unlock(&request_mtx);
+    return wait;
+}
+
+// Start a read of chunk p, q. Returns NULL, and no read is started, if the
+// chunk cannot be loaded.
+static ChunkSnapshot *begin_read(int p, int q)
+{
+    int r = reader_slot();
+    if (r == -1) {
+        return NULL;
+    }
+    for (int attempt = 0; attempt < 2; attempt++) {
+        atomic_store(&reader_epoch[r], atomic_load(&global_epoch));
+        ChunkSnapshot *s = find_snapshot(atomic_load(&table), p, q);
+        if (s) {
+            atomic_store_explicit(&s->used, 1, memory_order_relaxed);
+            return s;
+        }
+        atomic_store(&reader_epoch[r], READER_IDLE);
+        if (attempt == 0 && !request_snapshot(p, q)) {
+            break;
+        }
+    }
+    return NULL;
+}
+
+static void end_read(void)
+{
+    atomic_store(&reader_epoch[reader], READER_IDLE);
+}
+
+static int snapshot_get(int x, int y, int z, size_t offset)
+{
+    ChunkSnapshot *s = begin_read(chunked(x), chunked(z));
+    if (!s) {
+        return 0;
+    }
+    int w = map_get((Map *)((char *)s + offset), x, y, z);
+    end_read();
+    return w;
+}
+
+int snapshot_get_block(int x, int y, int z)
+{
+    if (is_main_thread()) {
+        return get_block(x, y, z);
+    }
+    return snapshot_get(x, y, z, offsetof(ChunkSnapshot, map));
+}
+
+int snapshot_get_extra(int x, int y, int z)
+{
+    if (is_main_thread()) {
+        return get_extra(x, y, z);
+    }
+    return snapshot_get(x, y, z, offsetof(ChunkSnapshot, extra));
+}
+
+int snapshot_get_light(int x, int y, int z)
+{
+    if (is_main_thread()) {
+        return get_light(chunked(x), chunked(z), x, y, z);
+    }
+    return snapshot_get(x, y, z, offsetof(ChunkSnapshot, lights));
+}
+
+int snapshot_get_shape(int x, int y, int z)
+{
+    if (is_main_thread()) {
+        return get_shape(x, y, z);
+    }
+    return snapshot_get(x, y, z, offsetof(ChunkSnapshot, shape));
+}
+
+int snapshot_get_transform(int x, int y, int z)
+{
+    if (is_main_thread()) {
+        return get_transform(x, y, z);
+    }
+    return snapshot_get(x, y, z, offsetof(ChunkSnapshot, transform));
+}
+
+// Copy the text of the sign at x, y, z, face into text, returns 0 if there
+// is no sign.
+int snapshot_get_sign(int x, int y, int z, int face, char *text,
+    size_t size)
+{
+    if (is_main_thread()) {
+        const unsigned char *sign = get_sign(chunked(x), chunked(z),
+            x, y, z, face);
+        if (sign == NULL) {
+            return 0;
+        }
+        snprintf(text, size, "%s", (const char *)sign);
+        return 1;
+    }
+    ChunkSnapshot *s = begin_read(chunked(x), chunked(z));
+    if (!s) {
+        return 0;
+    }
+    int found = 0;
+    for (size_t i = 0; i < s->signs.size; i++) {
+        Sign *e = s->signs.data + i;
+        if (e->x == x && e->y == y && e->z == z && e->face == face) {
+            snprintf(text, size, "%s", e->text);
+            found = 1;
+            break;
+        }
+    }
+    end_read();
+    return found;
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <stddef.h>
+
+// Lua script threads read the world through read only copies of chunks
+// (snapshots) instead of the chunks the main thread is changing. Snapshots
+// are made by the main thread when a script first asks for a chunk, are
+// brought up to date once a frame after the chunk changes and are dropped
+// when no script has read them for a while. Readers never lock, a snapshot
+// that has been replaced is only freed once every reader that could still
+// see it has finished its read.
+//
+// The snapshot_get_* functions can be called from any thread. On the main
+// thread they read the chunks directly. A script can instead ask for a
+// snapshot (or a sync) with a ticket and give up its thread until the ticket
+// is done.
+
+#define MAX_SNAPSHOTS 64
+#define MAX_SNAPSHOT_READERS 64
+#define MAX_SNAPSHOT_REQUESTS 64
+
+// Frames a snapshot can go unread before it is dropped.
+#define SNAPSHOT_IDLE_FRAMES 600
+
+// Something asked of the main thread, done at the end of a later frame.
+typedef struct {
+    int sync;
+    unsigned int count;
+} SnapshotTicket;
+
+void snapshot_init(void);
+void snapshot_deinit(void);
+void snapshot_update(void);
+void snapshot_dirty(int p, int q);
+void snapshot_clear(void);
+void snapshot_thread_exit(void);
+void snapshot_sync(void);
+int snapshot_request_sync(SnapshotTicket *ticket);
+int snapshot_request_chunk(int x, int z, SnapshotTicket *ticket);
+int snapshot_ticket_done(SnapshotTicket *ticket);
+void snapshot_ticket_wait(SnapshotTicket *ticket);
+
+int snapshot_get_block(int x, int y, int z);
+int snapshot_get_extra(int x, int y, int z);
+int snapshot_get_light(int x, int y, int z);
+int snapshot_get_shape(int x, int y, int z);
+int snapshot_get_transform(int x, int y, int z);
+int snapshot_get_sign(int x, int y, int z, int face, char *text,
+    size_t size);
@@ -0,0 +1,69 @@
+#include "profile.h"
+#include "upload.h"
+#include "util.h"
+#include "util_gl.h"
+
+// A new buffer has this share of its size again left for the mesh to grow.
+#define UPLOAD_SLACK 8
+
+// Only used by the main thread.
+static size_t budget;
+static size_t spent;
+static int taken;
+
+// Bytes to upload each frame, 0 is no limit.
+void upload_set_budget(size_t bytes)
+{
+    budget = bytes;
+}
+
+void upload_frame_begin(void)
+{
+    spent = 0;
+    taken = 0;
+}
+
+// Whether a job with bytes to upload may be given to GL this frame.
+int upload_may_take(size_t bytes)
+{
+    return budget == 0 || taken == 0 || spent + bytes <= budget;
+}
+
+void upload_spend(size_t bytes)
+{
+    spent += bytes;
+    taken++;
+    profile_add(PROFILE_UPLOADED, bytes);
+}
+
+// Put size bytes of data in *buffer, keeping the buffer when it has room for
+// them. An empty mesh deletes the buffer.
+void upload_buffer(GLuint *buffer, GLsizeiptr *capacity, GLsizeiptr size,
+    const void *data)
+{
+    if (size == 0) {
+        if (*buffer) {
+            del_buffer(*buffer);
+        }
+        *buffer = 0;
+        *capacity = 0;
+        return;
+    }
+    if (*buffer && size <= *capacity &&
+        size * UPLOAD_MIN_FILL >= *capacity) {
+        glBindBuffer(GL_ARRAY_BUFFER, *buffer);
+        glBufferData(GL_ARRAY_BUFFER, *capacity, NULL, GL_DYNAMIC_DRAW);
+        glBufferSubData(GL_ARRAY_BUFFER, 0, size, data);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        return;
+    }
+    if (*buffer) {
+        del_buffer(*buffer);
+    }
+    *capacity = size + size / UPLOAD_SLACK;
+    glGenBuffers(1, buffer);
+    glBindBuffer(GL_ARRAY_BUFFER, *buffer);
+    glBufferData(GL_ARRAY_BUFFER, *capacity, NULL, GL_DYNAMIC_DRAW);
+    glBufferSubData(GL_ARRAY_BUFFER, 0, size, data);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
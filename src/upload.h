@@ -0,0 +1,27 @@
+#pragma once
+
+#include <GLES2/gl2.h>
+#include <stddef.h>
+
+/*
+ * Meshes made by the workers are given to GL by the main thread. So that a
+ * frame is not held up when several jobs finish at once, only so many bytes
+ * are uploaded each frame, finished jobs past that wait in their worker for
+ * the next frame. The first job of a frame is always taken so a mesh larger
+ * than the budget still gets through.
+ *
+ * Buffers that hold all of one mesh (a chunk's signs and doors) are kept when
+ * the mesh is made again and the new one fits. Their old storage is orphaned
+ * first, so GL can hand back new memory instead of waiting for draws of the
+ * old mesh that are still queued.
+ */
+
+// Keep a buffer while the new data needs at least this share of it.
+#define UPLOAD_MIN_FILL 4
+
+void upload_set_budget(size_t bytes);
+void upload_frame_begin(void);
+int upload_may_take(size_t bytes);
+void upload_spend(size_t bytes);
+void upload_buffer(GLuint *buffer, GLsizeiptr *capacity, GLsizeiptr size,
+    const void *data);
@@ -2,14 +2,12 @@
 #include <math.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <sys/stat.h>
+#include <time.h>
 #include <unistd.h>
 #include <errno.h>
 #include <GLES2/gl2.h>
-#include <GLES2/gl2ext.h>
-#include "lodepng.h"
-#include "pg.h"
-#include "matrix.h"
 #include "util.h"
 
 char data_dir[MAX_DIR_LENGTH];
@@ -60,26 +58,12 @@ double rand_double() {
     return (double)rand() / (double)RAND_MAX;
 }
 
-void update_fps(FPS *fps) {
-    fps->frames++;
-    double now = pg_get_time();
-    double elapsed = now - fps->since;
-    if (elapsed >= 1) {
-        fps->fps = round(fps->frames / elapsed);
-        fps->frames = 0;
-        fps->since = now;
-    }
-}
-
-float time_of_day(void) {
-    if (config->day_length <= 0) {
-        return 0.5;
-    }
-    float t;
-    t = pg_get_time();
-    t = t / config->day_length;
-    t = t - (int)t;
-    return t;
+// Seconds from a fixed point in the past, never going backwards.
+double monotonic_seconds(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
 }
 
 char *load_file(const char *path) {
@@ -100,19 +84,6 @@ char *load_file(const char *path) {
     return data;
 }
 
-GLuint gen_buffer(GLsizei size, const void *data) {
-    GLuint buffer;
-    glGenBuffers(1, &buffer);
-    glBindBuffer(GL_ARRAY_BUFFER, buffer);
-    glBufferData(GL_ARRAY_BUFFER, size, data, GL_STATIC_DRAW);
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
-    return buffer;
-}
-
-void del_buffer(GLuint buffer) {
-    glDeleteBuffers(1, &buffer);
-}
-
 void *malloc_faces(int components, int faces, size_t type_size) {
     return malloc(type_size * 6 * components * faces);
 }
@@ -121,146 +92,6 @@ GLfloat *malloc_faces_with_rgba(int components, int faces) {
     return malloc(sizeof(GLfloat) * 6 * components * faces * 4);
 }
 
-GLuint gen_faces(int components, int faces, void *data, size_t type_size) {
-    GLuint buffer = gen_buffer( type_size * 6 * components * faces, data);
-    free(data);
-    return buffer;
-}
-
-GLuint gen_faces_with_rgba(int components, int faces, GLfloat *data) {
-    GLuint buffer = gen_buffer(
-        sizeof(GLfloat) * 6 * components * faces * 4, data);
-    free(data);
-    return buffer;
-}
-
-GLuint make_shader(GLenum type, const char *source) {
-    GLuint shader = glCreateShader(type);
-    glShaderSource(shader, 1, &source, NULL);
-    glCompileShader(shader);
-    GLint status;
-    glGetShaderiv(shader, GL_COMPILE_STATUS, &status);
-    if (status == GL_FALSE) {
-        GLint length;
-        glGetShaderiv(shader, GL_INFO_LOG_LENGTH, &length);
-        GLchar *info = calloc(length, sizeof(GLchar));
-        glGetShaderInfoLog(shader, length, NULL, info);
-        fprintf(stderr, "glCompileShader failed:\n%s\n", info);
-        free(info);
-    }
-    return shader;
-}
-
-GLuint load_shader(GLenum type, const char *path) {
-    char *data = load_file(path);
-    GLuint result = make_shader(type, data);
-    free(data);
-    return result;
-}
-
-GLuint make_program(GLuint shader1, GLuint shader2) {
-    GLuint program = glCreateProgram();
-    glAttachShader(program, shader1);
-    glAttachShader(program, shader2);
-    glLinkProgram(program);
-    GLint status;
-    glGetProgramiv(program, GL_LINK_STATUS, &status);
-    if (status == GL_FALSE) {
-        GLint length;
-        glGetProgramiv(program, GL_INFO_LOG_LENGTH, &length);
-        GLchar *info = calloc(length, sizeof(GLchar));
-        glGetProgramInfoLog(program, length, NULL, info);
-        fprintf(stderr, "glLinkProgram failed: %s\n", info);
-        free(info);
-    }
-    glDetachShader(program, shader1);
-    glDetachShader(program, shader2);
-    glDeleteShader(shader1);
-    glDeleteShader(shader2);
-    return program;
-}
-
-GLuint load_program(const char *name) {
-    char path1[MAX_PATH_LENGTH];
-    char path2[MAX_PATH_LENGTH];
-    snprintf(path1, MAX_PATH_LENGTH, "%s/shaders/%s_vertex.glsl",
-             data_dir, name);
-    snprintf(path2, MAX_PATH_LENGTH, "%s/shaders/%s_fragment.glsl",
-             data_dir, name);
-    GLuint shader1 = load_shader(GL_VERTEX_SHADER, path1);
-    GLuint shader2 = load_shader(GL_FRAGMENT_SHADER, path2);
-    GLuint program = make_program(shader1, shader2);
-    return program;
-}
-
-void flip_image_vertical(
-    unsigned char *data, unsigned int width, unsigned int height)
-{
-    unsigned int size = width * height * 4;
-    unsigned int stride = sizeof(char) * width * 4;
-    unsigned char *new_data = malloc(sizeof(unsigned char) * size);
-    for (unsigned int i = 0; i < height; i++) {
-        unsigned int j = height - i - 1;
-        memcpy(new_data + j * stride, data + i * stride, stride);
-    }
-    memcpy(data, new_data, size);
-    free(new_data);
-}
-
-void load_png_texture(const char *file_name) {
-    unsigned int error;
-    unsigned char *data;
-    unsigned int width, height;
-    error = lodepng_decode32_file(&data, &width, &height, file_name);
-    if (error) {
-        fprintf(stderr, "load_png_texture %s failed, error %u: %s\n", file_name, error, lodepng_error_text(error));
-        exit(1);
-    }
-    flip_image_vertical(data, width, height);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA,
-        GL_UNSIGNED_BYTE, data);
-    free(data);
-}
-
-#define DDS_HEADER_SIZE 128
-int load_etc1_in_dds_texture(const char *file_name) {
-    unsigned int width, height;
-    unsigned int texture_length;
-    char *data = load_file(file_name);
-    if (strncmp(data, "DDS ", 4) != 0) {
-        printf("Not a DDS file: %s\n", file_name);
-        return -1;
-    }
-    if (strncmp(&data[84], "ETC ", 4) != 0) {
-        printf("Not an ETC file: %s\n", file_name);
-        return -2;
-    }
-    height = *(unsigned int*)&data[12];
-    width = *(unsigned int*)&data[16];
-    texture_length = *(unsigned int*)&data[20];
-    glCompressedTexImage2D(GL_TEXTURE_2D, 0, GL_ETC1_RGB8_OES, width, height, 0,
-                           texture_length, &data[DDS_HEADER_SIZE]);
-    free(data);
-    return 0;
-}
-
-void load_texture(const char *name) {
-    // Try loading an ETC1 version of the texture at bin/name.dds, if it is not
-    // present or is older than the original PNG file use the PNG file instead.
-    struct stat st, st2;
-    char dds_file_name[MAX_PATH_LENGTH];
-    char png_file_name[MAX_PATH_LENGTH];
-    snprintf(dds_file_name, MAX_PATH_LENGTH, "%s/bin/%s.dds", data_dir, name);
-    snprintf(png_file_name, MAX_PATH_LENGTH, "%s/textures/%s.png",
-             data_dir, name);
-    if (stat(dds_file_name, &st) == 0 && stat(png_file_name, &st2) == 0 &&
-        st.st_mtime >= st2.st_mtime &&
-        load_etc1_in_dds_texture(dds_file_name) == 0) {
-        return;  // ETC1 texture will be used
-    }
-    load_png_texture(png_file_name);
-}
-
 char *tokenize(char *str, const char *delim, char **key) {
     char *result;
     if (str == NULL) {
@@ -476,48 +307,4 @@ hfloat float_to_hfloat(float *f)
     return hf;
 }
 
-#ifdef DEBUG
-void _check_gl_error(const char *file, int line);
-
-///
-/// Usage
-/// [... some opengl calls]
-/// check_gl_error();
-///
-#define check_gl_error() _check_gl_error(__FILE__,__LINE__)
-
-void _check_gl_error(const char *file, int line) {
-    GLenum err = glGetError();
-
-    while (err != GL_NO_ERROR) {
-        #define MAX_ERROR_TEXT_LENGTH 64
-        char error[MAX_ERROR_TEXT_LENGTH];
-
-        switch(err) {
-            case GL_INVALID_OPERATION:
-                snprintf(error, MAX_ERROR_TEXT_LENGTH, "INVALID_OPERATION");
-                break;
-            case GL_INVALID_ENUM:
-                snprintf(error, MAX_ERROR_TEXT_LENGTH, "INVALID_ENUM");
-                break;
-            case GL_INVALID_VALUE:
-                snprintf(error, MAX_ERROR_TEXT_LENGTH, "INVALID_VALUE");
-                break;
-            case GL_OUT_OF_MEMORY:
-                snprintf(error, MAX_ERROR_TEXT_LENGTH, "OUT_OF_MEMORY");
-                break;
-            case GL_INVALID_FRAMEBUFFER_OPERATION:
-                snprintf(error, MAX_ERROR_TEXT_LENGTH,
-                         "INVALID_FRAMEBUFFER_OPERATION");
-                break;
-            default:
-                snprintf(error, MAX_ERROR_TEXT_LENGTH, "[UNKNOWN ERROR - %d]",
-                         err);
-        }
-
-        printf("GL_%s - %s: %d\n", error, file, line);
-        err = glGetError();
-    }
-}
-#endif
 
@@ -25,12 +25,6 @@
     #define LOG(...)
 #endif
 
-typedef struct {
-    unsigned int fps;
-    unsigned int frames;
-    double since;
-} FPS;
-
 typedef unsigned short hfloat;
 
 void init_data_dir(void);
@@ -38,36 +32,14 @@ char *get_data_dir(void);
 
 int rand_int(int n);
 double rand_double(void);
-void update_fps(FPS *fps);
-float time_of_day(void);
+double monotonic_seconds(void);
+char *load_file(const char *path);
 
-GLuint gen_buffer(GLsizei size, const void *data);
-void del_buffer(GLuint buffer);
 void *malloc_faces(int components, int faces, size_t type_size);
 GLfloat *malloc_faces_with_rgba(int components, int faces);
-GLuint gen_faces(int components, int faces, void *data, size_t type_size);
-GLuint gen_faces_with_rgba(int components, int faces, GLfloat *data);
-GLuint make_shader(GLenum type, const char *source);
-GLuint load_shader(GLenum type, const char *path);
-GLuint make_program(GLuint shader1, GLuint shader2);
-GLuint load_program(const char *name);
-void load_png_texture(const char *file_name);
-void load_texture(const char *file_name);
 char *tokenize(char *str, const char *delim, char **key);
 int char_width(unsigned char input);
 int string_width(const char *input);
 int wrap(const char *input, int max_width, char *output, int max_length);
 void color_from_text(const char *text, float *r, float *g, float *b);
 hfloat float_to_hfloat(float *f);
-
-#ifdef DEBUG
-void _check_gl_error(const char *file, int line);
-
-///
-/// Usage
-/// [... some opengl calls]
-/// check_gl_error();
-///
-#define check_gl_error() _check_gl_error(__FILE__,__LINE__)
-#endif
-
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <GLES2/gl2.h>
+#include "util.h"
+
+/*
+ * The helpers that need a GL context or the platform layer. They are kept
+ * out of util.c so the code piworld-benchmark shares with the game links
+ * without GLES or X11.
+ */
+
+typedef struct {
+    unsigned int fps;
+    unsigned int frames;
+    double since;
+} FPS;
+
+void update_fps(FPS *fps);
+float time_of_day(void);
+
+GLuint gen_buffer(GLsizei size, const void *data);
+void del_buffer(GLuint buffer);
+GLuint gen_faces(int components, int faces, void *data, size_t type_size);
+GLuint gen_faces_with_rgba(int components, int faces, GLfloat *data);
+GLuint make_shader(GLenum type, const char *source);
+GLuint load_shader(GLenum type, const char *path);
+GLuint make_program(GLuint shader1, GLuint shader2);
+GLuint load_program(const char *name);
+void load_png_texture(const char *file_name);
+void load_texture(const char *file_name);
+
+#ifdef DEBUG
+void _check_gl_error(const char *file, int line);
+
+///
+/// Usage
+/// [... some opengl calls]
+/// check_gl_error();
+///
+#define check_gl_error() _check_gl_error(__FILE__,__LINE__)
+#endif
+
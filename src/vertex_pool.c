@@ -0,0 +1,209 @@
+#include <stdio.h>
+#include <string.h>
+#include "util.h"
+#include "util_gl.h"
+#include "vertex_pool.h"
+
+// Free space in a page is kept as a list of holes sorted by their first
+// face, neighbouring holes are joined when space is given back.
+typedef struct {
+    GLuint buffer;
+    int capacity;
+    int used;
+    int hole_count;
+    int hole_first[MAX_PAGE_HOLES];
+    int hole_faces[MAX_PAGE_HOLES];
+} VertexPage;
+
+static VertexPage pages[MAX_VERTEX_PAGES];
+static int page_count;
+
+static int take_hole(VertexPage *page, int faces)
+{
+    for (int i = 0; i < page->hole_count; i++) {
+        if (page->hole_faces[i] < faces) {
+            continue;
+        }
+        int first = page->hole_first[i];
+        page->hole_first[i] += faces;
+        page->hole_faces[i] -= faces;
+        if (page->hole_faces[i] == 0) {
+            page->hole_count--;
+            memmove(page->hole_first + i, page->hole_first + i + 1,
+                sizeof(int) * (page->hole_count - i));
+            memmove(page->hole_faces + i, page->hole_faces + i + 1,
+                sizeof(int) * (page->hole_count - i));
+        }
+        page->used += faces;
+        return first;
+    }
+    return -1;
+}
+
+static void give_hole(VertexPage *page, int first, int faces)
+{
+    page->used -= faces;
+    int i = 0;
+    while (i < page->hole_count && page->hole_first[i] < first) {
+        i++;
+    }
+    int join_prev = i > 0 &&
+        page->hole_first[i - 1] + page->hole_faces[i - 1] == first;
+    int join_next = i < page->hole_count &&
+        first + faces == page->hole_first[i];
+    if (join_prev && join_next) {
+        page->hole_faces[i - 1] += faces + page->hole_faces[i];
+        page->hole_count--;
+        memmove(page->hole_first + i, page->hole_first + i + 1,
+            sizeof(int) * (page->hole_count - i));
+        memmove(page->hole_faces + i, page->hole_faces + i + 1,
+            sizeof(int) * (page->hole_count - i));
+    } else if (join_prev) {
+        page->hole_faces[i - 1] += faces;
+    } else if (join_next) {
+        page->hole_first[i] = first;
+        page->hole_faces[i] += faces;
+    } else if (page->hole_count < MAX_PAGE_HOLES) {
+        memmove(page->hole_first + i + 1, page->hole_first + i,
+            sizeof(int) * (page->hole_count - i));
+        memmove(page->hole_faces + i + 1, page->hole_faces + i,
+            sizeof(int) * (page->hole_count - i));
+        page->hole_first[i] = first;
+        page->hole_faces[i] = faces;
+        page->hole_count++;
+    }
+    // When the hole list is full the space is lost until the page empties.
+}
+
+static int new_page(int faces, size_t float_size)
+{
+    int index = -1;
+    for (int i = 0; i < page_count; i++) {
+        if (pages[i].buffer == 0) {
+            index = i;
+            break;
+        }
+    }
+    if (index == -1) {
+        if (page_count >= MAX_VERTEX_PAGES) {
+            return -1;
+        }
+        index = page_count++;
+    }
+    VertexPage *page = pages + index;
+    page->capacity = faces > VERTEX_PAGE_FACES ? faces : VERTEX_PAGE_FACES;
+    page->used = 0;
+    page->hole_count = 1;
+    page->hole_first[0] = 0;
+    page->hole_faces[0] = page->capacity;
+    glGenBuffers(1, &page->buffer);
+    glBindBuffer(GL_ARRAY_BUFFER, page->buffer);
+    glBufferData(GL_ARRAY_BUFFER,
+        (GLsizeiptr)page->capacity * FACE_COMPONENTS * float_size, NULL,
+        GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    return index;
+}
+
+// Copy faces worth of vertex data into the pool, data is not freed.
+// Returns 0 when the pool is full.
+int vertex_pool_alloc(VertexRange *range, int faces, void *data,
+    size_t float_size)
+{
+    range->page = 0;
+    range->first = 0;
+    range->faces = 0;
+    if (faces <= 0) {
+        return 1;
+    }
+    int index = -1;
+    int first = -1;
+    for (int i = 0; i < page_count && first == -1; i++) {
+        VertexPage *page = pages + i;
+        if (page->buffer && page->capacity - page->used >= faces) {
+            first = take_hole(page, faces);
+            index = i;
+        }
+    }
+    if (first == -1) {
+        index = new_page(faces, float_size);
+        if (index == -1) {
+            printf("Out of vertex pages for %d faces\n", faces);
+            return 0;
+        }
+        first = take_hole(pages + index, faces);
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, pages[index].buffer);
+    glBufferSubData(GL_ARRAY_BUFFER,
+        (GLintptr)first * FACE_COMPONENTS * float_size,
+        (GLsizeiptr)faces * FACE_COMPONENTS * float_size, data);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    range->page = index;
+    range->first = first;
+    range->faces = faces;
+    return 1;
+}
+
+// Replace the mesh in range with faces worth of data, writing over the old
+// faces and giving back the rest of them when the new mesh fits, so the mesh
+// stays where it was. Returns 0 when the pool is full.
+int vertex_pool_realloc(VertexRange *range, int faces, void *data,
+    size_t float_size)
+{
+    if (faces <= 0 || faces > range->faces) {
+        vertex_pool_free(range);
+        return vertex_pool_alloc(range, faces, data, float_size);
+    }
+    VertexPage *page = pages + range->page;
+    glBindBuffer(GL_ARRAY_BUFFER, page->buffer);
+    glBufferSubData(GL_ARRAY_BUFFER,
+        (GLintptr)range->first * FACE_COMPONENTS * float_size,
+        (GLsizeiptr)faces * FACE_COMPONENTS * float_size, data);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    if (faces < range->faces) {
+        give_hole(page, range->first + faces, range->faces - faces);
+    }
+    range->faces = faces;
+    return 1;
+}
+
+void vertex_pool_free(VertexRange *range)
+{
+    if (range->faces == 0) {
+        return;
+    }
+    VertexPage *page = pages + range->page;
+    give_hole(page, range->first, range->faces);
+    if (page->used == 0) {
+        del_buffer(page->buffer);
+        page->buffer = 0;
+    }
+    range->faces = 0;
+}
+
+// The faces the pages in use have room for and the faces of meshes in them.
+void vertex_pool_usage(size_t *held_faces, size_t *used_faces)
+{
+    *held_faces = 0;
+    *used_faces = 0;
+    for (int i = 0; i < page_count; i++) {
+        if (pages[i].buffer) {
+            *held_faces += pages[i].capacity;
+            *used_faces += pages[i].used;
+        }
+    }
+}
+
+GLuint vertex_pool_buffer(int page)
+{
+    return pages[page].buffer;
+}
+
+void vertex_pool_reset(void)
+{
+    for (int i = 0; i < page_count; i++) {
+        del_buffer(pages[i].buffer);
+    }
+    memset(pages, 0, sizeof(pages));
+    page_count = 0;
+}
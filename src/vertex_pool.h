@@ -0,0 +1,29 @@
+#pragma once
+
+#include <GLES2/gl2.h>
+#include <stddef.h>
+
+// Chunk meshes are packed into a few large GL buffers (pages) so meshes that
+// share a page can be drawn without rebinding the buffer or respecifying the
+// vertex attributes. Space is handed out in whole faces of 6 vertices of 10
+// components each, a mesh larger than a page gets a page of its own.
+#define VERTEX_PAGE_FACES 8192
+#define MAX_VERTEX_PAGES 256
+#define MAX_PAGE_HOLES 1024
+#define FACE_COMPONENTS (6 * 10)
+
+// Where a mesh lives in the pool, faces is 0 for no mesh.
+typedef struct {
+    int page;
+    int first;
+    int faces;
+} VertexRange;
+
+int vertex_pool_alloc(VertexRange *range, int faces, void *data,
+    size_t float_size);
+int vertex_pool_realloc(VertexRange *range, int faces, void *data,
+    size_t float_size);
+void vertex_pool_free(VertexRange *range);
+void vertex_pool_usage(size_t *held_faces, size_t *used_faces);
+GLuint vertex_pool_buffer(int page);
+void vertex_pool_reset(void);
@@ -0,0 +1,223 @@
+#include <stdlib.h>
+#include "chunk.h"
+#include "chunks.h"
+#include "config.h"
+#include "lod.h"
+#include "matrix.h"
+#include "occlusion.h"
+#include "util.h"
+#include "view.h"
+
+#define PLANES_PER_VIEW 6
+#define MAX_PLANES (MAX_VIEWS * PLANES_PER_VIEW)
+
+View views[MAX_VIEWS];
+int view_count;
+
+// The chunk and sign lists of each view have room for every chunk in the
+// table, list_capacity of them.
+static int *chunk_lists[MAX_VIEWS];
+static int *sign_lists[MAX_VIEWS];
+static int list_capacity[MAX_VIEWS];
+static int lod_lists[MAX_VIEWS][MAX_LOD_CHUNKS];
+// Counts the calls to views_cull, the chunks remember the last one that
+// found them visible.
+static unsigned int frame;
+
+// Frustum planes of all views in structure of arrays form so the per chunk
+// plane distances can be computed in a single loop the compiler vectorises.
+static float plane_a[MAX_PLANES];
+static float plane_b[MAX_PLANES];
+static float plane_c[MAX_PLANES];
+static float plane_d[MAX_PLANES];
+
+void views_reset(void)
+{
+    view_count = 0;
+}
+
+View *views_add(Player *player, int width, int height, int ortho, float fov,
+    int render_radius, int sign_radius, int lod_radius)
+{
+    if (view_count >= MAX_VIEWS) {
+        return NULL;
+    }
+    int index = view_count++;
+    View *view = views + index;
+    State *s = &player->state;
+    view->player = player;
+    view->width = width;
+    view->height = height;
+    view->ortho = ortho;
+    view->fov = fov;
+    view->render_radius = render_radius;
+    view->sign_radius = sign_radius;
+    view->lod_radius = lod_radius;
+    view->far_radius = MAX(render_radius, lod_radius);
+    view->p = chunked(s->x);
+    view->q = chunked(s->z);
+    set_matrix_3d(
+        view->matrix, width, height,
+        s->x, s->y, s->z, s->rx, s->ry, fov, ortho, view->far_radius);
+    frustum_planes(view->planes, view->far_radius, view->matrix);
+    if (list_capacity[index] < chunk_capacity) {
+        list_capacity[index] = chunk_capacity;
+        chunk_lists[index] = realloc(chunk_lists[index],
+            sizeof(int) * chunk_capacity * SECTION_COUNT);
+        sign_lists[index] = realloc(sign_lists[index],
+            sizeof(int) * chunk_capacity);
+    }
+    view->chunk_list = chunk_lists[index];
+    view->chunk_list_count = 0;
+    view->sign_list = sign_lists[index];
+    view->sign_list_count = 0;
+    view->lod_list = lod_lists[index];
+    view->lod_list_count = 0;
+    view->occluded_faces = 0;
+    view->draw_calls = 0;
+    view->submit_time = 0;
+    for (int i = 0; i < PLANES_PER_VIEW; i++) {
+        int k = index * PLANES_PER_VIEW + i;
+        if (ortho && i >= 4) {
+            // The near and far planes are not used in ortho mode, make them
+            // always pass.
+            plane_a[k] = 0;
+            plane_b[k] = 0;
+            plane_c[k] = 0;
+            plane_d[k] = 1;
+        } else {
+            plane_a[k] = view->planes[i][0];
+            plane_b[k] = view->planes[i][1];
+            plane_c[k] = view->planes[i][2];
+            plane_d[k] = view->planes[i][3];
+        }
+    }
+    return view;
+}
+
+static int inside_planes(float *d)
+{
+    return d[0] >= 0 && d[1] >= 0 && d[2] >= 0 && d[3] >= 0 &&
+        d[4] >= 0 && d[5] >= 0;
+}
+
+// Build the draw lists of every view in one pass over the loaded chunks.
+// A bounding box is outside a plane when its corner furthest along the
+// plane normal is outside, which gives the same result as chunk_visible
+// without testing all eight corners. The x and z part of that distance is
+// shared by all sections of a chunk.
+void views_cull(void)
+{
+    float dist_xz[MAX_PLANES];
+    float dist[MAX_PLANES];
+    int distances[MAX_VIEWS];
+    int plane_count = view_count * PLANES_PER_VIEW;
+    for (int v = 0; v < view_count; v++) {
+        views[v].chunk_list_count = 0;
+        views[v].sign_list_count = 0;
+        views[v].lod_list_count = 0;
+    }
+    if (view_count == 0) {
+        return;
+    }
+    frame++;
+    for (int i = 0; i < chunk_count; i++) {
+        Chunk *chunk = chunks + i;
+        int in_range = 0;
+        for (int v = 0; v < view_count; v++) {
+            View *view = views + v;
+            distances[v] = chunk_distance(chunk, view->p, view->q);
+            if (distances[v] <= view->render_radius ||
+                distances[v] <= view->sign_radius) {
+                in_range = 1;
+            }
+        }
+        if (!in_range || (chunk->faces == 0 && chunk->dynamic.faces == 0 &&
+                          chunk->sign_faces == 0)) {
+            continue;
+        }
+        float x0 = chunk->p * CHUNK_SIZE - 1;
+        float x1 = x0 + CHUNK_SIZE + 1;
+        float z0 = chunk->q * CHUNK_SIZE - 1;
+        float z1 = z0 + CHUNK_SIZE + 1;
+        for (int k = 0; k < plane_count; k++) {
+            dist_xz[k] = plane_d[k] +
+                MAX(plane_a[k] * x0, plane_a[k] * x1) +
+                MAX(plane_c[k] * z0, plane_c[k] * z1);
+        }
+        for (int j = 0; j < SECTION_COUNT; j++) {
+            ChunkSection *section = chunk->sections + j;
+            if (section->faces == 0 && section->dynamic_count == 0) {
+                continue;
+            }
+            float y0 = section->miny;
+            float y1 = section->maxy;
+            for (int k = 0; k < plane_count; k++) {
+                dist[k] = dist_xz[k] +
+                    MAX(plane_b[k] * y0, plane_b[k] * y1);
+            }
+            for (int v = 0; v < view_count; v++) {
+                View *view = views + v;
+                if (distances[v] <= view->render_radius &&
+                    inside_planes(dist + v * PLANES_PER_VIEW)) {
+                    view->chunk_list[view->chunk_list_count++] =
+                        i * SECTION_COUNT + j;
+                    chunk->last_seen = frame;
+                }
+            }
+        }
+        if (chunk->sign_faces) {
+            float y0 = chunk->miny;
+            float y1 = chunk->maxy;
+            for (int k = 0; k < plane_count; k++) {
+                dist[k] = dist_xz[k] +
+                    MAX(plane_b[k] * y0, plane_b[k] * y1);
+            }
+            for (int v = 0; v < view_count; v++) {
+                View *view = views + v;
+                if (distances[v] <= view->sign_radius &&
+                    inside_planes(dist + v * PLANES_PER_VIEW)) {
+                    view->sign_list[view->sign_list_count++] = i;
+                }
+            }
+        }
+    }
+    // Far chunks are drawn beyond the render radius, and inside it until
+    // the full chunk has been meshed.
+    for (int i = 0; i < MAX_LOD_CHUNKS; i++) {
+        LodChunk *lod = lod_chunks + i;
+        if (lod->state != LOD_READY || lod->faces == 0) {
+            continue;
+        }
+        float x0 = lod->p * CHUNK_SIZE - 1;
+        float x1 = x0 + CHUNK_SIZE + 1;
+        float y0 = lod->miny;
+        float y1 = lod->maxy;
+        float z0 = lod->q * CHUNK_SIZE - 1;
+        float z1 = z0 + CHUNK_SIZE + 1;
+        for (int k = 0; k < plane_count; k++) {
+            dist[k] = plane_d[k] +
+                MAX(plane_a[k] * x0, plane_a[k] * x1) +
+                MAX(plane_b[k] * y0, plane_b[k] * y1) +
+                MAX(plane_c[k] * z0, plane_c[k] * z1);
+        }
+        for (int v = 0; v < view_count; v++) {
+            View *view = views + v;
+            int distance = MAX(ABS(lod->p - view->p), ABS(lod->q - view->q));
+            if (distance > view->lod_radius ||
+                (distance <= view->render_radius && lod->covered)) {
+                continue;
+            }
+            if (inside_planes(dist + v * PLANES_PER_VIEW)) {
+                view->lod_list[view->lod_list_count++] = i;
+            }
+        }
+    }
+    if (config->occlusion_culling) {
+        for (int v = 0; v < view_count; v++) {
+            if (!views[v].ortho) {
+                occlusion_cull(views + v);
+            }
+        }
+    }
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include "config.h"
+#include "player.h"
+
+// A main view and a picture-in-picture view for each local player.
+#define MAX_VIEWS (MAX_LOCAL_PLAYERS * 2)
+
+// A camera looking at the world this frame. The matrix and frustum planes
+// are built once in views_add, views_cull then fills in what the view should
+// draw: chunk_list holds chunk sections as (index into chunks[]) *
+// SECTION_COUNT + section, sign_list holds indices into chunks[] and lod_list
+// holds indices into lod_chunks[]. The matrix and fog reach out to
+// far_radius, the further of the render and lod radius.
+typedef struct View {
+    Player *player;
+    int width;
+    int height;
+    int ortho;
+    float fov;
+    int render_radius;
+    int sign_radius;
+    int lod_radius;
+    int far_radius;
+    int p;
+    int q;
+    float matrix[16];
+    float planes[6][4];
+    int *chunk_list;
+    int chunk_list_count;
+    int *sign_list;
+    int sign_list_count;
+    int *lod_list;
+    int lod_list_count;
+    int occluded_faces;
+    int draw_calls;
+    double submit_time;
+} View;
+
+extern View views[MAX_VIEWS];
+extern int view_count;
+
+void views_reset(void);
+View *views_add(Player *player, int width, int height, int ortho, float fov,
+    int render_radius, int sign_radius, int lod_radius);
+void views_cull(void);
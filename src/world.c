@@ -1,3 +1,4 @@
+#include <string.h>
 #include "config.h"
 #include "item.h"
 #include "noise.h"
@@ -9,93 +10,262 @@ int show_plants = SHOW_PLANTS;
 int show_trees = SHOW_TREES;
 #endif
 
-void create_world(int p, int q, world_func func, void *arg) {
-    int pad = 1;
-    for (int dx = -pad; dx < CHUNK_SIZE + pad; dx++) {
-        for (int dz = -pad; dz < CHUNK_SIZE + pad; dz++) {
-            int flag = 1;
-            if (dx < 0 || dz < 0 || dx >= CHUNK_SIZE || dz >= CHUNK_SIZE) {
-                flag = -1;
-            }
-            int x = p * CHUNK_SIZE + dx;
-            int z = q * CHUNK_SIZE + dz;
-            float f = simplex2(x * 0.01, z * 0.01, 4, 0.5, 2);
-            float g = simplex2(-x * 0.01, -z * 0.01, 2, 0.9, 2);
-            int mh = g * 32 + 16;
-            int h = f * mh;
-            int w = GRASS;
-            int t = 12;
-            if (h <= t) {
-                h = t;
-                w = SAND;
-            }
+#define PAD 1
+#define PADDED_SIZE (CHUNK_SIZE + PAD * 2)
+#define COLUMNS (PADDED_SIZE * PADDED_SIZE)
+#define TREE_PAD 4
+#define TREE_SIZE (CHUNK_SIZE - TREE_PAD * 2)
+#define CLOUD_MIN 64
+#define CLOUD_MAX 72
+#define WATER_LEVEL 12
 
-            func(x, 0, z, BEDROCK * flag, arg);
+// The chunk and its 1 block border is made in stages, each stage works
+// through every column of the chunk before the next starts:
+//
+//   heightmap   - the terrain height and surface block of each column
+//   surface     - bedrock, sand or grass up to the height, then plants
+//   decoration  - trees
+//   clouds
+//
+// Columns are stored one after the other, column (dx, dz) is at index
+// (dx + PAD) * PADDED_SIZE + (dz + PAD) with its blocks from y = 0 up.
+// Blocks in the border are negative, as they belong to the neighbouring
+// chunk. The result is exactly the same as making the world one column at a
+// time with each column overwriting what the columns before it made, which
+// is how the world was first made and so how existing worlds look.
+//
+// A WorldState is only used by the thread making the chunk, so any number
+// of chunks can be made at once by the workers.
+typedef struct {
+    int p;
+    int q;
+    int plants;
+    int trees;
+    int clouds;
+    int height[COLUMNS];
+    int surface[COLUMNS];
+    // The y above the terrain and plants, the blocks columns later in the
+    // order write over leaves from trees before them.
+    int ground_top[COLUMNS];
+    // The y above every block in the column.
+    int top[COLUMNS];
+    signed char blocks[COLUMNS * CHUNK_HEIGHT];
+} WorldState;
 
-            // sand and grass terrain
-            for (int y = 1; y < h; y++) {
-                func(x, y, z, w * flag, arg);
-            }
-            if (w == GRASS) {
-#ifdef SERVER
-                if (show_plants) {
-#else
-                if (config->show_plants) {
-#endif
-                    // grass
-                    if (simplex2(-x * 0.1, z * 0.1, 4, 0.8, 2) > 0.6) {
-                        func(x, h, z, TALL_GRASS * flag, arg);
-                    }
-                    // flowers
-                    if (simplex2(x * 0.05, -z * 0.05, 4, 0.8, 2) > 0.7) {
-                        int w = 18 + simplex2(x * 0.1, z * 0.1, 4, 0.8, 2) * 7;
-                        func(x, h, z, w * flag, arg);
-                    }
+static int column_index(int dx, int dz)
+{
+    return (dx + PAD) * PADDED_SIZE + (dz + PAD);
+}
+
+static int column_flag(int dx, int dz)
+{
+    if (dx < 0 || dz < 0 || dx >= CHUNK_SIZE || dz >= CHUNK_SIZE) {
+        return -1;
+    }
+    return 1;
+}
+
+// Note that column i has a block at y.
+static void raise_top(WorldState *s, int i, int y)
+{
+    if (s->top[i] <= y) {
+        s->top[i] = y + 1;
+    }
+}
+
+static void stage_heightmap(WorldState *s)
+{
+    float terrain[COLUMNS];
+    float mountains[COLUMNS];
+    int x0 = s->p * CHUNK_SIZE - PAD;
+    int z0 = s->q * CHUNK_SIZE - PAD;
+    simplex2_grid(terrain, x0, z0, PADDED_SIZE, PADDED_SIZE,
+        0.01, 0.01, 4, 0.5, 2);
+    simplex2_grid(mountains, x0, z0, PADDED_SIZE, PADDED_SIZE,
+        -0.01, -0.01, 2, 0.9, 2);
+    for (int i = 0; i < COLUMNS; i++) {
+        int mh = mountains[i] * 32 + 16;
+        int h = terrain[i] * mh;
+        s->height[i] = h <= WATER_LEVEL ? WATER_LEVEL : h;
+        s->surface[i] = h <= WATER_LEVEL ? SAND : GRASS;
+    }
+}
+
+static void stage_surface(WorldState *s)
+{
+    float grass[COLUMNS];
+    float flowers[COLUMNS];
+    int x0 = s->p * CHUNK_SIZE - PAD;
+    int z0 = s->q * CHUNK_SIZE - PAD;
+    if (s->plants) {
+        simplex2_grid(grass, x0, z0, PADDED_SIZE, PADDED_SIZE,
+            -0.1, 0.1, 4, 0.8, 2);
+        simplex2_grid(flowers, x0, z0, PADDED_SIZE, PADDED_SIZE,
+            0.05, -0.05, 4, 0.8, 2);
+    }
+    // Flower colours are sampled together once all the flowers are found.
+    int flower_columns[COLUMNS];
+    float flower_x[COLUMNS];
+    float flower_z[COLUMNS];
+    int flower_count = 0;
+    for (int dx = -PAD; dx < CHUNK_SIZE + PAD; dx++) {
+        for (int dz = -PAD; dz < CHUNK_SIZE + PAD; dz++) {
+            int i = column_index(dx, dz);
+            int flag = column_flag(dx, dz);
+            int h = s->height[i];
+            int w = s->surface[i];
+            signed char *column = s->blocks + i * CHUNK_HEIGHT;
+            column[0] = BEDROCK * flag;
+            memset(column + 1, w * flag, h - 1);
+            s->ground_top[i] = h;
+            if (w == GRASS && s->plants) {
+                if (grass[i] > 0.6) {
+                    column[h] = TALL_GRASS * flag;
+                    s->ground_top[i] = h + 1;
                 }
-                // trees
-#ifdef SERVER
-                int ok = show_trees;
-#else
-                int ok = config->show_trees;
-#endif
-                if (dx - 4 < 0 || dz - 4 < 0 ||
-                    dx + 4 >= CHUNK_SIZE || dz + 4 >= CHUNK_SIZE)
-                {
-                    ok = 0;
+                if (flowers[i] > 0.7) {
+                    flower_columns[flower_count] = i;
+                    flower_x[flower_count] = (x0 + dx + PAD) * 0.1;
+                    flower_z[flower_count] = (z0 + dz + PAD) * 0.1;
+                    flower_count++;
                 }
-                if (ok && simplex2(x, z, 6, 0.5, 2) > 0.84) {
-                    // leaves
-                    for (int y = h + 3; y < h + 8; y++) {
-                        for (int ox = -3; ox <= 3; ox++) {
-                            for (int oz = -3; oz <= 3; oz++) {
-                                int d = (ox * ox) + (oz * oz) +
-                                    (y - (h + 4)) * (y - (h + 4));
-                                if (d < 11) {
-                                    func(x + ox, y, z + oz, LEAVES, arg);
-                                }
-                            }
+            }
+        }
+    }
+    float colours[COLUMNS];
+    simplex2_batch(colours, flower_x, flower_z, flower_count, 4, 0.8, 2);
+    for (int n = 0; n < flower_count; n++) {
+        int i = flower_columns[n];
+        int dx = i / PADDED_SIZE - PAD;
+        int dz = i % PADDED_SIZE - PAD;
+        int w = 18 + colours[n] * 7;
+        s->blocks[i * CHUNK_HEIGHT + s->height[i]] =
+            w * column_flag(dx, dz);
+        s->ground_top[i] = s->height[i] + 1;
+    }
+    memcpy(s->top, s->ground_top, sizeof(s->top));
+}
+
+static void stage_decoration(WorldState *s)
+{
+    if (!s->trees) {
+        return;
+    }
+    float tree_noise[TREE_SIZE * TREE_SIZE];
+    simplex2_grid(tree_noise,
+        s->p * CHUNK_SIZE + TREE_PAD, s->q * CHUNK_SIZE + TREE_PAD,
+        TREE_SIZE, TREE_SIZE, 1, 1, 6, 0.5, 2);
+    for (int dx = TREE_PAD; dx < CHUNK_SIZE - TREE_PAD; dx++) {
+        for (int dz = TREE_PAD; dz < CHUNK_SIZE - TREE_PAD; dz++) {
+            int i = column_index(dx, dz);
+            if (s->surface[i] != GRASS ||
+                tree_noise[(dx - TREE_PAD) * TREE_SIZE + (dz - TREE_PAD)]
+                    <= 0.84) {
+                continue;
+            }
+            int h = s->height[i];
+            // leaves
+            for (int y = h + 3; y < h + 8; y++) {
+                for (int ox = -3; ox <= 3; ox++) {
+                    for (int oz = -3; oz <= 3; oz++) {
+                        int d = (ox * ox) + (oz * oz) +
+                            (y - (h + 4)) * (y - (h + 4));
+                        if (d >= 11) {
+                            continue;
                         }
+                        int j = column_index(dx + ox, dz + oz);
+                        if (j > i && y < s->ground_top[j]) {
+                            continue;
+                        }
+                        s->blocks[j * CHUNK_HEIGHT + y] = LEAVES;
+                        raise_top(s, j, y);
                     }
-                    // tree trunk
-                    for (int y = h; y < h + 7; y++) {
-                        func(x, y, z, WOOD, arg);
-                    }
                 }
             }
-            // clouds
+            // tree trunk
+            memset(s->blocks + i * CHUNK_HEIGHT + h, WOOD, 7);
+            raise_top(s, i, h + 6);
+        }
+    }
+}
+
+static void stage_clouds(WorldState *s)
+{
+    if (!s->clouds) {
+        return;
+    }
+    float cloud_noise[COLUMNS * (CLOUD_MAX - CLOUD_MIN)];
+    simplex3_grid(cloud_noise,
+        s->p * CHUNK_SIZE - PAD, CLOUD_MIN, s->q * CHUNK_SIZE - PAD,
+        PADDED_SIZE, CLOUD_MAX - CLOUD_MIN, PADDED_SIZE,
+        0.01, 0.1, 0.01, 8, 0.5, 2);
+    for (int dx = -PAD; dx < CHUNK_SIZE + PAD; dx++) {
+        for (int dz = -PAD; dz < CHUNK_SIZE + PAD; dz++) {
+            int i = column_index(dx, dz);
+            int flag = column_flag(dx, dz);
+            for (int y = CLOUD_MIN; y < CLOUD_MAX; y++) {
+                int index = ((dx + PAD) * (CLOUD_MAX - CLOUD_MIN) +
+                    (y - CLOUD_MIN)) * PADDED_SIZE + (dz + PAD);
+                if (cloud_noise[index] > 0.75) {
+                    s->blocks[i * CHUNK_HEIGHT + y] = 16 * flag;
+                    raise_top(s, i, y);
+                }
+            }
+        }
+    }
+}
+
+static void generate(WorldState *s, int p, int q)
+{
+    s->p = p;
+    s->q = q;
 #ifdef SERVER
-                if (show_clouds) {
+    s->plants = show_plants;
+    s->trees = show_trees;
+    s->clouds = show_clouds;
 #else
-                if (config->show_clouds) {
+    s->plants = config->show_plants;
+    s->trees = config->show_trees;
+    s->clouds = config->show_clouds;
 #endif
-                for (int y = 64; y < 72; y++) {
-                    if (simplex3(
-                        x * 0.01, y * 0.1, z * 0.01, 8, 0.5, 2) > 0.75)
-                    {
-                        func(x, y, z, 16 * flag, arg);
-                    }
-                }
+    memset(s->blocks, 0, sizeof(s->blocks));
+    stage_heightmap(s);
+    stage_surface(s);
+    stage_decoration(s);
+    stage_clouds(s);
+}
+
+void create_world(int p, int q, world_func func, void *arg) {
+    WorldState s;
+    generate(&s, p, q);
+    for (int i = 0; i < COLUMNS; i++) {
+        int x = p * CHUNK_SIZE - PAD + i / PADDED_SIZE;
+        int z = q * CHUNK_SIZE - PAD + i % PADDED_SIZE;
+        signed char *column = s.blocks + i * CHUNK_HEIGHT;
+        for (int y = 0; y < s.top[i]; y++) {
+            if (column[y]) {
+                func(x, y, z, column[y], arg);
             }
         }
     }
 }
+
+#ifndef SERVER
+// The same as create_world() with a func that sets each block in map, without
+// a call through a function pointer for every block.
+void create_world_map(int p, int q, Map *map)
+{
+    WorldState s;
+    generate(&s, p, q);
+    for (int i = 0; i < COLUMNS; i++) {
+        int x = p * CHUNK_SIZE - PAD + i / PADDED_SIZE;
+        int z = q * CHUNK_SIZE - PAD + i % PADDED_SIZE;
+        signed char *column = s.blocks + i * CHUNK_HEIGHT;
+        for (int y = 0; y < s.top[i]; y++) {
+            if (column[y]) {
+                map_set(map, x, y, z, column[y]);
+            }
+        }
+    }
+}
+#endif
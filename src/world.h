@@ -6,3 +6,8 @@ typedef void (*world_func)(int, int, int, int, void *);
 
 void create_world(int p, int q, world_func func, void *arg);
 
+#ifndef SERVER
+#include "map.h"
+
+void create_world_map(int p, int q, Map *map);
+#endif
@@ -0,0 +1,350 @@
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include "config.h"
+#include "tinycthread.h"
+#include "worldgen_cache.h"
+
+#define CACHE_FILE_MAGIC 0x43475750  // "PWGC"
+#define CACHE_FILE_VERSION 1
+
+typedef struct {
+    int p;
+    int q;
+    unsigned int key;
+    unsigned int last_used;
+    unsigned int count[WORLDGEN_LAYERS];
+    unsigned int *entries[WORLDGEN_LAYERS];
+    unsigned int sign_count;
+    Sign *signs;
+} CachedChunk;
+
+typedef struct {
+    unsigned int magic;
+    unsigned int version;
+    unsigned int key;
+    int p;
+    int q;
+    unsigned int count[WORLDGEN_LAYERS];
+    unsigned int sign_count;
+} CacheFileHeader;
+
+static mtx_t cache_mtx;
+static CachedChunk *cache;
+static int cache_size;
+static unsigned int use_counter;
+static unsigned int worldgen_key;
+static atomic_uint temp_counter;
+
+static unsigned int fnv1a(unsigned int h, const void *data, size_t size)
+{
+    const unsigned char *bytes = data;
+    for (size_t i = 0; i < size; i++) {
+        h = (h ^ bytes[i]) * 16777619u;
+    }
+    return h;
+}
+
+// The key of the chunks the worldgen makes with the current world options,
+// call with cache_mtx locked.
+static unsigned int current_key(void)
+{
+    int options[3] = {
+        config->show_plants, config->show_trees, config->show_clouds
+    };
+    return fnv1a(worldgen_key, options, sizeof(options));
+}
+
+static void free_cached_chunk(CachedChunk *c)
+{
+    for (int i = 0; i < WORLDGEN_LAYERS; i++) {
+        free(c->entries[i]);
+        c->entries[i] = NULL;
+        c->count[i] = 0;
+    }
+    free(c->signs);
+    c->signs = NULL;
+    c->sign_count = 0;
+    c->key = 0;
+}
+
+void worldgen_cache_init(void)
+{
+    mtx_init(&cache_mtx, mtx_plain);
+    cache_size = config->worldgen_cache;
+    if (cache_size > 0) {
+        cache = calloc(cache_size, sizeof(CachedChunk));
+    }
+    if (strlen(config->worldgen_cache_dir) > 0) {
+        mkdir(config->worldgen_cache_dir, 0755);
+    }
+    worldgen_cache_set_worldgen(NULL);
+}
+
+// Set the worldgen script in use, NULL for the built in worldgen. Chunks
+// made by any other worldgen are dropped.
+void worldgen_cache_set_worldgen(const char *path)
+{
+    unsigned int key = 2166136261u;
+    if (path) {
+        key = fnv1a(key, path, strlen(path));
+        FILE *file = fopen(path, "rb");
+        if (file) {
+            char buffer[4096];
+            size_t size;
+            while ((size = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+                key = fnv1a(key, buffer, size);
+            }
+            fclose(file);
+        }
+    }
+    mtx_lock(&cache_mtx);
+    worldgen_key = key;
+    for (int i = 0; i < cache_size; i++) {
+        free_cached_chunk(cache + i);
+    }
+    mtx_unlock(&cache_mtx);
+}
+
+static void apply(CachedChunk *c, Map *maps[WORLDGEN_LAYERS],
+    SignList *signs)
+{
+    for (int i = 0; i < WORLDGEN_LAYERS; i++) {
+        Map *map = maps[i];
+        for (unsigned int j = 0; j < c->count[i]; j++) {
+            MapEntry entry;
+            entry.value = c->entries[i][j];
+            map_set(map, entry.e.x + map->dx, entry.e.y + map->dy,
+                entry.e.z + map->dz, entry.e.w);
+        }
+    }
+    for (unsigned int i = 0; i < c->sign_count; i++) {
+        Sign *e = c->signs + i;
+        sign_list_add(signs, e->x, e->y, e->z, e->face, e->text);
+    }
+}
+
+// Fill c with a copy of the entries of maps and signs.
+static void pack(CachedChunk *c, Map *maps[WORLDGEN_LAYERS],
+    SignList *signs)
+{
+    for (int i = 0; i < WORLDGEN_LAYERS; i++) {
+        Map *map = maps[i];
+        c->count[i] = 0;
+        c->entries[i] = malloc(sizeof(unsigned int) * (map->size + 1));
+        // A map that is growing incrementally still has entries in its old
+        // table.
+        for (int t = 0; t < 2; t++) {
+            MapEntry *data = t ? map->old_data : map->data;
+            unsigned int mask = t ? map->old_mask : map->mask;
+            for (unsigned int j = 0; data && j <= mask; j++) {
+                MapEntry *entry = data + j;
+                if (!EMPTY_ENTRY(entry) && entry->e.w) {
+                    c->entries[i][c->count[i]++] = entry->value;
+                }
+            }
+        }
+    }
+    c->sign_count = signs->size;
+    c->signs = malloc(sizeof(Sign) * (signs->size + 1));
+    if (signs->size) {
+        memcpy(c->signs, signs->data, sizeof(Sign) * signs->size);
+    }
+}
+
+// Keep c in memory, c's data is taken over by the cache.
+static void remember(CachedChunk *c)
+{
+    if (cache_size == 0) {
+        free_cached_chunk(c);
+        return;
+    }
+    mtx_lock(&cache_mtx);
+    if (c->key != current_key()) {
+        // The worldgen changed while this chunk was being made.
+        mtx_unlock(&cache_mtx);
+        free_cached_chunk(c);
+        return;
+    }
+    CachedChunk *slot = cache;
+    for (int i = 0; i < cache_size; i++) {
+        CachedChunk *other = cache + i;
+        if (other->key == c->key && other->p == c->p && other->q == c->q) {
+            slot = other;
+            break;
+        }
+        if (other->last_used < slot->last_used) {
+            slot = other;
+        }
+    }
+    free_cached_chunk(slot);
+    *slot = *c;
+    slot->last_used = ++use_counter;
+    mtx_unlock(&cache_mtx);
+}
+
+static void cache_file_path(char *path, int p, int q, unsigned int key)
+{
+    snprintf(path, MAX_PATH_LENGTH, "%s/%08x.%d.%d.pwgc",
+             config->worldgen_cache_dir, key, p, q);
+}
+
+static int read_file(CachedChunk *c)
+{
+    char path[MAX_PATH_LENGTH];
+    cache_file_path(path, c->p, c->q, c->key);
+    FILE *file = fopen(path, "rb");
+    if (file == NULL) {
+        return 0;
+    }
+    CacheFileHeader header;
+    int ok = fread(&header, sizeof(header), 1, file) == 1 &&
+        header.magic == CACHE_FILE_MAGIC &&
+        header.version == CACHE_FILE_VERSION &&
+        header.key == c->key && header.p == c->p && header.q == c->q &&
+        header.sign_count < 65536;
+    for (int i = 0; ok && i < WORLDGEN_LAYERS; i++) {
+        if (header.count[i] > CHUNK_SIZE * CHUNK_SIZE * CHUNK_HEIGHT * 2) {
+            ok = 0;
+            break;
+        }
+        c->count[i] = header.count[i];
+        c->entries[i] = malloc(sizeof(unsigned int) * (c->count[i] + 1));
+        ok = fread(c->entries[i], sizeof(unsigned int), c->count[i], file)
+            == c->count[i];
+    }
+    if (ok) {
+        c->sign_count = header.sign_count;
+        c->signs = malloc(sizeof(Sign) * (c->sign_count + 1));
+        ok = fread(c->signs, sizeof(Sign), c->sign_count, file)
+            == c->sign_count;
+    }
+    fclose(file);
+    if (!ok) {
+        free_cached_chunk(c);
+    }
+    return ok;
+}
+
+// Returns 1 if the cache directory has the worldgen's chunk p, q.
+int worldgen_cache_on_disk(unsigned int key, int p, int q)
+{
+    if (strlen(config->worldgen_cache_dir) == 0) {
+        return 0;
+    }
+    char path[MAX_PATH_LENGTH];
+    cache_file_path(path, p, q, key);
+    FILE *file = fopen(path, "rb");
+    if (file == NULL) {
+        return 0;
+    }
+    CacheFileHeader header;
+    int ok = fread(&header, sizeof(header), 1, file) == 1 &&
+        header.magic == CACHE_FILE_MAGIC &&
+        header.version == CACHE_FILE_VERSION &&
+        header.key == key && header.p == p && header.q == q;
+    fclose(file);
+    return ok;
+}
+
+// Written to a temporary file first so other threads and later runs never
+// see part of a chunk.
+static void write_file(CachedChunk *c)
+{
+    char path[MAX_PATH_LENGTH];
+    char temp_path[MAX_PATH_LENGTH + 32];
+    cache_file_path(path, c->p, c->q, c->key);
+    snprintf(temp_path, sizeof(temp_path), "%s.%u.tmp", path,
+             atomic_fetch_add(&temp_counter, 1));
+    FILE *file = fopen(temp_path, "wb");
+    if (file == NULL) {
+        return;
+    }
+    CacheFileHeader header;
+    memset(&header, 0, sizeof(header));
+    header.magic = CACHE_FILE_MAGIC;
+    header.version = CACHE_FILE_VERSION;
+    header.key = c->key;
+    header.p = c->p;
+    header.q = c->q;
+    memcpy(header.count, c->count, sizeof(header.count));
+    header.sign_count = c->sign_count;
+    int ok = fwrite(&header, sizeof(header), 1, file) == 1;
+    for (int i = 0; ok && i < WORLDGEN_LAYERS; i++) {
+        ok = fwrite(c->entries[i], sizeof(unsigned int), c->count[i], file)
+            == c->count[i];
+    }
+    if (ok) {
+        ok = fwrite(c->signs, sizeof(Sign), c->sign_count, file)
+            == c->sign_count;
+    }
+    ok = (fclose(file) == 0) && ok;
+    if (!ok || rename(temp_path, path) != 0) {
+        remove(temp_path);
+    }
+}
+
+// The key to load and store chunks made from now on with.
+unsigned int worldgen_cache_key(void)
+{
+    mtx_lock(&cache_mtx);
+    unsigned int key = current_key();
+    mtx_unlock(&cache_mtx);
+    return key;
+}
+
+// Fill the empty maps and signs with the worldgen's chunk p, q if it is in
+// the cache. Returns 0 if the worldgen needs to be run.
+int worldgen_cache_load(unsigned int key, int p, int q,
+    Map *maps[WORLDGEN_LAYERS], SignList *signs)
+{
+    int found = 0;
+    mtx_lock(&cache_mtx);
+    for (int i = 0; i < cache_size; i++) {
+        CachedChunk *c = cache + i;
+        if (c->key == key && c->p == p && c->q == q) {
+            c->last_used = ++use_counter;
+            apply(c, maps, signs);
+            found = 1;
+            break;
+        }
+    }
+    mtx_unlock(&cache_mtx);
+    if (found || strlen(config->worldgen_cache_dir) == 0) {
+        return found;
+    }
+    CachedChunk c;
+    memset(&c, 0, sizeof(c));
+    c.p = p;
+    c.q = q;
+    c.key = key;
+    if (!read_file(&c)) {
+        return 0;
+    }
+    apply(&c, maps, signs);
+    remember(&c);
+    return 1;
+}
+
+// Keep the worldgen's chunk p, q, call before changes from the game save are
+// added to the maps.
+void worldgen_cache_store(unsigned int key, int p, int q,
+    Map *maps[WORLDGEN_LAYERS], SignList *signs)
+{
+    int to_disk = strlen(config->worldgen_cache_dir) > 0;
+    if (cache_size == 0 && !to_disk) {
+        return;
+    }
+    CachedChunk c;
+    memset(&c, 0, sizeof(c));
+    c.p = p;
+    c.q = q;
+    c.key = key;
+    pack(&c, maps, signs);
+    if (to_disk) {
+        write_file(&c);
+    }
+    remember(&c);
+}
@@ -0,0 +1,23 @@
+#pragma once
+
+#include "map.h"
+#include "sign.h"
+
+// Chunks made by the worldgen are kept so loading a chunk again, on any
+// thread, does not run the worldgen again. Only what the worldgen made is
+// kept, changes saved in the game file are applied on top as usual. Chunks
+// are looked up by the worldgen script (its path and contents), the world
+// options that change what is generated and the chunk's p, q. When a cache
+// directory is set chunks are also kept on disk between runs.
+
+// The block, extra, light, shape and transform maps, in that order.
+#define WORLDGEN_LAYERS 5
+
+void worldgen_cache_init(void);
+void worldgen_cache_set_worldgen(const char *path);
+unsigned int worldgen_cache_key(void);
+int worldgen_cache_load(unsigned int key, int p, int q,
+    Map *maps[WORLDGEN_LAYERS], SignList *signs);
+void worldgen_cache_store(unsigned int key, int p, int q,
+    Map *maps[WORLDGEN_LAYERS], SignList *signs);
+int worldgen_cache_on_disk(unsigned int key, int p, int q);
@@ -9,6 +9,19 @@ Handy for performance comparisons between C and Lua worldgens:
 
 function worldgen(p, q)
     local pad = 1
+    local size = CHUNK_SIZE + pad * 2
+    local x0 = p * CHUNK_SIZE - pad
+    local z0 = q * CHUNK_SIZE - pad
+    -- Sample the noise for all columns with one call each, the results are
+    -- the same as calling simplex2 and simplex3 for every column.
+    local terrain = simplex2_grid(x0, z0, size, size, 0.01, 0.01, 4, 0.5, 2)
+    local mountains = simplex2_grid(x0, z0, size, size, -0.01, -0.01, 2, 0.9, 2)
+    local grass = simplex2_grid(x0, z0, size, size, -0.1, 0.1, 4, 0.8, 2)
+    local flowers = simplex2_grid(x0, z0, size, size, 0.05, -0.05, 4, 0.8, 2)
+    local trees = simplex2_grid(p * CHUNK_SIZE + 4, q * CHUNK_SIZE + 4,
+                                CHUNK_SIZE - 8, CHUNK_SIZE - 8, 1, 1, 6, 0.5, 2)
+    local clouds = simplex3_grid(x0, 64, z0, size, 8, size,
+                                 0.01, 0.1, 0.01, 8, 0.5, 2)
     for dx = -pad, CHUNK_SIZE-1 + pad do
         for dz = -pad, CHUNK_SIZE-1 + pad do
             local flag = 1
@@ -17,8 +30,9 @@ function worldgen(p, q)
             end
             local x = p * CHUNK_SIZE + dx
             local z = q * CHUNK_SIZE + dz
-            local f = simplex2(x * 0.01, z * 0.01, 4, 0.5, 2)
-            local g = simplex2(-x * 0.01, -z * 0.01, 2, 0.9, 2)
+            local column = (dx + pad) * size + (dz + pad) + 1
+            local f = terrain[column]
+            local g = mountains[column]
             local mh = g * 32 + 16
             local h = f * mh
             local w = GRASS
@@ -36,11 +50,11 @@ function worldgen(p, q)
             end
             if w == GRASS then
                 -- grass
-                if simplex2(-x * 0.1, z * 0.1, 4, 0.8, 2) > 0.6 then
+                if grass[column] > 0.6 then
                     map_set(x, h, z, TALL_GRASS * flag)
                 end
                 -- flowers
-                if simplex2(x * 0.05, -z * 0.05, 4, 0.8, 2) > 0.7 then
+                if flowers[column] > 0.7 then
                     local w = 18 + simplex2(x * 0.1, z * 0.1, 4, 0.8, 2) * 7
                     map_set(x, h, z, w * flag)
                 end
@@ -50,7 +64,7 @@ function worldgen(p, q)
                 if dx - 4 < 0 or dz - 4 < 0 or dx + 4 >= CHUNK_SIZE or dz + 4 >= CHUNK_SIZE then
                     ok = false
                 end
-                if ok and simplex2(x, z, 6, 0.5, 2) > 0.84 then
+                if ok and trees[(dx - 4) * (CHUNK_SIZE - 8) + (dz - 4) + 1] > 0.84 then
                     -- leaves
                     for y = h + 3, h + 8 - 1 do
                         for ox = -3, 3 do
@@ -71,7 +85,7 @@ function worldgen(p, q)
 
             -- Clouds
             for y = 64, 72-1 do
-                if simplex3(x * 0.01, y * 0.1, z * 0.01, 8, 0.5, 2) > 0.75 then
+                if clouds[((dx + pad) * 8 + (y - 64)) * size + (dz + pad) + 1] > 0.75 then
                     map_set(x, y, z, 16 * flag)
                 end
             end
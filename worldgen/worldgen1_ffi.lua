@@ -0,0 +1,106 @@
+--[[
+Produces the same world as worldgen1.lua and the default C implementation,
+but writes blocks straight into the chunk's block volume using the LuaJIT FFI
+instead of calling map_set for each block.
+
+Compare with worldgen1.lua:
+
+  $ time ./piworld --benchmark-create-chunks 256 --worldgen worldgen/worldgen1.lua
+  $ time ./piworld --benchmark-create-chunks 256 --worldgen worldgen/worldgen1_ffi.lua
+--]]
+
+local ffi = require("ffi")
+
+local volume = ffi.cast("int8_t *", worldgen_volume())
+local floor = math.floor
+
+-- Index of the bottom of the column at (dx, dz) relative to the chunk.
+local function column_index(dx, dz)
+    return ((dx + 1) * VOLUME_SIZE + (dz + 1)) * CHUNK_HEIGHT
+end
+
+function worldgen(p, q)
+    local pad = 1
+    local size = CHUNK_SIZE + pad * 2
+    local x0 = p * CHUNK_SIZE - pad
+    local z0 = q * CHUNK_SIZE - pad
+    local terrain = simplex2_grid(x0, z0, size, size, 0.01, 0.01, 4, 0.5, 2)
+    local mountains = simplex2_grid(x0, z0, size, size, -0.01, -0.01, 2, 0.9, 2)
+    local grass = simplex2_grid(x0, z0, size, size, -0.1, 0.1, 4, 0.8, 2)
+    local flowers = simplex2_grid(x0, z0, size, size, 0.05, -0.05, 4, 0.8, 2)
+    local trees = simplex2_grid(p * CHUNK_SIZE + 4, q * CHUNK_SIZE + 4,
+                                CHUNK_SIZE - 8, CHUNK_SIZE - 8, 1, 1, 6, 0.5, 2)
+    local clouds = simplex3_grid(x0, 64, z0, size, 8, size,
+                                 0.01, 0.1, 0.01, 8, 0.5, 2)
+    for dx = -pad, CHUNK_SIZE-1 + pad do
+        for dz = -pad, CHUNK_SIZE-1 + pad do
+            local flag = 1
+            if dx < 0 or dz < 0 or dx >= CHUNK_SIZE or dz >= CHUNK_SIZE then
+                flag = -1
+            end
+            local x = p * CHUNK_SIZE + dx
+            local z = q * CHUNK_SIZE + dz
+            local base = column_index(dx, dz)
+            local column = (dx + pad) * size + (dz + pad) + 1
+            local f = terrain[column]
+            local g = mountains[column]
+            local mh = g * 32 + 16
+            local h = f * mh
+            local w = GRASS
+            local t = 12
+            if h < t+1 then
+                h = t
+                w = SAND
+            end
+            local top = floor(h)
+
+            volume[base] = BEDROCK * flag
+
+            -- sand and grass terrain
+            if h - 1 >= 1 then
+                ffi.fill(volume + base + 1, floor(h - 1), w * flag)
+            end
+            if w == GRASS then
+                -- grass
+                if grass[column] > 0.6 then
+                    volume[base + top] = TALL_GRASS * flag
+                end
+                -- flowers
+                if flowers[column] > 0.7 then
+                    local w = 18 + simplex2(x * 0.1, z * 0.1, 4, 0.8, 2) * 7
+                    volume[base + top] = w * flag
+                end
+
+                -- trees
+                local ok = true
+                if dx - 4 < 0 or dz - 4 < 0 or dx + 4 >= CHUNK_SIZE or dz + 4 >= CHUNK_SIZE then
+                    ok = false
+                end
+                if ok and trees[(dx - 4) * (CHUNK_SIZE - 8) + (dz - 4) + 1] > 0.84 then
+                    -- leaves
+                    for y = h + 3, h + 8 - 1 do
+                        for ox = -3, 3 do
+                            for oz = -3, 3 do
+                                local d = (ox * ox) + (oz * oz) + (y - (h + 4)) * (y - (h + 4))
+                                if d < 11 then
+                                    volume[column_index(dx + ox, dz + oz) + floor(y)] = LEAVES
+                                end
+                            end
+                        end
+                    end
+                    -- tree trunk
+                    for y = h, h + 6 do
+                        volume[base + floor(y)] = WOOD
+                    end
+                end
+            end
+
+            -- Clouds
+            for y = 64, 72-1 do
+                if clouds[((dx + pad) * 8 + (y - 64)) * size + (dz + pad) + 1] > 0.75 then
+                    volume[base + y] = 16 * flag
+                end
+            end
+        end
+    end
+end